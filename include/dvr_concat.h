@@ -0,0 +1,121 @@
+/**
+ * \file
+ * \brief Read the segments of a recording as one continuous stream
+ *
+ * The positions and times of the concatenated reader are those of the whole
+ * recording: the position of a segment start is the size of the segments
+ * before it, its time is their duration.
+ * Reads, time seeks and position seeks cross the segment boundaries, the next
+ * segment is opened before the current one ends.
+ */
+
+#ifndef _DVR_CONCAT_H_
+#define _DVR_CONCAT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dvr_types.h"
+#include "segment_ops.h"
+
+/**\brief Concatenated reader handle*/
+typedef void* DVR_ConcatHandle_t;
+
+/**\brief Concatenated reader information*/
+typedef struct {
+  uint32_t            nb_segments;                     /**< Number of segments*/
+  uint64_t            first_id;                        /**< Id of the first segment*/
+  uint64_t            last_id;                         /**< Id of the last segment*/
+  loff_t              size;                            /**< Size of all the segments*/
+  uint64_t            duration;                        /**< Duration of all the segments in ms*/
+} DVR_ConcatInfo_t;
+
+/**\brief Open the concatenated reader of a recording, positioned at its start
+ * \param[out] p_handle Return the reader handle
+ * \param[in] location The record file's location
+ * \param[in] ops Segment operations used to read the segments, NULL for the segment files
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_concat_open(DVR_ConcatHandle_t *p_handle, const char *location, Segment_Ops_t *ops);
+
+/**\brief Close the concatenated reader
+ * \param[in] handle Reader handle
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_concat_close(DVR_ConcatHandle_t handle);
+
+/**\brief Reload the segment list, to follow a recording still in progress
+ * The read position is kept, unless its segment was removed, then the reader
+ * is moved to the start of the first segment.
+ * \param[in] handle Reader handle
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_concat_refresh(DVR_ConcatHandle_t handle);
+
+/**\brief Read data, the segments following the current one are read if count is not reached
+ * \param[in] handle Reader handle
+ * \param[out] buf Output buffer, filled directly by the segment reads
+ * \param[in] count Output buffer length
+ * \return The number of bytes read, 0 at the end of the last segment
+ * \return Error code On failure
+ */
+ssize_t dvr_concat_read(DVR_ConcatHandle_t handle, void *buf, size_t count);
+
+/**\brief Seek to a time of the recording
+ * \param[in] handle Reader handle
+ * \param[in] time Time in ms from the start of the first segment
+ * \param[in] block_size If > 0, the position in the segment is aligned to block_size
+ * \return The new read position on success
+ * \return Error code On failure
+ */
+loff_t dvr_concat_seek_time(DVR_ConcatHandle_t handle, uint64_t time, int block_size);
+
+/**\brief Seek to a position of the recording
+ * \param[in] handle Reader handle
+ * \param[in] position Position in bytes from the start of the first segment
+ * \return The new read position on success
+ * \return Error code On failure
+ */
+loff_t dvr_concat_seek(DVR_ConcatHandle_t handle, loff_t position);
+
+/**\brief Tell the read position
+ * \param[in] handle Reader handle
+ * \return The read position on success
+ * \return Error code On failure
+ */
+loff_t dvr_concat_tell(DVR_ConcatHandle_t handle);
+
+/**\brief Tell the time of the read position
+ * \param[in] handle Reader handle
+ * \return The time in ms from the start of the first segment on success
+ * \return Error code On failure
+ */
+loff_t dvr_concat_tell_time(DVR_ConcatHandle_t handle);
+
+/**\brief Find the segment holding a position of the recording
+ * \param[in] handle Reader handle
+ * \param[in] position Position in bytes from the start of the first segment
+ * \param[out] p_segment_id Return the segment id
+ * \param[out] p_offset Return the position in the segment
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure, the position is beyond the last segment
+ */
+int dvr_concat_locate(DVR_ConcatHandle_t handle, loff_t position, uint64_t *p_segment_id, loff_t *p_offset);
+
+/**\brief Get the reader information
+ * \param[in] handle Reader handle
+ * \param[out] p_info Return the information
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_concat_get_info(DVR_ConcatHandle_t handle, DVR_ConcatInfo_t *p_info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_DVR_CONCAT_H_*/
@@ -0,0 +1,96 @@
+/**
+ * \file
+ * \brief Edit list of a recording
+ *
+ * The cuts of a recording are stored in its edit list file "<location>.edl",
+ * the segment files are not modified.
+ * A cut is resolved per segment with the record index: its start is at an
+ * index entry and its end at the first video key frame after an index entry,
+ * so playback jumps over a cut with one seek and restarts decoding at once.
+ * The playback skips the cuts when reading and reports the positions and
+ * durations without them.
+ */
+
+#ifndef _DVR_EDIT_H_
+#define _DVR_EDIT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dvr_types.h"
+
+/**\brief Cut of a segment*/
+typedef struct {
+  uint64_t            segment_id;                      /**< Segment id*/
+  uint32_t            start;                           /**< Start time in the segment in ms*/
+  uint32_t            end;                             /**< End time in the segment in ms*/
+  loff_t              start_offset;                    /**< Offset of the start in the segment*/
+  loff_t              end_offset;                      /**< Offset of the end in the segment*/
+} DVR_EditCut_t;
+
+/**\brief Edit list, the cuts are in the segment id order then in the time order*/
+typedef struct {
+  uint32_t            nb_cuts;                         /**< Number of cuts*/
+  DVR_EditCut_t       *cuts;                           /**< Cuts*/
+} DVR_EditList_t;
+
+/**\brief Cut a time range of a recording
+ * The range is merged with the cuts already in the edit list.
+ * \param[in] location The record file's location
+ * \param[in] start_ms Start time in ms from the start of the recording, the cuts not counted
+ * \param[in] end_ms End time in ms from the start of the recording, the cuts not counted
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_edit_cut(const char *location, uint64_t start_ms, uint64_t end_ms);
+
+/**\brief Remove all the cuts of a recording
+ * \param[in] location The record file's location
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_edit_clear(const char *location);
+
+/**\brief Load the edit list of a recording
+ * \param[in] location The record file's location
+ * \param[out] p_list Return the edit list, empty if the recording has no cut
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_edit_load(const char *location, DVR_EditList_t *p_list);
+
+/**\brief Free the cuts of an edit list
+ * \param[in] p_list Edit list
+ */
+void dvr_edit_free(DVR_EditList_t *p_list);
+
+/**\brief Get the time cut before a time of a segment
+ * \param[in] p_list Edit list
+ * \param[in] segment_id Segment id
+ * \param[in] time Time in the segment in ms
+ * \return The time cut in ms, the played time is time minus it
+ */
+uint32_t dvr_edit_get_cut_time(DVR_EditList_t *p_list, uint64_t segment_id, uint32_t time);
+
+/**\brief Get the segment time of a played time
+ * \param[in] p_list Edit list
+ * \param[in] segment_id Segment id
+ * \param[in] time Played time in the segment in ms, the cuts not counted
+ * \return The time in the segment in ms
+ */
+uint32_t dvr_edit_get_segment_time(DVR_EditList_t *p_list, uint64_t segment_id, uint32_t time);
+
+/**\brief Get the first cut of a segment ending after an offset
+ * \param[in] p_list Edit list
+ * \param[in] segment_id Segment id
+ * \param[in] offset Offset in the segment
+ * \return The cut, NULL if none
+ */
+DVR_EditCut_t *dvr_edit_get_cut(DVR_EditList_t *p_list, uint64_t segment_id, loff_t offset);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_DVR_EDIT_H_*/
@@ -0,0 +1,43 @@
+/**
+ * \file
+ * \brief Export a time range of a recording as a standalone recording
+ *
+ * The time range is mapped to byte ranges of the segments with their index
+ * files. The exported recording has one segment:
+ * \li TS file: a PAT and PMT of the recorded pids, then the packets of the
+ *  range. They take the PMT pid and the versions of the PAT and PMT found at
+ *  the range start, so the recorded ones copied with the range agree with them.
+ *  The packets are copied by the kernel, only the edges are checked in user space.
+ * \li Index file: the entries of the source index files in the range, moved
+ *  to the times and offsets of the exported segment.
+ * \li Information files and list file.
+ */
+
+#ifndef _DVR_EXPORT_H_
+#define _DVR_EXPORT_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dvr_types.h"
+
+/**\brief Export a time range of a recording
+ * The range starts at the index entry of start_ms and ends at the index entry
+ * of end_ms, or at the end of the recording if end_ms is beyond it.
+ * The files of segment 0 of a recording already at out_path are replaced.
+ * out_path and location must not start with each other, their files would mix.
+ * \param[in] location The record file's location
+ * \param[in] start_ms Start time in ms from the start of the recording
+ * \param[in] end_ms End time in ms from the start of the recording
+ * \param[in] out_path The location of the exported recording
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_export_range(const char *location, uint64_t start_ms, uint64_t end_ms, const char *out_path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_DVR_EXPORT_H_*/
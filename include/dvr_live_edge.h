@@ -0,0 +1,101 @@
+/**
+ * \file
+ * \brief Live edge notification from the recorder to the players of a location
+ */
+
+#ifndef _DVR_LIVE_EDGE_H_
+#define _DVR_LIVE_EDGE_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <pthread.h>
+#include "dvr_mutex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**\brief Live edge listener handle*/
+typedef void* DVR_LiveEdgeHandle_t;
+
+/**\brief Listen to the new data recorded to a location
+ * The cond is signaled and the sequence of the listener is increased each
+ * time new data are recorded to the location.
+ * \param[out] p_handle Listener handle
+ * \param[in] location Record file location
+ * \param[in] lock Mutex of the cond, held while it is signaled, the listener
+ *   checks its sequence and waits under it. Do not listen or unlisten with it held
+ * \param[in] cond Cond to be signaled
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_live_edge_listen(DVR_LiveEdgeHandle_t *p_handle, const char *location, dvr_mutex_t *lock, pthread_cond_t *cond);
+
+/**\brief Stop listening, the cond is not signaled after this returns
+ * \param[in] handle Listener handle
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_live_edge_unlisten(DVR_LiveEdgeHandle_t handle);
+
+/**\brief Get the sequence of a listener
+ * \param[in] handle Listener handle, may be NULL
+ * \return The number of notifications received, 0 if handle is NULL
+ */
+uint32_t dvr_live_edge_seq(DVR_LiveEdgeHandle_t handle);
+
+/**\brief Notify the listeners of a location that new data are recorded
+ * \param[in] location Record file location
+ */
+void dvr_live_edge_notify(const char *location);
+
+/**\brief Open the in memory live tail of a location
+ * The tail keeps the last data recorded to the location, so the players
+ * close to the live edge read them from memory instead of the disk.
+ * \param[out] p_handle Tail handle
+ * \param[in] location Record file location
+ * \param[in] size Memory size of the tail in bytes
+ * \param[in] max_time Maximum duration of the data in the tail in ms, 0 for no limit
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_live_edge_tail_open(DVR_LiveEdgeHandle_t *p_handle, const char *location, size_t size, uint32_t max_time);
+
+/**\brief Close the live tail, the players read from the disk after this
+ * \param[in] handle Tail handle
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_live_edge_tail_close(DVR_LiveEdgeHandle_t handle);
+
+/**\brief Add the data written to a segment to the live tail, the oldest data are dropped
+ * \param[in] handle Tail handle
+ * \param[in] segment_id Segment id
+ * \param[in] offset Offset of the data in the segment
+ * \param[in] buf Data written to the segment
+ * \param[in] len Data length
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_live_edge_tail_write(DVR_LiveEdgeHandle_t handle, uint64_t segment_id, loff_t offset, const uint8_t *buf, size_t len);
+
+/**\brief Read segment data from the live tail of a location
+ * \param[in] location Record file location
+ * \param[in] segment_id Segment id
+ * \param[in] offset Offset of the data in the segment
+ * \param[out] buf Output buffer
+ * \param[in] len Output buffer length
+ * \return Length read, 0 if the data are not in the tail
+ */
+size_t dvr_live_edge_tail_read(const char *location, uint64_t segment_id, loff_t offset, uint8_t *buf, size_t len);
+
+/**\brief Get the number of live tails opened, without lock
+ * \return Number of tails opened
+ */
+int dvr_live_edge_tail_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_DVR_LIVE_EDGE_H_*/
@@ -12,6 +12,8 @@
 #include "dvr_types.h"
 #include "dvr_crypto.h"
 #include "dvr_mutex.h"
+#include "dvr_live_edge.h"
+#include "dvr_edit.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -327,6 +329,8 @@ typedef struct
   dvr_mutex_t                lock;               /**< playback lock*/
   pthread_mutex_t            segment_lock;      /**< playback segment lock*/
   pthread_cond_t             cond;               /**< playback cond*/
+  DVR_LiveEdgeHandle_t       live_edge;          /**< listen to the recording data at the end of the playback*/
+  DVR_EditList_t             edits;              /**< cuts of the recording played, skipped when reading*/
   void                       *user_data;         /**< playback userdata, used to send event*/
   float                      speed;           /**< playback speed*/
   DVR_PlaybackPlayState_t    state;           /**< playback state*/
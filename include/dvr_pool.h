@@ -0,0 +1,97 @@
+/**
+ * \file
+ * Session pool with generation tagged handles.
+ */
+
+#ifndef _DVR_POOL_H_
+#define _DVR_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**Number of items allocated at a time when the pool grows*/
+#define DVR_POOL_CHUNK_SIZE  (16)
+/**Maximum number of chunks of a pool*/
+#define DVR_POOL_MAX_CHUNKS  (256)
+/**Maximum number of items of a pool*/
+#define DVR_POOL_MAX_ITEMS   (DVR_POOL_CHUNK_SIZE * DVR_POOL_MAX_CHUNKS)
+
+/**
+ * Pool of fixed size items.
+ * The items are allocated in chunks which are never moved or freed, so an
+ * item pointer stays valid for the lifetime of the process, and a handle is
+ * resolved without taking the pool lock.
+ * A handle is made of the item index, the pool tag and the generation of the
+ * item, a handle of a freed item is never resolved again.
+ */
+typedef struct {
+  pthread_mutex_t lock;                          /**< Protect allocation*/
+  size_t          item_size;                     /**< Size of the item*/
+  uint32_t        tag;                           /**< Pool tag in the handles, 0~15*/
+  int             nb_items;                      /**< Number of items allocated*/
+  int             nb_used;                       /**< Number of items in use*/
+  uint8_t         *chunks[DVR_POOL_MAX_CHUNKS];  /**< Item chunks*/
+} DVR_Pool_t;
+
+/**Static initializer of a pool of _type items*/
+#define DVR_POOL_INITIALIZER(_type, _tag) \
+  { .lock = PTHREAD_MUTEX_INITIALIZER, .item_size = sizeof(_type), .tag = (_tag) }
+
+/**
+ * Allocate an item from the pool, the pool grows if all items are in use.
+ * The item memory is zeroed when it is allocated the first time, and it is
+ * left as it was freed when the item is reused.
+ * \param pool The pool.
+ * \param[out] p_handle Returns the handle of the item, never 0.
+ * \return The item, NULL if the pool is full.
+ */
+void *dvr_pool_alloc(DVR_Pool_t *pool, uint32_t *p_handle);
+
+/**
+ * Free an item of the pool.
+ * \param pool The pool.
+ * \param handle The handle of the item.
+ */
+void dvr_pool_free(DVR_Pool_t *pool, uint32_t handle);
+
+/**
+ * Get the item of a handle.
+ * \param pool The pool.
+ * \param handle The handle of the item.
+ * \return The item, NULL if the handle is not in use.
+ */
+void *dvr_pool_get(DVR_Pool_t *pool, uint32_t handle);
+
+/**
+ * Get the item in use at an index, used to iterate over the pool.
+ * \param pool The pool.
+ * \param index The item index, from 0 to dvr_pool_size() - 1.
+ * \param[out] p_handle Returns the handle of the item if not NULL.
+ * \return The item, NULL if the item is not in use.
+ */
+void *dvr_pool_get_by_index(DVR_Pool_t *pool, int index, uint32_t *p_handle);
+
+/**
+ * Get the item index of a handle.
+ * \param handle The handle of the item.
+ * \return The item index.
+ */
+int dvr_pool_handle_index(uint32_t handle);
+
+/**
+ * Get the number of items allocated in the pool.
+ * \param pool The pool.
+ * \return The number of items, in use or not.
+ */
+int dvr_pool_size(DVR_Pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_DVR_POOL_H_*/
@@ -38,6 +38,8 @@ typedef enum {
   DVR_RECORD_FLAG_SCRAMBLED = (1 << 0),
   DVR_RECORD_FLAG_ACCURATE  = (1 << 1),
   DVR_RECORD_FLAG_DATAOUT   = (1 << 2),
+  DVR_RECORD_FLAG_PID_FILTER = (1 << 3),  /**< Drop null packets and packets of unrecorded pids before writing*/
+  DVR_RECORD_FLAG_RECYCLE   = (1 << 4),  /**< Timeshift, reuse the files of the removed segments for the new segments*/
 } DVR_RecordFlag_t;
 
 /**\brief DVR crypto parity flag*/
@@ -58,6 +60,7 @@ typedef enum {
   DVR_RECORD_EVENT_ERROR              = 0x1000,         /**< Signal a critical DVR error*/
   DVR_RECORD_EVENT_STATUS             = 0x1001,         /**< Signal the current record status which reach a certain size*/
   DVR_RECORD_EVENT_SYNC_END           = 0x1002,         /**< Signal that data sync has ended*/
+  DVR_RECORD_EVENT_SEGMENT_END        = 0x1003,         /**< Signal that a segment ended at a video key frame, with its final information*/
   DVR_RECORD_EVENT_CRYPTO_STATUS      = 0x2001,         /**< Signal the current crypto status*/
   DVR_RECORD_EVENT_WRITE_ERROR       = 0x9001,         /**< Signal the current crypto status*/
 } DVR_RecordEvent_t;
@@ -97,6 +100,12 @@ typedef struct {
   int                         notification_time;  /**< DVR record notification time, record module would send a notification when the size of current segment is multiple of this value. Put 0 in this argument if you don't want to receive the notification*/
   DVR_Bool_t                  force_sysclock;     /**< If ture, force to use system clock as PVR index time source. If false, libdvr can determine index time source based on actual situation*/
   loff_t                      guarded_segment_size;   /**< Guarded segment size in bytes. Libdvr will be forcely stopped to write anymore if current segment reaches this size*/
+  size_t                      tail_size;          /**< Memory size in bytes of the live tail read by the timeshift players, 0 to disable*/
+  uint32_t                    tail_time;          /**< Maximum duration in ms of the data kept in the live tail, 0 for no limit*/
+  uint32_t                    bitrate;            /**< Declared service bitrate in bps, sizes the ring buf if ringbuf_size is 0, 0 if unknown*/
+  uint32_t                    split_max_delay;    /**< Maximum time in ms the record thread waits to end the segment split by dvr_record_next_segment before a video key frame, 0 to end it at once*/
+  uint32_t                    index_interval;     /**< Time in ms between two index entries, 0 for the default. Low bitrates get sparser entries*/
+  uint32_t                    index_size;         /**< Data size in bytes between two index entries, 0 for the default. High bitrates get closer entries*/
 } DVR_RecordOpenParams_t;
 
 /**\brief DVR record segment start parameters*/
@@ -114,10 +123,39 @@ typedef DVR_Result_t (*DVR_RecordEncryptFunction_t) (uint8_t *p_in,
     uint32_t *p_out_len,
     void *userdata);
 
+/**\brief DVR record packet filter statistics, see DVR_RECORD_FLAG_PID_FILTER*/
+typedef struct {
+  uint64_t null_packets;                                          /**< Number of dropped null (pid 0x1fff) packets*/
+  uint64_t unwanted_packets;                                      /**< Number of dropped packets whose pid is not recorded*/
+} DVR_RecordFilterStats_t;
+
+/**\brief DVR record stream health counters, collected on the packets written to the segments*/
+typedef struct {
+  uint64_t packets;                                               /**< Number of checked ts packets*/
+  uint64_t cc_errors;                                             /**< Number of continuity counter errors*/
+  uint64_t lost_packets;                                          /**< Number of packets estimated lost from continuity counter gaps*/
+  uint64_t pcr_discontinuities;                                   /**< Number of unsignalled pcr jumps, backwards or over 100 ms*/
+  uint32_t pcr_jitter;                                            /**< Last pcr jitter against the system clock at read time, unit on ms*/
+  uint32_t pcr_jitter_max;                                        /**< Max pcr jitter against the system clock at read time, unit on ms*/
+} DVR_RecordStreamHealth_t;
+
+/**\brief DVR record device ring buffer statistics, the ring buffer grows on the next start of the device when its fill level approached its size*/
+typedef struct {
+  uint32_t ringbuf_size;                                          /**< Current ring buffer size*/
+  uint32_t peak_level;                                            /**< Highest fill level of the ring buffer seen*/
+  uint32_t overflows;                                             /**< Number of ring buffer overflows*/
+  uint32_t grows;                                                 /**< Number of times the ring buffer was enlarged*/
+  uint32_t read_size;                                             /**< Current read size*/
+  uint32_t drain_latency;                                         /**< Longest time between two reads, unit on ms*/
+} DVR_RecordBufferStats_t;
+
 /**\brief DVR record current status*/
 typedef struct {
   DVR_RecordState_t state;                                        /**< DVR record state*/
   DVR_RecordSegmentInfo_t info;                                   /**< DVR record segment information*/
+  DVR_RecordFilterStats_t filter;                                 /**< DVR record packet filter statistics of the session*/
+  DVR_RecordStreamHealth_t health;                                /**< DVR record stream health counters of the session*/
+  DVR_RecordBufferStats_t buffer;                                 /**< DVR record device ring buffer statistics*/
 } DVR_RecordStatus_t;
 
 /**\brief DVR record start parameters*/
@@ -164,6 +202,10 @@ int dvr_record_resume(DVR_RecordHandle_t handle);
 int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *params);
 
 /**\brief Stop the ongoing segment and start recording a new segment
+ * If split_max_delay is set, the ongoing segment ends before the next video key frame,
+ * found within split_max_delay ms, and the new segment starts with it. The call returns
+ * at once with the information of the ongoing segment so far, and the record thread
+ * signals DVR_RECORD_EVENT_SEGMENT_END with its final information when it ends.
  * \param[in] handle DVR recording session handle
  * \param[in] params DVR start parameters
  * \param[out] p_info DVR record segment information
@@ -206,6 +248,22 @@ int dvr_record_write(DVR_RecordHandle_t handle, void *buffer, uint32_t len);
  */
 int dvr_record_get_status(DVR_RecordHandle_t handle, DVR_RecordStatus_t *p_status);
 
+/**\brief DVR record get stream health counters
+ * \param[in] handle DVR recording session handle
+ * \param[out] p_health Return continuity counter and pcr health counters of the session
+ * \return DVR_SUCCESS on success
+ * \return error code on failure
+ */
+int dvr_record_get_stream_health(DVR_RecordHandle_t handle, DVR_RecordStreamHealth_t *p_health);
+
+/**\brief DVR record get device ring buffer statistics
+ * \param[in] handle DVR recording session handle
+ * \param[out] p_stats Return ring buffer size, peak fill level and overflow count of the device
+ * \return DVR_SUCCESS on success
+ * \return error code on failure
+ */
+int dvr_record_get_buffer_stats(DVR_RecordHandle_t handle, DVR_RecordBufferStats_t *p_stats);
+
 /**\brief Set DVR record encrypt function
  * \param[in] handle, DVR recording session handle
  * \param[in] func, DVR recording encrypt function
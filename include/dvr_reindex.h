@@ -0,0 +1,47 @@
+/**
+ * \file
+ * \brief Rebuild the index and information files of a recording
+ *
+ * After a power cut the index and information files of the last segments
+ * are often truncated or missing. They are rebuilt from the TS files:
+ * \li Index file: the PCR time and offset, the PTS of the video or audio
+ *  stream when the segment has no PCR.
+ * \li Information file: the pids, duration, size and number of packets.
+ * \li The information file of the location, with all the segments.
+ */
+
+#ifndef _DVR_REINDEX_H_
+#define _DVR_REINDEX_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "dvr_types.h"
+
+/**\brief Reindex statistics*/
+typedef struct {
+  uint32_t            nb_segments;                     /**< Number of segments found*/
+  uint32_t            nb_failed;                       /**< Number of segments failed to be rebuilt*/
+  uint32_t            nb_workers;                      /**< Number of segments scanned in parallel*/
+  uint64_t            bytes;                           /**< TS data scanned in bytes*/
+  uint32_t            time;                            /**< Time used in ms*/
+} DVR_ReindexStats_t;
+
+/**\brief Rebuild the index and information files of all the segments of a location
+ * The segments are found from the TS files in the directory of the location,
+ * and the list file of the location is created if it is missing.
+ * It must not be called on a location being recorded.
+ * \param[in] location The record file's location
+ * \param[in] nb_workers Number of segments scanned in parallel, 0 for the number of CPUs
+ * \param[out] p_stats Return the statistics, may be NULL
+ * \return DVR_SUCCESS On success, all the segments are rebuilt
+ * \return Error code On failure, the segments failed stay in the location with their old information
+ */
+int dvr_reindex(const char *location, int nb_workers, DVR_ReindexStats_t *p_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_DVR_REINDEX_H_*/
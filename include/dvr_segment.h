@@ -26,6 +26,15 @@ extern "C" {
  */
 int dvr_segment_delete(const char *location, uint64_t segment_id);
 
+/**\brief Remove a timeshift segment, its files are kept to be reused by the next segment
+ * recorded with DVR_RECORD_FLAG_RECYCLE, instead of being deleted and created again.
+ * \param[in] location The record file's location
+ * \param[in] segment_id The segment's index
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int dvr_segment_recycle(const char *location, uint64_t segment_id);
+
 /**\brief Get the segment list of a record file
  * \param[in] location The record file's location
  * \param[out] p_segment_nb Return the segments number
@@ -6,6 +6,8 @@
 #ifndef _DVR_UTILS_H_
 #define _DVR_UTILS_H_
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -57,6 +59,13 @@ int dvr_prop_read_int(const char *name, int def);
  */
 void clock_timespec_subtract(struct timespec *ts1, struct timespec *ts2, struct timespec *ts3);
 
+/**\brief Get the PCR in the adaptation field of a TS packet
+ * \param[in] pkt, TS packet of 188 bytes
+ * \param[out] p_pcr, the 33 bits PCR base, in 90KHz unit
+ * \return 1 if the packet has a PCR, 0 if not
+ */
+int dvr_ts_get_pcr(const uint8_t *pkt, uint64_t *p_pcr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -89,6 +89,12 @@ typedef struct {
   int                   flush_size;                      /**< DVR flush size.*/
   int                   ringbuf_size;                    /**< DVR ringbuf size.*/
   DVR_Bool_t            force_sysclock;                  /**< If ture, force to use system clock as PVR index time source. If false, libdvr can determine index time source based on actual situation*/
+  size_t                tail_size;                       /**< Memory size in bytes of the live tail read by the timeshift players, 0 to disable.*/
+  uint32_t              tail_time;                       /**< Maximum duration in ms of the data kept in the live tail, 0 for no limit.*/
+  uint32_t              bitrate;                         /**< Declared service bitrate in bps, sizes the ringbuf if ringbuf_size is 0, 0 if unknown.*/
+  uint32_t              split_max_delay;                 /**< Maximum time in ms a new segment waits for a video key frame to start with, 0 to start at once.*/
+  uint32_t              index_interval;                  /**< Time in ms between two index entries, 0 for the default.*/
+  uint32_t              index_size;                      /**< Data size in bytes between two index entries, 0 for the default.*/
 } DVR_WrapperRecordOpenParams_t;
 
 typedef struct {
@@ -14,8 +14,19 @@ typedef struct Record_DeviceOpenParams_t_s {
   int         dmx_dev_id;   /**< demux device id*/
   uint32_t    buf_size;     /**< dvr record buffer size*/
   uint32_t    ringbuf_size;     /**< dvr record ring buffer size*/
+  uint32_t    bitrate;      /**< declared service bitrate in bps, sizes the ring buffer if ringbuf_size is 0*/
 } Record_DeviceOpenParams_t;
 
+/**\brief DVR record device buffer statistics*/
+typedef struct Record_DeviceStats_s {
+  uint32_t    ringbuf_size;   /**< current dvr ring buffer size*/
+  uint32_t    peak_level;     /**< highest fill level of the ring buffer seen*/
+  uint32_t    overflows;      /**< number of ring buffer overflows*/
+  uint32_t    grows;          /**< number of times the ring buffer was enlarged*/
+  uint32_t    read_size;      /**< current read size*/
+  uint32_t    drain_latency;  /**< longest time between two reads, unit on ms*/
+} Record_DeviceStats_t;
+
 /**\brief Open a DVR record device
  * \param[out] p_handle, DVR device handle
  * \param[in] params, DVR device open parameters
@@ -71,6 +82,39 @@ int record_device_stop(Record_DeviceHandle_t handle);
  */
 int record_device_read(Record_DeviceHandle_t handle, void *buf, size_t len, int timeout);
 
+/**\brief Wait until data can be read from the record device, without reading them
+ * \param[in] handle, DVR device handle
+ * \param[in] timeout, unit on ms, -1 to wait until data come or the device stops
+ * \return DVR_SUCCESS if data can be read
+ * \return Error code on timeout, stop or failure
+ */
+int record_device_wait(Record_DeviceHandle_t handle, int timeout);
+
+/**\brief Read the output of the secure demux for the DVR record device
+ * The secure demux processes the dvr buffer in batches, shared by the recordings of the sid
+ * \param[in] handle, DVR device handle
+ * \param[out] buf, the output address
+ * \param[out] len, the output length
+ * \return The output length on Success
+ * \return Error code On failure
+ */
+ssize_t record_device_read_ext(Record_DeviceHandle_t handle, size_t *buf, size_t *len);
+
+/**\brief Get the read size of the DVR record device
+ * The read size starts from the flush size and follows the fill level of the ring buffer
+ * \param[in] handle, DVR device handle
+ * \return The read size, 0 on failure
+ */
+uint32_t record_device_get_read_size(Record_DeviceHandle_t handle);
+
+/**\brief Get the buffer statistics of the DVR record device
+ * \param[in] handle, DVR device handle
+ * \param[out] p_stats, the statistics
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int record_device_get_stats(Record_DeviceHandle_t handle, Record_DeviceStats_t *p_stats);
+
 /**\brief Configure secure buffer for the given record device
  * \param[in] handle, DVR device handle
  * \param[out] sec_buf, secure buffer address
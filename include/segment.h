@@ -74,6 +74,14 @@ int segment_update_pts(Segment_Handle_t handle, uint64_t pts, loff_t offset);
  */
 loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size);
 
+/**\brief Seek the segment to a position
+ * \param[in] handle, Segment handle
+ * \param[in] position, The position in bytes
+ * \return The segment current read position on success
+ * \return error code on failure
+ */
+loff_t segment_seek_position(Segment_Handle_t handle, loff_t position);
+
 /**\brief Tell the current position for the giving segment
  * \param[in] handle, Segment handle
  * \return The segment current read position on success
@@ -141,6 +149,16 @@ int segment_load_allInfo(Segment_Handle_t handle, struct list_head *list);
  */
 int segment_delete(const char *location, uint64_t segment_id);
 
+/**\brief Keep the files of a segment to be reused by the next segment opened with recycle set
+ * Only the files of one segment are kept for a location, the segment is deleted if
+ * some files are already kept.
+ * \param[in] location, The record file's location
+ * \param[in] segment_id, The segment's index
+ * \return DVR_SUCCESS On success
+ * \return Error code On failure
+ */
+int segment_recycle(const char *location, uint64_t segment_id);
+
 /**\brief check the segment is ongoing file
  * \param[in] handle, The segment handle
  * \return DVR_SUCCESS On success
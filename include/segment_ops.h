@@ -19,7 +19,8 @@ typedef void* Segment_Handle_t;
 typedef enum {
   SEGMENT_MODE_READ,            /**< Segment open read mode*/
   SEGMENT_MODE_WRITE,           /**< Segment open write mode*/
-  SEGMENT_MODE_MAX              /**< Segment invalid open mode*/
+  SEGMENT_MODE_MAX,             /**< Segment invalid open mode*/
+  SEGMENT_MODE_REPAIR = 0x100   /**< Segment open to rebuild the index and information files from the ts file*/
 } Segment_OpenMode_t;
 
 /**\brief Segment open parameters*/
@@ -28,6 +29,9 @@ typedef struct Segment_OpenParams_s {
   uint64_t              segment_id;                             /**< Segment index*/
   Segment_OpenMode_t    mode;                                   /**< Segment open mode*/
   DVR_Bool_t            force_sysclock;                         /**< If ture, force to use system clock as PVR index time source. If false, libdvr can determine index time source based on actual situation*/
+  DVR_Bool_t            recycle;                                /**< Write mode, reuse the files kept by segment_recycle instead of creating new ones*/
+  uint32_t              index_interval;                         /**< Write mode, time in ms between two index entries, 0 for the default*/
+  uint32_t              index_size;                             /**< Write mode, data size in bytes between two index entries, 0 for the default*/
 } Segment_OpenParams_t;
 
 typedef struct Segment_Ops_s {
@@ -188,6 +192,14 @@ typedef struct Segment_Ops_s {
    * \return segment id
    */
   uint64_t (*segment_get_cur_segment_id)(Segment_Handle_t handle);
+
+  /**\brief Seek the segment to a position
+   * \param[in] handle, Segment handle
+   * \param[in] position, The position in bytes
+   * \return The segment current read position on success
+   * \return error code on failure
+   */
+  loff_t (*segment_seek_position)(Segment_Handle_t handle, loff_t position);
 } Segment_Ops_t;
 
 #ifdef __cplusplus
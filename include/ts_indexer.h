@@ -19,6 +19,19 @@ typedef enum {
   TS_INDEXER_VIDEO_FORMAT_HEVC   /**< HEVC*/
 } TS_Indexer_StreamFormat_t;
 
+/**Stream type*/
+typedef enum {
+  TS_INDEXER_STREAM_TYPE_VIDEO,    /**< Video, frames are parsed if the format is set*/
+  TS_INDEXER_STREAM_TYPE_AUDIO,    /**< Audio*/
+  TS_INDEXER_STREAM_TYPE_SUBTITLE  /**< Subtitle*/
+} TS_Indexer_StreamType_t;
+
+/**Maximum number of streams indexed by one TS indexer*/
+#define TS_INDEXER_MAX_STREAMS (32)
+
+/**Maximum number of events generated by one TS packet, the minimum event array size of ts_indexer_parse_batch*/
+#define TS_INDEXER_PACKET_EVENTS_MAX (64)
+
 /**Event type.*/
 typedef enum {
   TS_INDEXER_EVENT_TYPE_START_INDICATOR,            /**< TS start indicator.*/
@@ -41,7 +54,8 @@ typedef enum {
   TS_INDEXER_EVENT_TYPE_HEVC_IDR_N_LP,              /**< HEVC NAL unit type IDR_N_LP.*/
   TS_INDEXER_EVENT_TYPE_HEVC_TRAIL_CRA,             /**< HEVC NAL unit type TRAIL_CRA.*/
   TS_INDEXER_EVENT_TYPE_VIDEO_PTS,                  /**< MEPG2/AVC/HEVC PTS.*/
-  TS_INDEXER_EVENT_TYPE_AUDIO_PTS                   /**< Audio PTS.*/
+  TS_INDEXER_EVENT_TYPE_AUDIO_PTS,                  /**< Audio PTS.*/
+  TS_INDEXER_EVENT_TYPE_SUBTITLE_PTS                /**< Subtitle PTS.*/
 } TS_Indexer_EventType_t;
 
 /**Stream Parser state.*/
@@ -71,25 +85,36 @@ typedef void (*TS_Indexer_EventCallback_t) (TS_Indexer_t *ts_indexer, TS_Indexer
 typedef struct {
   uint64_t                      pts;            /**< The a/v PTS.*/
   uint64_t                      offset;         /**< The current offset.*/
-  uint8_t                       data[184+16];   /**< The PES data.*/
-  int                           len;            /**< The length of PES data`.*/
+  uint8_t                       data[184+16];   /**< The cached PES header data.*/
+  int                           len;            /**< The length of cached PES header data.*/
+  int                           skip;           /**< The optional PES header bytes to be skipped.*/
   TS_Indexer_State_t            state;          /**< The stream state.*/
+  uint32_t                      sc_state;       /**< The last elementary stream bytes, to find the start codes across TS packets.*/
+  uint8_t                       sc_header[8];   /**< The unit header bytes following the start code.*/
+  int                           sc_len;         /**< The length of sc_header collected.*/
+  int                           sc_need;        /**< The length of sc_header needed to parse the unit, 0 if no start code is pending.*/
+  uint64_t                      sc_offset;      /**< The offset of the pending start code.*/
+  uint64_t                      sc_pts;         /**< The PTS of the pending start code.*/
 } PESParser;
 
 /**TS parser.*/
 typedef struct {
-  int                           pid;    /**< The a/v PID.*/
-  TS_Indexer_StreamFormat_t     format; /**< The a/v format.*/
+  int                           pid;    /**< The stream PID, 0x1fff if the parser is unused.*/
+  TS_Indexer_StreamType_t       type;   /**< The stream type.*/
+  TS_Indexer_StreamFormat_t     format; /**< The video format, -1 if frames are not parsed.*/
   PESParser                     PES;    /**< The PES parser.*/
   uint64_t                      offset; /**< The offset of packet with start indicator.*/
 } TSParser;
 
 /**TS indexer.*/
 struct TS_Indexer_s {
-  TSParser               video_parser;  /**< The video parser.*/
-  TSParser               audio_parser;  /**< The audio parser.*/
+  TSParser               streams[TS_INDEXER_MAX_STREAMS]; /**< The stream parsers, 0 is the video set by ts_indexer_set_video_pid, 1 is the audio set by ts_indexer_set_audio_pid.*/
+  uint8_t                pid_map[8192]; /**< PID to parser lookup, index in streams plus 1, 0 if the PID is not indexed.*/
   uint64_t                      offset; /**< The current offset.*/
   TS_Indexer_EventCallback_t callback;  /**< The event callback function.*/
+  TS_Indexer_Event_t        *events;    /**< The event array of ts_indexer_parse_batch.*/
+  int                    events_max;    /**< The size of the event array.*/
+  int                    events_num;    /**< The number of events in the array.*/
 };
 
 /**
@@ -133,6 +158,26 @@ int ts_indexer_set_video_pid (TS_Indexer_t *ts_indexer, int pid);
  */
 int ts_indexer_set_audio_pid (TS_Indexer_t *ts_indexer, int pid);
 
+/**
+ * Add a stream to be indexed, or update the type and format of an indexed PID.
+ * \param ts_indexer The TS indexer.
+ * \param pid The stream PID.
+ * \param type The stream type.
+ * \param format The video format, -1 if frames are not parsed.
+ * \retval 0 On success.
+ * \retval -1 On error.
+ */
+int ts_indexer_add_stream (TS_Indexer_t *ts_indexer, int pid, TS_Indexer_StreamType_t type, TS_Indexer_StreamFormat_t format);
+
+/**
+ * Remove an indexed stream.
+ * \param ts_indexer The TS indexer.
+ * \param pid The stream PID.
+ * \retval 0 On success.
+ * \retval -1 On error.
+ */
+int ts_indexer_remove_stream (TS_Indexer_t *ts_indexer, int pid);
+
 /**
  * Set the event callback function.
  * \param ts_indexer The TS indexer.
@@ -151,6 +196,22 @@ int ts_indexer_set_event_callback (TS_Indexer_t *ts_indexer, TS_Indexer_EventCal
  */
 int ts_indexer_parse (TS_Indexer_t *ts_indexer, uint8_t *data, int len);
 
+/**
+ * Parse the TS stream and store the generated events in an array instead of
+ * calling the event callback.
+ * \param ts_indexer The TS indexer.
+ * \param data The TS data.
+ * \param len The length of the TS data in bytes.
+ * \param events The array to store the events.
+ * \param max_events The size of the event array, at least TS_INDEXER_PACKET_EVENTS_MAX.
+ * \param[out] nb_events Returns the number of events stored.
+ * \return The left TS data length of bytes, it includes the packets not parsed
+ *  because the event array is full.
+ * \retval -1 On error.
+ */
+int ts_indexer_parse_batch (TS_Indexer_t *ts_indexer, uint8_t *data, int len,
+    TS_Indexer_Event_t *events, int max_events, int *nb_events);
+
 #ifdef __cplusplus
 }
 #endif
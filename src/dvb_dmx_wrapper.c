@@ -51,6 +51,7 @@ typedef struct
     int running;
     pthread_t thread;
     pthread_mutex_t lock;
+    pthread_cond_t cond;
 
     dvb_dmx_filter_t filter[DMX_FILTER_COUNT];
 }dvb_dmx_t;
@@ -113,14 +114,17 @@ static void* dmx_data_thread(void *arg)
            }
         }
 
-        pthread_mutex_unlock(&dmx->lock);
-
         if (!cnt)
         {
-            usleep(20*1000);
+            /*sleep until a filter is allocated or the device is closed*/
+            if (dmx->running)
+                pthread_cond_wait(&dmx->cond, &dmx->lock);
+            pthread_mutex_unlock(&dmx->lock);
             continue;
         }
 
+        pthread_mutex_unlock(&dmx->lock);
+
         ret = poll(fds, cnt, DMX_POLL_TIMEOUT);
         if (ret <= 0)
         {
@@ -203,6 +207,7 @@ DVB_RESULT AML_DMX_Open(int dev_no)
     dev->dev_no = dev_no;
 
     pthread_mutex_init(&dev->lock, NULL);
+    pthread_cond_init(&dev->cond, NULL);
     dev->running = 1;
     pthread_create(&dev->thread, NULL, dmx_data_thread, dev);
 
@@ -261,6 +266,7 @@ DVB_RESULT AML_DMX_AllocateFilter(int dev_no, int *fhandle)
     filter[fid].fd = fd;
     filter[fid].used = 1;
     *fhandle = fid;
+    pthread_cond_signal(&dev->cond);
 
     pthread_mutex_unlock(&dev->lock);
 
@@ -583,10 +589,14 @@ DVB_RESULT AML_DMX_Close(int dev_no)
 
     if (open_count == 0)
     {
+        pthread_mutex_lock(&dev->lock);
         dev->running = 0;
+        pthread_cond_signal(&dev->cond);
+        pthread_mutex_unlock(&dev->lock);
         pthread_join(dev->thread, NULL);
     }
 
+    pthread_cond_destroy(&dev->cond);
     pthread_mutex_destroy(&dev->lock);
 
     return ret;
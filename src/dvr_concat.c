@@ -0,0 +1,465 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dvr_types.h"
+#include "dvr_segment.h"
+#include "segment.h"
+#include "dvr_concat.h"
+
+/**\brief Segment of the concatenated reader*/
+typedef struct {
+  uint64_t          id;                              /**< Segment id*/
+  loff_t            start;                           /**< Position of the segment start*/
+  loff_t            size;                            /**< Segment size*/
+  uint64_t          start_time;                      /**< Time of the segment start in ms*/
+  uint64_t          duration;                        /**< Segment duration in ms*/
+} DVR_ConcatSegment_t;
+
+/**\brief Concatenated reader*/
+typedef struct {
+  char              location[DVR_MAX_LOCATION_SIZE]; /**< Record file location*/
+  Segment_Ops_t     ops;                             /**< Segment operations*/
+  DVR_ConcatSegment_t *segs;                         /**< Segments in the recording order*/
+  uint32_t          nb;                              /**< Number of segments*/
+  uint32_t          cur;                             /**< Index of the segment read*/
+  Segment_Handle_t  cur_handle;                      /**< Handle of the segment read, NULL if not opened*/
+  Segment_Handle_t  next_handle;                     /**< Handle of the following segment, opened ahead*/
+  loff_t            pos;                             /**< Read position*/
+} DVR_ConcatReader_t;
+
+#define CONCAT_CALL_IS_VALID(_r, _name) (!!(_r)->ops.segment_##_name)
+
+/****************************************************************************
+ * Static functions
+ ***************************************************************************/
+
+static void concat_set_default_ops(Segment_Ops_t *ops)
+{
+  memset(ops, 0, sizeof(Segment_Ops_t));
+  #define _SET(_op)\
+    ops->segment_##_op = segment_##_op
+  _SET(open);
+  _SET(close);
+  _SET(read);
+  _SET(seek);
+  _SET(seek_position);
+  _SET(tell_position);
+  _SET(tell_position_time);
+  _SET(tell_total_time);
+  _SET(get_cur_segment_size);
+  #undef _SET
+}
+
+/*recompute the starts of the segments from index i*/
+static void concat_update_starts(DVR_ConcatReader_t *r, uint32_t i)
+{
+  for (; i < r->nb; i++) {
+    r->segs[i].start = i ? r->segs[i - 1].start + r->segs[i - 1].size : 0;
+    r->segs[i].start_time = i ? r->segs[i - 1].start_time + r->segs[i - 1].duration : 0;
+  }
+}
+
+static Segment_Handle_t concat_open_segment(DVR_ConcatReader_t *r, uint32_t i)
+{
+  Segment_OpenParams_t params;
+  Segment_Handle_t h = NULL;
+
+  if (i >= r->nb)
+    return NULL;
+
+  memset(&params, 0, sizeof(params));
+  memcpy(params.location, r->location, sizeof(params.location));
+  params.segment_id = r->segs[i].id;
+  params.mode = SEGMENT_MODE_READ;
+  if (r->ops.segment_open(&params, &h) != DVR_SUCCESS)
+    return NULL;
+  return h;
+}
+
+static void concat_close_segments(DVR_ConcatReader_t *r)
+{
+  if (r->cur_handle)
+    r->ops.segment_close(r->cur_handle);
+  if (r->next_handle)
+    r->ops.segment_close(r->next_handle);
+  r->cur_handle = NULL;
+  r->next_handle = NULL;
+}
+
+/*the size of the opened segment is used, the information file of a recording segment is late*/
+static void concat_check_size(DVR_ConcatReader_t *r)
+{
+  off_t size;
+
+  if (!CONCAT_CALL_IS_VALID(r, get_cur_segment_size))
+    return;
+  size = r->ops.segment_get_cur_segment_size(r->cur_handle);
+  if (size >= 0 && size != r->segs[r->cur].size) {
+    r->segs[r->cur].size = size;
+    concat_update_starts(r, r->cur + 1);
+  }
+}
+
+/*make segment i the current one, the following segment is opened ahead*/
+static int concat_set_current(DVR_ConcatReader_t *r, uint32_t i)
+{
+  if (r->cur_handle && r->cur == i)
+    return DVR_SUCCESS;
+
+  if (r->cur_handle && r->next_handle && r->cur + 1 == i) {
+    r->ops.segment_close(r->cur_handle);
+    r->cur_handle = r->next_handle;
+    r->next_handle = NULL;
+  } else {
+    concat_close_segments(r);
+    r->cur_handle = concat_open_segment(r, i);
+    if (!r->cur_handle) {
+      DVR_ERROR("%s, cannot open segment %llu of %s", __func__, r->segs[i].id, r->location);
+      return DVR_FAILURE;
+    }
+  }
+  r->cur = i;
+  r->next_handle = concat_open_segment(r, i + 1);
+  concat_check_size(r);
+  return DVR_SUCCESS;
+}
+
+/*find the segment holding the position, the last one if beyond*/
+static uint32_t concat_find_position(DVR_ConcatReader_t *r, loff_t position)
+{
+  uint32_t lo = 0, hi = r->nb - 1;
+
+  while (lo < hi) {
+    uint32_t mid = (lo + hi + 1) / 2;
+    if (r->segs[mid].start <= position)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+static uint32_t concat_find_time(DVR_ConcatReader_t *r, uint64_t time)
+{
+  uint32_t lo = 0, hi = r->nb - 1;
+
+  while (lo < hi) {
+    uint32_t mid = (lo + hi + 1) / 2;
+    if (r->segs[mid].start_time <= time)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+/*load the segment list and information of the location*/
+static int concat_load(DVR_ConcatReader_t *r, DVR_ConcatSegment_t **p_segs, uint32_t *p_nb)
+{
+  DVR_RecordSegmentInfo_t seg_info;
+  DVR_RecordSegmentInfo_t *p_seg_info, *p_seg_tmp;
+  DVR_ConcatSegment_t *segs;
+  struct list_head info_list;
+  DVR_Bool_t has_list;
+  uint64_t *p_segment_ids = NULL;
+  uint32_t segment_nb = 0;
+  uint32_t i, nb = 0;
+  int error;
+
+  error = dvr_segment_get_list(r->location, &segment_nb, &p_segment_ids);
+  DVR_RETURN_IF_FALSE(error == DVR_SUCCESS);
+  if (segment_nb == 0) {
+    free(p_segment_ids);
+    return DVR_FAILURE;
+  }
+
+  segs = (DVR_ConcatSegment_t *)calloc(segment_nb, sizeof(DVR_ConcatSegment_t));
+  if (!segs) {
+    free(p_segment_ids);
+    return DVR_FAILURE;
+  }
+
+  INIT_LIST_HEAD(&info_list);
+  has_list = (dvr_segment_get_allInfo(r->location, &info_list) != DVR_FAILURE);
+
+  for (i = 0; i < segment_nb; i++) {
+    DVR_Bool_t found = DVR_FALSE;
+
+    if (has_list) {
+      // coverity[self_assign]
+      list_for_each_entry(p_seg_info, &info_list, head) {
+        if (p_seg_info->id == p_segment_ids[i]) {
+          seg_info = *p_seg_info;
+          found = DVR_TRUE;
+          break;
+        }
+      }
+    }
+    if (!found) {
+      memset(&seg_info, 0, sizeof(seg_info));
+      if (dvr_segment_get_info(r->location, p_segment_ids[i], &seg_info) != DVR_SUCCESS) {
+        /*no information yet, the size is got when the segment is opened*/
+        seg_info.id = p_segment_ids[i];
+      }
+    }
+    segs[nb].id = p_segment_ids[i];
+    segs[nb].size = seg_info.size;
+    segs[nb].duration = seg_info.duration > 0 ? seg_info.duration : 0;
+    nb++;
+  }
+
+  list_for_each_entry_safe(p_seg_info, p_seg_tmp, &info_list, head) {
+    list_del(&p_seg_info->head);
+    free(p_seg_info);
+  }
+  free(p_segment_ids);
+
+  *p_segs = segs;
+  *p_nb = nb;
+  return DVR_SUCCESS;
+}
+
+/****************************************************************************
+ * API functions
+ ***************************************************************************/
+
+int dvr_concat_open(DVR_ConcatHandle_t *p_handle, const char *location, Segment_Ops_t *ops)
+{
+  DVR_ConcatReader_t *r;
+
+  DVR_RETURN_IF_FALSE(p_handle);
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+
+  r = (DVR_ConcatReader_t *)calloc(1, sizeof(DVR_ConcatReader_t));
+  DVR_RETURN_IF_FALSE(r);
+
+  strncpy(r->location, location, sizeof(r->location) - 1);
+  if (ops)
+    r->ops = *ops;
+  else
+    concat_set_default_ops(&r->ops);
+
+  if (!CONCAT_CALL_IS_VALID(r, open) || !CONCAT_CALL_IS_VALID(r, close)
+      || !CONCAT_CALL_IS_VALID(r, read) || !CONCAT_CALL_IS_VALID(r, seek_position)
+      || !CONCAT_CALL_IS_VALID(r, tell_position)) {
+    DVR_ERROR("%s, segment operations cannot read", __func__);
+    free(r);
+    return DVR_FAILURE;
+  }
+
+  if (concat_load(r, &r->segs, &r->nb) != DVR_SUCCESS) {
+    DVR_ERROR("%s, no segment to read in %s", __func__, location);
+    free(r);
+    return DVR_FAILURE;
+  }
+  concat_update_starts(r, 0);
+  if (concat_set_current(r, 0) != DVR_SUCCESS) {
+    free(r->segs);
+    free(r);
+    return DVR_FAILURE;
+  }
+
+  DVR_INFO("%s, %s, %u segments", __func__, location, r->nb);
+  *p_handle = (DVR_ConcatHandle_t)r;
+  return DVR_SUCCESS;
+}
+
+int dvr_concat_close(DVR_ConcatHandle_t handle)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+
+  DVR_RETURN_IF_FALSE(r);
+
+  concat_close_segments(r);
+  free(r->segs);
+  free(r);
+  return DVR_SUCCESS;
+}
+
+int dvr_concat_refresh(DVR_ConcatHandle_t handle)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+  DVR_ConcatSegment_t *segs;
+  uint64_t id;
+  loff_t offset;
+  uint32_t nb, i;
+
+  DVR_RETURN_IF_FALSE(r);
+  DVR_RETURN_IF_FALSE(concat_load(r, &segs, &nb) == DVR_SUCCESS);
+
+  id = r->segs[r->cur].id;
+  offset = r->pos - r->segs[r->cur].start;
+
+  /*the opened segments are kept if they are still in the list*/
+  for (i = 0; i < nb && segs[i].id != id; i++)
+    ;
+  if (i < nb && (!r->next_handle || (i + 1 < nb && segs[i + 1].id == r->segs[r->cur + 1].id))) {
+    free(r->segs);
+    r->segs = segs;
+    r->nb = nb;
+    r->cur = i;
+    concat_update_starts(r, 0);
+    concat_check_size(r);
+    if (!r->next_handle)
+      r->next_handle = concat_open_segment(r, i + 1);
+    r->pos = r->segs[i].start + offset;
+    return DVR_SUCCESS;
+  }
+
+  concat_close_segments(r);
+  free(r->segs);
+  r->segs = segs;
+  r->nb = nb;
+  concat_update_starts(r, 0);
+  if (i < nb) {
+    DVR_RETURN_IF_FALSE(concat_set_current(r, i) == DVR_SUCCESS);
+    r->pos = r->segs[i].start + offset;
+  } else {
+    DVR_INFO("%s, segment %llu removed, restart from segment %llu", __func__, id, segs[0].id);
+    DVR_RETURN_IF_FALSE(concat_set_current(r, 0) == DVR_SUCCESS);
+    r->pos = 0;
+    offset = 0;
+  }
+  DVR_RETURN_IF_FALSE(r->ops.segment_seek_position(r->cur_handle, offset) == offset);
+  return DVR_SUCCESS;
+}
+
+ssize_t dvr_concat_read(DVR_ConcatHandle_t handle, void *buf, size_t count)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+  uint8_t *p = (uint8_t *)buf;
+  size_t rd = 0;
+  ssize_t len;
+
+  DVR_RETURN_IF_FALSE(r);
+  DVR_RETURN_IF_FALSE(buf);
+  DVR_RETURN_IF_FALSE(r->cur_handle);
+
+  while (rd < count) {
+    len = r->ops.segment_read(r->cur_handle, p + rd, count - rd);
+    if (len < 0) {
+      if (rd)
+        break;
+      return len;
+    }
+    if (len > 0) {
+      rd += len;
+      r->pos += len;
+      continue;
+    }
+
+    /*end of the segment, continue with the next one*/
+    if (r->cur + 1 >= r->nb)
+      break;
+    concat_check_size(r);
+    if (concat_set_current(r, r->cur + 1) != DVR_SUCCESS)
+      break;
+    r->pos = r->segs[r->cur].start;
+  }
+
+  return rd;
+}
+
+loff_t dvr_concat_seek_time(DVR_ConcatHandle_t handle, uint64_t time, int block_size)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+  loff_t offset;
+  uint32_t i;
+
+  DVR_RETURN_IF_FALSE(r);
+  DVR_RETURN_IF_FALSE(CONCAT_CALL_IS_VALID(r, seek));
+
+  i = concat_find_time(r, time);
+  DVR_RETURN_IF_FALSE(concat_set_current(r, i) == DVR_SUCCESS);
+
+  offset = r->ops.segment_seek(r->cur_handle, time - r->segs[i].start_time, block_size);
+  DVR_RETURN_IF_FALSE(offset >= 0);
+
+  r->pos = r->segs[i].start + offset;
+  return r->pos;
+}
+
+loff_t dvr_concat_seek(DVR_ConcatHandle_t handle, loff_t position)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+  loff_t offset;
+  uint32_t i;
+
+  DVR_RETURN_IF_FALSE(r);
+  DVR_RETURN_IF_FALSE(position >= 0);
+
+  i = concat_find_position(r, position);
+  DVR_RETURN_IF_FALSE(concat_set_current(r, i) == DVR_SUCCESS);
+  /*the segment sizes are known once opened*/
+  if (position >= r->segs[i].start + r->segs[i].size && i + 1 < r->nb) {
+    i = concat_find_position(r, position);
+    DVR_RETURN_IF_FALSE(concat_set_current(r, i) == DVR_SUCCESS);
+  }
+
+  offset = r->ops.segment_seek_position(r->cur_handle, position - r->segs[i].start);
+  DVR_RETURN_IF_FALSE(offset >= 0);
+
+  r->pos = r->segs[i].start + offset;
+  return r->pos;
+}
+
+loff_t dvr_concat_tell(DVR_ConcatHandle_t handle)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+
+  DVR_RETURN_IF_FALSE(r);
+
+  return r->pos;
+}
+
+loff_t dvr_concat_tell_time(DVR_ConcatHandle_t handle)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+  loff_t time;
+
+  DVR_RETURN_IF_FALSE(r);
+  DVR_RETURN_IF_FALSE(CONCAT_CALL_IS_VALID(r, tell_position_time));
+
+  time = r->ops.segment_tell_position_time(r->cur_handle, r->pos - r->segs[r->cur].start);
+  DVR_RETURN_IF_FALSE(time >= 0);
+
+  return r->segs[r->cur].start_time + time;
+}
+
+int dvr_concat_locate(DVR_ConcatHandle_t handle, loff_t position, uint64_t *p_segment_id, loff_t *p_offset)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+  uint32_t i;
+
+  DVR_RETURN_IF_FALSE(r);
+  DVR_RETURN_IF_FALSE(p_segment_id);
+  DVR_RETURN_IF_FALSE(p_offset);
+  DVR_RETURN_IF_FALSE(position >= 0);
+
+  i = concat_find_position(r, position);
+  DVR_RETURN_IF_FALSE(position < r->segs[i].start + r->segs[i].size);
+
+  *p_segment_id = r->segs[i].id;
+  *p_offset = position - r->segs[i].start;
+  return DVR_SUCCESS;
+}
+
+int dvr_concat_get_info(DVR_ConcatHandle_t handle, DVR_ConcatInfo_t *p_info)
+{
+  DVR_ConcatReader_t *r = (DVR_ConcatReader_t *)handle;
+  DVR_ConcatSegment_t *last;
+
+  DVR_RETURN_IF_FALSE(r);
+  DVR_RETURN_IF_FALSE(p_info);
+
+  last = &r->segs[r->nb - 1];
+  memset(p_info, 0, sizeof(*p_info));
+  p_info->nb_segments = r->nb;
+  p_info->first_id = r->segs[0].id;
+  p_info->last_id = last->id;
+  p_info->size = last->start + last->size;
+  p_info->duration = last->start_time + last->duration;
+  return DVR_SUCCESS;
+}
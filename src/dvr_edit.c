@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+
+#include "dvr_types.h"
+#include "dvr_segment.h"
+#include "dvr_edit.h"
+#include "segment.h"
+#include "ts_indexer.h"
+
+/****************************************************************************
+ * Macro definitions
+ ***************************************************************************/
+
+#define TS_PKT_SIZE           (188)
+/*data searched for a key frame after the end of a cut*/
+#define EDIT_SCAN_SIZE        (4*1024*1024)
+#define EDIT_READ_SIZE        (256*1024)
+#define EDIT_MAX_EVENTS       (TS_INDEXER_PACKET_EVENTS_MAX * 16)
+
+/****************************************************************************
+ * Static functions
+ ***************************************************************************/
+
+static void edit_get_fname(char *fname, size_t size, const char *location, const char *ext)
+{
+  snprintf(fname, size, "%s.%s", location, ext);
+}
+
+static int edit_is_key_frame(TS_Indexer_EventType_t type)
+{
+  switch (type) {
+    case TS_INDEXER_EVENT_TYPE_MPEG2_I_FRAME:
+    case TS_INDEXER_EVENT_TYPE_AVC_I_SLICE:
+    case TS_INDEXER_EVENT_TYPE_HEVC_BLA_W_LP:
+    case TS_INDEXER_EVENT_TYPE_HEVC_BLA_W_RADL:
+    case TS_INDEXER_EVENT_TYPE_HEVC_BLA_N_LP:
+    case TS_INDEXER_EVENT_TYPE_HEVC_IDR_W_RADL:
+    case TS_INDEXER_EVENT_TYPE_HEVC_IDR_N_LP:
+    case TS_INDEXER_EVENT_TYPE_HEVC_TRAIL_CRA:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/*the video pid and its indexer format, -1 if the segment has no indexed video*/
+static int edit_get_video(DVR_RecordSegmentInfo_t *p_info, TS_Indexer_StreamFormat_t *p_format)
+{
+  uint32_t i;
+
+  for (i = 0; i < p_info->nb_pids; i++) {
+    if (((p_info->pids[i].type >> 24) & 0x0f) != DVR_STREAM_TYPE_VIDEO)
+      continue;
+    switch (p_info->pids[i].type & 0xffffff) {
+      case DVR_VIDEO_FORMAT_MPEG1:
+      case DVR_VIDEO_FORMAT_MPEG2:
+        *p_format = TS_INDEXER_VIDEO_FORMAT_MPEG2;
+        return p_info->pids[i].pid;
+      case DVR_VIDEO_FORMAT_H264:
+        *p_format = TS_INDEXER_VIDEO_FORMAT_H264;
+        return p_info->pids[i].pid;
+      case DVR_VIDEO_FORMAT_HEVC:
+        *p_format = TS_INDEXER_VIDEO_FORMAT_HEVC;
+        return p_info->pids[i].pid;
+      default:
+        break;
+    }
+  }
+  return -1;
+}
+
+/*the offset of the PES of the first video key frame from offset,
+  offset if not found, as for scrambled data*/
+static loff_t edit_find_key_frame(Segment_Handle_t handle, DVR_RecordSegmentInfo_t *p_info, loff_t offset)
+{
+  TS_Indexer_t *indexer;
+  TS_Indexer_Event_t *events;
+  TS_Indexer_StreamFormat_t format = TS_INDEXER_VIDEO_FORMAT_MPEG2;
+  uint8_t *buf;
+  uint64_t pes = ULLONG_MAX, key = ULLONG_MAX;
+  int pid, len, left = 0, total, nb, i;
+  int scanned = 0;
+
+  pid = edit_get_video(p_info, &format);
+  if (pid == -1 || segment_seek_position(handle, offset) != offset)
+    return offset;
+
+  indexer = (TS_Indexer_t *)malloc(sizeof(TS_Indexer_t));
+  events = (TS_Indexer_Event_t *)malloc(EDIT_MAX_EVENTS * sizeof(TS_Indexer_Event_t));
+  buf = (uint8_t *)malloc(EDIT_READ_SIZE);
+  if (!indexer || !events || !buf) {
+    free(indexer);
+    free(events);
+    free(buf);
+    return offset;
+  }
+  ts_indexer_init(indexer);
+  ts_indexer_add_stream(indexer, pid, TS_INDEXER_STREAM_TYPE_VIDEO, format);
+
+  while (key == ULLONG_MAX && scanned < EDIT_SCAN_SIZE
+      && (len = segment_read(handle, buf + left, EDIT_READ_SIZE - left)) > 0) {
+    scanned += len;
+    total = left + len;
+    left = total;
+    do {
+      left = ts_indexer_parse_batch(indexer, buf + total - left, left, events, EDIT_MAX_EVENTS, &nb);
+      for (i = 0; i < nb && key == ULLONG_MAX; i++) {
+        if (events[i].type == TS_INDEXER_EVENT_TYPE_START_INDICATOR)
+          pes = events[i].offset;
+        else if (edit_is_key_frame(events[i].type) && pes != ULLONG_MAX)
+          key = pes;
+      }
+    } while (key == ULLONG_MAX && left >= TS_PKT_SIZE);
+    if (left < 0)
+      break;
+    memmove(buf, buf + total - left, left);
+  }
+
+  ts_indexer_destroy(indexer);
+  free(buf);
+  free(events);
+  free(indexer);
+  return (key == ULLONG_MAX) ? offset : offset + (loff_t)key;
+}
+
+/*resolve the cut [start, end] ms of a segment with its index*/
+static int edit_resolve_cut(const char *location, DVR_RecordSegmentInfo_t *p_info,
+    uint32_t start, uint32_t end, DVR_EditCut_t *p_cut)
+{
+  Segment_OpenParams_t params;
+  Segment_Handle_t handle;
+  loff_t size, offset, time;
+
+  memset(&params, 0, sizeof(params));
+  strncpy(params.location, location, sizeof(params.location) - 1);
+  params.segment_id = p_info->id;
+  params.mode = SEGMENT_MODE_READ;
+  DVR_RETURN_IF_FALSE(segment_open(&params, &handle) == DVR_SUCCESS);
+
+  size = segment_get_cur_segment_size(handle);
+  memset(p_cut, 0, sizeof(*p_cut));
+  p_cut->segment_id = p_info->id;
+
+  if (start > 0) {
+    offset = segment_seek(handle, start, 0);
+    time = (offset >= 0) ? segment_tell_position_time(handle, offset) : -1;
+    if (offset >= 0 && time >= 0) {
+      p_cut->start_offset = offset;
+      p_cut->start = time;
+    } else {
+      p_cut->start_offset = size;
+      p_cut->start = p_info->duration;
+    }
+  }
+
+  p_cut->end_offset = size;
+  p_cut->end = p_info->duration;
+  if (end < p_info->duration) {
+    offset = segment_seek(handle, end, 0);
+    if (offset >= 0)
+      offset = edit_find_key_frame(handle, p_info, offset);
+    time = (offset >= 0) ? segment_tell_position_time(handle, offset) : -1;
+    if (offset >= 0 && time >= 0 && offset < size) {
+      p_cut->end_offset = offset;
+      p_cut->end = time;
+    }
+  }
+  segment_close(handle);
+
+  DVR_INFO("%s, segment %llu [%u, %u] ms cut at [%u, %u] ms offset [%lld, %lld]", __func__,
+      p_info->id, start, end, p_cut->start, p_cut->end, p_cut->start_offset, p_cut->end_offset);
+  return (p_cut->end_offset > p_cut->start_offset) ? DVR_SUCCESS : DVR_FAILURE;
+}
+
+static int edit_compare_cut(const void *a, const void *b)
+{
+  const DVR_EditCut_t *ca = (const DVR_EditCut_t *)a;
+  const DVR_EditCut_t *cb = (const DVR_EditCut_t *)b;
+
+  if (ca->segment_id != cb->segment_id)
+    return (ca->segment_id > cb->segment_id) - (ca->segment_id < cb->segment_id);
+  return (ca->start_offset > cb->start_offset) - (ca->start_offset < cb->start_offset);
+}
+
+/*sort the cuts and merge the overlapping ones*/
+static void edit_merge(DVR_EditList_t *p_list)
+{
+  DVR_EditCut_t *cur, *next;
+  uint32_t i, n = 0;
+
+  if (!p_list->nb_cuts)
+    return;
+
+  qsort(p_list->cuts, p_list->nb_cuts, sizeof(DVR_EditCut_t), edit_compare_cut);
+  for (i = 1; i < p_list->nb_cuts; i++) {
+    cur = &p_list->cuts[n];
+    next = &p_list->cuts[i];
+    if (next->segment_id == cur->segment_id && next->start_offset <= cur->end_offset) {
+      if (next->end_offset > cur->end_offset) {
+        cur->end_offset = next->end_offset;
+        cur->end = next->end;
+      }
+    } else {
+      p_list->cuts[++n] = *next;
+    }
+  }
+  p_list->nb_cuts = n + 1;
+}
+
+static int edit_add(DVR_EditList_t *p_list, DVR_EditCut_t *p_cut)
+{
+  DVR_EditCut_t *cuts;
+
+  cuts = (DVR_EditCut_t *)realloc(p_list->cuts, (p_list->nb_cuts + 1) * sizeof(DVR_EditCut_t));
+  DVR_RETURN_IF_FALSE(cuts);
+  cuts[p_list->nb_cuts++] = *p_cut;
+  p_list->cuts = cuts;
+  return DVR_SUCCESS;
+}
+
+/*write the list to a new file replacing the old one, the readers see either list*/
+static int edit_store(const char *location, DVR_EditList_t *p_list)
+{
+  char fname[DVR_MAX_LOCATION_SIZE + 16];
+  char tmp_fname[DVR_MAX_LOCATION_SIZE + 16];
+  DVR_EditCut_t *cut;
+  FILE *fp;
+  uint32_t i;
+  int ret;
+
+  edit_get_fname(fname, sizeof(fname), location, "edl");
+  if (!p_list->nb_cuts) {
+    if (unlink(fname) == -1 && errno != ENOENT)
+      return DVR_FAILURE;
+    return DVR_SUCCESS;
+  }
+
+  edit_get_fname(tmp_fname, sizeof(tmp_fname), location, "edl.tmp");
+  fp = fopen(tmp_fname, "w");
+  if (!fp) {
+    DVR_ERROR("%s, open file failed [%s], reason:%s", __func__, tmp_fname, strerror(errno));
+    return DVR_FAILURE;
+  }
+  for (i = 0; i < p_list->nb_cuts; i++) {
+    cut = &p_list->cuts[i];
+    fprintf(fp, "{segment=%llu, start=%u, end=%u, start_offset=%lld, end_offset=%lld}\n",
+        cut->segment_id, cut->start, cut->end, cut->start_offset, cut->end_offset);
+  }
+  ret = (fflush(fp) == 0 && fsync(fileno(fp)) == 0) ? DVR_SUCCESS : DVR_FAILURE;
+  fclose(fp);
+  if (ret == DVR_SUCCESS && rename(tmp_fname, fname) == -1)
+    ret = DVR_FAILURE;
+  if (ret != DVR_SUCCESS) {
+    DVR_ERROR("%s, write file failed [%s], reason:%s", __func__, fname, strerror(errno));
+    unlink(tmp_fname);
+  }
+  return ret;
+}
+
+/*find the segment and the segment time of a played time of the recording,
+  failure if the time is beyond the recording, then the end of the last segment is returned*/
+static int edit_locate(DVR_EditList_t *p_list, DVR_RecordSegmentInfo_t *infos, uint32_t nb,
+    uint64_t time, uint32_t *p_index, uint32_t *p_time)
+{
+  uint32_t i, played;
+
+  for (i = 0; i < nb; i++) {
+    played = infos[i].duration - dvr_edit_get_cut_time(p_list, infos[i].id, infos[i].duration);
+    if (time < played) {
+      *p_index = i;
+      *p_time = dvr_edit_get_segment_time(p_list, infos[i].id, time);
+      return DVR_SUCCESS;
+    }
+    time -= played;
+  }
+  *p_index = nb - 1;
+  *p_time = infos[nb - 1].duration;
+  return DVR_FAILURE;
+}
+
+static int edit_get_infos(const char *location, DVR_RecordSegmentInfo_t **p_infos, uint32_t *p_nb)
+{
+  DVR_RecordSegmentInfo_t *infos;
+  uint64_t *ids = NULL;
+  uint32_t nb = 0, i;
+
+  DVR_RETURN_IF_FALSE(dvr_segment_get_list(location, &nb, &ids) == DVR_SUCCESS);
+  if (!nb) {
+    free(ids);
+    return DVR_FAILURE;
+  }
+  infos = (DVR_RecordSegmentInfo_t *)calloc(nb, sizeof(DVR_RecordSegmentInfo_t));
+  if (!infos) {
+    free(ids);
+    return DVR_FAILURE;
+  }
+  for (i = 0; i < nb; i++) {
+    if (dvr_segment_get_info(location, ids[i], &infos[i]) != DVR_SUCCESS) {
+      free(infos);
+      free(ids);
+      return DVR_FAILURE;
+    }
+    infos[i].id = ids[i];
+  }
+  free(ids);
+  *p_infos = infos;
+  *p_nb = nb;
+  return DVR_SUCCESS;
+}
+
+/****************************************************************************
+ * API functions
+ ***************************************************************************/
+
+int dvr_edit_cut(const char *location, uint64_t start_ms, uint64_t end_ms)
+{
+  DVR_EditList_t list;
+  DVR_EditCut_t cut;
+  DVR_RecordSegmentInfo_t *infos = NULL;
+  uint32_t nb = 0, first = 0, last = 0, start = 0, end = 0, i;
+  int ret;
+
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+  DVR_RETURN_IF_FALSE(start_ms < end_ms);
+
+  DVR_RETURN_IF_FALSE(dvr_edit_load(location, &list) == DVR_SUCCESS);
+  ret = edit_get_infos(location, &infos, &nb);
+  if (ret == DVR_SUCCESS) {
+    ret = edit_locate(&list, infos, nb, start_ms, &first, &start);
+    if (ret != DVR_SUCCESS)
+      DVR_ERROR("%s, start %llu beyond the recording", __func__, start_ms);
+    /*a range beyond the recording is cut to its end*/
+    edit_locate(&list, infos, nb, end_ms, &last, &end);
+  }
+
+  for (i = first; ret == DVR_SUCCESS && i <= last; i++) {
+    if (edit_resolve_cut(location, &infos[i],
+          (i == first) ? start : 0,
+          (i == last) ? end : infos[i].duration, &cut) == DVR_SUCCESS)
+      ret = edit_add(&list, &cut);
+  }
+  if (ret == DVR_SUCCESS) {
+    edit_merge(&list);
+    ret = edit_store(location, &list);
+  }
+
+  DVR_INFO("%s, %s [%llu, %llu] ms, %u cuts, ret %d", __func__, location, start_ms, end_ms, list.nb_cuts, ret);
+  dvr_edit_free(&list);
+  free(infos);
+  return ret;
+}
+
+int dvr_edit_clear(const char *location)
+{
+  DVR_EditList_t list;
+
+  DVR_RETURN_IF_FALSE(location);
+
+  memset(&list, 0, sizeof(list));
+  return edit_store(location, &list);
+}
+
+int dvr_edit_load(const char *location, DVR_EditList_t *p_list)
+{
+  char fname[DVR_MAX_LOCATION_SIZE + 16];
+  char buf[256];
+  DVR_EditCut_t cut;
+  unsigned long long id;
+  long long start_offset, end_offset;
+  FILE *fp;
+
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(p_list);
+
+  memset(p_list, 0, sizeof(*p_list));
+  edit_get_fname(fname, sizeof(fname), location, "edl");
+  fp = fopen(fname, "r");
+  if (!fp)
+    return (errno == ENOENT) ? DVR_SUCCESS : DVR_FAILURE;
+
+  while (fgets(buf, sizeof(buf), fp)) {
+    memset(&cut, 0, sizeof(cut));
+    if (sscanf(buf, "{segment=%llu, start=%u, end=%u, start_offset=%lld, end_offset=%lld}",
+          &id, &cut.start, &cut.end, &start_offset, &end_offset) != 5)
+      continue;
+    cut.segment_id = id;
+    cut.start_offset = start_offset;
+    cut.end_offset = end_offset;
+    if (cut.end_offset <= cut.start_offset || cut.end < cut.start)
+      continue;
+    if (edit_add(p_list, &cut) != DVR_SUCCESS) {
+      fclose(fp);
+      dvr_edit_free(p_list);
+      return DVR_FAILURE;
+    }
+  }
+  fclose(fp);
+  edit_merge(p_list);
+  return DVR_SUCCESS;
+}
+
+void dvr_edit_free(DVR_EditList_t *p_list)
+{
+  if (!p_list)
+    return;
+  free(p_list->cuts);
+  p_list->cuts = NULL;
+  p_list->nb_cuts = 0;
+}
+
+uint32_t dvr_edit_get_cut_time(DVR_EditList_t *p_list, uint64_t segment_id, uint32_t time)
+{
+  DVR_EditCut_t *cut;
+  uint32_t i, cut_time = 0;
+
+  for (i = 0; p_list && i < p_list->nb_cuts; i++) {
+    cut = &p_list->cuts[i];
+    if (cut->segment_id != segment_id || cut->start >= time)
+      continue;
+    cut_time += ((time < cut->end) ? time : cut->end) - cut->start;
+  }
+  return cut_time;
+}
+
+uint32_t dvr_edit_get_segment_time(DVR_EditList_t *p_list, uint64_t segment_id, uint32_t time)
+{
+  DVR_EditCut_t *cut;
+  uint32_t i;
+
+  /*the cuts starting before the time move it, a time at a cut start is at the cut end*/
+  for (i = 0; p_list && i < p_list->nb_cuts; i++) {
+    cut = &p_list->cuts[i];
+    if (cut->segment_id != segment_id)
+      continue;
+    if (cut->start > time)
+      break;
+    time += cut->end - cut->start;
+  }
+  return time;
+}
+
+DVR_EditCut_t *dvr_edit_get_cut(DVR_EditList_t *p_list, uint64_t segment_id, loff_t offset)
+{
+  uint32_t i;
+
+  for (i = 0; p_list && i < p_list->nb_cuts; i++) {
+    if (p_list->cuts[i].segment_id == segment_id && p_list->cuts[i].end_offset > offset)
+      return &p_list->cuts[i];
+  }
+  return NULL;
+}
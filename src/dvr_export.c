@@ -0,0 +1,649 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+
+#include "dvr_types.h"
+#include "dvr_segment.h"
+#include "dvr_concat.h"
+#include "dvr_export.h"
+#include "dvr_utils.h"
+#include "segment.h"
+
+/****************************************************************************
+ * Macro definitions
+ ***************************************************************************/
+
+#define TS_PKT_SIZE           (188)
+/*buffer of the copies done in user space*/
+#define EXPORT_BUF_SIZE       (1024*1024)
+/*bytes copied by the kernel in one call*/
+#define EXPORT_CHUNK_SIZE     (64*1024*1024)
+/*file system block, the kernel shares the blocks if the offsets are aligned the same way*/
+#define EXPORT_FS_BLOCK       (4096)
+/*smaller ranges are not worth the null packets aligning them*/
+#define EXPORT_ALIGN_MIN      (16*1024*1024)
+/*data searched for the PCR pid and the PSI at the range start*/
+#define EXPORT_SCAN_SIZE      (256*1024)
+#define EXPORT_PMT_PID        (0x1000)
+#define EXPORT_PROGRAM        (1)
+#define EXPORT_SEGMENT_ID     (0)
+
+#define EXPORT_MIN(_a, _b)    (((_a) < (_b)) ? (_a) : (_b))
+
+/**\brief PSI written at the start of the exported segment*/
+typedef struct {
+  int                      pcr_pid;                               /**< PCR pid, -1 if not found*/
+  int                      pmt_pid;                               /**< PMT pid, -1 if the PAT is not found*/
+  int                      program;                               /**< Program number*/
+  int                      tsid;                                  /**< Transport stream id*/
+  int                      pat_version;                           /**< Version of the PAT*/
+  int                      pmt_version;                           /**< Version of the PMT*/
+} DVR_ExportPsi_t;
+
+/**\brief Export context*/
+typedef struct {
+  char                     location[DVR_MAX_LOCATION_SIZE];       /**< Source record file location*/
+  DVR_RecordSegmentInfo_t  info;                                  /**< Information of the exported segment*/
+  int                      out_fd;                                /**< TS file of the exported segment*/
+  loff_t                   out_size;                              /**< Bytes written to the TS file*/
+  Segment_Handle_t         out_handle;                            /**< Exported segment opened in repair mode, for the index*/
+  uint64_t                 out_time;                              /**< Time of the next part in the exported segment*/
+  uint8_t                  *buf;                                  /**< Buffer of the copies done in user space*/
+} DVR_ExportCtx_t;
+
+/****************************************************************************
+ * Static functions
+ ***************************************************************************/
+
+static void export_get_fname(char *fname, size_t size, const char *location, uint64_t id, const char *ext)
+{
+  snprintf(fname, size, "%s-%04llu.%s", location, id, ext);
+}
+
+/*CRC of the PSI sections*/
+static uint32_t export_crc32(const uint8_t *p, int len)
+{
+  uint32_t crc = 0xffffffff;
+  int i;
+
+  while (len--) {
+    crc ^= (uint32_t)*p++ << 24;
+    for (i = 0; i < 8; i++)
+      crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : (crc << 1);
+  }
+  return crc;
+}
+
+/*the PMT stream type of a DVR stream type, -1 if not listed*/
+static int export_stream_type(uint32_t type, uint8_t *desc, int *p_desc_len)
+{
+  static const uint8_t subtitle[] = {0x59, 8, 'u', 'n', 'd', 0x10, 0x00, 0x01, 0x00, 0x01};
+  static const uint8_t teletext[] = {0x56, 5, 'u', 'n', 'd', 0x09, 0x00};
+  int format = type & 0xffffff;
+
+  *p_desc_len = 0;
+  switch ((type >> 24) & 0x0f) {
+    case DVR_STREAM_TYPE_VIDEO:
+      switch (format) {
+        case DVR_VIDEO_FORMAT_MPEG1:
+          return 0x01;
+        case DVR_VIDEO_FORMAT_MPEG2:
+          return 0x02;
+        case DVR_VIDEO_FORMAT_H264:
+          return 0x1b;
+        case DVR_VIDEO_FORMAT_HEVC:
+          return 0x24;
+        default:
+          return 0x06;
+      }
+    case DVR_STREAM_TYPE_AUDIO:
+    case DVR_STREAM_TYPE_AD:
+      switch (format) {
+        case DVR_AUDIO_FORMAT_MPEG:
+          return 0x03;
+        case DVR_AUDIO_FORMAT_AAC:
+        case DVR_AUDIO_FORMAT_HEAAC:
+          return 0x0f;
+        case DVR_AUDIO_FORMAT_LATM:
+          return 0x11;
+        case DVR_AUDIO_FORMAT_AC3:
+          desc[0] = 0x6a;
+          desc[1] = 1;
+          desc[2] = 0;
+          *p_desc_len = 3;
+          return 0x06;
+        case DVR_AUDIO_FORMAT_EAC3:
+          desc[0] = 0x7a;
+          desc[1] = 1;
+          desc[2] = 0;
+          *p_desc_len = 3;
+          return 0x06;
+        case DVR_AUDIO_FORMAT_DTS:
+          desc[0] = 0x7b;
+          desc[1] = 0;
+          *p_desc_len = 2;
+          return 0x06;
+        case DVR_AUDIO_FORMAT_AC4:
+          /*extension descriptor, AC-4 tag*/
+          desc[0] = 0x7f;
+          desc[1] = 1;
+          desc[2] = 0x15;
+          *p_desc_len = 3;
+          return 0x06;
+        default:
+          return 0x06;
+      }
+    case DVR_STREAM_TYPE_SUBTITLE:
+      memcpy(desc, subtitle, sizeof(subtitle));
+      *p_desc_len = sizeof(subtitle);
+      return 0x06;
+    case DVR_STREAM_TYPE_TELETEXT:
+      memcpy(desc, teletext, sizeof(teletext));
+      *p_desc_len = sizeof(teletext);
+      return 0x06;
+    default:
+      break;
+  }
+  return -1;
+}
+
+/*put a section in a packet, the last 4 bytes of the section are the CRC*/
+static void export_section_packet(uint8_t *pkt, int pid, uint8_t *sec, int len)
+{
+  uint32_t crc = export_crc32(sec, len - 4);
+
+  sec[len - 4] = crc >> 24;
+  sec[len - 3] = crc >> 16;
+  sec[len - 2] = crc >> 8;
+  sec[len - 1] = crc;
+
+  memset(pkt, 0xff, TS_PKT_SIZE);
+  pkt[0] = 0x47;
+  pkt[1] = 0x40 | ((pid >> 8) & 0x1f);
+  pkt[2] = pid & 0xff;
+  pkt[3] = 0x10;
+  pkt[4] = 0;
+  memcpy(pkt + 5, sec, len);
+}
+
+static void export_section_length(uint8_t *sec, int len)
+{
+  sec[1] = 0xb0 | (((len - 3) >> 8) & 0x0f);
+  sec[2] = (len - 3) & 0xff;
+}
+
+static int export_pmt_pid(DVR_RecordSegmentInfo_t *p_info)
+{
+  int pid;
+  uint32_t i;
+
+  for (pid = EXPORT_PMT_PID; ; pid++) {
+    for (i = 0; i < p_info->nb_pids && p_info->pids[i].pid != pid; i++)
+      ;
+    if (i == p_info->nb_pids)
+      return pid;
+  }
+}
+
+/*the section starting in a packet, NULL if none*/
+static uint8_t *export_section_start(uint8_t *p, int *p_len)
+{
+  int off = 4;
+
+  if (!(p[1] & 0x40) || !(p[3] & 0x10))
+    return NULL;
+  if (p[3] & 0x20)
+    off += 1 + p[4];
+  if (off >= TS_PKT_SIZE)
+    return NULL;
+  off += 1 + p[off];
+  if (off + 12 > TS_PKT_SIZE)
+    return NULL;
+  /*the loops end before the CRC*/
+  *p_len = EXPORT_MIN(3 + (((p[off + 1] & 0x0f) << 8) | p[off + 2]) - 4, TS_PKT_SIZE - off);
+  return p + off;
+}
+
+/*the PCR pid and the PAT and PMT at the start of the range.
+  the packets of the range are copied as they are, with their PAT and PMT if they
+  are recorded, so the PSI written before them reuse the original pids and versions*/
+static void export_scan_psi(int fd, loff_t offset, uint8_t *buf, DVR_ExportPsi_t *psi)
+{
+  ssize_t len = pread(fd, buf, EXPORT_SCAN_SIZE, offset);
+  uint64_t pcr;
+  uint8_t *p, *sec;
+  int pid, sec_len, i;
+
+  psi->pcr_pid = -1;
+  psi->pmt_pid = -1;
+  psi->program = EXPORT_PROGRAM;
+  psi->tsid = 0;
+  psi->pat_version = 0;
+  psi->pmt_version = 0;
+
+  for (p = buf; len >= TS_PKT_SIZE; p += TS_PKT_SIZE, len -= TS_PKT_SIZE) {
+    if (p[0] != 0x47)
+      continue;
+    pid = ((p[1] & 0x1f) << 8) | p[2];
+    if (psi->pcr_pid == -1 && dvr_ts_get_pcr(p, &pcr))
+      psi->pcr_pid = pid;
+    if (pid == 0 && psi->pmt_pid == -1 && (sec = export_section_start(p, &sec_len)) && sec[0] == 0x00) {
+      /*the first program, the program 0 is the NIT*/
+      for (i = 8; i + 4 <= sec_len; i += 4) {
+        if (!sec[i] && !sec[i + 1])
+          continue;
+        psi->program = (sec[i] << 8) | sec[i + 1];
+        psi->pmt_pid = ((sec[i + 2] & 0x1f) << 8) | sec[i + 3];
+        psi->tsid = (sec[3] << 8) | sec[4];
+        psi->pat_version = (sec[5] >> 1) & 0x1f;
+        break;
+      }
+    } else if (pid == psi->pmt_pid && (sec = export_section_start(p, &sec_len))
+        && sec[0] == 0x02 && ((sec[3] << 8) | sec[4]) == psi->program) {
+      psi->pmt_version = (sec[5] >> 1) & 0x1f;
+      if (psi->pcr_pid != -1)
+        break;
+    }
+  }
+}
+
+/*write the PAT and PMT of the exported segment, with the pid and versions of the recorded ones*/
+static int export_write_psi(DVR_ExportCtx_t *ctx, DVR_ExportPsi_t *psi)
+{
+  uint8_t pkts[TS_PKT_SIZE * 2];
+  uint8_t sec[TS_PKT_SIZE];
+  uint8_t desc[16];
+  int pmt_pid = (psi->pmt_pid != -1) ? psi->pmt_pid : export_pmt_pid(&ctx->info);
+  int pcr_pid = (psi->pcr_pid != -1) ? psi->pcr_pid : 0x1fff;
+  int len, desc_len, stream_type, pid;
+  uint32_t i;
+
+  memset(sec, 0, sizeof(sec));
+  sec[0] = 0x00;
+  sec[3] = psi->tsid >> 8;
+  sec[4] = psi->tsid & 0xff;
+  sec[5] = 0xc1 | (psi->pat_version << 1);
+  sec[8] = psi->program >> 8;
+  sec[9] = psi->program & 0xff;
+  sec[10] = 0xe0 | (pmt_pid >> 8);
+  sec[11] = pmt_pid & 0xff;
+  len = 16;
+  export_section_length(sec, len);
+  export_section_packet(pkts, 0, sec, len);
+
+  memset(sec, 0, sizeof(sec));
+  sec[0] = 0x02;
+  sec[3] = psi->program >> 8;
+  sec[4] = psi->program & 0xff;
+  sec[5] = 0xc1 | (psi->pmt_version << 1);
+  sec[8] = 0xe0 | (pcr_pid >> 8);
+  sec[9] = pcr_pid & 0xff;
+  sec[10] = 0xf0;
+  len = 12;
+  for (i = 0; i < ctx->info.nb_pids; i++) {
+    pid = ctx->info.pids[i].pid;
+    stream_type = export_stream_type(ctx->info.pids[i].type, desc, &desc_len);
+    if (stream_type == -1 || pid == 0 || pid == pmt_pid)
+      continue;
+    if (len + 5 + desc_len + 4 > TS_PKT_SIZE - 5) {
+      DVR_WARN("%s, PMT full, pid %d and the following are not listed", __func__, pid);
+      break;
+    }
+    sec[len] = stream_type;
+    sec[len + 1] = 0xe0 | (pid >> 8);
+    sec[len + 2] = pid & 0xff;
+    sec[len + 3] = 0xf0;
+    sec[len + 4] = desc_len;
+    memcpy(sec + len + 5, desc, desc_len);
+    len += 5 + desc_len;
+  }
+  len += 4;
+  export_section_length(sec, len);
+  export_section_packet(pkts + TS_PKT_SIZE, pmt_pid, sec, len);
+
+  DVR_RETURN_IF_FALSE(pwrite(ctx->out_fd, pkts, sizeof(pkts), ctx->out_size) == sizeof(pkts));
+  ctx->out_size += sizeof(pkts);
+  return DVR_SUCCESS;
+}
+
+/*the first of 3 packets in a row from offset, the index offsets are not always packet aligned*/
+static loff_t export_find_sync(int fd, loff_t offset, uint8_t *buf)
+{
+  ssize_t len = pread(fd, buf, TS_PKT_SIZE * 4, offset);
+  int i;
+
+  for (i = 0; i < TS_PKT_SIZE && i + TS_PKT_SIZE * 2 < len; i++) {
+    if (buf[i] == 0x47 && buf[i + TS_PKT_SIZE] == 0x47 && buf[i + TS_PKT_SIZE * 2] == 0x47)
+      return offset + i;
+  }
+  return offset;
+}
+
+/*null packets moving the output offset to the same place in a block as the input offset*/
+static int export_align(DVR_ExportCtx_t *ctx, loff_t in_offset)
+{
+  int nb = 0;
+  uint8_t *p;
+
+  /*the packet size and the block size are multiples of 4*/
+  if ((ctx->out_size - in_offset) % 4)
+    return DVR_SUCCESS;
+
+  while ((ctx->out_size + nb * TS_PKT_SIZE - in_offset) % EXPORT_FS_BLOCK)
+    nb++;
+  if (!nb)
+    return DVR_SUCCESS;
+
+  for (p = ctx->buf; p < ctx->buf + nb * TS_PKT_SIZE; p += TS_PKT_SIZE) {
+    memset(p, 0xff, TS_PKT_SIZE);
+    p[0] = 0x47;
+    p[1] = 0x1f;
+    p[2] = 0xff;
+    p[3] = 0x10;
+  }
+  DVR_RETURN_IF_FALSE(pwrite(ctx->out_fd, ctx->buf, nb * TS_PKT_SIZE, ctx->out_size) == nb * TS_PKT_SIZE);
+  ctx->out_size += nb * TS_PKT_SIZE;
+  return DVR_SUCCESS;
+}
+
+/*copy the data in the kernel, in user space only if the kernel cannot*/
+static int export_copy(DVR_ExportCtx_t *ctx, int in_fd, loff_t in_offset, loff_t size)
+{
+  loff_t out_offset = ctx->out_size;
+  ssize_t len = 0;
+
+#ifdef __NR_copy_file_range
+  /*the blocks are shared if the file system supports it*/
+  while (size > 0) {
+    len = syscall(__NR_copy_file_range, in_fd, &in_offset, ctx->out_fd, &out_offset,
+        (size_t)EXPORT_MIN(size, EXPORT_CHUNK_SIZE), 0);
+    if (len <= 0)
+      break;
+    size -= len;
+  }
+  if (size > 0 && len < 0)
+    DVR_INFO("%s, copy_file_range failed, reason:%s", __func__, strerror(errno));
+#endif
+
+  /*sendfile writes at the file position*/
+  if (size > 0 && lseek(ctx->out_fd, out_offset, SEEK_SET) != -1) {
+    while (size > 0) {
+      len = sendfile(ctx->out_fd, in_fd, &in_offset, (size_t)EXPORT_MIN(size, EXPORT_CHUNK_SIZE));
+      if (len <= 0)
+        break;
+      size -= len;
+      out_offset += len;
+    }
+  }
+
+  while (size > 0) {
+    len = pread(in_fd, ctx->buf, (size_t)EXPORT_MIN(size, EXPORT_BUF_SIZE), in_offset);
+    if (len <= 0 || pwrite(ctx->out_fd, ctx->buf, len, out_offset) != len)
+      break;
+    size -= len;
+    in_offset += len;
+    out_offset += len;
+  }
+
+  if (size > 0) {
+    DVR_ERROR("%s, copy failed, reason:%s", __func__, strerror(errno));
+    return DVR_FAILURE;
+  }
+  ctx->out_size = out_offset;
+  return DVR_SUCCESS;
+}
+
+/*move the index entries of [start, end) of a segment to the exported segment*/
+static void export_index(DVR_ExportCtx_t *ctx, uint64_t id, loff_t start, loff_t end, loff_t out_start, DVR_Bool_t whole)
+{
+  char fname[DVR_MAX_LOCATION_SIZE + 32];
+  char buf[256];
+  DVR_RecordSegmentInfo_t info;
+  unsigned long long time;
+  long long offset;
+  uint64_t first = start ? ULLONG_MAX : 0;
+  uint64_t last = 0;
+  FILE *fp;
+
+  export_get_fname(fname, sizeof(fname), ctx->location, id, "idx");
+  fp = fopen(fname, "r");
+  if (!fp) {
+    DVR_WARN("%s, open file failed [%s], reason:%s", __func__, fname, strerror(errno));
+    return;
+  }
+  while (fgets(buf, sizeof(buf), fp)) {
+    if (sscanf(buf, " {time=%llu, offset=%lld}", &time, &offset) != 2 || offset < start)
+      continue;
+    if (offset >= end)
+      break;
+    if (first == ULLONG_MAX)
+      first = time;
+    if (time < first)
+      continue;
+    segment_update_pts(ctx->out_handle, ctx->out_time + time - first, out_start + offset - start);
+    last = time;
+  }
+  fclose(fp);
+
+  if (first == ULLONG_MAX)
+    return;
+  /*the index ends before the segment*/
+  if (whole && dvr_segment_get_info(ctx->location, id, &info) == DVR_SUCCESS && info.duration > last)
+    last = info.duration;
+  ctx->out_time += last - first;
+}
+
+/*export [start, end) of a segment, end -1 for the segment end*/
+static int export_part(DVR_ExportCtx_t *ctx, uint64_t id, loff_t start, loff_t end, DVR_Bool_t first)
+{
+  char fname[DVR_MAX_LOCATION_SIZE + 32];
+  struct stat st;
+  loff_t size, out_start;
+  int fd, ret = DVR_SUCCESS;
+
+  export_get_fname(fname, sizeof(fname), ctx->location, id, "ts");
+  fd = open(fname, O_RDONLY);
+  if (fd == -1) {
+    DVR_ERROR("%s, open file failed [%s], reason:%s", __func__, fname, strerror(errno));
+    return DVR_FAILURE;
+  }
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return DVR_FAILURE;
+  }
+  if (end < 0 || end > st.st_size)
+    end = st.st_size;
+
+  if (first) {
+    DVR_ExportPsi_t psi;
+
+    start = export_find_sync(fd, start, ctx->buf);
+    export_scan_psi(fd, start, ctx->buf, &psi);
+    ret = export_write_psi(ctx, &psi);
+  }
+
+  size = end - start;
+  size -= size % TS_PKT_SIZE;
+  if (ret == DVR_SUCCESS && size > 0) {
+    if (size >= EXPORT_ALIGN_MIN)
+      export_align(ctx, start);
+    out_start = ctx->out_size;
+    ret = export_copy(ctx, fd, start, size);
+    if (ret == DVR_SUCCESS)
+      export_index(ctx, id, start, start + size, out_start, start + size == st.st_size);
+  }
+  close(fd);
+  return ret;
+}
+
+/*the segment and offset of a time, offset -1 for the end of the last segment*/
+static int export_locate(DVR_ConcatHandle_t concat, DVR_ConcatInfo_t *p_info, uint64_t time,
+    uint64_t *p_id, loff_t *p_offset)
+{
+  loff_t pos;
+
+  if (time >= p_info->duration) {
+    *p_id = p_info->last_id;
+    *p_offset = -1;
+    return DVR_SUCCESS;
+  }
+  pos = dvr_concat_seek_time(concat, time, TS_PKT_SIZE);
+  DVR_RETURN_IF_FALSE(pos >= 0);
+  return dvr_concat_locate(concat, pos, p_id, p_offset);
+}
+
+static int export_map_range(DVR_ExportCtx_t *ctx, uint64_t start_ms, uint64_t end_ms,
+    uint64_t *p_start_id, loff_t *p_start, uint64_t *p_end_id, loff_t *p_end)
+{
+  DVR_ConcatHandle_t concat;
+  DVR_ConcatInfo_t info;
+  int ret;
+
+  DVR_RETURN_IF_FALSE(dvr_concat_open(&concat, ctx->location, NULL) == DVR_SUCCESS);
+  ret = dvr_concat_get_info(concat, &info);
+  if (ret == DVR_SUCCESS && start_ms >= info.duration) {
+    DVR_ERROR("%s, start %llu beyond the recording of %llu ms", __func__, start_ms, info.duration);
+    ret = DVR_FAILURE;
+  }
+  if (ret == DVR_SUCCESS)
+    ret = export_locate(concat, &info, start_ms, p_start_id, p_start);
+  if (ret == DVR_SUCCESS)
+    ret = export_locate(concat, &info, end_ms, p_end_id, p_end);
+  dvr_concat_close(concat);
+
+  if (ret == DVR_SUCCESS && *p_start < 0)
+    *p_start = 0;
+  return ret;
+}
+
+static int export_segments(DVR_ExportCtx_t *ctx, uint64_t start_id, loff_t start, uint64_t end_id, loff_t end)
+{
+  uint64_t *ids = NULL;
+  uint32_t nb = 0, i;
+  int ret = DVR_FAILURE;
+
+  DVR_RETURN_IF_FALSE(dvr_segment_get_list(ctx->location, &nb, &ids) == DVR_SUCCESS);
+  for (i = 0; i < nb && ids[i] != start_id; i++)
+    ;
+  for (; i < nb; i++) {
+    ret = export_part(ctx, ids[i],
+        (ids[i] == start_id) ? start : 0,
+        (ids[i] == end_id) ? end : -1,
+        ids[i] == start_id);
+    if (ret != DVR_SUCCESS || ids[i] == end_id)
+      break;
+  }
+  free(ids);
+  return ret;
+}
+
+static int export_store_info(DVR_ExportCtx_t *ctx, const char *out_path)
+{
+  uint64_t id = EXPORT_SEGMENT_ID;
+
+  ctx->info.id = id;
+  ctx->info.duration = ctx->out_time;
+  ctx->info.size = ctx->out_size;
+  ctx->info.nb_packets = ctx->out_size / TS_PKT_SIZE;
+  DVR_RETURN_IF_FALSE(segment_store_info(ctx->out_handle, &ctx->info) == DVR_SUCCESS);
+  DVR_RETURN_IF_FALSE(segment_store_allInfo(ctx->out_handle, &ctx->info) == DVR_SUCCESS);
+  return dvr_segment_link(out_path, 1, &id);
+}
+
+/*remove the files written by an export, the other files starting with the location are kept*/
+static void export_remove(const char *out_path)
+{
+  const char *exts[] = {"ts", "idx", "dat"};
+  char fname[DVR_MAX_LOCATION_SIZE + 32];
+  size_t i;
+
+  for (i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+    export_get_fname(fname, sizeof(fname), out_path, EXPORT_SEGMENT_ID, exts[i]);
+    unlink(fname);
+  }
+  snprintf(fname, sizeof(fname), "%s.dat", out_path);
+  unlink(fname);
+  snprintf(fname, sizeof(fname), "%s.list", out_path);
+  unlink(fname);
+}
+
+/****************************************************************************
+ * API functions
+ ***************************************************************************/
+
+int dvr_export_range(const char *location, uint64_t start_ms, uint64_t end_ms, const char *out_path)
+{
+  DVR_ExportCtx_t ctx;
+  Segment_OpenParams_t params;
+  char fname[DVR_MAX_LOCATION_SIZE + 32];
+  uint64_t start_id, end_id;
+  loff_t start, end;
+  int ret;
+
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(out_path);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+  DVR_RETURN_IF_FALSE(strlen(out_path) < DVR_MAX_LOCATION_SIZE);
+  /*the files of a location start with it, a location starting with the other one shares file names*/
+  DVR_RETURN_IF_FALSE(strncmp(location, out_path, EXPORT_MIN(strlen(location), strlen(out_path))));
+  DVR_RETURN_IF_FALSE(start_ms < end_ms);
+
+  memset(&ctx, 0, sizeof(ctx));
+  strncpy(ctx.location, location, sizeof(ctx.location) - 1);
+  ctx.out_fd = -1;
+
+  ret = export_map_range(&ctx, start_ms, end_ms, &start_id, &start, &end_id, &end);
+  DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
+  DVR_RETURN_IF_FALSE(dvr_segment_get_info(location, start_id, &ctx.info) == DVR_SUCCESS);
+  DVR_INFO("%s, %s [%llu, %llu] ms: segment %llu offset %lld to segment %llu offset %lld", __func__,
+      location, start_ms, end_ms, start_id, start, end_id, end);
+
+  ctx.buf = (uint8_t *)malloc(EXPORT_BUF_SIZE);
+  DVR_RETURN_IF_FALSE(ctx.buf);
+
+  export_remove(out_path);
+  export_get_fname(fname, sizeof(fname), out_path, EXPORT_SEGMENT_ID, "ts");
+  ctx.out_fd = open(fname, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (ctx.out_fd == -1) {
+    DVR_ERROR("%s, open file failed [%s], reason:%s", __func__, fname, strerror(errno));
+    free(ctx.buf);
+    return DVR_FAILURE;
+  }
+
+  /*the index times are the times from the start of the exported segment*/
+  memset(&params, 0, sizeof(params));
+  strncpy(params.location, out_path, sizeof(params.location) - 1);
+  params.segment_id = EXPORT_SEGMENT_ID;
+  params.mode = SEGMENT_MODE_REPAIR;
+  params.force_sysclock = DVR_TRUE;
+  ret = segment_open(&params, &ctx.out_handle);
+  if (ret == DVR_SUCCESS) {
+    segment_update_pts(ctx.out_handle, 0, 0);
+    ret = export_segments(&ctx, start_id, start, end_id, end);
+  }
+  if (ret == DVR_SUCCESS)
+    ret = fsync(ctx.out_fd) ? DVR_FAILURE : DVR_SUCCESS;
+  if (ret == DVR_SUCCESS)
+    ret = export_store_info(&ctx, out_path);
+
+  if (ctx.out_handle)
+    segment_close(ctx.out_handle);
+  close(ctx.out_fd);
+  free(ctx.buf);
+
+  if (ret != DVR_SUCCESS) {
+    DVR_ERROR("%s, export of %s to %s failed", __func__, location, out_path);
+    export_remove(out_path);
+    return DVR_FAILURE;
+  }
+  DVR_INFO("%s, %s exported, %lld bytes, %llu ms", __func__, out_path, ctx.out_size, ctx.out_time);
+  return DVR_SUCCESS;
+}
@@ -0,0 +1,323 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "dvr_types.h"
+#include "list.h"
+#include "dvr_live_edge.h"
+
+/****************************************************************************
+ * Macro definitions
+ ***************************************************************************/
+
+typedef struct {
+  struct list_head head;
+  char             location[DVR_MAX_LOCATION_SIZE];  /**< Record file location*/
+  dvr_mutex_t      *lock;                            /**< Mutex of the cond*/
+  pthread_cond_t   *cond;                            /**< Cond to be signaled*/
+  uint32_t         seq;                              /**< Number of notifications*/
+} DVR_LiveEdgeListener_t;
+
+/*maximum number of writes kept in a tail*/
+#define TAIL_MAX_CHUNKS  (1024)
+
+typedef struct {
+  uint64_t         segment_id;                       /**< Segment of the data*/
+  loff_t           offset;                           /**< Offset of the data in the segment*/
+  size_t           pos;                              /**< Position of the data in the ring*/
+  size_t           len;                              /**< Data length*/
+  uint32_t         time;                             /**< Monotonic time of the write in ms*/
+} DVR_LiveTailChunk_t;
+
+typedef struct {
+  struct list_head head;
+  char             location[DVR_MAX_LOCATION_SIZE];  /**< Record file location*/
+  pthread_mutex_t  lock;                             /**< Protect the ring*/
+  uint8_t          *buf;                             /**< Ring buffer*/
+  size_t           size;                             /**< Ring buffer size*/
+  size_t           used;                             /**< Bytes used in the ring*/
+  uint32_t         max_time;                         /**< Maximum duration of the data in ms, 0 for no limit*/
+  DVR_LiveTailChunk_t chunks[TAIL_MAX_CHUNKS];       /**< Writes in the ring, oldest first*/
+  int              first;                            /**< Index of the oldest chunk*/
+  int              nb;                               /**< Number of chunks*/
+} DVR_LiveTail_t;
+
+/****************************************************************************
+ * Static data
+ ***************************************************************************/
+
+static struct list_head listeners = LIST_HEAD_INIT(listeners);
+static pthread_mutex_t listeners_lock = PTHREAD_MUTEX_INITIALIZER;
+static int nb_listeners = 0;
+
+static struct list_head tails = LIST_HEAD_INIT(tails);
+static pthread_mutex_t tails_lock = PTHREAD_MUTEX_INITIALIZER;
+static int nb_tails = 0;
+
+/****************************************************************************
+ * Static functions
+ ***************************************************************************/
+
+static uint32_t tail_time_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static inline DVR_LiveTailChunk_t *tail_chunk(DVR_LiveTail_t *t, int i)
+{
+  return &t->chunks[(t->first + i) % TAIL_MAX_CHUNKS];
+}
+
+static void tail_drop_oldest(DVR_LiveTail_t *t)
+{
+  t->used -= tail_chunk(t, 0)->len;
+  t->first = (t->first + 1) % TAIL_MAX_CHUNKS;
+  t->nb--;
+}
+
+/*copy between the ring at pos and buf, the ring wraps*/
+static void tail_copy(DVR_LiveTail_t *t, size_t pos, uint8_t *buf, size_t len, int to_ring)
+{
+  size_t n = t->size - pos;
+
+  if (n > len)
+    n = len;
+  if (to_ring) {
+    memcpy(t->buf + pos, buf, n);
+    memcpy(t->buf, buf + n, len - n);
+  } else {
+    memcpy(buf, t->buf + pos, n);
+    memcpy(buf + n, t->buf, len - n);
+  }
+}
+
+/****************************************************************************
+ * API functions
+ ***************************************************************************/
+
+int dvr_live_edge_listen(DVR_LiveEdgeHandle_t *p_handle, const char *location, dvr_mutex_t *lock, pthread_cond_t *cond)
+{
+  DVR_LiveEdgeListener_t *l;
+
+  DVR_RETURN_IF_FALSE(p_handle);
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(lock);
+  DVR_RETURN_IF_FALSE(cond);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+
+  l = (DVR_LiveEdgeListener_t *)calloc(1, sizeof(DVR_LiveEdgeListener_t));
+  DVR_RETURN_IF_FALSE(l);
+
+  strncpy(l->location, location, sizeof(l->location) - 1);
+  l->lock = lock;
+  l->cond = cond;
+
+  pthread_mutex_lock(&listeners_lock);
+  list_add(&l->head, &listeners);
+  __atomic_add_fetch(&nb_listeners, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&listeners_lock);
+
+  *p_handle = (DVR_LiveEdgeHandle_t)l;
+  return DVR_SUCCESS;
+}
+
+int dvr_live_edge_unlisten(DVR_LiveEdgeHandle_t handle)
+{
+  DVR_LiveEdgeListener_t *l = (DVR_LiveEdgeListener_t *)handle;
+
+  DVR_RETURN_IF_FALSE(l);
+
+  pthread_mutex_lock(&listeners_lock);
+  list_del(&l->head);
+  __atomic_sub_fetch(&nb_listeners, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&listeners_lock);
+
+  free(l);
+  return DVR_SUCCESS;
+}
+
+uint32_t dvr_live_edge_seq(DVR_LiveEdgeHandle_t handle)
+{
+  DVR_LiveEdgeListener_t *l = (DVR_LiveEdgeListener_t *)handle;
+
+  if (!l)
+    return 0;
+
+  return __atomic_load_n(&l->seq, __ATOMIC_ACQUIRE);
+}
+
+void dvr_live_edge_notify(const char *location)
+{
+  DVR_LiveEdgeListener_t *l;
+
+  /*nobody is waiting, most recordings*/
+  if (!location || !__atomic_load_n(&nb_listeners, __ATOMIC_ACQUIRE))
+    return;
+
+  pthread_mutex_lock(&listeners_lock);
+  // coverity[self_assign]
+  list_for_each_entry(l, &listeners, head) {
+    if (!strcmp(l->location, location)) {
+      /*signaled under the listener's mutex, the wakeup is not lost between its check and its wait*/
+      dvr_mutex_lock(l->lock);
+      __atomic_add_fetch(&l->seq, 1, __ATOMIC_RELEASE);
+      pthread_cond_signal(l->cond);
+      dvr_mutex_unlock(l->lock);
+    }
+  }
+  pthread_mutex_unlock(&listeners_lock);
+}
+
+int dvr_live_edge_tail_open(DVR_LiveEdgeHandle_t *p_handle, const char *location, size_t size, uint32_t max_time)
+{
+  DVR_LiveTail_t *t;
+
+  DVR_RETURN_IF_FALSE(p_handle);
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(size > 0);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+
+  t = (DVR_LiveTail_t *)calloc(1, sizeof(DVR_LiveTail_t));
+  DVR_RETURN_IF_FALSE(t);
+
+  t->buf = (uint8_t *)malloc(size);
+  if (!t->buf) {
+    DVR_ERROR("%s, no memory for a %zu bytes tail", __func__, size);
+    free(t);
+    return DVR_FAILURE;
+  }
+  t->size = size;
+  t->max_time = max_time;
+  strncpy(t->location, location, sizeof(t->location) - 1);
+  pthread_mutex_init(&t->lock, NULL);
+
+  pthread_mutex_lock(&tails_lock);
+  list_add(&t->head, &tails);
+  __atomic_add_fetch(&nb_tails, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&tails_lock);
+
+  DVR_INFO("%s, tail of %s, %zu bytes %u ms", __func__, location, size, max_time);
+  *p_handle = (DVR_LiveEdgeHandle_t)t;
+  return DVR_SUCCESS;
+}
+
+int dvr_live_edge_tail_close(DVR_LiveEdgeHandle_t handle)
+{
+  DVR_LiveTail_t *t = (DVR_LiveTail_t *)handle;
+
+  DVR_RETURN_IF_FALSE(t);
+
+  pthread_mutex_lock(&tails_lock);
+  list_del(&t->head);
+  __atomic_sub_fetch(&nb_tails, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&tails_lock);
+
+  /*wait for the reader found the tail before it was removed*/
+  pthread_mutex_lock(&t->lock);
+  pthread_mutex_unlock(&t->lock);
+
+  pthread_mutex_destroy(&t->lock);
+  free(t->buf);
+  free(t);
+  return DVR_SUCCESS;
+}
+
+int dvr_live_edge_tail_write(DVR_LiveEdgeHandle_t handle, uint64_t segment_id, loff_t offset, const uint8_t *buf, size_t len)
+{
+  DVR_LiveTail_t *t = (DVR_LiveTail_t *)handle;
+  DVR_LiveTailChunk_t *c;
+  uint32_t now = tail_time_ms();
+  size_t pos;
+
+  DVR_RETURN_IF_FALSE(t);
+  DVR_RETURN_IF_FALSE(buf);
+
+  pthread_mutex_lock(&t->lock);
+
+  if (len > t->size) {
+    /*too large to be kept, the older data are no longer the tail*/
+    t->first = 0;
+    t->nb = 0;
+    t->used = 0;
+    pthread_mutex_unlock(&t->lock);
+    return DVR_SUCCESS;
+  }
+
+  while (t->nb && (t->used + len > t->size || t->nb >= TAIL_MAX_CHUNKS
+      || (t->max_time && now - tail_chunk(t, 0)->time > t->max_time)))
+    tail_drop_oldest(t);
+
+  if (t->nb) {
+    c = tail_chunk(t, t->nb - 1);
+    pos = (c->pos + c->len) % t->size;
+  } else {
+    pos = 0;
+  }
+  tail_copy(t, pos, (uint8_t *)buf, len, 1);
+
+  c = tail_chunk(t, t->nb);
+  c->segment_id = segment_id;
+  c->offset = offset;
+  c->pos = pos;
+  c->len = len;
+  c->time = now;
+  t->nb++;
+  t->used += len;
+
+  pthread_mutex_unlock(&t->lock);
+  return DVR_SUCCESS;
+}
+
+size_t dvr_live_edge_tail_read(const char *location, uint64_t segment_id, loff_t offset, uint8_t *buf, size_t len)
+{
+  DVR_LiveTail_t *t;
+  size_t rd = 0;
+  int i;
+
+  if (!location || !buf || !__atomic_load_n(&nb_tails, __ATOMIC_ACQUIRE))
+    return 0;
+
+  pthread_mutex_lock(&tails_lock);
+  // coverity[self_assign]
+  list_for_each_entry(t, &tails, head) {
+    if (!strcmp(t->location, location))
+      break;
+  }
+  if (&t->head == &tails) {
+    pthread_mutex_unlock(&tails_lock);
+    return 0;
+  }
+  pthread_mutex_lock(&t->lock);
+  pthread_mutex_unlock(&tails_lock);
+
+  /*copy from the chunk holding offset and the following contiguous chunks*/
+  for (i = 0; i < t->nb && rd < len; i++) {
+    DVR_LiveTailChunk_t *c = tail_chunk(t, i);
+    loff_t cur = offset + rd;
+    size_t skip, n;
+
+    if (c->segment_id != segment_id || cur < c->offset || cur >= c->offset + (loff_t)c->len) {
+      if (rd)
+        break;
+      continue;
+    }
+    skip = cur - c->offset;
+    n = c->len - skip;
+    if (n > len - rd)
+      n = len - rd;
+    tail_copy(t, (c->pos + skip) % t->size, buf + rd, n, 0);
+    rd += n;
+  }
+
+  pthread_mutex_unlock(&t->lock);
+  return rd;
+}
+
+int dvr_live_edge_tail_count(void)
+{
+  return __atomic_load_n(&nb_tails, __ATOMIC_ACQUIRE);
+}
@@ -637,6 +637,49 @@ static int _dvr_get_next_segmentId(DVR_PlaybackHandle_t handle) {
   return DVR_SUCCESS;
 }
 //open next segment to play,if reach list end return errro.
+/*reload the cuts of the recording when a segment is opened, called with the segment lock*/
+static void _dvr_playback_load_edits(DVR_Playback_t *player)
+{
+  dvr_edit_free(&player->edits);
+  if (dvr_edit_load(player->cur_segment.location, &player->edits) != DVR_SUCCESS) {
+    DVR_PB_WARN("load edit list of [%s] failed", player->cur_segment.location);
+  } else if (player->edits.nb_cuts) {
+    DVR_PB_INFO("[%s] has %d cuts", player->cur_segment.location, player->edits.nb_cuts);
+  }
+}
+
+//read the current segment without the cuts, called with the segment lock
+static ssize_t _dvr_playback_read(DVR_Playback_t *player, uint8_t *buf, size_t len)
+{
+  DVR_EditCut_t *cut;
+  int block = player->openParams.block_size;
+  loff_t pos, start, end;
+
+  pos = segment_tell_position(player->segment_handle);
+  if (!player->edits.nb_cuts || pos < 0)
+    return segment_read(player->segment_handle, buf, len);
+
+  for (cut = dvr_edit_get_cut(&player->edits, player->cur_segment_id, pos);
+      cut;
+      cut = dvr_edit_get_cut(&player->edits, player->cur_segment_id, cut->end_offset)) {
+    //the data is decrypted by blocks, the cuts are moved to the block starts
+    start = (block > 0) ? cut->start_offset - cut->start_offset % block : cut->start_offset;
+    end = (block > 0) ? cut->end_offset - cut->end_offset % block : cut->end_offset;
+    if (pos < start) {
+      if ((loff_t)len > start - pos)
+        len = start - pos;
+      break;
+    }
+    if (pos < end) {
+      DVR_PB_INFO("skip cut of segment [%lld] [%lld, %lld]", player->cur_segment_id, pos, end);
+      if (segment_seek_position(player->segment_handle, end) != end)
+        return DVR_FAILURE;
+      pos = end;
+    }
+  }
+  return segment_read(player->segment_handle, buf, len);
+}
+
 static int _change_to_next_segment(DVR_PlaybackHandle_t handle)
 {
   DVR_Playback_t *player = (DVR_Playback_t *) handle;
@@ -674,6 +717,7 @@ retry:
     DVR_PB_INFO("open segment error");
     goto retry;
   }
+  _dvr_playback_load_edits(player);
   // Keep the start segment_id when the first segment_open is called during a playback
   if (player->first_start_id == UINT64_MAX) {
     player->first_start_id = player->cur_segment.segment_id;
@@ -772,6 +816,8 @@ static int _dvr_open_segment(DVR_PlaybackHandle_t handle, uint64_t segment_id)
   ret = segment_open(&params, &(player->segment_handle));
   if (ret == DVR_FAILURE) {
     DVR_PB_INFO("segment open error");
+  } else {
+    _dvr_playback_load_edits(player);
   }
   // Keep the start segment_id when the first segment_open is called during a playback
   if (player->first_start_id == UINT64_MAX) {
@@ -965,6 +1011,7 @@ static void* _dvr_playback_thread(void *arg)
   int real_read = 0;
   DVR_Bool_t goto_rewrite = DVR_FALSE;
   int read = 0;
+  uint32_t live_seq = 0;
 
   prctl(PR_SET_NAME,"DvrPlayback");
 
@@ -1241,9 +1288,11 @@ static void* _dvr_playback_thread(void *arg)
     dvr_mutex_unlock(&player->lock);
     _dvr_playback_sent_playtime((DVR_PlaybackHandle_t)player, DVR_FALSE);
     dvr_mutex_lock(&player->lock);
+    /*data recorded after this are notified by the live edge listener*/
+    live_seq = dvr_live_edge_seq(player->live_edge);
     pthread_mutex_lock(&player->segment_lock);
     //DVR_PB_INFO("start read");
-    read = segment_read(player->segment_handle, buf + real_read, buf_len - real_read);
+    read = _dvr_playback_read(player, buf + real_read, buf_len - real_read);
     real_read = real_read + read;
     player->ts_cache_len = real_read;
     //DVR_PB_INFO("start read end [%d]", read);
@@ -1335,8 +1384,12 @@ static void* _dvr_playback_thread(void *arg)
         continue;
       } else if (ret != DVR_SUCCESS) {
         DVR_PB_INFO("delay:%d pauselive:%d", delay, _dvr_pauselive_decode_success((DVR_PlaybackHandle_t)player));
+        /*at the end of the recording data, wake up as soon as the recorder writes more*/
+        if (!player->live_edge)
+          dvr_live_edge_listen(&player->live_edge, player->cur_segment.location, &player->lock, &player->cond);
         dvr_mutex_lock(&player->lock);
-        _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, timeout);
+        if (dvr_live_edge_seq(player->live_edge) == live_seq)
+          _dvr_playback_timeoutwait((DVR_PlaybackHandle_t)player, timeout);
         dvr_mutex_unlock(&player->lock);
 
         get_effective_tsplayer_delay_time(player,&delay);
@@ -1360,7 +1413,7 @@ static void* _dvr_playback_thread(void *arg)
       _dvr_replay_changed_pid((DVR_PlaybackHandle_t)player);
       _dvr_check_cur_segment_flag((DVR_PlaybackHandle_t)player);
       pthread_mutex_lock(&player->segment_lock);
-      read = segment_read(player->segment_handle, buf + real_read, buf_len - real_read);
+      read = _dvr_playback_read(player, buf + real_read, buf_len - real_read);
       real_read = real_read + read;
       player->ts_cache_len = real_read;
       pthread_mutex_unlock(&player->segment_lock);
@@ -1553,6 +1606,10 @@ check1:
   }
 end:
   DVR_PB_INFO("playback thread is end");
+  if (player->live_edge) {
+    dvr_live_edge_unlisten(player->live_edge);
+    player->live_edge = NULL;
+  }
   free(buf);
   free(dec_bufs.buf_data);
   return NULL;
@@ -1782,6 +1839,7 @@ int dvr_playback_close(DVR_PlaybackHandle_t handle) {
   dvr_mutex_destroy(&player->lock);
   pthread_mutex_destroy(&player->segment_lock);
   pthread_cond_destroy(&player->cond);
+  dvr_edit_free(&player->edits);
 
   if (player) {
     free(player);
@@ -2962,6 +3020,10 @@ int dvr_playback_seek(DVR_PlaybackHandle_t handle, uint64_t segment_id, uint32_t
     dvr_mutex_unlock(&player->lock);
     return DVR_FAILURE;
   }
+  //the time offset is the played time, the cuts not counted
+  pthread_mutex_lock(&player->segment_lock);
+  time_offset = dvr_edit_get_segment_time(&player->edits, segment_id, time_offset);
+  pthread_mutex_unlock(&player->segment_lock);
   if (time_offset >_dvr_get_end_time(handle) &&_dvr_has_next_segmentId(handle, segment_id) == DVR_FAILURE) {
     if (segment_ongoing(player->segment_handle) == DVR_SUCCESS) {
       DVR_PB_INFO("is ongoing segment when seek end, need return success");
@@ -3915,6 +3977,15 @@ static int _dvr_playback_get_status(DVR_PlaybackHandle_t handle,
 
   p_status->time_end = _dvr_get_end_time(handle);
   p_status->time_cur = _dvr_get_play_cur_time(handle, &segment_id);
+  //the cuts are not played
+  pthread_mutex_lock(&player->segment_lock);
+  if (player->edits.nb_cuts) {
+    if (p_status->time_end > 0)
+      p_status->time_end -= dvr_edit_get_cut_time(&player->edits, player->cur_segment_id, p_status->time_end);
+    if (p_status->time_cur > 0)
+      p_status->time_cur -= dvr_edit_get_cut_time(&player->edits, segment_id, p_status->time_cur);
+  }
+  pthread_mutex_unlock(&player->segment_lock);
 
   if (player->control_speed_enable == 1) {
     if (player->con_spe.ply_sta == 0) {
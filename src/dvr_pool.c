@@ -0,0 +1,161 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dvr_types.h"
+#include "dvr_pool.h"
+
+/*the item header is kept 16 bytes aligned so the item is aligned as by malloc*/
+#define POOL_HDR_SIZE          (16)
+#define POOL_ALIGN(_s)         (((_s) + 15) & ~((size_t)15))
+
+#define POOL_INDEX_MASK        (0xffff)
+#define POOL_TAG_SHIFT         (16)
+#define POOL_TAG_MASK          (0xf)
+#define POOL_GEN_SHIFT         (20)
+#define POOL_GEN_MASK          (0xfff)
+
+typedef struct {
+  uint32_t handle;  /**< Handle of the item, 0 if the item is free*/
+  uint32_t gen;     /**< Generation of the item, increased on each allocation*/
+} DVR_PoolItemHdr_t;
+
+static inline size_t pool_stride(DVR_Pool_t *pool)
+{
+  return POOL_HDR_SIZE + POOL_ALIGN(pool->item_size);
+}
+
+static inline DVR_PoolItemHdr_t *pool_hdr(DVR_Pool_t *pool, int index)
+{
+  uint8_t *chunk;
+
+  if (index < 0 || index >= DVR_POOL_MAX_ITEMS)
+    return NULL;
+
+  chunk = __atomic_load_n(&pool->chunks[index / DVR_POOL_CHUNK_SIZE], __ATOMIC_ACQUIRE);
+  if (!chunk)
+    return NULL;
+
+  return (DVR_PoolItemHdr_t *)(chunk + (index % DVR_POOL_CHUNK_SIZE) * pool_stride(pool));
+}
+
+static inline void *pool_item(DVR_PoolItemHdr_t *hdr)
+{
+  return (uint8_t *)hdr + POOL_HDR_SIZE;
+}
+
+void *dvr_pool_alloc(DVR_Pool_t *pool, uint32_t *p_handle)
+{
+  DVR_PoolItemHdr_t *hdr = NULL;
+  uint32_t handle;
+  int i;
+
+  if (!pool || !p_handle)
+    return NULL;
+
+  pthread_mutex_lock(&pool->lock);
+
+  if (pool->nb_used < pool->nb_items) {
+    for (i = 0; i < pool->nb_items; i++) {
+      hdr = pool_hdr(pool, i);
+      if (!hdr->handle)
+        break;
+    }
+  } else {
+    uint8_t *chunk;
+
+    i = pool->nb_items;
+    if (i >= DVR_POOL_MAX_ITEMS) {
+      DVR_ERROR("%s, pool is full with %d items", __func__, i);
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    chunk = calloc(DVR_POOL_CHUNK_SIZE, pool_stride(pool));
+    if (!chunk) {
+      DVR_ERROR("%s, memory allocation failed", __func__);
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    __atomic_store_n(&pool->chunks[i / DVR_POOL_CHUNK_SIZE], chunk, __ATOMIC_RELEASE);
+    __atomic_store_n(&pool->nb_items, i + DVR_POOL_CHUNK_SIZE, __ATOMIC_RELEASE);
+    hdr = pool_hdr(pool, i);
+  }
+
+  hdr->gen = (hdr->gen + 1) & POOL_GEN_MASK;
+  if (!hdr->gen)
+    hdr->gen = 1;
+  handle = (hdr->gen << POOL_GEN_SHIFT)
+    | ((pool->tag & POOL_TAG_MASK) << POOL_TAG_SHIFT)
+    | (uint32_t)(i + 1);
+  __atomic_store_n(&hdr->handle, handle, __ATOMIC_RELEASE);
+  pool->nb_used++;
+
+  pthread_mutex_unlock(&pool->lock);
+
+  *p_handle = handle;
+  return pool_item(hdr);
+}
+
+void dvr_pool_free(DVR_Pool_t *pool, uint32_t handle)
+{
+  DVR_PoolItemHdr_t *hdr;
+
+  if (!pool || !handle)
+    return;
+
+  pthread_mutex_lock(&pool->lock);
+  hdr = pool_hdr(pool, dvr_pool_handle_index(handle));
+  if (hdr && hdr->handle == handle) {
+    __atomic_store_n(&hdr->handle, 0, __ATOMIC_RELEASE);
+    pool->nb_used--;
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+void *dvr_pool_get(DVR_Pool_t *pool, uint32_t handle)
+{
+  DVR_PoolItemHdr_t *hdr;
+
+  if (!pool || !handle)
+    return NULL;
+  if (((handle >> POOL_TAG_SHIFT) & POOL_TAG_MASK) != (pool->tag & POOL_TAG_MASK))
+    return NULL;
+
+  hdr = pool_hdr(pool, dvr_pool_handle_index(handle));
+  if (!hdr || __atomic_load_n(&hdr->handle, __ATOMIC_ACQUIRE) != handle)
+    return NULL;
+
+  return pool_item(hdr);
+}
+
+void *dvr_pool_get_by_index(DVR_Pool_t *pool, int index, uint32_t *p_handle)
+{
+  DVR_PoolItemHdr_t *hdr;
+  uint32_t handle;
+
+  if (!pool)
+    return NULL;
+
+  hdr = pool_hdr(pool, index);
+  if (!hdr)
+    return NULL;
+  handle = __atomic_load_n(&hdr->handle, __ATOMIC_ACQUIRE);
+  if (!handle)
+    return NULL;
+
+  if (p_handle)
+    *p_handle = handle;
+  return pool_item(hdr);
+}
+
+int dvr_pool_handle_index(uint32_t handle)
+{
+  return (int)(handle & POOL_INDEX_MASK) - 1;
+}
+
+int dvr_pool_size(DVR_Pool_t *pool)
+{
+  if (!pool)
+    return 0;
+
+  return __atomic_load_n(&pool->nb_items, __ATOMIC_ACQUIRE);
+}
@@ -3,10 +3,12 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <string.h>
+#include <errno.h>
 #include "dvr_types.h"
 #include "dvr_record.h"
 #include "dvr_crypto.h"
 #include "dvb_utils.h"
+#include "dvr_utils.h"
 #include "record_device.h"
 #include <sys/time.h>
 #include <sys/prctl.h>
@@ -14,13 +16,19 @@
 
 #include "segment.h"
 #include "segment_dataout.h"
+#include "dvr_pool.h"
+#include "dvr_live_edge.h"
+#include "ts_indexer.h"
 
 #define CHECK_PTS_MAX_COUNT  (20)
 
 //#define DEBUG_PERFORMANCE
-#define MAX_DVR_RECORD_SESSION_COUNT 4
 #define RECORD_BLOCK_SIZE (256 * 1024)
 #define NEW_DEVICE_RECORD_BLOCK_SIZE (1024 * 188)
+#define RECORD_PID_BITMAP_SIZE (8192 / 32)
+#define RECORD_CC_INVALID (0xff)
+#define RECORD_PCR_DISCONTINUITY_MS (100)
+#define RECORD_SPLIT_EVENTS (256)
 
 /**\brief DVR index file type*/
 typedef enum {
@@ -29,6 +37,12 @@ typedef enum {
   DVR_INDEX_TYPE_INVALID                                                 /**< DVR index file type invalid type*/
 } DVR_IndexType_t;
 
+/**\brief Segment split state, see split_max_delay*/
+typedef enum {
+  RECORD_SPLIT_NONE,                                                    /**< No split requested*/
+  RECORD_SPLIT_WAIT                                                     /**< The record thread waits for a video key frame to split*/
+} Record_SplitState_t;
+
 /**\brief DVR VOD context*/
 typedef struct {
   pthread_mutex_t                 mutex;                                /**< VOD mutex lock*/
@@ -84,6 +98,37 @@ typedef struct {
   DVR_Bool_t                      discard_coming_data;                  /**< Whether to discard subsequent recording data due to exceeding total size limit too much.*/
   Segment_Ops_t                   segment_ops;
   struct list_head                segment_ctrls;
+  DVR_Bool_t                      pid_filter;                           /**< Drop null and unrecorded pid packets before write*/
+  DVR_Bool_t                      recycle;                              /**< Reuse the files of the removed timeshift segments*/
+  uint32_t                        index_interval;                       /**< Time in ms between two index entries, 0 for the default*/
+  uint32_t                        index_size;                           /**< Data size in bytes between two index entries, 0 for the default*/
+  uint32_t                        pid_bitmap[RECORD_PID_BITMAP_SIZE];   /**< Pids kept by the packet filter*/
+  uint8_t                         filter_remain[188];                   /**< Partial packet left by the last read*/
+  int                             filter_remain_len;                    /**< Length of the partial packet*/
+  DVR_RecordFilterStats_t         filter_stats;                         /**< Packet filter statistics*/
+  DVR_RecordStreamHealth_t        health;                               /**< Stream health counters*/
+  uint8_t                         last_cc[8192];                        /**< Last continuity counter of each pid*/
+  int                             health_pcr_pid;                       /**< Pid whose pcr is checked*/
+  uint64_t                        health_last_pcr;                      /**< Last checked pcr, unit on ms*/
+  int64_t                         health_pcr_offset;                    /**< Smoothed pcr to system clock offset, unit on ms*/
+  int                             check_health;                         /**< Whether the packets being indexed are health checked*/
+  DVR_Bool_t                      health_pcr_valid;                     /**< Whether health_last_pcr is valid*/
+  DVR_Bool_t                      health_pcr_rebase;                    /**< Pcr timeline changed, restart jitter reference*/
+  DVR_Bool_t                      health_pcr_updated;                   /**< Whether the block being indexed carried a pcr of health_pcr_pid*/
+  size_t                          tail_size;                            /**< Memory size of the live tail, 0 if disabled*/
+  uint32_t                        tail_time;                            /**< Maximum duration of the live tail in ms*/
+  DVR_LiveEdgeHandle_t            tail;                                 /**< Live tail of the location*/
+  uint32_t                        split_max_delay;                      /**< Maximum time in ms a segment split waits for a video key frame, 0 to split at once*/
+  Record_SplitState_t             split_state;                          /**< Segment split state, set by the control calls and cleared by the record thread*/
+  Segment_Handle_t                split_segment_handle;                 /**< Segment the record thread continues with after the split*/
+  DVR_RecordSegmentStartParams_t  split_params;                         /**< Start parameters of the segment after the split*/
+  struct timespec                 split_start;                          /**< Time the split was requested*/
+  TS_Indexer_t                    *split_indexer;                       /**< Finds the key frames of the video pid*/
+  TS_Indexer_Event_t              *split_events;                        /**< Events of split_indexer*/
+  uint64_t                        split_pes_offset;                     /**< Offset of the last video PES start seen by split_indexer*/
+  uint8_t                         *split_carry;                         /**< Data from the key frame, written first to the next segment*/
+  size_t                          split_carry_len;                      /**< Length of split_carry*/
+  size_t                          split_carry_size;                     /**< Allocated size of split_carry*/
 } DVR_RecordContext_t;
 
 typedef struct {
@@ -107,16 +152,13 @@ typedef struct {
   } while(0)
 #define SEG_CALL_IS_VALID(_name) (!!ops->segment_##_name)
 
-extern ssize_t record_device_read_ext(Record_DeviceHandle_t handle, size_t *buf, size_t *len);
 
-static DVR_RecordContext_t record_ctx[MAX_DVR_RECORD_SESSION_COUNT] = {
-  {
-    .state = DVR_RECORD_STATE_CLOSED
-  },
-  {
-    .state = DVR_RECORD_STATE_CLOSED
-  }
-};
+static DVR_Pool_t record_pool = DVR_POOL_INITIALIZER(DVR_RecordContext_t, 0);
+
+static inline DVR_RecordContext_t *record_get_ctx(DVR_RecordHandle_t handle)
+{
+  return (DVR_RecordContext_t *)dvr_pool_get(&record_pool, (uint32_t)(uintptr_t)handle);
+}
 
 
 static int record_set_segment_ops(DVR_RecordContext_t *p_ctx, int flags)
@@ -150,6 +192,7 @@ static int record_set_segment_ops(DVR_RecordContext_t *p_ctx, int flags)
     _SET(update_pts);
     _SET(update_pts_force);
     _SET(seek);
+    _SET(seek_position);
     _SET(tell_position);
     _SET(tell_position_time);
     _SET(tell_current_time);
@@ -178,6 +221,154 @@ static int record_is_valid_pid(DVR_RecordContext_t *p_ctx, int pid)
   return 0;
 }
 
+static void record_set_filter_pids(DVR_RecordContext_t *p_ctx, DVR_RecordSegmentStartParams_t *params, int check_action)
+{
+  uint32_t i;
+
+  memset(p_ctx->pid_bitmap, 0, sizeof(p_ctx->pid_bitmap));
+  for (i = 0; i < params->nb_pids; i++) {
+    if (check_action && params->pid_action[i] == DVR_RECORD_PID_CLOSE)
+      continue;
+    if (params->pids[i].pid < 0x1fff)
+      p_ctx->pid_bitmap[params->pids[i].pid >> 5] |= 1u << (params->pids[i].pid & 0x1f);
+  }
+}
+
+/* Drop null packets and packets of unrecorded pids in place.
+ * The returned length is what will be written to the segment, so the
+ * time index built from this buffer stays consistent with the file.
+ * A partial packet at the end is kept back and prepended to the next read.*/
+static int record_filter_packets(DVR_RecordContext_t *p_ctx, uint8_t *buf, int len)
+{
+  uint8_t *src = buf;
+  uint8_t *dst = buf;
+  int left = len;
+  int pid;
+
+  while (left >= 188) {
+    if (*src != 0x47) {
+      /* Not synced, keep the byte untouched */
+      *dst++ = *src++;
+      left--;
+      continue;
+    }
+    pid = ((src[1] & 0x1f) << 8) | src[2];
+    if (pid == 0x1fff) {
+      p_ctx->filter_stats.null_packets++;
+    } else if (!(p_ctx->pid_bitmap[pid >> 5] & (1u << (pid & 0x1f)))) {
+      p_ctx->filter_stats.unwanted_packets++;
+    } else {
+      if (dst != src)
+        memmove(dst, src, 188);
+      dst += 188;
+    }
+    src += 188;
+    left -= 188;
+  }
+
+  if (left > 0) {
+    memcpy(p_ctx->filter_remain, src, left);
+  }
+  p_ctx->filter_remain_len = left;
+
+  return dst - buf;
+}
+
+static void record_reset_health(DVR_RecordContext_t *p_ctx)
+{
+  memset(&p_ctx->health, 0, sizeof(p_ctx->health));
+  memset(p_ctx->last_cc, RECORD_CC_INVALID, sizeof(p_ctx->last_cc));
+  p_ctx->health_pcr_pid = DVR_INVALID_PID;
+  p_ctx->health_pcr_valid = DVR_FALSE;
+  p_ctx->health_pcr_rebase = DVR_TRUE;
+}
+
+/* Continuity counter check, see 13818-1 2.4.3.3 */
+static void record_check_cc(DVR_RecordContext_t *p_ctx, uint8_t *p)
+{
+  int pid = ((p[1] & 0x1f) << 8) | p[2];
+  int afc = (p[3] >> 4) & 0x03;
+  int cc = p[3] & 0x0f;
+  int last = p_ctx->last_cc[pid];
+
+  if (pid == 0x1fff)
+    return;
+
+  p_ctx->health.packets++;
+
+  /* discontinuity_indicator resets the counter */
+  if ((afc & 2) && p[4] > 0 && (p[5] & 0x80)) {
+    p_ctx->last_cc[pid] = cc;
+    return;
+  }
+  p_ctx->last_cc[pid] = cc;
+  if (last == RECORD_CC_INVALID)
+    return;
+  if (!(afc & 1)) {
+    /* No payload, counter shall not increment */
+    if (cc != last)
+      p_ctx->health.cc_errors++;
+    return;
+  }
+  if (cc == last) {
+    /* Duplicate packet */
+    return;
+  }
+  if (cc != ((last + 1) & 0x0f)) {
+    p_ctx->health.cc_errors++;
+    p_ctx->health.lost_packets += (cc - last - 1) & 0x0f;
+  }
+}
+
+/* Check pcr jumps of the first pid carrying pcr */
+static void record_check_pcr(DVR_RecordContext_t *p_ctx, int pid, uint64_t pcr_ms, int discontinuity)
+{
+  int64_t diff;
+
+  if (p_ctx->health_pcr_pid == DVR_INVALID_PID)
+    p_ctx->health_pcr_pid = pid;
+  if (pid != p_ctx->health_pcr_pid)
+    return;
+
+  if (discontinuity) {
+    p_ctx->health_pcr_rebase = DVR_TRUE;
+  } else if (p_ctx->health_pcr_valid) {
+    diff = (int64_t)pcr_ms - (int64_t)p_ctx->health_last_pcr;
+    if (diff < 0 || diff > RECORD_PCR_DISCONTINUITY_MS) {
+      p_ctx->health.pcr_discontinuities++;
+      p_ctx->health_pcr_rebase = DVR_TRUE;
+    }
+  }
+  p_ctx->health_last_pcr = pcr_ms;
+  p_ctx->health_pcr_valid = DVR_TRUE;
+  p_ctx->health_pcr_updated = DVR_TRUE;
+}
+
+/* The jitter is the deviation of the pcr progress from the system clock
+ * progress at read time, it reflects delivery and read delays of the dvr device.*/
+static void record_check_pcr_jitter(DVR_RecordContext_t *p_ctx, uint64_t pcr_ms)
+{
+  struct timespec ts;
+  int64_t offset, jitter;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  offset = (int64_t)pcr_ms - (int64_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+  if (p_ctx->health_pcr_rebase) {
+    p_ctx->health_pcr_rebase = DVR_FALSE;
+    p_ctx->health_pcr_offset = offset;
+    p_ctx->health.pcr_jitter = 0;
+    return;
+  }
+  jitter = offset - p_ctx->health_pcr_offset;
+  if (jitter < 0)
+    jitter = -jitter;
+  p_ctx->health.pcr_jitter = (uint32_t)jitter;
+  if (p_ctx->health.pcr_jitter > p_ctx->health.pcr_jitter_max)
+    p_ctx->health.pcr_jitter_max = p_ctx->health.pcr_jitter;
+  /* Follow the clock drift slowly */
+  p_ctx->health_pcr_offset += (offset - p_ctx->health_pcr_offset) / 16;
+}
+
 static int record_save_pcr(DVR_RecordContext_t *p_ctx, uint8_t *buf, loff_t pos)
 {
   uint8_t *p = buf;
@@ -206,15 +397,9 @@ static int record_save_pcr(DVR_RecordContext_t *p_ctx, uint8_t *buf, loff_t pos)
     /* Skip adaptation len */
     p++;
     len--;
-    /* Parse pcr field, see 13818 spec table I-2-6,adaptation_field */
-    if (p[0] & 0x10 && len >= 6 && adp_field_len >= 6) {
-    /* get pcr value,pcr is 33bit value */
-    pcr = (((uint64_t)(p[1])) << 25)
-        | (((uint64_t)p[2]) << 17)
-        | (((uint64_t)(p[3])) << 9)
-        | (((uint64_t)p[4]) << 1)
-        | ((((uint64_t)p[5]) & 0x80) >> 7);
-      has_pcr = 1;
+    has_pcr = dvr_ts_get_pcr(buf, &pcr);
+    if (has_pcr && p_ctx->check_health) {
+      record_check_pcr(p_ctx, pid, pcr/90, p[0] & 0x80);
     }
 
     len -= adp_field_len;
@@ -238,7 +423,7 @@ static int record_save_pcr(DVR_RecordContext_t *p_ctx, uint8_t *buf, loff_t pos)
   return has_pcr;
 }
 
-static int record_do_pcr_index(DVR_RecordContext_t *p_ctx, uint8_t *buf, int len)
+static int record_do_pcr_index(DVR_RecordContext_t *p_ctx, uint8_t *buf, int len, int check_health)
 {
   uint8_t *p = buf;
   int left = len;
@@ -255,8 +440,12 @@ static int record_do_pcr_index(DVR_RecordContext_t *p_ctx, uint8_t *buf, int len
   if (pos >= len) {
     pos = pos - len;
   }
+  p_ctx->check_health = check_health;
+  p_ctx->health_pcr_updated = DVR_FALSE;
   while (left >= 188) {
     if (*p == 0x47) {
+      if (check_health)
+        record_check_cc(p_ctx, p);
       has_pcr |= record_save_pcr(p_ctx, p, pos);
       p += 188;
       left -= 188;
@@ -267,9 +456,365 @@ static int record_do_pcr_index(DVR_RecordContext_t *p_ctx, uint8_t *buf, int len
       pos++;
     }
   }
+  p_ctx->check_health = 0;
+
+  /* Sample the jitter on the latest pcr of the block, the closest one to read time.
+   * An older pcr compared to the current clock would show a jitter that did not happen */
+  if (check_health && p_ctx->health_pcr_updated) {
+    record_check_pcr_jitter(p_ctx, p_ctx->health_last_pcr);
+  }
   return has_pcr;
 }
 
+/*the state is read by the record thread without lock*/
+static inline void record_set_state(DVR_RecordContext_t *p_ctx, DVR_RecordState_t state)
+{
+  __atomic_store_n(&p_ctx->state, state, __ATOMIC_RELEASE);
+}
+
+static int record_split_elapsed(DVR_RecordContext_t *p_ctx)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec - p_ctx->split_start.tv_sec) * 1000
+    + (ts.tv_nsec - p_ctx->split_start.tv_nsec) / 1000000;
+}
+
+static int record_is_key_frame(TS_Indexer_EventType_t type)
+{
+  switch (type) {
+    case TS_INDEXER_EVENT_TYPE_MPEG2_I_FRAME:
+    case TS_INDEXER_EVENT_TYPE_AVC_I_SLICE:
+    case TS_INDEXER_EVENT_TYPE_HEVC_BLA_W_LP:
+    case TS_INDEXER_EVENT_TYPE_HEVC_BLA_W_RADL:
+    case TS_INDEXER_EVENT_TYPE_HEVC_BLA_N_LP:
+    case TS_INDEXER_EVENT_TYPE_HEVC_IDR_W_RADL:
+    case TS_INDEXER_EVENT_TYPE_HEVC_IDR_N_LP:
+    case TS_INDEXER_EVENT_TYPE_HEVC_TRAIL_CRA:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/*index the video pid of the segment to find the key frames,
+  return 0 if the segment cannot end at a key frame*/
+static int record_split_arm(DVR_RecordContext_t *p_ctx)
+{
+  TS_Indexer_StreamFormat_t format = TS_INDEXER_VIDEO_FORMAT_MPEG2;
+  int pid = -1;
+  uint32_t i;
+
+  /*only the clear data written by the record thread can be split*/
+  if (!p_ctx->split_indexer || p_ctx->is_vod || p_ctx->is_secure_mode
+      || p_ctx->enc_func || p_ctx->cryptor)
+    return 0;
+
+  for (i = 0; i < p_ctx->segment_params.nb_pids && pid == -1; i++) {
+    int type = (p_ctx->segment_params.pids[i].type >> 24) & 0x0f;
+
+    if (type != DVR_STREAM_TYPE_VIDEO || p_ctx->segment_params.pid_action[i] == DVR_RECORD_PID_CLOSE)
+      continue;
+    switch (p_ctx->segment_params.pids[i].type & 0xffffff) {
+      case DVR_VIDEO_FORMAT_MPEG1:
+      case DVR_VIDEO_FORMAT_MPEG2:
+        format = TS_INDEXER_VIDEO_FORMAT_MPEG2;
+        pid = p_ctx->segment_params.pids[i].pid;
+        break;
+      case DVR_VIDEO_FORMAT_H264:
+        format = TS_INDEXER_VIDEO_FORMAT_H264;
+        pid = p_ctx->segment_params.pids[i].pid;
+        break;
+      case DVR_VIDEO_FORMAT_HEVC:
+        format = TS_INDEXER_VIDEO_FORMAT_HEVC;
+        pid = p_ctx->segment_params.pids[i].pid;
+        break;
+      default:
+        break;
+    }
+  }
+  if (pid == -1)
+    return 0;
+
+  ts_indexer_init(p_ctx->split_indexer);
+  ts_indexer_add_stream(p_ctx->split_indexer, pid, TS_INDEXER_STREAM_TYPE_VIDEO, format);
+  p_ctx->split_pes_offset = ULLONG_MAX;
+  clock_gettime(CLOCK_MONOTONIC, &p_ctx->split_start);
+  return 1;
+}
+
+static inline Record_SplitState_t record_get_split_state(DVR_RecordContext_t *p_ctx)
+{
+  return __atomic_load_n(&p_ctx->split_state, __ATOMIC_ACQUIRE);
+}
+
+/*the split parameters are set before the state, and read by the record thread after it*/
+static inline void record_set_split_state(DVR_RecordContext_t *p_ctx, Record_SplitState_t state)
+{
+  __atomic_store_n(&p_ctx->split_state, state, __ATOMIC_RELEASE);
+}
+
+/*run by the record thread while a split waits, the data from the key frame are
+  kept for the next segment. return the length to write to the current segment,
+  *p_split is set if the segment ends after it*/
+static ssize_t record_split_check(DVR_RecordContext_t *p_ctx, uint8_t *buf, ssize_t len, int *p_split)
+{
+  TS_Indexer_t *indexer = p_ctx->split_indexer;
+  uint64_t base = indexer->offset;
+  uint64_t split = ULLONG_MAX;
+  int left = len;
+  int nb, i, ret;
+
+  while (left > 0 && split == ULLONG_MAX) {
+    ret = ts_indexer_parse_batch(indexer, buf + len - left, left, p_ctx->split_events, RECORD_SPLIT_EVENTS, &nb);
+    if (ret < 0)
+      break;
+    for (i = 0; i < nb; i++) {
+      TS_Indexer_Event_t *evt = &p_ctx->split_events[i];
+
+      if (evt->type == TS_INDEXER_EVENT_TYPE_START_INDICATOR) {
+        p_ctx->split_pes_offset = evt->offset;
+      } else if (record_is_key_frame(evt->type)
+          && p_ctx->split_pes_offset != ULLONG_MAX && p_ctx->split_pes_offset >= base) {
+        /*the PES of the key frame is not written yet*/
+        split = p_ctx->split_pes_offset;
+        break;
+      }
+    }
+    if (ret == left)
+      break;
+    left = ret;
+  }
+  /*a partial packet at the end of the block is skipped*/
+  indexer->offset = base + len;
+
+  *p_split = 0;
+  if (split != ULLONG_MAX) {
+    size_t keep = len - (split - base);
+
+    if (keep > p_ctx->split_carry_size) {
+      uint8_t *carry = (uint8_t *)realloc(p_ctx->split_carry, keep);
+
+      if (!carry) {
+        DVR_ERROR("%s, no memory to keep %zu bytes from the key frame, split at block end", __func__, keep);
+        *p_split = 1;
+        return len;
+      }
+      p_ctx->split_carry = carry;
+      p_ctx->split_carry_size = keep;
+    }
+    memcpy(p_ctx->split_carry, buf + (split - base), keep);
+    p_ctx->split_carry_len = keep;
+    len -= keep;
+  }
+  if (split != ULLONG_MAX || record_split_elapsed(p_ctx) >= (int)p_ctx->split_max_delay)
+    *p_split = 1;
+  return len;
+}
+
+/*store the final information of the current segment to p_info and close it*/
+static int record_end_segment(DVR_RecordContext_t *p_ctx, DVR_RecordSegmentInfo_t *p_info)
+{
+  int ret = DVR_SUCCESS;
+  int close_ret = DVR_SUCCESS;
+  loff_t pos;
+
+  SEG_CALL_INIT(&p_ctx->segment_ops);
+
+  //add index file store
+  if (SEG_CALL_IS_VALID(update_pts_force)) {
+    SEG_CALL_RET_VALID(tell_position, (p_ctx->segment_handle), pos, -1);
+    if (pos != -1) {
+      SEG_CALL(update_pts_force, (p_ctx->segment_handle, p_ctx->segment_info.duration, pos));
+    }
+  }
+
+  SEG_CALL_RET(tell_total_time, (p_ctx->segment_handle), p_ctx->segment_info.duration);
+
+  /*Update segment info*/
+  memcpy(p_info, &p_ctx->segment_info, sizeof(p_ctx->segment_info));
+
+  SEG_CALL_RET(store_info, (p_ctx->segment_handle, p_info), ret);
+  if (ret == DVR_SUCCESS)
+    SEG_CALL(store_allInfo, (p_ctx->segment_handle, p_info));
+
+  DVR_INFO("%s dump segment info, id:%lld, nb_pids:%d, duration:%ld ms, size:%zu, nb_packets:%d",
+      __func__, p_info->id, p_info->nb_pids, p_info->duration, p_info->size, p_info->nb_packets);
+
+  /*Close current segment*/
+  SEG_CALL_RET(close, (p_ctx->segment_handle), close_ret);
+  p_ctx->segment_handle = NULL;
+  return (ret == DVR_SUCCESS) ? close_ret : ret;
+}
+
+/*open the segment following the current one*/
+static int record_open_next_segment(DVR_RecordContext_t *p_ctx, uint64_t segment_id, Segment_Handle_t *p_handle)
+{
+  Segment_OpenParams_t open_params;
+  int ret = DVR_SUCCESS;
+
+  SEG_CALL_INIT(&p_ctx->segment_ops);
+
+  if (SEG_CALL_IS_VALID(open)) {
+    memset(&open_params, 0, sizeof(open_params));
+    memcpy(open_params.location, p_ctx->location, sizeof(p_ctx->location));
+    open_params.segment_id = segment_id;
+    open_params.mode = SEGMENT_MODE_WRITE;
+    open_params.force_sysclock = p_ctx->force_sysclock;
+    open_params.recycle = p_ctx->recycle;
+    open_params.index_interval = p_ctx->index_interval;
+    open_params.index_size = p_ctx->index_size;
+    DVR_INFO("%s: p_ctx->location:%s", __func__, p_ctx->location);
+    SEG_CALL_RET(open, (&open_params, p_handle), ret);
+  }
+  return ret;
+}
+
+/*run the pid actions of the next segment, the created pids before the split, the closed ones at it*/
+static int record_update_pids(DVR_RecordContext_t *p_ctx, DVR_RecordSegmentStartParams_t *params, DVR_RecordPidAction_t action)
+{
+  int ret = DVR_SUCCESS;
+  uint32_t i;
+
+  for (i = 0; i < params->nb_pids; i++) {
+    if (params->pid_action[i] != action)
+      continue;
+    if (action == DVR_RECORD_PID_CREATE) {
+      DVR_INFO("%s create pid:%d", __func__, params->pids[i].pid);
+      ret = record_device_add_pid(p_ctx->dev_handle, params->pids[i].pid);
+    } else if (action == DVR_RECORD_PID_CLOSE) {
+      DVR_INFO("%s close pid:%d", __func__, params->pids[i].pid);
+      ret = record_device_remove_pid(p_ctx->dev_handle, params->pids[i].pid);
+    }
+    DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
+  }
+  return DVR_SUCCESS;
+}
+
+/*make the opened segment handle the current one*/
+static int record_begin_segment(DVR_RecordContext_t *p_ctx, Segment_Handle_t handle, DVR_RecordSegmentStartParams_t *params)
+{
+  int ret = DVR_SUCCESS;
+  uint32_t i;
+
+  SEG_CALL_INIT(&p_ctx->segment_ops);
+
+  p_ctx->segment_handle = handle;
+  p_ctx->last_send_size = 0;
+  p_ctx->last_send_time = 0;
+
+  /*process params*/
+  {
+    //need all params??
+    memcpy(&p_ctx->segment_params, params, sizeof(*params));
+    /*save current segment info*/
+    memset(&p_ctx->segment_info, 0, sizeof(p_ctx->segment_info));
+    p_ctx->segment_info.id = params->segment_id;
+    memcpy(p_ctx->segment_info.pids, params->pids, params->nb_pids*sizeof(DVR_StreamPid_t));
+  }
+
+  p_ctx->segment_info.nb_pids = 0;
+  for (i = 0; i < params->nb_pids; i++) {
+    if (params->pid_action[i] != DVR_RECORD_PID_CLOSE)
+      p_ctx->segment_info.nb_pids++;
+  }
+  record_set_filter_pids(p_ctx, params, 1);
+
+  /*Update segment info*/
+  SEG_CALL_RET(store_info, (p_ctx->segment_handle, &p_ctx->segment_info), ret);
+  DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
+
+  if (p_ctx->pts != ULLONG_MAX) {
+    SEG_CALL(update_pts, (p_ctx->segment_handle, p_ctx->pts, 0));
+  }
+  return DVR_SUCCESS;
+}
+
+/*end the current segment at the split and continue with the one opened by
+  dvr_record_next_segment, run by the record thread or after it stopped*/
+static void record_split_finish(DVR_RecordContext_t *p_ctx)
+{
+  DVR_RecordStatus_t record_status;
+  int ret;
+
+  DVR_INFO("%s, split %s after %d ms", __func__,
+      p_ctx->split_carry_len ? "at key frame" : "at block end", record_split_elapsed(p_ctx));
+
+  memset(&record_status, 0, sizeof(record_status));
+  ret = record_end_segment(p_ctx, &record_status.info);
+  if (ret != DVR_SUCCESS)
+    DVR_ERROR("%s, failed to end segment %lld", __func__, record_status.info.id);
+  if (record_update_pids(p_ctx, &p_ctx->split_params, DVR_RECORD_PID_CLOSE) != DVR_SUCCESS)
+    DVR_ERROR("%s, failed to close the pids of segment %lld", __func__, record_status.info.id);
+  if (record_begin_segment(p_ctx, p_ctx->split_segment_handle, &p_ctx->split_params) != DVR_SUCCESS)
+    DVR_ERROR("%s, failed to store the info of segment %lld", __func__, p_ctx->split_params.segment_id);
+  p_ctx->split_segment_handle = NULL;
+  record_set_split_state(p_ctx, RECORD_SPLIT_NONE);
+
+  if (p_ctx->event_notify_fn) {
+    record_status.state = p_ctx->state;
+    p_ctx->event_notify_fn(DVR_RECORD_EVENT_SEGMENT_END, &record_status, p_ctx->event_userdata);
+  }
+}
+
+/*write the data from the key frame left by a split before the record thread stopped*/
+static void record_flush_carry(DVR_RecordContext_t *p_ctx)
+{
+  int ret = 0;
+
+  SEG_CALL_INIT(&p_ctx->segment_ops);
+
+  if (!p_ctx->split_carry_len)
+    return;
+  SEG_CALL_RET(write, (p_ctx->segment_handle, p_ctx->split_carry, p_ctx->split_carry_len), ret);
+  if (ret > 0)
+    p_ctx->segment_info.size += ret;
+  else
+    DVR_ERROR("%s, failed to write %zu bytes", __func__, p_ctx->split_carry_len);
+  p_ctx->split_carry_len = 0;
+}
+
+/*follow the read size of the device, the buffers are enlarged with it*/
+static uint32_t record_adapt_read_size(DVR_RecordContext_t *p_ctx, uint8_t **p_buf, uint8_t **p_buf_out, uint32_t *p_cap)
+{
+  uint32_t size = record_device_get_read_size(p_ctx->dev_handle);
+  uint8_t *b;
+
+  if (size < p_ctx->block_size)
+    size = p_ctx->block_size;
+  if (size <= *p_cap)
+    return size;
+
+  b = (uint8_t *)realloc(*p_buf, size + 188);
+  if (!b)
+    return *p_cap;
+  *p_buf = b;
+  b = (uint8_t *)realloc(*p_buf_out, size + 188);
+  if (!b)
+    return *p_cap;
+  *p_buf_out = b;
+  DVR_INFO("%s, read size %u -> %u", __func__, *p_cap, size);
+  *p_cap = size;
+  return size;
+}
+
+static void record_get_buffer_stats(DVR_RecordContext_t *p_ctx, DVR_RecordBufferStats_t *p_stats)
+{
+  Record_DeviceStats_t stats;
+
+  memset(p_stats, 0, sizeof(*p_stats));
+  if (p_ctx->is_vod || record_device_get_stats(p_ctx->dev_handle, &stats) != DVR_SUCCESS)
+    return;
+
+  p_stats->ringbuf_size = stats.ringbuf_size;
+  p_stats->peak_level = stats.peak_level;
+  p_stats->overflows = stats.overflows;
+  p_stats->grows = stats.grows;
+  p_stats->read_size = stats.read_size;
+  p_stats->drain_latency = stats.drain_latency;
+}
+
 static int get_diff_time(struct timeval start_tv, struct timeval end_tv)
 {
   return end_tv.tv_sec * 1000 + end_tv.tv_usec / 1000 - start_tv.tv_sec * 1000 - start_tv.tv_usec / 1000;
@@ -279,33 +824,31 @@ void *record_thread(void *arg)
 {
   DVR_RecordContext_t *p_ctx = (DVR_RecordContext_t *)arg;
   ssize_t len;
-  uint8_t *buf, *buf_out;
+  uint8_t *buf, *buf_out, *data;
   uint32_t block_size = p_ctx->block_size;
+  uint32_t buf_cap = block_size;
   loff_t pos = 0;
   int ret = DVR_SUCCESS;
   struct timespec start_ts, end_ts, start_no_pcr_ts, end_no_pcr_ts;
   DVR_RecordStatus_t record_status;
   int has_pcr;
-  int pcr_rec_len = 0;
+  int pcr_rec_len;
   DVR_Bool_t guarded_size_exceeded = DVR_FALSE;
 
-  time_t pre_time = 0;
+  time_t pre_time;
   #define DVR_STORE_INFO_TIME (400)
   DVR_SecureBuffer_t secure_buf = {0,0};
   DVR_NewDmxSecureBuffer_t new_dmx_secure_buf;
   int first_read = 0;
+  int carried;
+  int split;
 
   SEG_CALL_INIT(&p_ctx->segment_ops);
 
   prctl(PR_SET_NAME,"DvrRecording");
 
-  // Force to use LOCAL_CLOCK as index type if force_sysclock is on. Please
-  // refer to SWPL-75327
-  if (p_ctx->force_sysclock)
-    p_ctx->index_type = DVR_INDEX_TYPE_LOCAL_CLOCK;
-  else
-    p_ctx->index_type = DVR_INDEX_TYPE_INVALID;
-  buf = (uint8_t *)malloc(block_size);
+  /* Reserve room for the partial packet carried by the packet filter */
+  buf = (uint8_t *)malloc(block_size + 188);
   if (!buf) {
     DVR_INFO("%s, malloc failed", __func__);
     return NULL;
@@ -322,6 +865,16 @@ void *record_thread(void *arg)
     return NULL;
   }
 
+next_segment:
+  // Force to use LOCAL_CLOCK as index type if force_sysclock is on. Please
+  // refer to SWPL-75327
+  if (p_ctx->force_sysclock)
+    p_ctx->index_type = DVR_INDEX_TYPE_LOCAL_CLOCK;
+  else
+    p_ctx->index_type = DVR_INDEX_TYPE_INVALID;
+  pcr_rec_len = 0;
+  pre_time = 0;
+
   memset(&record_status, 0, sizeof(record_status));
   record_status.state = DVR_RECORD_STATE_STARTED;
   if (p_ctx->event_notify_fn) {
@@ -330,9 +883,12 @@ void *record_thread(void *arg)
     DVR_INFO("%s line %d notify record status, state:%d id=%lld",
           __func__,__LINE__, record_status.state, p_ctx->segment_info.id);
   }
-  DVR_INFO("%s, --secure_mode:%d, block_size:%d, cryptor:%p",
+  if (p_ctx->pid_filter && p_ctx->is_secure_mode) {
+    DVR_WARN("%s, packet filter is not supported in secure mode", __func__);
+  }
+  DVR_INFO("%s, --secure_mode:%d, block_size:%d, cryptor:%p, pid_filter:%d",
         __func__, p_ctx->is_secure_mode,
-        block_size, p_ctx->cryptor);
+        block_size, p_ctx->cryptor, p_ctx->pid_filter);
   clock_gettime(CLOCK_MONOTONIC, &start_ts);
   p_ctx->check_pts_count = 0;
   p_ctx->check_no_pts_count++;
@@ -342,10 +898,21 @@ void *record_thread(void *arg)
   while (p_ctx->state == DVR_RECORD_STATE_STARTED ||
     p_ctx->state == DVR_RECORD_STATE_PAUSE) {
 
+    if (!p_ctx->is_secure_mode)
+      block_size = record_adapt_read_size(p_ctx, &buf, &buf_out, &buf_cap);
+
     gettimeofday(&t1, NULL);
 
-    /* data from dmx, normal dvr case */
-    if (p_ctx->is_secure_mode) {
+    carried = 0;
+    split = 0;
+    data = buf;
+    if (p_ctx->split_carry_len > 0) {
+      /* data from the key frame the segment starts with, already filtered */
+      data = p_ctx->split_carry;
+      len = p_ctx->split_carry_len;
+      p_ctx->split_carry_len = 0;
+      carried = 1;
+    } else if (p_ctx->is_secure_mode) {
       if (p_ctx->is_new_dmx) {
         /* We resolve the below invoke for dvbcore to be under safety status */
         memset(&new_dmx_secure_buf, 0, sizeof(new_dmx_secure_buf));
@@ -360,6 +927,12 @@ void *record_thread(void *arg)
           len = record_device_read(p_ctx->dev_handle, &secure_buf,
               sizeof(secure_buf), 1000);
       }
+    } else if (p_ctx->pid_filter) {
+      if (p_ctx->filter_remain_len > 0)
+        memcpy(buf, p_ctx->filter_remain, p_ctx->filter_remain_len);
+      len = record_device_read(p_ctx->dev_handle, buf + p_ctx->filter_remain_len, block_size, 1000);
+      if (len > 0)
+        len += p_ctx->filter_remain_len;
     } else {
       len = record_device_read(p_ctx->dev_handle, buf, block_size, 1000);
     }
@@ -368,11 +941,21 @@ void *record_thread(void *arg)
       //DVR_INFO("%s, start_read error", __func__);
       continue;
     }
-    if (p_ctx->state == DVR_RECORD_STATE_PAUSE) {
-      //wait resume record
-      usleep(20*1000);
+    if (p_ctx->state == DVR_RECORD_STATE_PAUSE && !carried) {
+      //drop the data in pause, so the device buffer does not overflow
+      p_ctx->filter_remain_len = 0;
       continue;
     }
+    if (p_ctx->pid_filter && !p_ctx->is_secure_mode && len > 0 && !carried) {
+      len = record_filter_packets(p_ctx, data, len);
+      if (len == 0) {
+        /* Everything read was filtered out, nothing to write */
+        continue;
+      }
+    }
+    if (len > 0 && !carried && record_get_split_state(p_ctx) == RECORD_SPLIT_WAIT) {
+      len = record_split_check(p_ctx, data, len, &split);
+    }
     gettimeofday(&t2, NULL);
 
     guarded_size_exceeded = DVR_FALSE;
@@ -408,7 +991,7 @@ void *record_thread(void *arg)
         crypto_params.output_buffer.size = p_ctx->secbuf_size + 188;
       } else {
         crypto_params.input_buffer.type = DVR_BUFFER_TYPE_NORMAL;
-        crypto_params.input_buffer.addr = (size_t)buf;
+        crypto_params.input_buffer.addr = (size_t)data;
         crypto_params.input_buffer.size = len;
         crypto_params.output_buffer.size = block_size + 188;
       }
@@ -428,7 +1011,7 @@ void *record_thread(void *arg)
     } else if (p_ctx->cryptor) {
       /* Encrypt with clear key */
       int crypt_len = len;
-      am_crypt_des_crypt(p_ctx->cryptor, buf_out, buf, &crypt_len, 0);
+      am_crypt_des_crypt(p_ctx->cryptor, buf_out, data, &crypt_len, 0);
       len = crypt_len;
       gettimeofday(&t3, NULL);
       SEG_CALL_RET(write, (p_ctx->segment_handle, buf_out, len), ret);
@@ -438,7 +1021,7 @@ void *record_thread(void *arg)
         DVR_INFO("%s：%d,first read ts", __func__,__LINE__);
       }
       gettimeofday(&t3, NULL);
-      SEG_CALL_RET(write, (p_ctx->segment_handle, buf, len), ret);
+      SEG_CALL_RET(write, (p_ctx->segment_handle, data, len), ret);
     }
     gettimeofday(&t4, NULL);
     //add DVR_RECORD_EVENT_WRITE_ERROR event if write error
@@ -456,9 +1039,11 @@ void *record_thread(void *arg)
 
     if (len > 0 && SEG_CALL_IS_VALID(tell_position)) {
       /* Do time index */
-      uint8_t *index_buf = (p_ctx->enc_func || p_ctx->cryptor)? buf_out : buf;
+      uint8_t *index_buf = (p_ctx->enc_func || p_ctx->cryptor)? buf_out : data;
       SEG_CALL_RET(tell_position, (p_ctx->segment_handle), pos);
-      has_pcr = record_do_pcr_index(p_ctx, index_buf, len);
+      if (p_ctx->tail)
+        dvr_live_edge_tail_write(p_ctx->tail, p_ctx->segment_info.id, pos - len, index_buf, len);
+      has_pcr = record_do_pcr_index(p_ctx, index_buf, len, 1);
       if (has_pcr == 0 && p_ctx->index_type == DVR_INDEX_TYPE_INVALID) {
         clock_gettime(CLOCK_MONOTONIC, &end_ts);
         if ((end_ts.tv_sec*1000 + end_ts.tv_nsec/1000000) -
@@ -470,7 +1055,7 @@ void *record_thread(void *arg)
       } else if (has_pcr && p_ctx->index_type == DVR_INDEX_TYPE_INVALID){
         DVR_INFO("%s use pcr time index", __func__);
         p_ctx->index_type = DVR_INDEX_TYPE_PCR;
-        record_do_pcr_index(p_ctx, index_buf, len);
+        record_do_pcr_index(p_ctx, index_buf, len, 0);
       }
       gettimeofday(&t5, NULL);
       if (p_ctx->index_type == DVR_INDEX_TYPE_PCR) {
@@ -541,6 +1126,8 @@ void *record_thread(void *arg)
         SEG_CALL(store_info, (p_ctx->segment_handle, &p_ctx->segment_info));
         p_ctx->segment_info.duration = duration;
       }
+      /*wake up the players waiting at the end of the recording*/
+      dvr_live_edge_notify(p_ctx->location);
     } else {
       gettimeofday(&t5, NULL);
     }
@@ -569,6 +1156,9 @@ void *record_thread(void *arg)
         record_status.info.duration = p_ctx->segment_info.duration;
       record_status.info.size = p_ctx->segment_info.size;
       record_status.info.nb_packets = p_ctx->segment_info.size/188;
+      record_status.filter = p_ctx->filter_stats;
+      record_status.health = p_ctx->health;
+      record_get_buffer_stats(p_ctx, &record_status.buffer);
       p_ctx->event_notify_fn(DVR_RECORD_EVENT_STATUS, &record_status, p_ctx->event_userdata);
       DVR_INFO("%s notify record status, state:%d, id:%lld, duration:%ld ms, size:%zu loc[%s]",
           __func__, record_status.state,
@@ -582,8 +1172,14 @@ void *record_thread(void *arg)
         get_diff_time(t5, t6), get_diff_time(t6, t7), get_diff_time(t1, t5), len,
         p_ctx->notification_time,p_ctx->segment_info.duration -p_ctx->last_send_time);
 #endif
+    if (split) {
+      //the segment ends here, continue with the next one
+      record_split_finish(p_ctx);
+      goto next_segment;
+    }
     if (len == 0) {
-      usleep(20*1000);
+      //nothing ready, wait for the device to receive more data or to stop
+      record_device_wait(p_ctx->dev_handle, 1000);
     }
   }
 end:
@@ -598,19 +1194,15 @@ int dvr_record_open(DVR_RecordHandle_t *p_handle, DVR_RecordOpenParams_t *params
   DVR_RecordContext_t *p_ctx;
   Record_DeviceOpenParams_t dev_open_params;
   int ret = DVR_SUCCESS;
-  uint32_t i;
+  uint32_t handle;
 
   DVR_RETURN_IF_FALSE(p_handle);
   DVR_RETURN_IF_FALSE(params);
 
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (record_ctx[i].state == DVR_RECORD_STATE_CLOSED) {
-      break;
-    }
-  }
-  DVR_RETURN_IF_FALSE(i < MAX_DVR_RECORD_SESSION_COUNT);
-  DVR_RETURN_IF_FALSE(record_ctx[i].state == DVR_RECORD_STATE_CLOSED);
-  p_ctx = &record_ctx[i];
+  p_ctx = dvr_pool_alloc(&record_pool, &handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
+  memset(p_ctx, 0, sizeof(DVR_RecordContext_t));
+  p_ctx->state = DVR_RECORD_STATE_CLOSED;
   DVR_INFO("%s , current state:%d, dmx_id:%d, notification_size:%zu, flags:%d, keylen:%d ",
         __func__, p_ctx->state, params->dmx_dev_id,
     params->notification_size,
@@ -651,10 +1243,16 @@ int dvr_record_open(DVR_RecordHandle_t *p_handle, DVR_RecordOpenParams_t *params
     dev_open_params.buf_size = (params->flush_size > 0 ? params->flush_size : RECORD_BLOCK_SIZE);
     //set dvbcore ringbuf size
     dev_open_params.ringbuf_size = params->ringbuf_size;
+    dev_open_params.bitrate = params->bitrate;
 
     ret = record_device_open(&p_ctx->dev_handle, &dev_open_params);
     if (ret != DVR_SUCCESS) {
       DVR_INFO("%s, open record devices failed", __func__);
+      if (p_ctx->cryptor)
+        am_crypt_des_close(p_ctx->cryptor);
+      memset(p_ctx, 0, sizeof(DVR_RecordContext_t));
+      p_ctx->state = DVR_RECORD_STATE_CLOSED;
+      dvr_pool_free(&record_pool, handle);
       return DVR_FAILURE;
     }
   }
@@ -666,19 +1264,40 @@ int dvr_record_open(DVR_RecordHandle_t *p_handle, DVR_RecordOpenParams_t *params
   p_ctx->is_secure_mode = 0;
   p_ctx->state = DVR_RECORD_STATE_OPENED;
   p_ctx->force_sysclock = params->force_sysclock;
+  p_ctx->index_interval = params->index_interval;
+  p_ctx->index_size = params->index_size;
   p_ctx->guarded_segment_size = params->guarded_segment_size;
+  p_ctx->tail_size = params->tail_size;
+  p_ctx->tail_time = params->tail_time;
   if (p_ctx->guarded_segment_size <= 0) {
     DVR_WARN("Odd guarded_segment_size value %lld is given. Change it to"
         " 0 to disable segment guarding mechanism.", p_ctx->guarded_segment_size);
     p_ctx->guarded_segment_size = 0;
   }
   p_ctx->discard_coming_data = DVR_FALSE;
-  DVR_INFO("%s, block_size:%d is_new:%d", __func__, p_ctx->block_size, p_ctx->is_new_dmx);
+  p_ctx->pid_filter = (params->flags & DVR_RECORD_FLAG_PID_FILTER) ? DVR_TRUE : DVR_FALSE;
+  p_ctx->recycle = (params->flags & DVR_RECORD_FLAG_RECYCLE) ? DVR_TRUE : DVR_FALSE;
+  p_ctx->split_max_delay = params->split_max_delay;
+  if (p_ctx->split_max_delay) {
+    p_ctx->split_indexer = (TS_Indexer_t *)malloc(sizeof(TS_Indexer_t));
+    p_ctx->split_events = (TS_Indexer_Event_t *)malloc(RECORD_SPLIT_EVENTS * sizeof(TS_Indexer_Event_t));
+    if (!p_ctx->split_indexer || !p_ctx->split_events) {
+      DVR_WARN("%s, no memory to split at key frames", __func__);
+      free(p_ctx->split_indexer);
+      free(p_ctx->split_events);
+      p_ctx->split_indexer = NULL;
+      p_ctx->split_events = NULL;
+    }
+  }
+  p_ctx->filter_remain_len = 0;
+  memset(&p_ctx->filter_stats, 0, sizeof(p_ctx->filter_stats));
+  record_reset_health(p_ctx);
+  DVR_INFO("%s, block_size:%d is_new:%d pid_filter:%d", __func__, p_ctx->block_size, p_ctx->is_new_dmx, p_ctx->pid_filter);
 
   record_set_segment_ops(p_ctx, params->flags);
   INIT_LIST_HEAD(&p_ctx->segment_ctrls);
 
-  *p_handle = p_ctx;
+  *p_handle = (DVR_RecordHandle_t)(uintptr_t)handle;
   return DVR_SUCCESS;
 }
 
@@ -686,14 +1305,9 @@ int dvr_record_close(DVR_RecordHandle_t handle)
 {
   DVR_RecordContext_t *p_ctx;
   int ret = DVR_SUCCESS;
-  uint32_t i;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   DVR_INFO("%s , current state:%d", __func__, p_ctx->state);
   DVR_RETURN_IF_FALSE(p_ctx->state != DVR_RECORD_STATE_CLOSED);
@@ -720,8 +1334,16 @@ int dvr_record_close(DVR_RecordHandle_t handle)
     }
   }
 
+  if (p_ctx->tail)
+    dvr_live_edge_tail_close(p_ctx->tail);
+
+  free(p_ctx->split_indexer);
+  free(p_ctx->split_events);
+  free(p_ctx->split_carry);
+
   memset(p_ctx, 0, sizeof(DVR_RecordContext_t));
   p_ctx->state = DVR_RECORD_STATE_CLOSED;
+  dvr_pool_free(&record_pool, (uint32_t)(uintptr_t)handle);
   return ret;
 }
 
@@ -729,14 +1351,9 @@ int dvr_record_pause(DVR_RecordHandle_t handle)
 {
   DVR_RecordContext_t *p_ctx;
   int ret = DVR_SUCCESS;
-  uint32_t i;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   DVR_INFO("%s , current state:%d", __func__, p_ctx->state);
   DVR_RETURN_IF_FALSE(p_ctx->state != DVR_RECORD_STATE_CLOSED);
@@ -745,7 +1362,7 @@ int dvr_record_pause(DVR_RecordHandle_t handle)
     ret = DVR_SUCCESS;
   }
   //set pause state,will not store ts into segment
-  p_ctx->state = DVR_RECORD_STATE_PAUSE;
+  record_set_state(p_ctx, DVR_RECORD_STATE_PAUSE);
   return ret;
 }
 
@@ -753,14 +1370,9 @@ int dvr_record_resume(DVR_RecordHandle_t handle)
 {
   DVR_RecordContext_t *p_ctx;
   int ret = DVR_SUCCESS;
-  uint32_t i;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   DVR_INFO("%s , current state:%d", __func__, p_ctx->state);
   DVR_RETURN_IF_FALSE(p_ctx->state != DVR_RECORD_STATE_CLOSED);
@@ -769,7 +1381,7 @@ int dvr_record_resume(DVR_RecordHandle_t handle)
     ret = DVR_SUCCESS;
   }
   //set stated state,will resume store ts into segment
-  p_ctx->state = DVR_RECORD_STATE_STARTED;
+  record_set_state(p_ctx, DVR_RECORD_STATE_STARTED);
   return ret;
 }
 
@@ -790,12 +1402,8 @@ int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
   int ret = DVR_SUCCESS;
   uint32_t i;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   SEG_CALL_INIT(&p_ctx->segment_ops);
 
@@ -812,6 +1420,9 @@ int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
     open_params.segment_id = params->segment.segment_id;
     open_params.mode = SEGMENT_MODE_WRITE;
     open_params.force_sysclock = p_ctx->force_sysclock;
+    open_params.recycle = p_ctx->recycle;
+    open_params.index_interval = p_ctx->index_interval;
+    open_params.index_size = p_ctx->index_size;
 
     SEG_CALL_RET(open, (&open_params, &p_ctx->segment_handle), ret);
     DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
@@ -827,6 +1438,12 @@ int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
 
   /*process params*/
   {
+    if (p_ctx->tail && strcmp(p_ctx->location, params->location)) {
+      dvr_live_edge_tail_close(p_ctx->tail);
+      p_ctx->tail = NULL;
+    }
+    if (p_ctx->tail_size && !p_ctx->tail)
+      dvr_live_edge_tail_open(&p_ctx->tail, params->location, p_ctx->tail_size, p_ctx->tail_time);
     memcpy(p_ctx->location, params->location, sizeof(params->location));
     //need all params??
     memcpy(&p_ctx->segment_params, &params->segment, sizeof(params->segment));
@@ -835,6 +1452,9 @@ int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
     p_ctx->segment_info.id = params->segment.segment_id;
     p_ctx->segment_info.nb_pids = params->segment.nb_pids;
     memcpy(p_ctx->segment_info.pids, params->segment.pids, params->segment.nb_pids*sizeof(DVR_StreamPid_t));
+    record_set_filter_pids(p_ctx, &params->segment, 0);
+    p_ctx->filter_remain_len = 0;
+    record_reset_health(p_ctx);
   }
 
   if (!p_ctx->is_vod) {
@@ -860,17 +1480,11 @@ int dvr_record_start_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
 int dvr_record_next_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *params, DVR_RecordSegmentInfo_t *p_info)
 {
   DVR_RecordContext_t *p_ctx;
-  Segment_OpenParams_t open_params;
+  Segment_Handle_t segment_handle = NULL;
   int ret = DVR_SUCCESS;
-  uint32_t i;
-  loff_t pos;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   DVR_INFO("%s , current state:%d p_ctx->location:%s", __func__, p_ctx->state, p_ctx->location);
   DVR_RETURN_IF_FALSE(p_ctx->state == DVR_RECORD_STATE_STARTED);
@@ -879,99 +1493,47 @@ int dvr_record_next_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *
   DVR_RETURN_IF_FALSE(p_info);
   DVR_RETURN_IF_FALSE(!p_ctx->is_vod);
 
-  SEG_CALL_INIT(&p_ctx->segment_ops);
+  /*Open the new record segment*/
+  ret = record_open_next_segment(p_ctx, params->segment.segment_id, &segment_handle);
+  DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
+  ret = record_update_pids(p_ctx, &params->segment, DVR_RECORD_PID_CREATE);
+  DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
+
+  /*End the segment at a video key frame, the record thread does the split*/
+  if (p_ctx->split_max_delay && record_get_split_state(p_ctx) == RECORD_SPLIT_NONE
+      && record_split_arm(p_ctx)) {
+    memcpy(&p_ctx->split_params, &params->segment, sizeof(params->segment));
+    p_ctx->split_segment_handle = segment_handle;
+    record_set_split_state(p_ctx, RECORD_SPLIT_WAIT);
+    /*the final information comes with DVR_RECORD_EVENT_SEGMENT_END*/
+    memcpy(p_info, &p_ctx->segment_info, sizeof(p_ctx->segment_info));
+    return DVR_SUCCESS;
+  }
 
   /*Stop the on going record segment*/
   //ret = record_device_stop(p_ctx->dev_handle);
   //DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
-  p_ctx->state = DVR_RECORD_STATE_STOPPED;
+  record_set_state(p_ctx, DVR_RECORD_STATE_STOPPED);
   pthread_join(p_ctx->thread, NULL);
+  /*a split still waiting for its key frame ends at once*/
+  if (record_get_split_state(p_ctx) == RECORD_SPLIT_WAIT)
+    record_split_finish(p_ctx);
+  record_flush_carry(p_ctx);
 
-  //add index file store
-  if (SEG_CALL_IS_VALID(update_pts_force)) {
-    SEG_CALL_RET_VALID(tell_position, (p_ctx->segment_handle), pos, -1);
-    if (pos != -1) {
-      SEG_CALL(update_pts_force, (p_ctx->segment_handle, p_ctx->segment_info.duration, pos));
-    }
-  }
-
-  SEG_CALL_RET(tell_total_time, (p_ctx->segment_handle), p_ctx->segment_info.duration);
-
-  /*Update segment info*/
-  memcpy(p_info, &p_ctx->segment_info, sizeof(p_ctx->segment_info));
-
-  SEG_CALL_RET(store_info, (p_ctx->segment_handle, p_info), ret);
+  ret = record_end_segment(p_ctx, p_info);
   DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
 
-  SEG_CALL(store_allInfo, (p_ctx->segment_handle, p_info));
-
-  DVR_INFO("%s dump segment info, id:%lld, nb_pids:%d, duration:%ld ms, size:%zu, nb_packets:%d params->segment.nb_pids:%d",
-      __func__, p_info->id, p_info->nb_pids, p_info->duration, p_info->size, p_info->nb_packets, params->segment.nb_pids);
+  DVR_INFO("%s params->segment.nb_pids:%d", __func__, params->segment.nb_pids);
 
-  /*Close current segment*/
-  SEG_CALL_RET(close, (p_ctx->segment_handle), ret);
+  ret = record_update_pids(p_ctx, &params->segment, DVR_RECORD_PID_CLOSE);
   DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
 
-  p_ctx->last_send_size = 0;
-  p_ctx->last_send_time = 0;
-
-  /*Open the new record segment*/
-  if (SEG_CALL_IS_VALID(open)) {
-    memset(&open_params, 0, sizeof(open_params));
-    memcpy(open_params.location, p_ctx->location, sizeof(p_ctx->location));
-    open_params.segment_id = params->segment.segment_id;
-    open_params.mode = SEGMENT_MODE_WRITE;
-    open_params.force_sysclock = p_ctx->force_sysclock;
-    DVR_INFO("%s: p_ctx->location:%s  params->location:%s", __func__, p_ctx->location,params->location);
-    SEG_CALL_RET(open, (&open_params, &p_ctx->segment_handle), ret);
-    DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
-  }
-
-  /*process params*/
-  {
-    //need all params??
-    memcpy(&p_ctx->segment_params, &params->segment, sizeof(params->segment));
-    /*save current segment info*/
-    memset(&p_ctx->segment_info, 0, sizeof(p_ctx->segment_info));
-    p_ctx->segment_info.id = params->segment.segment_id;
-    memcpy(p_ctx->segment_info.pids, params->segment.pids, params->segment.nb_pids*sizeof(DVR_StreamPid_t));
-  }
-
-  p_ctx->segment_info.nb_pids = 0;
-  for (i = 0; i < params->segment.nb_pids; i++) {
-    switch (params->segment.pid_action[i]) {
-      case DVR_RECORD_PID_CREATE:
-        DVR_INFO("%s create pid:%d", __func__, params->segment.pids[i].pid);
-        ret = record_device_add_pid(p_ctx->dev_handle, params->segment.pids[i].pid);
-        p_ctx->segment_info.nb_pids++;
-        DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
-        break;
-      case DVR_RECORD_PID_KEEP:
-        DVR_INFO("%s keep pid:%d", __func__, params->segment.pids[i].pid);
-        p_ctx->segment_info.nb_pids++;
-        break;
-      case DVR_RECORD_PID_CLOSE:
-        DVR_INFO("%s close pid:%d", __func__, params->segment.pids[i].pid);
-        ret = record_device_remove_pid(p_ctx->dev_handle, params->segment.pids[i].pid);
-        DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
-        break;
-      default:
-        DVR_INFO("%s wrong action pid:%d", __func__, params->segment.pids[i].pid);
-        return DVR_FAILURE;
-    }
-  }
-
   //ret = record_device_start(p_ctx->dev_handle);
   //DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
 
-  /*Update segment info*/
-  SEG_CALL_RET(store_info, (p_ctx->segment_handle, &p_ctx->segment_info), ret);
+  ret = record_begin_segment(p_ctx, segment_handle, &params->segment);
   DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
 
-  if (p_ctx->pts != ULLONG_MAX) {
-    SEG_CALL(update_pts, (p_ctx->segment_handle, p_ctx->pts, 0));
-  }
-
   p_ctx->state = DVR_RECORD_STATE_STARTED;
   pthread_create(&p_ctx->thread, NULL, record_thread, p_ctx);
   return DVR_SUCCESS;
@@ -981,15 +1543,10 @@ int dvr_record_stop_segment(DVR_RecordHandle_t handle, DVR_RecordSegmentInfo_t *
 {
   DVR_RecordContext_t *p_ctx;
   int ret = DVR_SUCCESS;
-  uint32_t i;
   loff_t pos = 0;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   if (p_ctx->segment_handle == NULL) {
     // It seems this stop function has been called twice on the same recording,
@@ -1004,11 +1561,15 @@ int dvr_record_stop_segment(DVR_RecordHandle_t handle, DVR_RecordSegmentInfo_t *
 
   SEG_CALL_INIT(&p_ctx->segment_ops);
 
-  p_ctx->state = DVR_RECORD_STATE_STOPPED;
+  record_set_state(p_ctx, DVR_RECORD_STATE_STOPPED);
   if (p_ctx->is_vod) {
     p_ctx->segment_info.duration = 10*1000; //debug, should delete it
   } else {
     pthread_join(p_ctx->thread, NULL);
+    /*the segment the caller was given by dvr_record_next_segment is stopped*/
+    if (record_get_split_state(p_ctx) == RECORD_SPLIT_WAIT)
+      record_split_finish(p_ctx);
+    record_flush_carry(p_ctx);
     ret = record_device_stop(p_ctx->dev_handle);
     //DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
     if (ret != DVR_SUCCESS)
@@ -1049,15 +1610,10 @@ end:
 int dvr_record_resume_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t *params, uint64_t *p_resume_size)
 {
   DVR_RecordContext_t *p_ctx;
-  uint32_t i;
   int ret = DVR_SUCCESS;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(params);
   DVR_RETURN_IF_FALSE(p_resume_size);
 
@@ -1073,14 +1629,9 @@ int dvr_record_resume_segment(DVR_RecordHandle_t handle, DVR_RecordStartParams_t
 int dvr_record_get_status(DVR_RecordHandle_t handle, DVR_RecordStatus_t *p_status)
 {
   DVR_RecordContext_t *p_ctx;
-  int i;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(p_status);
 
   //lock
@@ -1089,29 +1640,51 @@ int dvr_record_get_status(DVR_RecordHandle_t handle, DVR_RecordStatus_t *p_statu
   p_status->info.duration = p_ctx->segment_info.duration;
   p_status->info.size = p_ctx->segment_info.size;
   p_status->info.nb_packets = p_ctx->segment_info.size/188;
+  p_status->filter = p_ctx->filter_stats;
+  p_status->health = p_ctx->health;
+  record_get_buffer_stats(p_ctx, &p_status->buffer);
 
   return DVR_SUCCESS;
 }
 
+int dvr_record_get_stream_health(DVR_RecordHandle_t handle, DVR_RecordStreamHealth_t *p_health)
+{
+  DVR_RecordContext_t *p_ctx;
+
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_health);
+
+  *p_health = p_ctx->health;
+  return DVR_SUCCESS;
+}
+
+int dvr_record_get_buffer_stats(DVR_RecordHandle_t handle, DVR_RecordBufferStats_t *p_stats)
+{
+  DVR_RecordContext_t *p_ctx;
+
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_stats);
+
+  record_get_buffer_stats(p_ctx, p_stats);
+  return DVR_SUCCESS;
+}
+
 int dvr_record_write(DVR_RecordHandle_t handle, void *buffer, uint32_t len)
 {
   DVR_RecordContext_t *p_ctx;
-  uint32_t i;
   int ret = DVR_SUCCESS;
   int has_pcr;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(buffer);
   DVR_RETURN_IF_FALSE(len);
 
   SEG_CALL_INIT(&p_ctx->segment_ops);
 
-  has_pcr = record_do_pcr_index(p_ctx, buffer, len);
+  has_pcr = record_do_pcr_index(p_ctx, buffer, len, 1);
   if (has_pcr == 0) {
     /* Pull VOD record should use PCR time index */
     DVR_INFO("%s has no pcr, can NOT do time index", __func__);
@@ -1129,14 +1702,9 @@ int dvr_record_write(DVR_RecordHandle_t handle, void *buffer, uint32_t len)
 int dvr_record_set_encrypt_callback(DVR_RecordHandle_t handle, DVR_CryptoFunction_t func, void *userdata)
 {
   DVR_RecordContext_t *p_ctx;
-  uint32_t i;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(func);
 
   DVR_INFO("%s , current state:%d", __func__, p_ctx->state);
@@ -1151,15 +1719,10 @@ int dvr_record_set_encrypt_callback(DVR_RecordHandle_t handle, DVR_CryptoFunctio
 int dvr_record_set_secure_buffer(DVR_RecordHandle_t handle, uint8_t *p_secure_buf, uint32_t len)
 {
   DVR_RecordContext_t *p_ctx;
-  uint32_t i;
   int ret = DVR_SUCCESS;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(p_secure_buf);
   DVR_RETURN_IF_FALSE(len);
 
@@ -1178,16 +1741,10 @@ int dvr_record_set_secure_buffer(DVR_RecordHandle_t handle, uint8_t *p_secure_bu
 int dvr_record_is_secure_mode(DVR_RecordHandle_t handle)
 {
   DVR_RecordContext_t *p_ctx;
-  uint32_t i;
   int ret = DVR_SUCCESS;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   if (p_ctx->is_secure_mode == 1)
     ret = 1;
@@ -1199,14 +1756,9 @@ int dvr_record_is_secure_mode(DVR_RecordHandle_t handle)
 int dvr_record_discard_coming_data(DVR_RecordHandle_t handle, DVR_Bool_t discard)
 {
   DVR_RecordContext_t *p_ctx;
-  int i;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   if (p_ctx->discard_coming_data != discard) {
     p_ctx->discard_coming_data = discard;
@@ -1224,14 +1776,9 @@ int dvr_record_ioctl(DVR_RecordHandle_t handle, unsigned int cmd, void *data, si
 {
   DVR_RecordContext_t *p_ctx;
   int ret = DVR_FAILURE;
-  int i;
 
-  p_ctx = (DVR_RecordContext_t *)handle;
-  for (i = 0; i < MAX_DVR_RECORD_SESSION_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
+  p_ctx = record_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
 
   SEG_CALL_INIT(&p_ctx->segment_ops);
 
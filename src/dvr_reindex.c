@@ -0,0 +1,648 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "dvr_types.h"
+#include "dvr_segment.h"
+#include "dvr_reindex.h"
+#include "segment.h"
+#include "ts_indexer.h"
+#include "dvr_utils.h"
+
+/****************************************************************************
+ * Macro definitions
+ ***************************************************************************/
+
+#define TS_PKT_SIZE           (188)
+/*size of the TS data read at a time by a worker*/
+#define REINDEX_READ_SIZE     (1024*1024)
+#define REINDEX_MAX_WORKERS   (16)
+#define REINDEX_MAX_EVENTS    (TS_INDEXER_PACKET_EVENTS_MAX * 16)
+/*largest step back in 90KHz of the pts of reordered video frames*/
+#define REINDEX_PTS_REORDER   (90*1000)
+
+#define REINDEX_TYPE(_t, _f)  (((_t) << 24) | (_f))
+
+/**\brief Segment to be reindexed*/
+typedef struct {
+  uint64_t                 id;                                    /**< Segment id*/
+  int                      result;                                /**< DVR_SUCCESS if the segment is rebuilt*/
+  DVR_RecordSegmentInfo_t  info;                                  /**< Segment information rebuilt*/
+} DVR_ReindexSegment_t;
+
+/**\brief Reindex context shared by the workers*/
+typedef struct {
+  char                     location[DVR_MAX_LOCATION_SIZE];       /**< Record file location*/
+  DVR_ReindexSegment_t     *segments;                             /**< Segments in the id order*/
+  uint32_t                 nb_segments;                           /**< Number of segments*/
+  uint32_t                 next;                                  /**< Next segment to be scanned*/
+  uint64_t                 bytes;                                 /**< TS data scanned in bytes*/
+} DVR_ReindexCtx_t;
+
+/**\brief Stream listed in the PMT*/
+typedef struct {
+  int                      pid;                                   /**< Stream pid*/
+  uint32_t                 type;                                  /**< DVR stream type and format*/
+} DVR_ReindexPmtStream_t;
+
+/**\brief Scan state of a segment*/
+typedef struct {
+  Segment_Handle_t         handle;                                /**< Segment opened in repair mode*/
+  int                      pmt_pid;                               /**< PMT pid from the PAT, -1 if not found*/
+  int                      pcr_pid;                               /**< PCR pid, -1 if not found*/
+  DVR_Bool_t               has_pcr;                               /**< A PCR is indexed*/
+  DVR_Bool_t               has_pmt;                               /**< The PMT is parsed*/
+  int                      nb_pmt;                                /**< Number of streams in the PMT*/
+  DVR_ReindexPmtStream_t   pmt[DVR_MAX_RECORD_PIDS_COUNT];        /**< Streams in the PMT*/
+  uint32_t                 nb_pids;                               /**< Number of pids found*/
+  DVR_StreamPid_t          pids[DVR_MAX_RECORD_PIDS_COUNT];       /**< Pids in the order found*/
+  DVR_Bool_t               typed[DVR_MAX_RECORD_PIDS_COUNT];      /**< The type is found from the PES*/
+  uint8_t                  pid_map[8192];                         /**< Index in pids plus 1, 0 if not found*/
+} DVR_ReindexScan_t;
+
+/****************************************************************************
+ * Static functions
+ ***************************************************************************/
+
+static uint32_t reindex_time_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/*the section starting in a payload, NULL if none*/
+static uint8_t *reindex_section(uint8_t *pl, int len, int *p_len)
+{
+  if (len < 1 || 1 + pl[0] + 12 > len)
+    return NULL;
+
+  *p_len = len - 1 - pl[0];
+  return pl + 1 + pl[0];
+}
+
+/*end of the section data before the CRC, bounded by the payload*/
+static int reindex_section_end(uint8_t *s, int len)
+{
+  int end = 3 + (((s[1] & 0x0f) << 8) | s[2]) - 4;
+
+  return (end < len) ? end : len;
+}
+
+static int reindex_parse_pat(uint8_t *pl, int len)
+{
+  uint8_t *s;
+  int i, end;
+
+  s = reindex_section(pl, len, &len);
+  if (!s || s[0] != 0x00)
+    return -1;
+
+  end = reindex_section_end(s, len);
+  for (i = 8; i + 4 <= end; i += 4) {
+    /*the first program, 0 is the network PID*/
+    if (s[i] || s[i + 1])
+      return ((s[i + 2] & 0x1f) << 8) | s[i + 3];
+  }
+  return -1;
+}
+
+static uint32_t reindex_stream_type(int stream_type, uint8_t *desc, int len)
+{
+  int i;
+
+  switch (stream_type) {
+    case 0x01:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_VIDEO, DVR_VIDEO_FORMAT_MPEG1);
+    case 0x02:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_VIDEO, DVR_VIDEO_FORMAT_MPEG2);
+    case 0x1b:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_VIDEO, DVR_VIDEO_FORMAT_H264);
+    case 0x24:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_VIDEO, DVR_VIDEO_FORMAT_HEVC);
+    case 0x03:
+    case 0x04:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_MPEG);
+    case 0x0f:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_AAC);
+    case 0x11:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_LATM);
+    case 0x81:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_AC3);
+    case 0x87:
+      return REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_EAC3);
+    case 0x06:
+      /*private data, the format is in the descriptors*/
+      for (i = 0; i + 2 <= len; i += 2 + desc[i + 1]) {
+        switch (desc[i]) {
+          case 0x6a:
+            return REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_AC3);
+          case 0x7a:
+            return REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_EAC3);
+          case 0x7b:
+            return REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_DTS);
+          case 0x59:
+            return REINDEX_TYPE(DVR_STREAM_TYPE_SUBTITLE, 0);
+          case 0x56:
+            return REINDEX_TYPE(DVR_STREAM_TYPE_TELETEXT, 0);
+          default:
+            break;
+        }
+      }
+      break;
+    default:
+      break;
+  }
+  return REINDEX_TYPE(DVR_STREAM_TYPE_OTHER, 0);
+}
+
+static DVR_Bool_t reindex_parse_pmt(DVR_ReindexScan_t *scan, uint8_t *pl, int len)
+{
+  uint8_t *s;
+  int i, end, es_len;
+
+  s = reindex_section(pl, len, &len);
+  if (!s || s[0] != 0x02)
+    return DVR_FALSE;
+
+  end = reindex_section_end(s, len);
+  if (scan->pcr_pid == -1 && (((s[8] & 0x1f) << 8) | s[9]) != 0x1fff)
+    scan->pcr_pid = ((s[8] & 0x1f) << 8) | s[9];
+
+  i = 12 + (((s[10] & 0x0f) << 8) | s[11]);
+  while (i + 5 <= end && scan->nb_pmt < DVR_MAX_RECORD_PIDS_COUNT) {
+    es_len = ((s[i + 3] & 0x0f) << 8) | s[i + 4];
+    if (i + 5 + es_len > end)
+      break;
+    scan->pmt[scan->nb_pmt].pid = ((s[i + 1] & 0x1f) << 8) | s[i + 2];
+    scan->pmt[scan->nb_pmt].type = reindex_stream_type(s[i], s + i + 5, es_len);
+    scan->nb_pmt++;
+    i += 5 + es_len;
+  }
+  return DVR_TRUE;
+}
+
+/*guess the type of a stream not in the PMT from its PES, false if not known yet*/
+static DVR_Bool_t reindex_parse_pes(uint8_t *pl, int len, uint32_t *p_type)
+{
+  int i, sid;
+
+  if (len < 9 || pl[0] || pl[1] || pl[2] != 1)
+    return DVR_FALSE;
+
+  sid = pl[3];
+  if (sid >= 0xc0 && sid <= 0xdf) {
+    *p_type = REINDEX_TYPE(DVR_STREAM_TYPE_AUDIO, DVR_AUDIO_FORMAT_MPEG);
+    return DVR_TRUE;
+  }
+  if (sid < 0xe0 || sid > 0xef) {
+    *p_type = REINDEX_TYPE(DVR_STREAM_TYPE_OTHER, 0);
+    return DVR_TRUE;
+  }
+
+  /*the first start code of the video tells the format*/
+  for (i = 9 + pl[8]; i + 4 < len; i++) {
+    if (pl[i] || pl[i + 1] || pl[i + 2] != 1)
+      continue;
+    if (pl[i + 3] == 0x00 || pl[i + 3] == 0xb3 || pl[i + 3] == 0xb8)
+      *p_type = REINDEX_TYPE(DVR_STREAM_TYPE_VIDEO, DVR_VIDEO_FORMAT_MPEG2);
+    else if ((pl[i + 3] == 0x40 || pl[i + 3] == 0x42 || pl[i + 3] == 0x46) && pl[i + 4] == 0x01)
+      *p_type = REINDEX_TYPE(DVR_STREAM_TYPE_VIDEO, DVR_VIDEO_FORMAT_HEVC);
+    else if (!(pl[i + 3] & 0x80))
+      *p_type = REINDEX_TYPE(DVR_STREAM_TYPE_VIDEO, DVR_VIDEO_FORMAT_H264);
+    else
+      continue;
+    return DVR_TRUE;
+  }
+  *p_type = REINDEX_TYPE(DVR_STREAM_TYPE_VIDEO, DVR_VIDEO_FORMAT_H264);
+  return DVR_FALSE;
+}
+
+/*the PCR are parsed as in record_save_pcr*/
+static void reindex_scan_packet(DVR_ReindexScan_t *scan, uint8_t *p, loff_t pos)
+{
+  int pid, afc, idx, off = 4;
+  uint64_t pcr;
+
+  pid = ((p[1] & 0x1f) << 8) | p[2];
+  if (pid == 0x1fff)
+    return;
+
+  idx = scan->pid_map[pid];
+  if (!idx && scan->nb_pids < DVR_MAX_RECORD_PIDS_COUNT) {
+    scan->pids[scan->nb_pids].pid = pid;
+    scan->pids[scan->nb_pids].type = REINDEX_TYPE(DVR_STREAM_TYPE_OTHER, 0);
+    scan->pid_map[pid] = idx = ++scan->nb_pids;
+  }
+
+  afc = (p[3] >> 4) & 0x03;
+  if (afc & 2) {
+    off += 1 + p[4];
+    if (dvr_ts_get_pcr(p, &pcr)) {
+      if (scan->pcr_pid == -1)
+        scan->pcr_pid = pid;
+      if (pid == scan->pcr_pid) {
+        segment_update_pts(scan->handle, pcr/90, pos);
+        scan->has_pcr = DVR_TRUE;
+      }
+    }
+  }
+
+  /*only the start of the sections and PES are parsed*/
+  if (!(afc & 1) || !(p[1] & 0x40) || off >= TS_PKT_SIZE)
+    return;
+
+  if (pid == 0 && scan->pmt_pid == -1) {
+    scan->pmt_pid = reindex_parse_pat(p + off, TS_PKT_SIZE - off);
+  } else if (pid == scan->pmt_pid && !scan->has_pmt) {
+    scan->has_pmt = reindex_parse_pmt(scan, p + off, TS_PKT_SIZE - off);
+  } else if (idx && pid != scan->pmt_pid && !scan->typed[idx - 1]) {
+    uint32_t type = scan->pids[idx - 1].type;
+
+    scan->typed[idx - 1] = reindex_parse_pes(p + off, TS_PKT_SIZE - off, &type);
+    scan->pids[idx - 1].type = type;
+  }
+}
+
+/*pids found in the stream, with the type from the PMT or the PES*/
+static void reindex_scan_pids(DVR_ReindexScan_t *scan, DVR_RecordSegmentInfo_t *p_info)
+{
+  uint32_t i;
+  int j;
+
+  p_info->nb_pids = scan->nb_pids;
+  for (i = 0; i < scan->nb_pids; i++) {
+    p_info->pids[i] = scan->pids[i];
+    for (j = 0; j < scan->nb_pmt; j++) {
+      if (scan->pmt[j].pid == scan->pids[i].pid) {
+        p_info->pids[i].type = scan->pmt[j].type;
+        break;
+      }
+    }
+  }
+}
+
+/*index a segment without PCR with the PTS of its video or audio*/
+static int reindex_pts(Segment_Handle_t handle, uint8_t *buf, DVR_RecordSegmentInfo_t *p_info)
+{
+  TS_Indexer_t *indexer;
+  TS_Indexer_Event_t *events;
+  TS_Indexer_StreamType_t stream_type = TS_INDEXER_STREAM_TYPE_AUDIO;
+  int pid = -1;
+  int len, left = 0, total, nb, i;
+  uint32_t n;
+  uint64_t last_pts = 0;
+  DVR_Bool_t has_pts = DVR_FALSE;
+
+  for (n = 0; n < p_info->nb_pids; n++) {
+    int type = (p_info->pids[n].type >> 24) & 0x0f;
+
+    if (type == DVR_STREAM_TYPE_VIDEO) {
+      pid = p_info->pids[n].pid;
+      stream_type = TS_INDEXER_STREAM_TYPE_VIDEO;
+      break;
+    }
+    if (pid == -1 && (type == DVR_STREAM_TYPE_AUDIO || type == DVR_STREAM_TYPE_AD))
+      pid = p_info->pids[n].pid;
+  }
+  if (pid == -1)
+    return DVR_FAILURE;
+
+  indexer = (TS_Indexer_t *)malloc(sizeof(TS_Indexer_t));
+  events = (TS_Indexer_Event_t *)malloc(REINDEX_MAX_EVENTS * sizeof(TS_Indexer_Event_t));
+  if (!indexer || !events) {
+    free(indexer);
+    free(events);
+    return DVR_FAILURE;
+  }
+  ts_indexer_init(indexer);
+  ts_indexer_add_stream(indexer, pid, stream_type, -1);
+
+  if (segment_seek(handle, 0, 0) == 0) {
+    while ((len = segment_read(handle, buf + left, REINDEX_READ_SIZE - left)) > 0) {
+      total = left + len;
+      left = total;
+      /*the indexer stops before the packets whose events may not fit in the array*/
+      do {
+        left = ts_indexer_parse_batch(indexer, buf + total - left, left,
+            events, REINDEX_MAX_EVENTS, &nb);
+        for (i = 0; i < nb; i++) {
+          if (events[i].type != TS_INDEXER_EVENT_TYPE_VIDEO_PTS
+              && events[i].type != TS_INDEXER_EVENT_TYPE_AUDIO_PTS)
+            continue;
+          /*the video pts go back with the reordered frames, only the increasing ones are used.
+            a larger step back is a discontinuity, handled by segment_update_pts*/
+          if (has_pts && events[i].pts <= last_pts && last_pts - events[i].pts < REINDEX_PTS_REORDER)
+            continue;
+          segment_update_pts(handle, events[i].pts/90, events[i].offset);
+          last_pts = events[i].pts;
+          has_pts = DVR_TRUE;
+        }
+      } while (left >= TS_PKT_SIZE);
+      if (left < 0)
+        break;
+      memmove(buf, buf + total - left, left);
+    }
+  }
+
+  ts_indexer_destroy(indexer);
+  free(events);
+  free(indexer);
+  return has_pts ? DVR_SUCCESS : DVR_FAILURE;
+}
+
+static int reindex_segment(DVR_ReindexCtx_t *ctx, DVR_ReindexSegment_t *seg, uint8_t *buf, DVR_ReindexScan_t *scan)
+{
+  Segment_OpenParams_t params;
+  Segment_Handle_t handle;
+  DVR_RecordSegmentInfo_t old;
+  DVR_Bool_t has_old = DVR_FALSE;
+  uint8_t *p;
+  loff_t pos = 0;
+  int len, left = 0;
+  loff_t duration;
+  off_t size;
+  int ret;
+
+  memset(&params, 0, sizeof(params));
+  snprintf(params.location, sizeof(params.location), "%s", ctx->location);
+  params.segment_id = seg->id;
+
+  /*the pids and their types are kept if the information file is valid,
+    a segment failing below keeps its old information in the location*/
+  memset(&seg->info, 0, sizeof(seg->info));
+  seg->info.id = seg->id;
+  params.mode = SEGMENT_MODE_READ;
+  if (segment_open(&params, &handle) == DVR_SUCCESS) {
+    memset(&old, 0, sizeof(old));
+    if (segment_load_info(handle, &old) == DVR_SUCCESS) {
+      seg->info = old;
+      seg->info.id = seg->id;
+      has_old = (old.nb_pids > 0);
+    }
+    segment_close(handle);
+  }
+
+  params.mode = SEGMENT_MODE_REPAIR;
+  ret = segment_open(&params, &handle);
+  DVR_RETURN_IF_FALSE(ret == DVR_SUCCESS);
+
+  memset(scan, 0, sizeof(*scan));
+  scan->handle = handle;
+  scan->pmt_pid = -1;
+  scan->pcr_pid = -1;
+
+  /*same packet walk as record_do_pcr_index*/
+  while ((len = segment_read(handle, buf + left, REINDEX_READ_SIZE - left)) > 0) {
+    __atomic_add_fetch(&ctx->bytes, len, __ATOMIC_RELAXED);
+    left += len;
+    p = buf;
+    while (left >= TS_PKT_SIZE) {
+      if (*p == 0x47) {
+        reindex_scan_packet(scan, p, pos);
+        p += TS_PKT_SIZE;
+        left -= TS_PKT_SIZE;
+        pos += TS_PKT_SIZE;
+      } else {
+        p++;
+        left--;
+        pos++;
+      }
+    }
+    memmove(buf, p, left);
+  }
+
+  memset(&seg->info, 0, sizeof(seg->info));
+  seg->info.id = seg->id;
+  if (has_old) {
+    seg->info.nb_pids = old.nb_pids;
+    memcpy(seg->info.pids, old.pids, sizeof(old.pids));
+  } else {
+    reindex_scan_pids(scan, &seg->info);
+  }
+
+  if (!scan->has_pcr && reindex_pts(handle, buf, &seg->info) != DVR_SUCCESS) {
+    DVR_WARN("%s, no time found in segment %llu", __func__, seg->id);
+  }
+
+  duration = segment_tell_total_time(handle);
+  seg->info.duration = (duration > 0) ? duration : 0;
+  size = segment_get_cur_segment_size(handle);
+  seg->info.size = (size > 0) ? size : 0;
+  seg->info.nb_packets = seg->info.size/188;
+
+  ret = segment_store_info(handle, &seg->info);
+  segment_close(handle);
+
+  DVR_INFO("%s, segment %llu, nb_pids:%d, duration:%ld ms, size:%zu, %s", __func__,
+      seg->id, seg->info.nb_pids, seg->info.duration, seg->info.size,
+      scan->has_pcr ? "pcr" : "pts");
+  return ret;
+}
+
+static void *reindex_worker(void *arg)
+{
+  DVR_ReindexCtx_t *ctx = (DVR_ReindexCtx_t *)arg;
+  DVR_ReindexScan_t *scan;
+  uint8_t *buf;
+  uint32_t i;
+
+  buf = (uint8_t *)malloc(REINDEX_READ_SIZE);
+  scan = (DVR_ReindexScan_t *)malloc(sizeof(DVR_ReindexScan_t));
+  if (!buf || !scan) {
+    DVR_ERROR("%s, no memory", __func__);
+    free(buf);
+    free(scan);
+    return NULL;
+  }
+
+  while ((i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED)) < ctx->nb_segments) {
+    ctx->segments[i].result = reindex_segment(ctx, &ctx->segments[i], buf, scan);
+  }
+
+  free(scan);
+  free(buf);
+  return NULL;
+}
+
+static int reindex_compare_id(const void *a, const void *b)
+{
+  uint64_t ida = ((const DVR_ReindexSegment_t *)a)->id;
+  uint64_t idb = ((const DVR_ReindexSegment_t *)b)->id;
+
+  return (ida > idb) - (ida < idb);
+}
+
+/*find the "<location>-<id>.ts" files*/
+static int reindex_find_segments(DVR_ReindexCtx_t *ctx)
+{
+  char dname[DVR_MAX_LOCATION_SIZE];
+  const char *fname;
+  int fname_len;
+  DIR *dir;
+  struct dirent *entry;
+  DVR_ReindexSegment_t *segs;
+  uint32_t cap = 0;
+  char *end;
+  uint64_t id;
+
+  fname = strrchr(ctx->location, '/');
+  DVR_RETURN_IF_FALSE(fname && fname[1]);
+  fname++;
+  fname_len = strlen(fname);
+
+  memset(dname, 0, sizeof(dname));
+  memcpy(dname, ctx->location, fname - ctx->location);
+  dir = opendir(dname);
+  if (!dir) {
+    DVR_ERROR("%s, open dir %s failed, reason:%s", __func__, dname, strerror(errno));
+    return DVR_FAILURE;
+  }
+
+  while ((entry = readdir(dir)) != NULL) {
+    if (strncmp(entry->d_name, fname, fname_len) || entry->d_name[fname_len] != '-')
+      continue;
+    if (entry->d_name[fname_len + 1] < '0' || entry->d_name[fname_len + 1] > '9')
+      continue;
+    id = strtoull(entry->d_name + fname_len + 1, &end, 10);
+    if (strcmp(end, ".ts"))
+      continue;
+
+    if (ctx->nb_segments == cap) {
+      cap = cap ? cap * 2 : 64;
+      segs = (DVR_ReindexSegment_t *)realloc(ctx->segments, cap * sizeof(DVR_ReindexSegment_t));
+      if (!segs) {
+        closedir(dir);
+        return DVR_FAILURE;
+      }
+      ctx->segments = segs;
+    }
+    memset(&ctx->segments[ctx->nb_segments], 0, sizeof(DVR_ReindexSegment_t));
+    ctx->segments[ctx->nb_segments].id = id;
+    ctx->segments[ctx->nb_segments].result = DVR_FAILURE;
+    ctx->nb_segments++;
+  }
+  closedir(dir);
+
+  if (!ctx->nb_segments) {
+    DVR_ERROR("%s, no segment of %s", __func__, ctx->location);
+    return DVR_FAILURE;
+  }
+  qsort(ctx->segments, ctx->nb_segments, sizeof(DVR_ReindexSegment_t), reindex_compare_id);
+  return DVR_SUCCESS;
+}
+
+/*the location information is rebuilt in the segment order,
+  the segments failed are kept with their old information*/
+static void reindex_store_allInfo(DVR_ReindexCtx_t *ctx)
+{
+  Segment_OpenParams_t params;
+  Segment_Handle_t handle;
+  char fpath[DVR_MAX_LOCATION_SIZE + 8];
+  uint32_t i;
+
+  snprintf(fpath, sizeof(fpath), "%s.dat", ctx->location);
+  unlink(fpath);
+
+  memset(&params, 0, sizeof(params));
+  snprintf(params.location, sizeof(params.location), "%s", ctx->location);
+  params.mode = SEGMENT_MODE_REPAIR;
+  for (i = 0; i < ctx->nb_segments; i++) {
+    params.segment_id = ctx->segments[i].id;
+    if (segment_open(&params, &handle) == DVR_SUCCESS) {
+      segment_store_allInfo(handle, &ctx->segments[i].info);
+      segment_close(handle);
+    }
+  }
+}
+
+/*create the list file if it is lost*/
+static void reindex_link(DVR_ReindexCtx_t *ctx)
+{
+  char fpath[DVR_MAX_LOCATION_SIZE + 8];
+  uint64_t *ids;
+  uint32_t i;
+
+  snprintf(fpath, sizeof(fpath), "%s.list", ctx->location);
+  if (access(fpath, F_OK) == 0)
+    return;
+
+  ids = (uint64_t *)malloc(ctx->nb_segments * sizeof(uint64_t));
+  if (!ids)
+    return;
+  for (i = 0; i < ctx->nb_segments; i++)
+    ids[i] = ctx->segments[i].id;
+  dvr_segment_link(ctx->location, ctx->nb_segments, ids);
+  free(ids);
+}
+
+/****************************************************************************
+ * API functions
+ ***************************************************************************/
+
+int dvr_reindex(const char *location, int nb_workers, DVR_ReindexStats_t *p_stats)
+{
+  DVR_ReindexCtx_t ctx;
+  pthread_t threads[REINDEX_MAX_WORKERS];
+  uint32_t start = reindex_time_ms();
+  uint32_t i, nb_failed = 0;
+  int nb_threads = 0;
+
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+
+  memset(&ctx, 0, sizeof(ctx));
+  snprintf(ctx.location, sizeof(ctx.location), "%s", location);
+  if (reindex_find_segments(&ctx) != DVR_SUCCESS) {
+    free(ctx.segments);
+    return DVR_FAILURE;
+  }
+
+  if (nb_workers <= 0)
+    nb_workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nb_workers > REINDEX_MAX_WORKERS)
+    nb_workers = REINDEX_MAX_WORKERS;
+  if (nb_workers > (int)ctx.nb_segments)
+    nb_workers = ctx.nb_segments;
+  if (nb_workers < 1)
+    nb_workers = 1;
+
+  DVR_INFO("%s, location:%s segments:%d workers:%d", __func__, location, ctx.nb_segments, nb_workers);
+
+  /*the calling thread is one of the workers*/
+  while (nb_threads < nb_workers - 1
+      && pthread_create(&threads[nb_threads], NULL, reindex_worker, &ctx) == 0)
+    nb_threads++;
+  reindex_worker(&ctx);
+  for (i = 0; i < (uint32_t)nb_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  for (i = 0; i < ctx.nb_segments; i++) {
+    if (ctx.segments[i].result != DVR_SUCCESS) {
+      DVR_ERROR("%s, segment %llu of %s failed", __func__, ctx.segments[i].id, location);
+      nb_failed++;
+    }
+  }
+
+  reindex_store_allInfo(&ctx);
+  reindex_link(&ctx);
+
+  if (p_stats) {
+    p_stats->nb_segments = ctx.nb_segments;
+    p_stats->nb_failed = nb_failed;
+    p_stats->nb_workers = nb_threads + 1;
+    p_stats->bytes = ctx.bytes;
+    p_stats->time = reindex_time_ms() - start;
+  }
+  DVR_INFO("%s, location:%s done, %d of %d segments failed, %llu bytes in %u ms", __func__,
+      location, nb_failed, ctx.nb_segments, ctx.bytes, reindex_time_ms() - start);
+
+  free(ctx.segments);
+  return nb_failed ? DVR_FAILURE : DVR_SUCCESS;
+}
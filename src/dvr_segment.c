@@ -63,6 +63,16 @@ int dvr_segment_delete(const char *location, uint64_t segment_id)
   return DVR_SUCCESS;
 }
 
+int dvr_segment_recycle(const char *location, uint64_t segment_id)
+{
+  DVR_RETURN_IF_FALSE(location);
+  DVR_RETURN_IF_FALSE(strlen(location) < DVR_MAX_LOCATION_SIZE);
+  DVR_INFO("In function %s, segment %s's id is %lld", __func__, location, segment_id);
+
+  /*renames only, no need of the deletion thread*/
+  return segment_recycle(location, segment_id);
+}
+
 int dvr_segment_del_by_location(const char *location)
 {
 #if 0
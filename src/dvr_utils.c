@@ -250,3 +250,19 @@ void clock_timespec_subtract(struct timespec *ts1, struct timespec *ts2, struct
   ts3->tv_nsec = nsec;
 }
 
+int dvr_ts_get_pcr(const uint8_t *pkt, uint64_t *p_pcr)
+{
+  const uint8_t *p = pkt + 4;
+
+  /* Parse pcr field, see 13818 spec table I-2-6,adaptation_field */
+  if (!(pkt[3] & 0x20) || p[0] < 6 || !(p[1] & 0x10))
+    return 0;
+
+  /* get pcr value,pcr is 33bit value */
+  *p_pcr = (((uint64_t)(p[2])) << 25)
+      | (((uint64_t)p[3]) << 17)
+      | (((uint64_t)(p[4])) << 9)
+      | (((uint64_t)p[5]) << 1)
+      | ((((uint64_t)p[6]) & 0x80) >> 7);
+  return 1;
+}
@@ -21,6 +21,7 @@
 #include "list.h"
 
 #include "dvr_wrapper.h"
+#include "dvr_pool.h"
 
 #define WRAPPER_LOG_TAG "libdvr-wrapper"
 #define DVR_WRAPPER_DEBUG(...) DVR_LOG_PRINT(LOG_LV_DEBUG, WRAPPER_LOG_TAG, __VA_ARGS__)
@@ -147,6 +148,8 @@ typedef struct {
   /*valid if (sn != 0)*/
   unsigned long                 sn;
   unsigned long                 sn_linked;
+  uint32_t                      location_hash;               /**<hash of the location, to compare locations fast*/
+  uint32_t                      timeshift_seq;               /**<order of the timeshift opens, the latest peer is linked first*/
 
   struct list_head              segments;                    /**<head-add list*/
   uint64_t                      current_segment_id;          /**<id of the current segment*/
@@ -184,6 +187,11 @@ typedef struct {
 
       DVR_WrapperInfo_t               obsolete;
       DVR_Bool_t                      tf_full;
+
+      pthread_t                       loader_thread;        /**<thread adding the remaining segments after a fast start*/
+      DVR_Bool_t                      loader_running;       /**<loader_thread is to be joined*/
+      DVR_Bool_t                      loader_done;          /**<loader_thread does not use the ctx anymore*/
+      DVR_Bool_t                      loader_stop;          /**<request the loader to stop adding segments*/
     } playback;
   };
 } DVR_WrapperCtx_t;
@@ -209,11 +217,13 @@ typedef struct {
 
 typedef struct {
   pthread_mutex_t lock;
-  char            *name;
+  char            name[16];
   int             running;
   pthread_cond_t  cond;
   pthread_t       thread;
   int             type;
+  struct list_head evt_list;        /**<events to be handled by this thread*/
+  pthread_mutex_t evt_list_lock;
 } DVR_WrapperThreadCtx_t;
 
 typedef struct {
@@ -229,69 +239,36 @@ typedef struct {
   DVR_RecordSegmentInfo_t info;
 } DVR_WrapperRecordSegmentInfo_t;
 
-/* serial num generater */
-static unsigned long sn = 1;
-static pthread_mutex_t sn_lock = PTHREAD_MUTEX_INITIALIZER;
-
-static inline unsigned long get_sn()
-{
-  unsigned long no = 0;
-
-  pthread_mutex_lock(&sn_lock);
-  no = sn++;
-  if (!no)
-    no = sn++;
-  pthread_mutex_unlock(&sn_lock);
-  return no;
-}
-
-/* entity ctx */
-#define DVR_WRAPPER_MAX 10
-
-static DVR_WrapperCtx_t record_list[DVR_WRAPPER_MAX] =
-{
-  [0 ... (DVR_WRAPPER_MAX - 1)] =
-  {
-    .type = W_REC,
-  }
-};
-
-static DVR_WrapperCtx_t playback_list[DVR_WRAPPER_MAX] =
-{
-  [0 ... (DVR_WRAPPER_MAX - 1)] =
-  {
-    .type = W_PLAYBACK,
-  }
-};
-
-/* events lists */
-static struct list_head record_evt_list = LIST_HEAD_INIT(record_evt_list);
-static struct list_head playback_evt_list = LIST_HEAD_INIT(playback_evt_list);
-
-static pthread_mutex_t record_evt_list_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t playback_evt_list_lock = PTHREAD_MUTEX_INITIALIZER;
-
-static DVR_WrapperThreadCtx_t wrapper_thread[2] =
-{
-  [0] =
-  {
-    .lock = PTHREAD_MUTEX_INITIALIZER,
-    .running = 0,
-    .name = "record",
-    .type = W_REC,
-  },
-  [1] =
-  {
-    .lock = PTHREAD_MUTEX_INITIALIZER,
-    .running = 0,
-    .name = "playback",
-    .type = W_PLAYBACK,
-  },
-};
-
-/*now only support one timeshift now*/
-static unsigned long sn_timeshift_record;
-static unsigned long sn_timeshift_playback;
+typedef struct {
+  DVR_WrapperCtx_t   *ctx;
+  unsigned long      sn;
+  char               location[DVR_MAX_LOCATION_SIZE];
+  DVR_PlaybackPids_t pids;
+  uint64_t           *segment_ids;
+  uint32_t           segment_nb;
+  uint32_t           next;                 /**<index of the 1st segment to be loaded*/
+} DVR_WrapperPlaybackLoader_t;
+
+/* entity ctx, the sn of a ctx is its handle in the pool */
+static DVR_Pool_t record_pool = DVR_POOL_INITIALIZER(DVR_WrapperCtx_t, 2);
+static DVR_Pool_t playback_pool = DVR_POOL_INITIALIZER(DVR_WrapperCtx_t, 3);
+
+/* event threads
+ * the sessions are spread over the shards by their pool index,
+ * all the events of a session are handled by the same shard thread in order,
+ * so a session blocked on slow storage does not delay the other shards.
+ * one thread as before, more are enabled by vendor.tv.libdvr.wrapper.shards.
+ */
+#define WRAPPER_THREAD_SHARDS_MAX      (8)
+#define WRAPPER_THREAD_SHARDS_DEFAULT  (1)
+
+static DVR_WrapperThreadCtx_t record_threads[WRAPPER_THREAD_SHARDS_MAX];
+static DVR_WrapperThreadCtx_t playback_threads[WRAPPER_THREAD_SHARDS_MAX];
+static int wrapper_thread_shards = 1;
+static pthread_once_t wrapper_thread_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t timeshift_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t timeshift_seq = 0;
 
 static void *wrapper_task(void *arg);
 static inline int process_handleEvents(DVR_WrapperEventCtx_t *evt, DVR_WrapperCtx_t *ctx);
@@ -342,16 +319,6 @@ static DVR_WrapperEventCtx_t *ctx_getEvent(struct list_head *list, pthread_mutex
   return p_evt;
 }
 
-static inline DVR_WrapperEventCtx_t *ctx_getRecordEvent()
-{
-  return ctx_getEvent(&record_evt_list, &record_evt_list_lock);
-}
-
-static inline DVR_WrapperEventCtx_t *ctx_getPlaybackEvent()
-{
-  return ctx_getEvent(&playback_evt_list, &playback_evt_list_lock);
-}
-
 static int ctx_addEvent(struct list_head *list, pthread_mutex_t *lock, DVR_WrapperEventCtx_t *evt)
 {
   DVR_WrapperEventCtx_t *padd;
@@ -371,48 +338,74 @@ static inline void ctx_freeEvent(DVR_WrapperEventCtx_t *evt)
 }
 
 /*useless*/
-static void ctx_cleanOutdatedEvents(struct list_head *evt_list,
-    pthread_mutex_t *evt_list_lock,
-    DVR_WrapperCtx_t *list)
+static void ctx_cleanOutdatedEvents(DVR_WrapperThreadCtx_t *threads, DVR_Pool_t *pool)
 {
   DVR_WrapperEventCtx_t *p_evt, *p_evt_tmp;
-  unsigned long sns[DVR_WRAPPER_MAX];
-  int cnt = 0;
   int i;
-  int found = 0;
-
-  /*copy all valid sns*/
-  for (i = 0; i < DVR_WRAPPER_MAX; i++) {
-    sns[cnt] = list[i].sn;
-    if (!sns[cnt])
-      cnt++;
-  }
 
   /*free evts that not belong to any valid sns*/
-  pthread_mutex_lock(evt_list_lock);
-  list_for_each_entry_safe(p_evt, p_evt_tmp, evt_list, head) {
-    for (i = 0; i < cnt; i++) {
-      if (p_evt->sn == sns[i]) {
-        found = 1;
-        break;
+  for (i = 0; i < wrapper_thread_shards; i++) {
+    pthread_mutex_lock(&threads[i].evt_list_lock);
+    list_for_each_entry_safe(p_evt, p_evt_tmp, &threads[i].evt_list, head) {
+      if (!dvr_pool_get(pool, p_evt->sn)) {
+        list_del(&p_evt->head);
+        ctx_freeEvent(p_evt);
       }
     }
-    if (!found) {
-      list_del(&p_evt->head);
-      ctx_freeEvent(p_evt);
-    }
+    pthread_mutex_unlock(&threads[i].evt_list_lock);
   }
-  pthread_mutex_unlock(evt_list_lock);
 }
 
 static inline void ctx_cleanOutdatedRecordEvents()
 {
-  ctx_cleanOutdatedEvents(&record_evt_list, &record_evt_list_lock, record_list);
+  ctx_cleanOutdatedEvents(record_threads, &record_pool);
 }
 
 static inline void ctx_cleanOutdatedPlaybackEvents()
 {
-  ctx_cleanOutdatedEvents(&playback_evt_list, &playback_evt_list_lock, playback_list);
+  ctx_cleanOutdatedEvents(playback_threads, &playback_pool);
+}
+
+static inline void ctx_reset(DVR_WrapperCtx_t *ctx)
+{
+  memset((char *)ctx + offsetof(DVR_WrapperCtx_t, sn),
+    0,
+    sizeof(DVR_WrapperCtx_t) - offsetof(DVR_WrapperCtx_t, sn));
+}
+
+static inline int ctx_valid(DVR_WrapperCtx_t *ctx)
+{
+  return (ctx->sn != 0);
+}
+
+/*FNV-1a hash of the location*/
+static uint32_t location_hash(const char *location)
+{
+  uint32_t h = 2166136261u;
+
+  while (*location) {
+    h ^= (uint8_t)*location++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+/*find the valid ctx of the location, the locations are only compared if the hashes match*/
+static DVR_WrapperCtx_t *ctx_findByLocation(DVR_Pool_t *pool, char *location)
+{
+  DVR_WrapperCtx_t *cnt;
+  uint32_t hash = location_hash(location);
+  int i;
+
+  for (i = 0; i < dvr_pool_size(pool); i++) {
+    cnt = dvr_pool_get_by_index(pool, i, NULL);
+    if (!cnt || !ctx_valid(cnt) || cnt->location_hash != hash)
+      continue;
+    if (!strcmp((cnt->type == W_REC) ?
+        cnt->record.param_open.location : cnt->playback.param_open.location, location))
+      return cnt;
+  }
+  return NULL;
 }
 
 //check this play is recording file
@@ -420,18 +413,13 @@ static inline void ctx_cleanOutdatedPlaybackEvents()
 //else return record id
 static inline int ctx_isPlay_recording(char *play_location)
 {
-  int i;
-  DVR_WrapperCtx_t *cnt;
+  DVR_WrapperCtx_t *cnt = ctx_findByLocation(&record_pool, play_location);
 
-  for (i = 0; i < DVR_WRAPPER_MAX; i++) {
-    cnt = &record_list[i];
-    //DVR_WRAPPER_INFO("[%d]sn[%d]R:[%s]P:[%s] ...\n", i, cnt->sn, cnt->record.param_open.location, play_location);
-    if (!strcmp(cnt->record.param_open.location, play_location)) {
-      DVR_WRAPPER_INFO("[%d]sn[%d]R:[%s]P:[%s] .found..\n", i, cnt->sn, cnt->record.param_open.location, play_location);
-      return cnt->sn;
-    }
+  if (cnt) {
+    DVR_WRAPPER_INFO("sn[%d]R:[%s]P:[%s] .found..\n", cnt->sn, cnt->record.param_open.location, play_location);
+    return cnt->sn;
   }
-  DVR_WRAPPER_INFO(" not found any play is in recording [%d]", DVR_WRAPPER_MAX);
+  DVR_WRAPPER_INFO(" not found any play is in recording [%d]", dvr_pool_size(&record_pool));
   return 0;
 }
 
@@ -439,52 +427,145 @@ static inline int ctx_isPlay_recording(char *play_location)
 // Return 0 if it is not being played, otherwise return its playback id.
 static inline int ctx_isRecord_playing(char *rec_location)
 {
-    int i;
-    DVR_WrapperCtx_t *cnt;
-    for (i = 0; i < DVR_WRAPPER_MAX; i++) {
-      cnt = &playback_list[i];
-      //DVR_WRAPPER_INFO("[%d]sn[%d]P[%s]R[%s] ...\n", i, cnt->sn, cnt->playback.param_open.location, rec_location);
-      if (!strcmp(cnt->playback.param_open.location, rec_location)) {
-        DVR_WRAPPER_DEBUG("[%d]sn[%d]P[%s]R[%s] ..found.",
-            i, cnt->sn, cnt->playback.param_open.location, rec_location);
-        return cnt->sn;
-      }
+    DVR_WrapperCtx_t *cnt = ctx_findByLocation(&playback_pool, rec_location);
+
+    if (cnt) {
+      DVR_WRAPPER_DEBUG("sn[%d]P[%s]R[%s] ..found.",
+          cnt->sn, cnt->playback.param_open.location, rec_location);
+      return cnt->sn;
     }
     return 0;
 }
 
-static inline DVR_WrapperCtx_t *ctx_get(unsigned long sn, DVR_WrapperCtx_t *list)
+static inline DVR_WrapperCtx_t *ctx_get(unsigned long sn, DVR_Pool_t *pool)
 {
-  int i;
-  for (i = 0; i < DVR_WRAPPER_MAX; i++) {
-    if (list[i].sn == sn) {
-      wrapper_mutex_init(&list[i].wrapper_lock);
-      return &list[i];
-    }
-  }
-  return NULL;
-}
+  DVR_WrapperCtx_t *ctx = dvr_pool_get(pool, (uint32_t)sn);
 
-static inline void ctx_reset(DVR_WrapperCtx_t *ctx)
-{
-  memset((char *)ctx + offsetof(DVR_WrapperCtx_t, sn),
-    0,
-    sizeof(DVR_WrapperCtx_t) - offsetof(DVR_WrapperCtx_t, sn));
+  if (ctx)
+    wrapper_mutex_init(&ctx->wrapper_lock);
+  return ctx;
 }
 
-static inline int ctx_valid(DVR_WrapperCtx_t *ctx)
+/*get a free ctx, the sn is set to the new handle*/
+static DVR_WrapperCtx_t *ctx_new(DVR_Pool_t *pool, int type)
 {
-  return (ctx->sn != 0);
+  DVR_WrapperCtx_t *ctx;
+  uint32_t handle;
+
+  ctx = dvr_pool_alloc(pool, &handle);
+  if (!ctx)
+    return NULL;
+
+  wrapper_mutex_init(&ctx->wrapper_lock);
+  wrapper_mutex_lock(&ctx->wrapper_lock);
+  ctx_reset(ctx);
+  ctx->type = type;
+  ctx->sn = handle;
+  return ctx;
 }
 
 static inline DVR_WrapperCtx_t *ctx_getRecord(unsigned long sn)
 {
-  return ctx_get(sn, record_list);
+  return ctx_get(sn, &record_pool);
 }
 
 static inline DVR_WrapperCtx_t *ctx_getPlayback(unsigned long sn)
 {
-  return ctx_get(sn, playback_list);
+  return ctx_get(sn, &playback_pool);
+}
+
+/*reset the ctx and give it back to the pool*/
+static void ctx_free(DVR_WrapperCtx_t *ctx)
+{
+  unsigned long sn = ctx->sn;
+
+  ctx_reset(ctx);
+  dvr_pool_free((ctx->type == W_REC) ? &record_pool : &playback_pool, (uint32_t)sn);
+}
+
+static inline char *ctx_location(DVR_WrapperCtx_t *ctx)
+{
+  return (ctx->type == W_REC) ?
+    ctx->record.param_open.location : ctx->playback.param_open.location;
+}
+
+static inline DVR_Bool_t ctx_isTimeshift(DVR_WrapperCtx_t *ctx)
+{
+  return (ctx->type == W_REC) ?
+    ctx->record.param_open.is_timeshift : ctx->playback.param_open.is_timeshift;
+}
+
+/*
+  link a timeshift record/playback to an unlinked timeshift peer,
+  the peer with the same location is preferred,
+  or the latest opened unlinked peer, as there was only one timeshift pair before
+*/
+static void ctx_linkTimeshift(DVR_WrapperCtx_t *ctx)
+{
+  DVR_Pool_t *pool = (ctx->type == W_REC) ? &playback_pool : &record_pool;
+  DVR_WrapperCtx_t *peer = NULL;
+  int nb_unlinked = 0;
+  int i;
+
+  if (!ctx_isTimeshift(ctx))
+    return;
+
+  pthread_mutex_lock(&timeshift_lock);
+  ctx->timeshift_seq = ++timeshift_seq;
+  for (i = 0; i < dvr_pool_size(pool); i++) {
+    DVR_WrapperCtx_t *p = dvr_pool_get_by_index(pool, i, NULL);
+
+    if (!p || !ctx_valid(p) || !ctx_isTimeshift(p) || p->sn_linked)
+      continue;
+    if (p->location_hash == ctx->location_hash
+      && !strcmp(ctx_location(p), ctx_location(ctx))) {
+      peer = p;
+      nb_unlinked = 1;
+      break;
+    }
+    nb_unlinked++;
+    if (!peer || (int32_t)(p->timeshift_seq - peer->timeshift_seq) > 0)
+      peer = p;
+  }
+  if (nb_unlinked > 1) {
+    DVR_WRAPPER_WARN("timeshift, %d unlinked peers for %s(sn:%ld) at [%s], the latest opened is linked\n",
+      nb_unlinked, (ctx->type == W_REC) ? "record" : "playback", ctx->sn, ctx_location(ctx));
+  }
+  if (peer) {
+    ctx->sn_linked = peer->sn;
+    peer->sn_linked = ctx->sn;
+    DVR_WRAPPER_INFO("timeshift, %s(sn:%ld) linked to %s(sn:%ld)\n",
+      (ctx->type == W_REC) ? "record" : "playback", ctx->sn,
+      (peer->type == W_REC) ? "record" : "playback", peer->sn);
+  }
+  pthread_mutex_unlock(&timeshift_lock);
+}
+
+static void ctx_unlinkTimeshift(DVR_WrapperCtx_t *ctx)
+{
+  DVR_WrapperCtx_t *peer;
+
+  pthread_mutex_lock(&timeshift_lock);
+  if (ctx->sn_linked) {
+    peer = (ctx->type == W_REC) ?
+      ctx_getPlayback(ctx->sn_linked) : ctx_getRecord(ctx->sn_linked);
+    if (peer && peer->sn_linked == ctx->sn)
+      peer->sn_linked = 0;
+    ctx->sn_linked = 0;
+  }
+  pthread_mutex_unlock(&timeshift_lock);
+}
+
+/*get the sn of the timeshift peer, 0 if not linked*/
+static unsigned long ctx_getTimeshiftLinked(DVR_WrapperCtx_t *ctx)
+{
+  unsigned long sn;
+
+  pthread_mutex_lock(&timeshift_lock);
+  sn = ctx->sn_linked;
+  pthread_mutex_unlock(&timeshift_lock);
+
+  return sn;
 }
 
 static int wrapper_requestThread(DVR_WrapperThreadCtx_t *ctx, void *(thread_fn)(void *))
@@ -524,28 +605,58 @@ static int wrapper_releaseThread(DVR_WrapperThreadCtx_t *ctx)
   return 0;
 }
 
-#define WRAPPER_THREAD_RECORD    (&wrapper_thread[0])
-#define WRAPPER_THREAD_PLAYBACK  (&wrapper_thread[1])
+static void wrapper_threadsInit(void)
+{
+  int i, shards;
 
-static inline int wrapper_requestThreadFor(DVR_WrapperCtx_t *ctx)
+  shards = dvr_prop_read_int("vendor.tv.libdvr.wrapper.shards", WRAPPER_THREAD_SHARDS_DEFAULT);
+  if (shards < 1)
+    shards = 1;
+  else if (shards > WRAPPER_THREAD_SHARDS_MAX)
+    shards = WRAPPER_THREAD_SHARDS_MAX;
+  wrapper_thread_shards = shards;
+
+  for (i = 0; i < WRAPPER_THREAD_SHARDS_MAX; i++) {
+    DVR_WrapperThreadCtx_t *rec = &record_threads[i];
+    DVR_WrapperThreadCtx_t *play = &playback_threads[i];
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_mutex_init(&rec->evt_list_lock, NULL);
+    INIT_LIST_HEAD(&rec->evt_list);
+    snprintf(rec->name, sizeof(rec->name), "record%d", i);
+    rec->type = W_REC;
+
+    pthread_mutex_init(&play->lock, NULL);
+    pthread_mutex_init(&play->evt_list_lock, NULL);
+    INIT_LIST_HEAD(&play->evt_list);
+    snprintf(play->name, sizeof(play->name), "playback%d", i);
+    play->type = W_PLAYBACK;
+  }
+  DVR_WRAPPER_INFO("wrapper event threads, %d shards\n", shards);
+}
+
+/*get the thread handling the events of the session sn*/
+static DVR_WrapperThreadCtx_t *wrapper_threadForSn(int type, unsigned long sn)
 {
-  DVR_WrapperThreadCtx_t *thread_ctx = (ctx->type == W_REC)?
-    WRAPPER_THREAD_RECORD : WRAPPER_THREAD_PLAYBACK;
-  return wrapper_requestThread(thread_ctx, wrapper_task);
+  int idx;
+
+  pthread_once(&wrapper_thread_once, wrapper_threadsInit);
+
+  idx = dvr_pool_handle_index((uint32_t)sn);
+  if (idx < 0)
+    idx = 0;
+  idx %= wrapper_thread_shards;
+  return (type == W_REC) ? &record_threads[idx] : &playback_threads[idx];
 }
 
-static inline int wrapper_releaseThreadFor(DVR_WrapperCtx_t *ctx)
+static inline int wrapper_requestThreadFor(DVR_WrapperCtx_t *ctx)
 {
-  DVR_WrapperThreadCtx_t *thread_ctx = (ctx->type == W_REC)?
-    WRAPPER_THREAD_RECORD : WRAPPER_THREAD_PLAYBACK;
-  return wrapper_releaseThread(thread_ctx);
+  return wrapper_requestThread(wrapper_threadForSn(ctx->type, ctx->sn), wrapper_task);
 }
 
-static inline int wrapper_releaseThreadForType(int type)
+static inline int wrapper_releaseThreadForSn(int type, unsigned long sn)
 {
-  DVR_WrapperThreadCtx_t *thread_ctx = (type == W_REC)?
-    WRAPPER_THREAD_RECORD : WRAPPER_THREAD_PLAYBACK;
-  return wrapper_releaseThread(thread_ctx);
+  return wrapper_releaseThread(wrapper_threadForSn(type, sn));
 }
 
 static inline void wrapper_threadSignal(DVR_WrapperThreadCtx_t *thread_ctx)
@@ -561,28 +672,6 @@ static inline int wrapper_threadWait(DVR_WrapperThreadCtx_t *thread_ctx)
   return 0;
 }
 
-static inline void wrapper_threadSignalForType(int type)
-{
-  DVR_WrapperThreadCtx_t *thread_ctx = (type == W_REC) ?
-    WRAPPER_THREAD_RECORD : WRAPPER_THREAD_PLAYBACK;
-  wrapper_threadSignal(thread_ctx);
-}
-
-static inline void wrapper_threadSignalFor(DVR_WrapperCtx_t *ctx)
-{
-  DVR_WrapperThreadCtx_t *thread_ctx = (ctx->type == W_REC) ?
-    WRAPPER_THREAD_RECORD : WRAPPER_THREAD_PLAYBACK;
-  wrapper_threadSignal(thread_ctx);
-}
-
-static inline int wrapper_threadWaitFor(DVR_WrapperCtx_t *ctx)
-{
-  DVR_WrapperThreadCtx_t *thread_ctx = (ctx->type == W_REC) ?
-    WRAPPER_THREAD_RECORD : WRAPPER_THREAD_PLAYBACK;
-  wrapper_threadWait(thread_ctx);
-  return 0;
-}
-
 /*return condition, locked if condition == true*/
 static int wrapper_mutex_lock_if(DVR_WrapperMutex_t *lock, int *condition)
 {
@@ -609,7 +698,7 @@ static void *wrapper_task(void *arg)
   while (thread_ctx->running) {
     int ret;
 
-    evt = (thread_ctx->type == W_REC)? ctx_getRecordEvent() : ctx_getPlaybackEvent();
+    evt = ctx_getEvent(&thread_ctx->evt_list, &thread_ctx->evt_list_lock);
     if (!evt) {
       pthread_mutex_lock(&thread_ctx->lock);
       ret = wrapper_threadWait(thread_ctx);
@@ -645,7 +734,7 @@ static void *wrapper_task(void *arg)
 processed:
       ctx_freeEvent(evt);
 
-      evt = (thread_ctx->type == W_REC)? ctx_getRecordEvent() : ctx_getPlaybackEvent();
+      evt = ctx_getEvent(&thread_ctx->evt_list, &thread_ctx->evt_list_lock);
     }
   }
 
@@ -653,22 +742,25 @@ processed:
   return NULL;
 }
 
-static inline int ctx_addRecordEvent(DVR_WrapperEventCtx_t *evt)
+static int ctx_addThreadEvent(DVR_WrapperEventCtx_t *evt)
 {
-  pthread_mutex_lock(&WRAPPER_THREAD_RECORD->lock);
-  if (ctx_addEvent(&record_evt_list, &record_evt_list_lock, evt) == 0)
-    wrapper_threadSignalForType(evt->type);
-  pthread_mutex_unlock(&WRAPPER_THREAD_RECORD->lock);
+  DVR_WrapperThreadCtx_t *thread_ctx = wrapper_threadForSn(evt->type, evt->sn);
+
+  pthread_mutex_lock(&thread_ctx->lock);
+  if (ctx_addEvent(&thread_ctx->evt_list, &thread_ctx->evt_list_lock, evt) == 0)
+    wrapper_threadSignal(thread_ctx);
+  pthread_mutex_unlock(&thread_ctx->lock);
   return 0;
 }
 
+static inline int ctx_addRecordEvent(DVR_WrapperEventCtx_t *evt)
+{
+  return ctx_addThreadEvent(evt);
+}
+
 static inline int ctx_addPlaybackEvent(DVR_WrapperEventCtx_t *evt)
 {
-  pthread_mutex_lock(&WRAPPER_THREAD_PLAYBACK->lock);
-  if (ctx_addEvent(&playback_evt_list, &playback_evt_list_lock, evt) == 0)
-    wrapper_threadSignalForType(evt->type);
-  pthread_mutex_unlock(&WRAPPER_THREAD_PLAYBACK->lock);
-  return 0;
+  return ctx_addThreadEvent(evt);
 }
 
 static inline void ctx_freeSegments(DVR_WrapperCtx_t *ctx)
@@ -826,17 +918,16 @@ static int wrapper_updateRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentI
   int sn = 0;
   if (ctx->record.param_open.is_timeshift ||
     (sn = ctx_isRecord_playing(ctx->record.param_open.location))) {
-    DVR_WrapperCtx_t *ctx_playback;
+    DVR_WrapperCtx_t *ctx_playback = NULL;
     if (ctx->record.param_open.is_timeshift)
-      ctx_playback = ctx_getPlayback(sn_timeshift_playback);
-    else
+      sn = ctx_getTimeshiftLinked(ctx);
+    if (sn)
       ctx_playback = ctx_getPlayback(sn);
 
     if (ctx_playback) {
       wrapper_mutex_lock(&ctx_playback->wrapper_lock);
       if (ctx_valid(ctx_playback)
-          && (ctx_playback->sn == sn_timeshift_playback ||
-              ctx_playback->sn == sn)) {
+          && ctx_playback->sn == sn) {
           wrapper_updatePlaybackSegment(ctx_playback, seg_info, update_flags);
       }
       wrapper_mutex_unlock(&ctx_playback->wrapper_lock);
@@ -891,6 +982,254 @@ static int wrapper_addPlaybackSegment(DVR_WrapperCtx_t *ctx,
   return error;
 }
 
+/*check if the segment has audio or video, segments without av are not played*/
+static DVR_Bool_t wrapper_segmentHasAV(DVR_RecordSegmentInfo_t *seg_info)
+{
+  uint32_t i;
+
+  for (i = 0; i < seg_info->nb_pids; i++) {
+    int type = (seg_info->pids[i].type >> 24) & 0x0f;
+    if (type == DVR_STREAM_TYPE_VIDEO ||
+      type == DVR_STREAM_TYPE_AUDIO ||
+      type == DVR_STREAM_TYPE_AD)
+      return DVR_TRUE;
+  }
+  return DVR_FALSE;
+}
+
+/*add the segments from loader->next to the playback,
+  the ctx is locked for each segment if not locked by the caller*/
+static int wrapper_loadPlaybackSegments(DVR_WrapperPlaybackLoader_t *loader, DVR_Bool_t locked)
+{
+  DVR_WrapperCtx_t *ctx = loader->ctx;
+  DVR_RecordSegmentInfo_t seg_info;
+  DVR_RecordSegmentInfo_t *p_seg_info, *p_seg_tmp;
+  struct list_head info_list;
+  DVR_Bool_t has_list;
+  DVR_EditList_t edits;
+  uint32_t i, nb = 0;
+  int error = DVR_SUCCESS;
+
+  INIT_LIST_HEAD(&info_list);
+  has_list = (dvr_segment_get_allInfo(loader->location, &info_list) != DVR_FAILURE);
+  if (dvr_edit_load(loader->location, &edits) != DVR_SUCCESS)
+    memset(&edits, 0, sizeof(edits));
+
+  for (i = loader->next; i < loader->segment_nb; i++) {
+    DVR_Bool_t found = DVR_FALSE;
+
+    if (has_list) {
+      // coverity[self_assign]
+      list_for_each_entry(p_seg_info, &info_list, head) {
+        if (p_seg_info->id == loader->segment_ids[i]) {
+          seg_info = *p_seg_info;
+          found = DVR_TRUE;
+          break;
+        }
+      }
+    }
+    if (!found) {
+      memset(&seg_info, 0, sizeof(seg_info));
+      error = dvr_segment_get_info(loader->location, loader->segment_ids[i], &seg_info);
+      if (error) {
+        DVR_WRAPPER_INFO("fail to get seg info (location:%s, seg:%llu), (error:%d)\n",
+          loader->location, loader->segment_ids[i], error);
+        break;
+      }
+    }
+    if (!wrapper_segmentHasAV(&seg_info)) {
+      DVR_WRAPPER_INFO("seg(%llu) has no av, skipped\n", seg_info.id);
+      continue;
+    }
+    /*the durations are played durations, the cuts not counted*/
+    if (edits.nb_cuts && seg_info.duration) {
+      seg_info.duration -= dvr_edit_get_cut_time(&edits, seg_info.id, seg_info.duration);
+      if (!seg_info.duration) {
+        DVR_WRAPPER_INFO("seg(%llu) is cut, skipped\n", seg_info.id);
+        continue;
+      }
+    }
+
+    if (!locked) {
+      wrapper_mutex_lock(&ctx->wrapper_lock);
+      if (ctx->playback.loader_stop || !ctx_valid(ctx) || ctx->sn != loader->sn) {
+        wrapper_mutex_unlock(&ctx->wrapper_lock);
+        break;
+      }
+    }
+    error = wrapper_addPlaybackSegment(ctx, &seg_info, &loader->pids,
+        DVR_PLAYBACK_SEGMENT_DISPLAYABLE | DVR_PLAYBACK_SEGMENT_CONTINUOUS);
+    if (!locked)
+      wrapper_mutex_unlock(&ctx->wrapper_lock);
+    if (error == DVR_FAILURE) {
+      DVR_WRAPPER_WARN("adding playback segment fails");
+      break;
+    }
+    nb++;
+  }
+
+  list_for_each_entry_safe(p_seg_info, p_seg_tmp, &info_list, head) {
+    list_del(&p_seg_info->head);
+    free(p_seg_info);
+  }
+  dvr_edit_free(&edits);
+
+  DVR_WRAPPER_INFO("playback(sn:%ld) (%d) segments loaded\n", loader->sn, nb);
+  return error;
+}
+
+static void *wrapper_playbackLoader(void *arg)
+{
+  DVR_WrapperPlaybackLoader_t *loader = (DVR_WrapperPlaybackLoader_t *)arg;
+  DVR_WrapperCtx_t *ctx = loader->ctx;
+  DVR_WrapperEventCtx_t evt;
+  DVR_Bool_t notify = DVR_FALSE;
+
+  prctl(PR_SET_NAME, "DvrWrapperLoad");
+
+  wrapper_loadPlaybackSegments(loader, DVR_FALSE);
+
+  /*report the total duration now the segment list is complete*/
+  memset(&evt, 0, sizeof(evt));
+  wrapper_mutex_lock(&ctx->wrapper_lock);
+  if (ctx_valid(ctx) && ctx->sn == loader->sn)
+    ctx->playback.loader_done = DVR_TRUE;
+  if (!ctx->playback.loader_stop && ctx_valid(ctx) && ctx->sn == loader->sn) {
+    evt.sn = loader->sn;
+    evt.type = W_PLAYBACK;
+    evt.playback.event = DVR_PLAYBACK_EVENT_NOTIFY_PLAYTIME;
+    evt.playback.status.play_status = ctx->playback.seg_status;
+    notify = DVR_TRUE;
+  }
+  wrapper_mutex_unlock(&ctx->wrapper_lock);
+  if (notify)
+    ctx_addPlaybackEvent(&evt);
+
+  free(loader->segment_ids);
+  free(loader);
+  return NULL;
+}
+
+/*wait for the loader of the playback sn to exit, ask it to stop first if stop is set*/
+static void wrapper_joinPlaybackLoader(DVR_WrapperCtx_t *ctx, unsigned long sn, DVR_Bool_t stop)
+{
+  pthread_t thread;
+
+  wrapper_mutex_lock(&ctx->wrapper_lock);
+  if (!ctx_valid(ctx) || ctx->sn != sn) {
+    wrapper_mutex_unlock(&ctx->wrapper_lock);
+    return;
+  }
+  if (stop)
+    ctx->playback.loader_stop = DVR_TRUE;
+  if (!ctx->playback.loader_running) {
+    wrapper_mutex_unlock(&ctx->wrapper_lock);
+    return;
+  }
+  ctx->playback.loader_running = DVR_FALSE;
+  thread = ctx->playback.loader_thread;
+  wrapper_mutex_unlock(&ctx->wrapper_lock);
+
+  pthread_join(thread, NULL);
+}
+
+/*start the playback as soon as the 1st segment with av is known,
+  the remaining segments are added by the loader thread,
+  the ctx is locked by the caller*/
+static int wrapper_startPlaybackFast(DVR_WrapperCtx_t *ctx, DVR_PlaybackFlag_t flags, DVR_PlaybackPids_t *p_pids)
+{
+  DVR_WrapperPlaybackLoader_t *loader;
+  DVR_RecordSegmentInfo_t seg_info;
+  uint64_t *p_segment_ids = NULL;
+  uint32_t segment_nb = 0;
+  uint32_t i;
+  int error;
+
+  /*started again without stop, the loader of the previous start is joined if it is over*/
+  if (ctx->playback.loader_running) {
+    if (!ctx->playback.loader_done) {
+      DVR_WRAPPER_WARN("playback(sn:%ld) segments of the previous start still loading", ctx->sn);
+      return DVR_FAILURE;
+    }
+    pthread_join(ctx->playback.loader_thread, NULL);
+    ctx->playback.loader_running = DVR_FALSE;
+  }
+
+  error = dvr_segment_get_list(ctx->playback.param_open.location, &segment_nb, &p_segment_ids);
+  if (error)
+    return error;
+
+  DVR_WRAPPER_INFO("get list segment_nb::%d", segment_nb);
+  for (i = 0; i < segment_nb; i++) {
+    memset(&seg_info, 0, sizeof(seg_info));
+    error = dvr_segment_get_info(ctx->playback.param_open.location, p_segment_ids[i], &seg_info);
+    if (error) {
+      DVR_WRAPPER_INFO("fail to get seg info (location:%s, seg:%llu), (error:%d)\n",
+        ctx->playback.param_open.location, p_segment_ids[i], error);
+      break;
+    }
+    if (wrapper_segmentHasAV(&seg_info))
+      break;
+  }
+  if (error || i >= segment_nb) {
+    DVR_WRAPPER_INFO("playback(sn:%ld) no segment to start (%d)\n", ctx->sn, error);
+    free(p_segment_ids);
+    return error;
+  }
+
+  error = wrapper_addPlaybackSegment(ctx, &seg_info, p_pids,
+      DVR_PLAYBACK_SEGMENT_DISPLAYABLE | DVR_PLAYBACK_SEGMENT_CONTINUOUS);
+  if (error) {
+    DVR_WRAPPER_WARN("adding playback segment fails");
+    free(p_segment_ids);
+    return error;
+  }
+
+  ctx->playback.reach_end = DVR_FALSE;
+  if ((flags&DVR_PLAYBACK_STARTED_PAUSEDLIVE) == DVR_PLAYBACK_STARTED_PAUSEDLIVE)
+    ctx->playback.speed = 0.0f;
+  else
+    ctx->playback.speed = 100.0f;
+  ctx->playback.pids_req = *p_pids;
+
+  dvr_playback_seek(ctx->playback.player, seg_info.id, 0);
+  error = dvr_playback_start(ctx->playback.player, flags);
+  DVR_WRAPPER_INFO("playback(sn:%ld) fast started at seg:%llu (%d)\n", ctx->sn, seg_info.id, error);
+
+  if (error || i + 1 >= segment_nb) {
+    free(p_segment_ids);
+    return error;
+  }
+
+  loader = (DVR_WrapperPlaybackLoader_t *)calloc(1, sizeof(DVR_WrapperPlaybackLoader_t));
+  if (!loader) {
+    DVR_WRAPPER_ERROR("memory allocation failed");
+    free(p_segment_ids);
+    return DVR_FAILURE;
+  }
+  loader->ctx = ctx;
+  loader->sn = ctx->sn;
+  snprintf(loader->location, sizeof(loader->location), "%s", ctx->playback.param_open.location);
+  loader->pids = *p_pids;
+  loader->segment_ids = p_segment_ids;
+  loader->segment_nb = segment_nb;
+  loader->next = i + 1;
+
+  ctx->playback.loader_stop = DVR_FALSE;
+  ctx->playback.loader_done = DVR_FALSE;
+  if (pthread_create(&ctx->playback.loader_thread, NULL, wrapper_playbackLoader, loader) == 0) {
+    ctx->playback.loader_running = DVR_TRUE;
+    return error;
+  }
+
+  /*no thread, load here*/
+  DVR_WRAPPER_WARN("playback(sn:%ld) fail to create loader, load segments now", ctx->sn);
+  wrapper_loadPlaybackSegments(loader, DVR_TRUE);
+  free(p_segment_ids);
+  free(loader);
+  return error;
+}
+
 static int wrapper_addRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo_t *seg_info)
 {
   DVR_WrapperRecordSegmentInfo_t *p_seg;
@@ -908,17 +1247,17 @@ static int wrapper_addRecordSegment(DVR_WrapperCtx_t *ctx, DVR_RecordSegmentInfo
   if (ctx->record.param_open.is_timeshift ||
       (sn = ctx_isRecord_playing(ctx->record.param_open.location))) {
 
-    DVR_WrapperCtx_t *ctx_playback;
+    DVR_WrapperCtx_t *ctx_playback = NULL;
     if (ctx->record.param_open.is_timeshift)
-      ctx_playback = ctx_getPlayback(sn_timeshift_playback);
-    else
+      sn = ctx_getTimeshiftLinked(ctx);
+    if (sn)
       ctx_playback = ctx_getPlayback(sn);
 
     DVR_WRAPPER_INFO("rec(sn:%ld) add_seg: playback(sn:%ld) add seg\n", ctx->sn, sn);
 
     if (ctx_playback) {
       wrapper_mutex_lock(&ctx_playback->wrapper_lock);
-      if (ctx_valid(ctx_playback)) {
+      if (ctx_valid(ctx_playback) && ctx_playback->sn == sn) {
         DVR_PlaybackSegmentFlag_t flags;
 
         /*only if playback has started, the previous segments have been loaded*/
@@ -1007,17 +1346,30 @@ static int wrapper_removeRecordSegment(DVR_WrapperCtx_t *ctx, DVR_WrapperRecordS
 {
   int error;
   DVR_WrapperRecordSegmentInfo_t *p_seg, *p_seg_tmp;
+  DVR_Bool_t played = DVR_FALSE;
 
   DVR_WRAPPER_INFO("calling %s on record(sn:%ld) segment(%lld) ...",
           __func__, ctx->sn, seg_info->info.id);
 
   /*if timeshifting, notify the playback first, then deal with record*/
   if (ctx->record.param_open.is_timeshift) {
-    DVR_WrapperCtx_t *ctx_playback = ctx_getPlayback(sn_timeshift_playback);
+    unsigned long sn = ctx_getTimeshiftLinked(ctx);
+    DVR_WrapperCtx_t *ctx_playback = sn ? ctx_getPlayback(sn) : NULL;
 
     if (ctx_playback) {
       wrapper_mutex_lock(&ctx_playback->wrapper_lock);
-      if (ctx_playback->current_segment_id == seg_info->info.id && ctx_playback->playback.speed == 100.0f) {
+      if (ctx_valid(ctx_playback) && ctx_playback->sn == sn) {
+        DVR_PlaybackStatus_t play_status;
+
+        /*a paused or trick mode player keeps the file opened too,
+          the player may have changed segment since the last status*/
+        if (ctx_playback->current_segment_id == seg_info->info.id)
+          played = DVR_TRUE;
+        else if (dvr_playback_get_status(ctx_playback->playback.player, &play_status) == DVR_SUCCESS
+          && play_status.segment_id == seg_info->info.id)
+          played = DVR_TRUE;
+      }
+      if (played && ctx_playback->playback.speed == 100.0f) {
           ctx_playback->playback.tf_full = DVR_TRUE;
           DVR_WRAPPER_INFO("%s, cannot remove record(sn:%ld) segment(%lld) for it is being"
             " played on segment(%lld) at speed %f.", __func__, ctx->sn, seg_info->info.id,
@@ -1030,7 +1382,7 @@ static int wrapper_removeRecordSegment(DVR_WrapperCtx_t *ctx, DVR_WrapperRecordS
             ctx_playback->current_segment_id,ctx_playback->playback.speed);
       }
       if (ctx_valid(ctx_playback)
-        && ctx_playback->sn == sn_timeshift_playback
+        && ctx_playback->sn == sn
         && !list_empty(&ctx_playback->segments)) {
         error = wrapper_removePlaybackSegment(ctx_playback, &seg_info->info);
         if (error != DVR_SUCCESS) {
@@ -1058,7 +1410,11 @@ static int wrapper_removeRecordSegment(DVR_WrapperCtx_t *ctx, DVR_WrapperRecordS
     }
   }
 
-  error = dvr_segment_delete(ctx->record.param_open.location, id);
+  /*the files of a segment opened by the player are not written again, they are deleted*/
+  if (ctx->record.param_open.is_timeshift && (ctx->record.param_open.flags & DVR_RECORD_FLAG_RECYCLE) && !played)
+    error = dvr_segment_recycle(ctx->record.param_open.location, id);
+  else
+    error = dvr_segment_delete(ctx->record.param_open.location, id);
 
   DVR_WRAPPER_INFO("%s, removed record(sn:%ld) segment(%lld), ret=(%d)\n",
     __func__, ctx->sn, id, error);
@@ -1071,27 +1427,25 @@ int dvr_wrapper_open_record (DVR_WrapperRecord_t *rec, DVR_WrapperRecordOpenPara
   int error;
   DVR_WrapperCtx_t *ctx;
   DVR_RecordOpenParams_t open_param;
+  unsigned long sn;
 
   DVR_RETURN_IF_FALSE(rec);
   DVR_RETURN_IF_FALSE(params);
 
   /*get a free ctx*/
-  ctx = ctx_getRecord(0);
+  ctx = ctx_new(&record_pool, W_REC);
   DVR_RETURN_IF_FALSE(ctx);
 
-  wrapper_mutex_lock(&ctx->wrapper_lock);
-
   DVR_WRAPPER_INFO("open record(dmx:%d) .is_tf(%d)..time (%ld)ms max size(%lld)byte seg size(%lld)byte\n",
   params->dmx_dev_id, params->is_timeshift, params->max_time, params->max_size, params->segment_size);
 
-  ctx_reset(ctx);
-
   ctx->record.param_open = *params;
   ctx->record.event_fn = params->event_fn;
   ctx->record.event_userdata = params->event_userdata;
 
+  ctx->location_hash = location_hash(params->location);
+
   INIT_LIST_HEAD(&ctx->segments);
-  ctx->sn = get_sn();
 
   wrapper_requestThreadFor(ctx);
 
@@ -1117,17 +1471,23 @@ int dvr_wrapper_open_record (DVR_WrapperRecord_t *rec, DVR_WrapperRecordOpenPara
   }
   open_param.force_sysclock = params->force_sysclock;
   open_param.guarded_segment_size = params->segment_size/2*3;
+  open_param.tail_size = params->tail_size;
+  open_param.tail_time = params->tail_time;
+  open_param.bitrate = params->bitrate;
+  open_param.split_max_delay = params->split_max_delay;
+  open_param.index_interval = params->index_interval;
+  open_param.index_size = params->index_size;
 
   error = dvr_record_open(&ctx->record.recorder, &open_param);
   if (error) {
     DVR_WRAPPER_INFO("record(dmx:%d) open fail(error:%d).\n", params->dmx_dev_id, error);
-    ctx_reset(ctx);
+    sn = ctx->sn;
+    ctx_free(ctx);
     wrapper_mutex_unlock(&ctx->wrapper_lock);
-    wrapper_releaseThreadForType(ctx->type);
+    wrapper_releaseThreadForSn(W_REC, sn);
     return DVR_FAILURE;
   }
-  if (params->is_timeshift)
-    sn_timeshift_record = ctx->sn;
+  ctx_linkTimeshift(ctx);
 
   DVR_WRAPPER_INFO("record(dmx:%d) openned ok(sn:%ld).\n", params->dmx_dev_id, ctx->sn);
 
@@ -1164,16 +1524,15 @@ int dvr_wrapper_close_record (DVR_WrapperRecord_t rec)
 
   error = dvr_record_close(ctx->record.recorder);
 
-  if (ctx->record.param_open.is_timeshift)
-    sn_timeshift_record = 0;
+  ctx_unlinkTimeshift(ctx);
 
   ctx_freeSegments(ctx);
 
   DVR_WRAPPER_INFO("record(sn:%ld) closed = (%d).\n", ctx->sn, error);
-  ctx_reset(ctx);
+  ctx_free(ctx);
   wrapper_mutex_unlock(&ctx->wrapper_lock);
 
-  wrapper_releaseThreadForType(ctx->type);
+  wrapper_releaseThreadForSn(W_REC, (unsigned long)rec);
 
   return error;
 }
@@ -1560,28 +1919,25 @@ int dvr_wrapper_open_playback (DVR_WrapperPlayback_t *playback, DVR_WrapperPlayb
   DVR_WrapperCtx_t *ctx;
   DVR_PlaybackOpenParams_t open_param;
   int error;
+  unsigned long sn;
 
   DVR_RETURN_IF_FALSE(playback);
   DVR_RETURN_IF_FALSE(params);
   DVR_RETURN_IF_FALSE(params->playback_handle);
 
   /*get a free ctx*/
-  ctx = ctx_getPlayback(0);
+  ctx = ctx_new(&playback_pool, W_PLAYBACK);
   DVR_RETURN_IF_FALSE(ctx);
 
-  wrapper_mutex_lock(&ctx->wrapper_lock);
-
   DVR_WRAPPER_INFO("libdvr_api, open_playback (dmx:%d) ..vendor[%d]params->block_size[%d].",
       params->dmx_dev_id, params->vendor, params->block_size);
 
-  ctx_reset(ctx);
-
   ctx->playback.param_open = *params;
   ctx->playback.event_fn = params->event_fn;
   ctx->playback.event_userdata = params->event_userdata;
   ctx->current_segment_id = 0;
   INIT_LIST_HEAD(&ctx->segments);
-  ctx->sn = get_sn();
+  ctx->location_hash = location_hash(params->location);
 
   wrapper_requestThreadFor(ctx);
 
@@ -1607,13 +1963,13 @@ int dvr_wrapper_open_playback (DVR_WrapperPlayback_t *playback, DVR_WrapperPlayb
   error = dvr_playback_open(&ctx->playback.player, &open_param);
   if (error) {
     DVR_WRAPPER_INFO("playback(dmx:%d) openned fail(error:%d).\n", params->dmx_dev_id, error);
-    ctx_reset(ctx);
+    sn = ctx->sn;
+    ctx_free(ctx);
     wrapper_mutex_unlock(&ctx->wrapper_lock);
-    wrapper_releaseThreadForType(ctx->type);
+    wrapper_releaseThreadForSn(W_PLAYBACK, sn);
     return DVR_FAILURE;
   }
-  if (params->is_timeshift)
-    sn_timeshift_playback = ctx->sn;
+  ctx_linkTimeshift(ctx);
 
   DVR_WRAPPER_INFO("playback(dmx:%d) openned ok(sn:%ld).\n", params->dmx_dev_id, ctx->sn);
   error = dvr_playback_set_decrypt_callback(ctx->playback.player, params->crypto_fn, params->crypto_data);
@@ -1636,12 +1992,13 @@ int dvr_wrapper_close_playback (DVR_WrapperPlayback_t playback)
   ctx = ctx_getPlayback((unsigned long)playback);
   DVR_RETURN_IF_FALSE(ctx);
 
+  wrapper_joinPlaybackLoader(ctx, (unsigned long)playback, DVR_TRUE);
+
   wrapper_mutex_lock(&ctx->wrapper_lock);
   DVR_WRAPPER_INFO("libdvr_api, close_playback (sn:%ld)", ctx->sn);
   WRAPPER_RETURN_IF_FALSE_WITH_UNLOCK(ctx_valid(ctx), &ctx->wrapper_lock);
 
-  if (ctx->playback.param_open.is_timeshift)
-    sn_timeshift_playback = 0;
+  ctx_unlinkTimeshift(ctx);
 
   /*try stop first*/
   dvr_playback_stop(ctx->playback.player, DVR_TRUE);
@@ -1665,10 +2022,10 @@ int dvr_wrapper_close_playback (DVR_WrapperPlayback_t playback)
   error = dvr_playback_close(ctx->playback.player);
 
   DVR_WRAPPER_INFO("playback(sn:%ld) closed.\n", ctx->sn);
-  ctx_reset(ctx);
+  ctx_free(ctx);
   wrapper_mutex_unlock(&ctx->wrapper_lock);
 
-  wrapper_releaseThreadForType(ctx->type);
+  wrapper_releaseThreadForSn(W_PLAYBACK, (unsigned long)playback);
 
   return error;
 }
@@ -1683,32 +2040,36 @@ int dvr_wrapper_start_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackFlag
   DVR_RecordSegmentInfo_t seg_info_1st;
   int got_1st_seg=0;
   DVR_WrapperCtx_t *ctx_record;/*for timeshift*/
+  unsigned long sn_record;
   DVR_Bool_t is_timeshift = DVR_FALSE;
   DVR_PlaybackSegmentFlag_t seg_flags = 0;
 
   DVR_RETURN_IF_FALSE(playback);
   DVR_RETURN_IF_FALSE(p_pids);
 
+  ctx = ctx_getPlayback((unsigned long)playback);
+  DVR_RETURN_IF_FALSE(ctx);
+
   ctx_record = NULL;
 
-  /*lock the recorder to avoid changing the recording segments*/
-  ctx_record = ctx_getRecord(sn_timeshift_record);
+  /*lock the recorder linked to this playback to avoid changing the recording segments*/
+  sn_record = ctx_getTimeshiftLinked(ctx);
+  if (sn_record)
+    ctx_record = ctx_getRecord(sn_record);
 
   if (ctx_record) {
     wrapper_mutex_lock(&ctx_record->wrapper_lock);
     if (!ctx_valid(ctx_record)
-      || ctx_record->sn != sn_timeshift_record) {
+      || ctx_record->sn != sn_record) {
       DVR_WRAPPER_INFO("timeshift, record is not for timeshifting, FATAL error found\n");
       wrapper_mutex_unlock(&ctx_record->wrapper_lock);
+      ctx_record = NULL;
       is_timeshift  = DVR_FALSE;
     } else {
       is_timeshift  = DVR_TRUE;
     }
   }
 
-  ctx = ctx_getPlayback((unsigned long)playback);
-  DVR_RETURN_IF_FALSE(ctx);
-
   wrapper_mutex_lock(&ctx->wrapper_lock);
 
   DVR_WRAPPER_INFO("libdvr_api, start_playback (sn:%ld) location:%s"
@@ -1722,7 +2083,12 @@ int dvr_wrapper_start_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackFlag
       p_pids->subtitle.pid, p_pids->subtitle.format,
       p_pids->pcr.pid);
 
-  WRAPPER_RETURN_IF_FALSE_WITH_UNLOCK(ctx_valid(ctx), &ctx->wrapper_lock);
+  if (!ctx_valid(ctx)) {
+    if (ctx_record)
+      wrapper_mutex_unlock(&ctx_record->wrapper_lock);
+    wrapper_mutex_unlock(&ctx->wrapper_lock);
+    return DVR_FAILURE;
+  }
 
   if (ctx->playback.param_open.is_timeshift) {
     /*lock the recorder to avoid changing the recording segments*/
@@ -1736,6 +2102,17 @@ int dvr_wrapper_start_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackFlag
     }
   }
 
+  /*start with the 1st segment and load the others in background,
+    not for timeshift and recording files whose segments are added by the recorder,
+    and not with limit which needs all the segments to seek*/
+  if (!ctx->playback.param_open.is_timeshift
+    && !dvr_playback_check_limit(ctx->playback.player)
+    && !ctx_isPlay_recording(ctx->playback.param_open.location)) {
+    error = wrapper_startPlaybackFast(ctx, flags, p_pids);
+    wrapper_mutex_unlock(&ctx->wrapper_lock);
+    return error;
+  }
+
   /*obtain all segments in a list*/
   segment_nb = 0;
   p_segment_ids = NULL;
@@ -1973,13 +2350,11 @@ int dvr_wrapper_start_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackFlag
     }
   }
 
-  if (ctx->playback.param_open.is_timeshift) {
+  if (ctx_record) {
     /*unlock the recorder locked above*/
-    if (ctx_record && ctx_valid(ctx_record)) {
-        wrapper_mutex_unlock(&ctx_record->wrapper_lock);
-        DVR_WRAPPER_INFO("playback(sn:%ld), record(sn:%ld) unlocked ok due to timeshift\n",
-          ctx->sn, ctx_record->sn);
-    }
+    wrapper_mutex_unlock(&ctx_record->wrapper_lock);
+    DVR_WRAPPER_INFO("playback(sn:%ld), record(sn:%ld) unlocked ok due to timeshift\n",
+      ctx->sn, ctx_record->sn);
   }
   wrapper_mutex_unlock(&ctx->wrapper_lock);
 
@@ -1988,13 +2363,23 @@ int dvr_wrapper_start_playback (DVR_WrapperPlayback_t playback, DVR_PlaybackFlag
 //stop record and playback
 int dvr_wrapper_stop_timeshift (DVR_WrapperPlayback_t playback)
 {
+  DVR_WrapperCtx_t *ctx;
   DVR_WrapperCtx_t *ctx_record = NULL;/*for timeshift*/
+  unsigned long sn_record;
   int error;
   DVR_WRAPPER_INFO("libdvr_api, stop_timeshift");
 
-  //stop timeshift record
-  ctx_record = ctx_getRecord(sn_timeshift_record);
-  dvr_wrapper_stop_record((DVR_WrapperRecord_t)sn_timeshift_record);
+  DVR_RETURN_IF_FALSE(playback);
+
+  ctx = ctx_getPlayback((unsigned long)playback);
+  DVR_RETURN_IF_FALSE(ctx);
+
+  //stop timeshift record linked to this playback
+  sn_record = ctx_getTimeshiftLinked(ctx);
+  if (sn_record) {
+    ctx_record = ctx_getRecord(sn_record);
+    dvr_wrapper_stop_record((DVR_WrapperRecord_t)sn_record);
+  }
 
   DVR_WRAPPER_INFO("stop timeshift ...stop play\n");
   //stop play
@@ -2011,9 +2396,19 @@ int dvr_wrapper_restart_timeshift(DVR_WrapperPlayback_t playback, DVR_PlaybackFl
 {
   DVR_WrapperCtx_t *ctx;
   DVR_RecordStartParams_t *start_param;
+  unsigned long sn_record;
   int error;
 
-  ctx = ctx_getRecord((unsigned long)sn_timeshift_record);
+  DVR_RETURN_IF_FALSE(playback);
+
+  ctx = ctx_getPlayback((unsigned long)playback);
+  DVR_RETURN_IF_FALSE(ctx);
+
+  /*restart the timeshift record linked to this playback*/
+  sn_record = ctx_getTimeshiftLinked(ctx);
+  DVR_RETURN_IF_FALSE(sn_record);
+
+  ctx = ctx_getRecord(sn_record);
   DVR_RETURN_IF_FALSE(ctx);
 
   wrapper_mutex_lock(&ctx->wrapper_lock);
@@ -2108,6 +2503,8 @@ int dvr_wrapper_stop_playback (DVR_WrapperPlayback_t playback)
   ctx = ctx_getPlayback((unsigned long)playback);
   DVR_RETURN_IF_FALSE(ctx);
 
+  wrapper_joinPlaybackLoader(ctx, (unsigned long)playback, DVR_TRUE);
+
   wrapper_mutex_lock(&ctx->wrapper_lock);
   DVR_WRAPPER_INFO("libdvr_api, stop_playback (sn:%ld)", ctx->sn);
   WRAPPER_RETURN_IF_FALSE_WITH_UNLOCK(ctx_valid(ctx), &ctx->wrapper_lock);
@@ -2262,6 +2659,9 @@ int dvr_wrapper_seek_playback (DVR_WrapperPlayback_t playback, uint32_t time_off
   ctx = ctx_getPlayback((unsigned long)playback);
   DVR_RETURN_IF_FALSE(ctx);
 
+  /*the offset is found with the whole segment list*/
+  wrapper_joinPlaybackLoader(ctx, (unsigned long)playback, DVR_FALSE);
+
   wrapper_mutex_lock(&ctx->wrapper_lock);
 
   DVR_WRAPPER_INFO("libdvr_api, seek_playback (sn:%ld) offset:%dms", ctx->sn, time_offset);
@@ -2825,6 +3225,13 @@ static int process_handleRecordEvent(DVR_WrapperEventCtx_t *evt, DVR_WrapperCtx_
 
   DVR_WRAPPER_DEBUG("evt (sn:%ld) 0x%x (state:%d)\n",
       evt->sn, evt->record.event, evt->record.status.state);
+  if (evt->record.event == DVR_RECORD_EVENT_SEGMENT_END) {
+    /*the segment ended after record_startNextSegment returned*/
+    DVR_WRAPPER_INFO("evt (sn:%ld) segment %lld ended, duration:%ld size:%zu\n",
+      evt->sn, evt->record.status.info.id, evt->record.status.info.duration, evt->record.status.info.size);
+    wrapper_updateRecordSegment(ctx, &evt->record.status.info, U_ALL);
+    return 0;
+  }
   if (ctx->record.param_update.segment.segment_id != evt->record.status.info.id) {
     DVR_WRAPPER_INFO("evt (sn:%ld) cur id:0x%x (event id:%d)\n",
     evt->sn, (int)ctx->record.param_update.segment.segment_id, (int)evt->record.status.info.id);
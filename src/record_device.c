@@ -8,6 +8,7 @@
 #include <string.h>
 #include <errno.h>
 #include <poll.h>
+#include <time.h>
 #include <dlfcn.h>
 
 #include <dmx.h>
@@ -16,11 +17,30 @@
 #include "dvr_types.h"
 #include "dvr_utils.h"
 #include "dvb_utils.h"
+#include "dvr_pool.h"
 
-#define MAX_RECORD_DEVICE_COUNT 8
 #define MAX_DEMUX_DEVICE_COUNT 8
 #define MAX_FEND_DEVICE_COUNT 2
 
+/*device nodes, overridden by the benchmark to run on fake devices*/
+#ifndef RECORD_DEVICE_DVR_NAME
+#define RECORD_DEVICE_DVR_NAME "/dev/dvb0.dvr%d"
+#endif
+#ifndef RECORD_DEVICE_DMX_NAME
+#define RECORD_DEVICE_DMX_NAME "/dev/dvb0.demux%d"
+#endif
+
+/*ring buffer size of dvb core when it is not set*/
+#define RECORD_DEVICE_DEFAULT_RING_SIZE (10 * 188 * 1024)
+#define RECORD_DEVICE_MIN_RING_SIZE (188 * 1024)
+#define RECORD_DEVICE_MAX_RING_SIZE (32 * 1024 * 1024)
+/*duration of stream kept by the ring buffer on top of the drain latency, unit on ms*/
+#define RECORD_DEVICE_RING_TIME (2000)
+#define RECORD_DEVICE_MAX_READ_SIZE (1024 * 1024)
+/*the secure demux processes the dvr buffer once this many bytes are written or this time passed*/
+#define RECORD_DEVICE_SECDMX_BATCH_SIZE (188 * 1024)
+#define RECORD_DEVICE_SECDMX_BATCH_TIME (40)
+
 /**\brief DVR record device state*/
 typedef enum {
   RECORD_DEVICE_STATE_OPENED,                                         /**< Record open state*/
@@ -45,26 +65,61 @@ typedef struct {
   int                           fend_dev_id;                           /**< Frontend device id*/
   uint32_t                      dmx_dev_id;                            /**< Record source*/
   size_t                        dvr_buf;
+  uint32_t                      dvr_buf_size;                          /**< Secure dvr buffer size*/
   size_t                        output_handle;                         /**< Secure demux output*/
   pthread_mutex_t               lock;                                  /**< Record device lock*/
   int                           evtfd;                                 /**< eventfd for poll's exit*/
+  int                           dev_no;                                /**< Index of the device in the pool, the async fifo used*/
+  uint32_t                      bitrate;                               /**< Declared service bitrate in bps, 0 if unknown*/
+  uint32_t                      min_read_size;                         /**< Read size floor, the flush size*/
+  DVR_Bool_t                    has_fionread;                          /**< Whether the ring buffer level is given by FIONREAD*/
+  DVR_Bool_t                    grow_pending;                          /**< The ring buffer is to be enlarged, its new size is computed on the next read*/
+  uint32_t                      grow_size;                             /**< Ring buffer size set on the next start, 0 if not enlarged*/
+  uint64_t                      run_bytes;                             /**< Without FIONREAD, bytes of the full reads in a row*/
+  uint64_t                      last_read_time;                        /**< End of the last read, unit on ms*/
+  uint64_t                      first_read_time;                       /**< Start of the first read, unit on ms*/
+  uint64_t                      read_bytes;                            /**< Bytes read since the first read*/
+  Record_DeviceStats_t          stats;                                 /**< Ring buffer statistics*/
 } Record_DeviceContext_t;
 
+/**\brief Secure demux processing state of a sid, shared by the recordings of the sid*/
+typedef struct {
+  uint32_t                      wp;                                    /**< Write pointer of the last processing*/
+  uint64_t                      time;                                  /**< Time of the last processing, unit on ms*/
+} Record_DeviceSecdmx_t;
+
 /*  each sid need one mutex */
 static pthread_mutex_t secdmx_lock[MAX_DEMUX_DEVICE_COUNT] = PTHREAD_MUTEX_INITIALIZER;
+static Record_DeviceSecdmx_t secdmx_state[MAX_DEMUX_DEVICE_COUNT];
 
-static Record_DeviceContext_t record_ctx[MAX_RECORD_DEVICE_COUNT] = {
-  {
-    .state = RECORD_DEVICE_STATE_CLOSED,
-    .fend_dev_id = -1,
-    .lock = PTHREAD_MUTEX_INITIALIZER
-  },
-  {
-    .state = RECORD_DEVICE_STATE_CLOSED,
-    .fend_dev_id = -1,
-    .lock = PTHREAD_MUTEX_INITIALIZER
+/*the lock of a new device is zeroed, which is the same as PTHREAD_MUTEX_INITIALIZER*/
+static DVR_Pool_t device_pool = DVR_POOL_INITIALIZER(Record_DeviceContext_t, 1);
+
+static inline Record_DeviceContext_t *record_device_get_ctx(Record_DeviceHandle_t handle)
+{
+  return (Record_DeviceContext_t *)dvr_pool_get(&device_pool, (uint32_t)(uintptr_t)handle);
+}
+
+/*
+  find another opened device with a dvr buffer, of the same dmx_dev_id or fend_dev_id,
+  and the dvr buffer must be dvr_buf if it is not 0
+*/
+static Record_DeviceContext_t *record_device_find_shared(Record_DeviceContext_t *p_ctx, int by_dmx, size_t dvr_buf)
+{
+  Record_DeviceContext_t *p;
+  int i;
+
+  for (i = 0; i < dvr_pool_size(&device_pool); i++) {
+    p = dvr_pool_get_by_index(&device_pool, i, NULL);
+    if (!p || p == p_ctx || p->state == RECORD_DEVICE_STATE_CLOSED || !p->dvr_buf)
+      continue;
+    if (dvr_buf && p->dvr_buf != dvr_buf)
+      continue;
+    if (by_dmx ? (p->dmx_dev_id == p_ctx->dmx_dev_id) : (p->fend_dev_id == p_ctx->fend_dev_id))
+      return p;
   }
-};
+  return NULL;
+}
 /*define sec dmx function api ptr*/
 static void* secdmx_handle = NULL;
 int (*SECDMX_Init_Ptr)(int ts_clone_enabled);
@@ -120,6 +175,125 @@ static int unload_secdmx_api(void)
   return ret;
 }
 
+static uint64_t record_device_time_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*ring buffer size holding RECORD_DEVICE_RING_TIME plus twice the drain latency of stream*/
+static uint32_t record_device_ring_size_for(uint64_t byte_rate, uint32_t latency)
+{
+  uint64_t size = byte_rate * (RECORD_DEVICE_RING_TIME + 2 * latency) / 1000;
+
+  if (size < RECORD_DEVICE_MIN_RING_SIZE)
+    size = RECORD_DEVICE_MIN_RING_SIZE;
+  if (size > RECORD_DEVICE_MAX_RING_SIZE)
+    size = RECORD_DEVICE_MAX_RING_SIZE;
+  return (uint32_t)((size + 4095) & ~(uint64_t)4095);
+}
+
+/*the statistics are written by the reader only, and read by record_device_get_stats without lock*/
+#define RECORD_DEVICE_STAT_SET(_ctx, _field, _v) \
+  __atomic_store_n(&(_ctx)->stats._field, (_v), __ATOMIC_RELAXED)
+#define RECORD_DEVICE_STAT_GET(_ctx, _field) \
+  __atomic_load_n(&(_ctx)->stats._field, __ATOMIC_RELAXED)
+
+static inline Record_DeviceState_t record_device_get_state(Record_DeviceContext_t *p_ctx)
+{
+  return __atomic_load_n(&p_ctx->state, __ATOMIC_ACQUIRE);
+}
+
+/*the state is changed with the device lock, and read by record_device_read without lock*/
+static inline void record_device_set_state(Record_DeviceContext_t *p_ctx, Record_DeviceState_t state)
+{
+  __atomic_store_n(&p_ctx->state, state, __ATOMIC_RELEASE);
+}
+
+static int record_device_set_ring_size(Record_DeviceContext_t *p_ctx, uint32_t size)
+{
+  if (ioctl(p_ctx->fd, DMX_SET_BUFFER_SIZE, size) == -1) {
+    DVR_INFO("%s set dvr ringbuf size failed (%s) buf_size:%u", __func__, strerror(errno), size);
+    return DVR_FAILURE;
+  }
+  DVR_INFO("%s set dvr%d ringbuf size %u -> %u", __func__, p_ctx->dmx_dev_id, p_ctx->stats.ringbuf_size, size);
+  RECORD_DEVICE_STAT_SET(p_ctx, ringbuf_size, size);
+  return DVR_SUCCESS;
+}
+
+/*called by the reader before reading len bytes*/
+static uint32_t record_device_check_level(Record_DeviceContext_t *p_ctx, size_t len)
+{
+  uint64_t now = record_device_time_ms();
+  int level = 0;
+
+  if (p_ctx->last_read_time && now - p_ctx->last_read_time > p_ctx->stats.drain_latency)
+    RECORD_DEVICE_STAT_SET(p_ctx, drain_latency, (uint32_t)(now - p_ctx->last_read_time));
+  if (!p_ctx->first_read_time)
+    p_ctx->first_read_time = now;
+
+  if (p_ctx->has_fionread && ioctl(p_ctx->fd, FIONREAD, &level) == -1) {
+    DVR_INFO("%s, FIONREAD not supported, use the full reads as level", __func__);
+    p_ctx->has_fionread = DVR_FALSE;
+  }
+  return p_ctx->has_fionread ? (uint32_t)level : 0;
+}
+
+/*called by the reader after len bytes were asked and ret bytes read*/
+static void record_device_update_level(Record_DeviceContext_t *p_ctx, uint32_t level, size_t len, int ret)
+{
+  Record_DeviceStats_t *st = &p_ctx->stats;
+  uint32_t read_size = st->read_size;
+
+  p_ctx->last_read_time = record_device_time_ms();
+  if (ret <= 0)
+    return;
+  p_ctx->read_bytes += ret;
+
+  if (!p_ctx->has_fionread) {
+    /*the full reads in a row and the short one draining the ring buffer
+      read at least the level at the first of them*/
+    p_ctx->run_bytes += ret;
+    level = (p_ctx->run_bytes > UINT32_MAX) ? UINT32_MAX : (uint32_t)p_ctx->run_bytes;
+    if ((size_t)ret < len)
+      p_ctx->run_bytes = 0;
+  }
+
+  if (level > st->peak_level)
+    RECORD_DEVICE_STAT_SET(p_ctx, peak_level, level);
+  if (level >= st->ringbuf_size / 4 * 3 && st->ringbuf_size < RECORD_DEVICE_MAX_RING_SIZE)
+    p_ctx->grow_pending = DVR_TRUE;
+
+  /*more than two reads pending, read more at a time; mostly idle, read less*/
+  if ((size_t)ret == len && level >= 2 * len && read_size < RECORD_DEVICE_MAX_READ_SIZE) {
+    read_size = (read_size * 2 > RECORD_DEVICE_MAX_READ_SIZE) ? RECORD_DEVICE_MAX_READ_SIZE : read_size * 2;
+  } else if ((size_t)ret < len / 4 && read_size > p_ctx->min_read_size) {
+    read_size = (read_size / 2 < p_ctx->min_read_size) ? p_ctx->min_read_size : read_size / 2;
+  }
+  if (read_size != st->read_size)
+    RECORD_DEVICE_STAT_SET(p_ctx, read_size, read_size);
+
+  /*DMX_SET_BUFFER_SIZE drops the data of a running dvr, the size is set on the next start*/
+  if (p_ctx->grow_pending) {
+    uint64_t elapsed = p_ctx->last_read_time - p_ctx->first_read_time;
+    uint64_t byte_rate = p_ctx->bitrate / 8;
+    uint32_t size;
+
+    if (elapsed >= 1000 && p_ctx->read_bytes * 1000 / elapsed > byte_rate)
+      byte_rate = p_ctx->read_bytes * 1000 / elapsed;
+    size = record_device_ring_size_for(byte_rate, st->drain_latency);
+    if (size < st->ringbuf_size * 2)
+      size = st->ringbuf_size * 2;
+    if (size > RECORD_DEVICE_MAX_RING_SIZE)
+      size = RECORD_DEVICE_MAX_RING_SIZE;
+    if (size > __atomic_load_n(&p_ctx->grow_size, __ATOMIC_RELAXED))
+      __atomic_store_n(&p_ctx->grow_size, size, __ATOMIC_RELEASE);
+    p_ctx->grow_pending = DVR_FALSE;
+  }
+}
+
 int add_dvr_pids(Record_DeviceContext_t *p_ctx)
 {
   int i;
@@ -152,10 +326,21 @@ int get_sid(Record_DeviceContext_t *p_ctx)
   }
 }
 
+/*the write pointer of a new buffer or a restarted device starts over*/
+static void reset_secdmx_state(Record_DeviceContext_t *p_ctx)
+{
+  int sid = get_sid(p_ctx);
+
+  pthread_mutex_lock(&secdmx_lock[sid]);
+  memset(&secdmx_state[sid], 0, sizeof(secdmx_state[sid]));
+  pthread_mutex_unlock(&secdmx_lock[sid]);
+}
+
 int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_t *params)
 {
   int i;
   int dev_no;
+  uint32_t handle;
   char dev_name[32];
   int ret;
   char buf[64];
@@ -166,15 +351,14 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
   DVR_RETURN_IF_FALSE(params);
   DVR_RETURN_IF_FALSE(params->dmx_dev_id < MAX_DEMUX_DEVICE_COUNT);
 
-  for (dev_no = 0; dev_no <  MAX_RECORD_DEVICE_COUNT; dev_no++) {
-    if (record_ctx[dev_no].state == RECORD_DEVICE_STATE_CLOSED)
-      break;
-  }
-  DVR_RETURN_IF_FALSE(dev_no < MAX_RECORD_DEVICE_COUNT);
-  DVR_RETURN_IF_FALSE(record_ctx[dev_no].state == RECORD_DEVICE_STATE_CLOSED);
-  p_ctx = &record_ctx[dev_no];
+  p_ctx = dvr_pool_alloc(&device_pool, &handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
+  /*the async fifo is selected by the index in the pool*/
+  dev_no = dvr_pool_handle_index(handle);
 
   pthread_mutex_lock(&p_ctx->lock);
+  record_device_set_state(p_ctx, RECORD_DEVICE_STATE_CLOSED);
+  p_ctx->dev_no = dev_no;
   for (i = 0; i < DVR_MAX_RECORD_PIDS_COUNT; i++) {
     p_ctx->streams[i].is_start = DVR_FALSE;
     p_ctx->streams[i].pid = DVR_INVALID_PID;
@@ -182,22 +366,26 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
   }
   /*Open dvr device*/
   memset(dev_name, 0, sizeof(dev_name));
-  snprintf(dev_name, sizeof(dev_name), "/dev/dvb0.dvr%d", params->dmx_dev_id);
+  snprintf(dev_name, sizeof(dev_name), RECORD_DEVICE_DVR_NAME, params->dmx_dev_id);
   p_ctx->fd = open(dev_name, O_RDONLY);
   if (p_ctx->fd == -1)
   {
     DVR_INFO("%s cannot open \"%s\" (%s)", __func__, dev_name, strerror(errno));
     pthread_mutex_unlock(&p_ctx->lock);
+    dvr_pool_free(&device_pool, handle);
     return DVR_FAILURE;
   }
   if (fcntl(p_ctx->fd, F_SETFL, fcntl(p_ctx->fd, F_GETFL, 0) | O_NONBLOCK, 0) < 0) {
     DVR_ERROR("%s setting non-block flag fails with errno:%d(%s)",
         __func__,errno,strerror(errno));
+    close(p_ctx->fd);
+    p_ctx->fd = -1;
     pthread_mutex_unlock(&p_ctx->lock);
+    dvr_pool_free(&device_pool, handle);
     return DVR_FAILURE;
   }
 
-  p_ctx->evtfd = eventfd(0, 0);
+  p_ctx->evtfd = eventfd(0, EFD_NONBLOCK);
   DVR_INFO("%s, %d fd: %d %p %d %p", __func__, __LINE__, p_ctx->fd, &(p_ctx->fd), p_ctx->evtfd, &(p_ctx->evtfd));
   load_secdmx_api();
   /*Configure flush size*/
@@ -211,19 +399,24 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
       }
     }
   }
-  //set dvbcore ringbuf size
-  {
-      //set del buf size is 10 * 188 *1024
-      int buf_size = params->ringbuf_size;
-      if (buf_size > 0) {
-          ret = ioctl(p_ctx->fd, DMX_SET_BUFFER_SIZE, buf_size);
-          if (ret == -1) {
-            DVR_INFO("%s set dvr ringbuf size failed\"%s\" (%s) buf_size:%d", __func__, dev_name, strerror(errno), buf_size);
-          } else {
-            DVR_INFO("%s set dvr ringbuf size success \"%s\" buf_size:%d", __func__, dev_name, buf_size);
-          }
-      }
-  }
+  p_ctx->dmx_dev_id = params->dmx_dev_id;
+  p_ctx->bitrate = params->bitrate;
+  p_ctx->min_read_size = params->buf_size;
+  p_ctx->has_fionread = DVR_TRUE;
+  p_ctx->grow_pending = DVR_FALSE;
+  p_ctx->grow_size = 0;
+  p_ctx->run_bytes = 0;
+  p_ctx->last_read_time = 0;
+  p_ctx->first_read_time = 0;
+  p_ctx->read_bytes = 0;
+  memset(&p_ctx->stats, 0, sizeof(p_ctx->stats));
+  p_ctx->stats.ringbuf_size = RECORD_DEVICE_DEFAULT_RING_SIZE;
+  p_ctx->stats.read_size = params->buf_size;
+  //set dvbcore ringbuf size, the given size or from the declared bitrate
+  if (params->ringbuf_size > 0)
+    record_device_set_ring_size(p_ctx, params->ringbuf_size);
+  else if (params->bitrate > 0)
+    record_device_set_ring_size(p_ctx, record_device_ring_size_for(params->bitrate / 8, 0));
   memset(buf, 0, sizeof(buf));
   snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_flush_size", dev_no);
   memset(cmd, 0, sizeof(cmd));
@@ -236,7 +429,6 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
   snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_source", dev_no);
   memset(cmd, 0, sizeof(cmd));
   snprintf(cmd, sizeof(cmd), "dmx%d", params->dmx_dev_id);
-  p_ctx->dmx_dev_id = params->dmx_dev_id;
   dvr_file_echo(buf, cmd);
 
   /*Configure Non secure mode*/
@@ -261,8 +453,8 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
   }
   p_ctx->output_handle = (size_t)NULL;
   p_ctx->dvr_buf = (size_t)NULL;
-  p_ctx->state = RECORD_DEVICE_STATE_OPENED;
-  *p_handle = p_ctx;
+  record_device_set_state(p_ctx, RECORD_DEVICE_STATE_OPENED);
+  *p_handle = (Record_DeviceHandle_t)(uintptr_t)handle;
   pthread_mutex_unlock(&p_ctx->lock);
   return DVR_SUCCESS;
 }
@@ -270,16 +462,9 @@ int record_device_open(Record_DeviceHandle_t *p_handle, Record_DeviceOpenParams_
 int record_device_close(Record_DeviceHandle_t handle)
 {
   Record_DeviceContext_t *p_ctx;
-  int i;
 
-  p_ctx = (Record_DeviceContext_t *)handle;
+  p_ctx = record_device_get_ctx(handle);
   DVR_RETURN_IF_FALSE(p_ctx);
-  for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(i < MAX_RECORD_DEVICE_COUNT);
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
 
   pthread_mutex_lock(&p_ctx->lock);
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->state != RECORD_DEVICE_STATE_CLOSED, &p_ctx->lock);
@@ -293,14 +478,7 @@ int record_device_close(Record_DeviceHandle_t handle)
     }
     if (p_ctx->dvr_buf) {
       if (SECDMX_FreeDVRBuffer_Ptr != NULL) {
-    for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-      if (&record_ctx[i] != p_ctx &&
-          record_ctx[i].fend_dev_id == p_ctx->fend_dev_id &&
-          record_ctx[i].dvr_buf == p_ctx->dvr_buf) {
-        break;
-      }
-    }
-    if (i >= MAX_RECORD_DEVICE_COUNT) {
+    if (!record_device_find_shared(p_ctx, 0, p_ctx->dvr_buf)) {
           SECDMX_FreeDVRBuffer_Ptr(p_ctx->fend_dev_id);
     }
     p_ctx->dvr_buf = (size_t)NULL;
@@ -308,9 +486,11 @@ int record_device_close(Record_DeviceHandle_t handle)
     }
   }
   p_ctx->fend_dev_id = -1;
-  p_ctx->state = RECORD_DEVICE_STATE_CLOSED;
+  record_device_set_state(p_ctx, RECORD_DEVICE_STATE_CLOSED);
   pthread_mutex_unlock(&p_ctx->lock);
 
+  dvr_pool_free(&device_pool, (uint32_t)(uintptr_t)handle);
+
   return DVR_SUCCESS;
 }
 
@@ -323,15 +503,9 @@ int record_device_add_pid(Record_DeviceHandle_t handle, int pid)
   char dev_name[32];
   struct dmx_pes_filter_params params;
 
-  p_ctx = (Record_DeviceContext_t *)handle;
+  p_ctx = record_device_get_ctx(handle);
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(pid != DVR_INVALID_PID);
-  for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(i < MAX_RECORD_DEVICE_COUNT);
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
 
   pthread_mutex_lock(&p_ctx->lock);
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->state != RECORD_DEVICE_STATE_CLOSED, &p_ctx->lock);
@@ -344,7 +518,7 @@ int record_device_add_pid(Record_DeviceHandle_t handle, int pid)
 
   p_ctx->streams[i].pid = pid;
   DVR_INFO("%s add pid:%#x", __func__, pid);
-    snprintf(dev_name, sizeof(dev_name), "/dev/dvb0.demux%d", p_ctx->dmx_dev_id);
+    snprintf(dev_name, sizeof(dev_name), RECORD_DEVICE_DMX_NAME, p_ctx->dmx_dev_id);
   fd = open(dev_name, O_RDWR);
   if (fd == -1) {
     DVR_INFO("%s cannot open \"%s\" (%s)", __func__, dev_name, strerror(errno));
@@ -394,15 +568,9 @@ int record_device_remove_pid(Record_DeviceHandle_t handle, int pid)
   int ret;
   int i;
 
-  p_ctx = (Record_DeviceContext_t *)handle;
+  p_ctx = record_device_get_ctx(handle);
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(pid != DVR_INVALID_PID);
-  for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(i < MAX_RECORD_DEVICE_COUNT);
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
 
   pthread_mutex_lock(&p_ctx->lock);
   DVR_RETURN_IF_FALSE_WITH_UNLOCK(p_ctx->state != RECORD_DEVICE_STATE_CLOSED, &p_ctx->lock);
@@ -442,16 +610,11 @@ int record_device_start(Record_DeviceHandle_t handle)
   int fd;
   int ret;
   int i;
+  uint32_t size;
   struct dmx_pes_filter_params params;
 
-  p_ctx = (Record_DeviceContext_t *)handle;
+  p_ctx = record_device_get_ctx(handle);
   DVR_RETURN_IF_FALSE(p_ctx);
-  for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(i < MAX_RECORD_DEVICE_COUNT);
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
 
   pthread_mutex_lock(&p_ctx->lock);
   if (p_ctx->state != RECORD_DEVICE_STATE_OPENED &&
@@ -461,6 +624,11 @@ int record_device_start(Record_DeviceHandle_t handle)
     return DVR_FAILURE;
   }
 
+  /*the dvr is not running, the ring buffer is enlarged as asked by the reads*/
+  size = __atomic_exchange_n(&p_ctx->grow_size, 0, __ATOMIC_ACQ_REL);
+  if (size > p_ctx->stats.ringbuf_size && record_device_set_ring_size(p_ctx, size) == DVR_SUCCESS)
+    RECORD_DEVICE_STAT_SET(p_ctx, grows, p_ctx->stats.grows + 1);
+
   //DVR_RETURN_IF_FALSE_WITH_UNLOCK(DVR_SUCCESS == add_dvr_pids(p_ctx), &p_ctx->lock);
   add_dvr_pids(p_ctx);
 
@@ -496,7 +664,14 @@ int record_device_start(Record_DeviceHandle_t handle)
       p_ctx->streams[i].is_start = DVR_TRUE;
     }
   }
-  p_ctx->state = RECORD_DEVICE_STATE_STARTED;
+  {
+    /*consume the wakeup of the last stop*/
+    uint64_t pad;
+    read(p_ctx->evtfd, &pad, sizeof(pad));
+  }
+  if (p_ctx->output_handle)
+    reset_secdmx_state(p_ctx);
+  record_device_set_state(p_ctx, RECORD_DEVICE_STATE_STARTED);
   pthread_mutex_unlock(&p_ctx->lock);
   return DVR_SUCCESS;
 }
@@ -508,14 +683,8 @@ int record_device_stop(Record_DeviceHandle_t handle)
   int ret;
   int i;
 
-  p_ctx = (Record_DeviceContext_t *)handle;
+  p_ctx = record_device_get_ctx(handle);
   DVR_RETURN_IF_FALSE(p_ctx);
-  for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(i < MAX_RECORD_DEVICE_COUNT);
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
 
   pthread_mutex_lock(&p_ctx->lock);
   if (p_ctx->state != RECORD_DEVICE_STATE_STARTED) {
@@ -544,7 +713,7 @@ int record_device_stop(Record_DeviceHandle_t handle)
       p_ctx->streams[i].is_start = DVR_FALSE;
     }
   }
-  p_ctx->state = RECORD_DEVICE_STATE_STOPPED;
+  record_device_set_state(p_ctx, RECORD_DEVICE_STATE_STOPPED);
   {
     /*wakeup the poll*/
     int64_t pad = 1;
@@ -560,7 +729,7 @@ int record_device_read(Record_DeviceHandle_t handle, void *buf, size_t len, int
   struct pollfd fds[2];
   int ret;
 
-  p_ctx = (Record_DeviceContext_t *)handle;
+  p_ctx = record_device_get_ctx(handle);
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(p_ctx->fd != -1);
   DVR_RETURN_IF_FALSE(buf);
@@ -568,10 +737,10 @@ int record_device_read(Record_DeviceHandle_t handle, void *buf, size_t len, int
 
   memset(fds, 0, sizeof(fds));
 
-  pthread_mutex_lock(&p_ctx->lock);
+  /*the fds are not changed until the device is closed, after the reader stopped,
+    so the read path runs without the device lock held by the control calls*/
   fds[0].fd = p_ctx->fd;
   fds[1].fd = p_ctx->evtfd;
-  pthread_mutex_unlock(&p_ctx->lock);
 
   fds[0].events = fds[1].events = POLLIN | POLLERR;
   ret = poll(fds, 2, timeout);
@@ -584,37 +753,74 @@ int record_device_read(Record_DeviceHandle_t handle, void *buf, size_t len, int
   if (!(fds[0].revents & POLLIN))
     return DVR_FAILURE;
 
-  pthread_mutex_lock(&p_ctx->lock);
-  if (p_ctx->state == RECORD_DEVICE_STATE_STARTED) {
+  if (record_device_get_state(p_ctx) == RECORD_DEVICE_STATE_STARTED) {
+    /*the secure buffers are not in the dvr ring buffer*/
+    DVR_Bool_t track = !p_ctx->dvr_buf;
+    uint32_t level = track ? record_device_check_level(p_ctx, len) : 0;
+
     ret = read(fds[0].fd, buf, len);
+    if (ret < 0 && errno == EOVERFLOW && track) {
+      RECORD_DEVICE_STAT_SET(p_ctx, overflows, p_ctx->stats.overflows + 1);
+      p_ctx->grow_pending = DVR_TRUE;
+      DVR_WARN("%s, dvr%d ring buffer overflow %u, size %u", __func__,
+          p_ctx->dmx_dev_id, p_ctx->stats.overflows, p_ctx->stats.ringbuf_size);
+    }
+    if (track)
+      record_device_update_level(p_ctx, level, len, ret);
     if (ret <= 0) {
       DVR_INFO("%s, %d failed: %s", __func__, __LINE__, strerror(errno));
-      pthread_mutex_unlock(&p_ctx->lock);
       return DVR_FAILURE;
     }
   } else {
       ret = DVR_FAILURE;
   }
-  pthread_mutex_unlock(&p_ctx->lock);
   return ret;
 }
 
+int record_device_wait(Record_DeviceHandle_t handle, int timeout)
+{
+  Record_DeviceContext_t *p_ctx;
+  struct pollfd fds[2];
+  int ret;
+
+  p_ctx = record_device_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_ctx->fd != -1);
+
+  memset(fds, 0, sizeof(fds));
+  fds[0].fd = p_ctx->fd;
+  fds[1].fd = p_ctx->evtfd;
+  fds[0].events = fds[1].events = POLLIN | POLLERR;
+  ret = poll(fds, 2, timeout);
+  DVR_RETURN_IF_FALSE(ret > 0);
+  DVR_RETURN_IF_FALSE(fds[0].revents & POLLIN);
+  DVR_RETURN_IF_FALSE(record_device_get_state(p_ctx) == RECORD_DEVICE_STATE_STARTED);
+  return DVR_SUCCESS;
+}
+
 ssize_t record_device_read_ext(Record_DeviceHandle_t handle, size_t *buf, size_t *len)
 {
   Record_DeviceContext_t *p_ctx;
+  Record_DeviceSecdmx_t *st;
   int result;
   int sid;
   struct dvr_mem_info info;
+  uint32_t advance;
+  uint64_t now;
 
-  p_ctx = (Record_DeviceContext_t *)handle;
+  p_ctx = record_device_get_ctx(handle);
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(buf);
   DVR_RETURN_IF_FALSE(len);
+  /*the secure buffers are set before the device starts and kept until it closes,
+    so the device lock is not needed here*/
   DVR_RETURN_IF_FALSE(p_ctx->dvr_buf);
   DVR_RETURN_IF_FALSE(p_ctx->output_handle);
+  DVR_RETURN_IF_FALSE(record_device_get_state(p_ctx) == RECORD_DEVICE_STATE_STARTED);
 
   sid = get_sid(p_ctx);
-  pthread_mutex_lock(&p_ctx->lock);
+  st = &secdmx_state[sid];
+  now = record_device_time_ms();
 
   /* wp_offset is hw write pointer shared by multiple recordings under one sid,
    * must use mutex for thread safe
@@ -624,42 +830,78 @@ ssize_t record_device_read_ext(Record_DeviceHandle_t handle, size_t *buf, size_t
   result = ioctl(p_ctx->fd, DMX_GET_DVR_MEM, &info);
   //DVR_INFO("sid[%d] fd[%d] wp:%#x\n", sid, p_ctx->fd, info.wp_offset);
   if (result == DVR_SUCCESS) {
-    if (SECDMX_ProcessData_Ptr != NULL)
-      result = SECDMX_ProcessData_Ptr(sid, info.wp_offset);
+    if (info.wp_offset >= st->wp || !p_ctx->dvr_buf_size)
+      advance = info.wp_offset - st->wp;
+    else
+      advance = info.wp_offset + p_ctx->dvr_buf_size - st->wp;
+
+    /*process the advances of the write pointer in batches, a recording of the
+      same sid may have processed them already*/
+    if (advance && (advance >= RECORD_DEVICE_SECDMX_BATCH_SIZE
+          || now - st->time >= RECORD_DEVICE_SECDMX_BATCH_TIME)) {
+      if (SECDMX_ProcessData_Ptr != NULL)
+        result = SECDMX_ProcessData_Ptr(sid, info.wp_offset);
+      if (result == DVR_SUCCESS) {
+        st->wp = info.wp_offset;
+        st->time = now;
+      }
+    }
   }
   if (result) {
     DVR_INFO("result:%#x\n", result);
   }
   pthread_mutex_unlock(&secdmx_lock[sid]);
 
-  DVR_RETURN_IF_FALSE_WITH_UNLOCK(result == DVR_SUCCESS, &p_ctx->lock);
+  DVR_RETURN_IF_FALSE(result == DVR_SUCCESS);
+  /*the output of this recording may be filled by the processing of another one*/
+  *len = 0;
   if (SECDMX_GetOutputBufferStatus_Ptr != NULL)
     result = SECDMX_GetOutputBufferStatus_Ptr(p_ctx->output_handle, buf, len);
   //DVR_INFO("addr:%#x, len:%#x\n", *buf, *len);
-  DVR_RETURN_IF_FALSE_WITH_UNLOCK(result == DVR_SUCCESS, &p_ctx->lock);
+  DVR_RETURN_IF_FALSE(result == DVR_SUCCESS);
 
-  pthread_mutex_unlock(&p_ctx->lock);
   return *len;
 }
 
+uint32_t record_device_get_read_size(Record_DeviceHandle_t handle)
+{
+  Record_DeviceContext_t *p_ctx;
+
+  p_ctx = record_device_get_ctx(handle);
+  if (!p_ctx)
+    return 0;
+
+  return RECORD_DEVICE_STAT_GET(p_ctx, read_size);
+}
+
+int record_device_get_stats(Record_DeviceHandle_t handle, Record_DeviceStats_t *p_stats)
+{
+  Record_DeviceContext_t *p_ctx;
+
+  p_ctx = record_device_get_ctx(handle);
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_stats);
+
+  p_stats->ringbuf_size = RECORD_DEVICE_STAT_GET(p_ctx, ringbuf_size);
+  p_stats->peak_level = RECORD_DEVICE_STAT_GET(p_ctx, peak_level);
+  p_stats->overflows = RECORD_DEVICE_STAT_GET(p_ctx, overflows);
+  p_stats->grows = RECORD_DEVICE_STAT_GET(p_ctx, grows);
+  p_stats->read_size = RECORD_DEVICE_STAT_GET(p_ctx, read_size);
+  p_stats->drain_latency = RECORD_DEVICE_STAT_GET(p_ctx, drain_latency);
+  return DVR_SUCCESS;
+}
+
 int record_device_set_secure_buffer(Record_DeviceHandle_t handle, uint8_t *sec_buf, uint32_t len)
 {
   Record_DeviceContext_t *p_ctx;
-  int i;
   char buf[64];
   char cmd[32];
 
-  p_ctx = (Record_DeviceContext_t *)handle;
+  p_ctx = record_device_get_ctx(handle);
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(sec_buf);
   DVR_RETURN_IF_FALSE(len);
 
-  for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-    if (p_ctx == &record_ctx[i])
-      break;
-  }
-  DVR_RETURN_IF_FALSE(i < MAX_RECORD_DEVICE_COUNT);
-  DVR_RETURN_IF_FALSE(p_ctx == &record_ctx[i]);
 
   pthread_mutex_lock(&p_ctx->lock);
   if (p_ctx->state != RECORD_DEVICE_STATE_OPENED &&
@@ -678,7 +920,7 @@ int record_device_set_secure_buffer(Record_DeviceHandle_t handle, uint8_t *sec_b
     int fd;
     char node[32] = {0};
     memset(node, 0, sizeof(node));
-    snprintf(node, sizeof(node), "/dev/dvb0.demux%d", p_ctx->dmx_dev_id);
+    snprintf(node, sizeof(node), RECORD_DEVICE_DMX_NAME, p_ctx->dmx_dev_id);
     fd = open(node, O_RDONLY);
     if (fd<0) {
       DVR_ERROR("opening %d returns failure. errno:%d, %s", fd, errno, strerror(errno));
@@ -698,42 +940,35 @@ int record_device_set_secure_buffer(Record_DeviceHandle_t handle, uint8_t *sec_b
     DVR_INFO("%s dvr_ts_clone_enable is [%d] ", __func__, dvr_ts_clone_enable());
 
     if (SECDMX_AllocateDVRBuffer_Ptr != NULL) {
-        if (dvr_ts_clone_enable()) {
-            for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-              if (record_ctx[i].state != RECORD_DEVICE_STATE_CLOSED &&
-                  &record_ctx[i] != p_ctx &&
-                  record_ctx[i].dmx_dev_id == p_ctx->dmx_dev_id &&
-                  record_ctx[i].dvr_buf != 0) {
-                DVR_INFO("%s dvr_ts_clone_enable found [%d] ", __func__, i);
-                break;
-              }
-            }
-        } else {
-        for (i = 0; i < MAX_RECORD_DEVICE_COUNT; i++) {
-          if (record_ctx[i].state != RECORD_DEVICE_STATE_CLOSED &&
-              &record_ctx[i] != p_ctx &&
-              record_ctx[i].fend_dev_id == p_ctx->fend_dev_id &&
-              record_ctx[i].dvr_buf != 0) {
-            DVR_INFO("%s Non-dvr_ts_clone_enable found [%d] ", __func__, i);
-            break;
-          }
-        }
+      Record_DeviceContext_t *p_shared;
+
+      if (dvr_ts_clone_enable()) {
+        p_shared = record_device_find_shared(p_ctx, 1, 0);
+        if (p_shared)
+          DVR_INFO("%s dvr_ts_clone_enable found [%d] ", __func__, p_shared->dev_no);
+      } else {
+        p_shared = record_device_find_shared(p_ctx, 0, 0);
+        if (p_shared)
+          DVR_INFO("%s Non-dvr_ts_clone_enable found [%d] ", __func__, p_shared->dev_no);
       }
 
-    if (i >= MAX_RECORD_DEVICE_COUNT) {
+    if (!p_shared) {
       result = SECDMX_AllocateDVRBuffer_Ptr(sid, &len, &dvr_buf);
       if (result != DVR_SUCCESS) {
       //DVR_INFO("%s libdvrFilterTrace close2-1. fd: 0x%x ", __func__, fd);
          close(fd);
       }
       DVR_RETURN_IF_FALSE_WITH_UNLOCK(result == DVR_SUCCESS, &p_ctx->lock);
+      p_ctx->dvr_buf_size = len;
     } else {
-      dvr_buf = record_ctx[i].dvr_buf;
+      dvr_buf = p_shared->dvr_buf;
+      p_ctx->dvr_buf_size = p_shared->dvr_buf_size;
     }
 
     p_ctx->dvr_buf = dvr_buf;
     } else {
     p_ctx->dvr_buf = (size_t)sec_buf;
+    p_ctx->dvr_buf_size = len;
     }
 
     struct dmx_sec_mem sec_mem;
@@ -748,21 +983,22 @@ int record_device_set_secure_buffer(Record_DeviceHandle_t handle, uint8_t *sec_b
     }
     //DVR_INFO("%s libdvrFilterTrace close2-3. fd: 0x%x ", __func__, fd);
     close(fd);
+    reset_secdmx_state(p_ctx);
     pthread_mutex_unlock(&p_ctx->lock);
     return DVR_SUCCESS;
   }
 
   memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_enable", i);
+  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_enable", p_ctx->dev_no);
   dvr_file_echo(buf, "1");
 
   memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_addr", i);
+  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_addr", p_ctx->dev_no);
   snprintf(cmd, sizeof(cmd), "%llu", (uint64_t)sec_buf);
   dvr_file_echo(buf, cmd);
 
   memset(buf, 0, sizeof(buf));
-  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_addr_size", i);
+  snprintf(buf, sizeof(buf), "/sys/class/stb/asyncfifo%d_secure_addr_size", p_ctx->dev_no);
   snprintf(cmd, sizeof(cmd), "%d", len);
   dvr_file_echo(buf, cmd);
 
@@ -1,4 +1,6 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -6,13 +8,18 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <pthread.h>
+#include <time.h>
 #include "dvr_types.h"
 #include "segment.h"
+#include "dvr_live_edge.h"
 
 #define MAX_SEGMENT_FD_COUNT (128)
 #define MAX_SEGMENT_PATH_SIZE (DVR_MAX_LOCATION_SIZE + 32)
 #define MAX_PTS_THRESHOLD (10*1000)
 #define PCR_RECORD_INTERVAL_MS (300)
+/*default data size between two index entries*/
+#define SEGMENT_INDEX_SIZE (1024*1024)
 #define PTS_DISCONTINUED_DEVIATION     (40)
 #define PTS_HEAD_DEVIATION     (40)
 #define PCR_JUMP_DUR     (5000)
@@ -20,14 +27,74 @@
 #define IDX_FILE_SYNC_TIME    (10)//10*PCR_RECORD_INTERVAL_MS
 #define TS_FILE_SYNC_TIME     (9)//9*PCR_RECORD_INTERVAL_MS
 
+/*number of directories remembered as existing*/
+#define MAX_SEGMENT_DIR_CACHE (8)
+
+/*an entry of the index file is kept in memory every stride lines*/
+#define SEGMENT_INDEX_MARK_STRIDE (64)
+/*maximum number of entries kept in memory, the stride is doubled beyond*/
+#define SEGMENT_INDEX_MAX_MARKS   (1024)
+/*time in ms before a missing index file is looked for again, the recorder may create it later*/
+#define SEGMENT_INDEX_RETRY_TIME  (1000)
+
+#define SEGMENT_INFO_MAGIC      (0x49525644)/*"DVRI"*/
+#define SEGMENT_INFO_VERSION    (1)
+/*each copy of the information has its own block, a torn write does not reach the other one*/
+#define SEGMENT_INFO_SLOT_SIZE  (4096)
+/*maximum time in ms the information stays only in the page cache*/
+#define SEGMENT_INFO_SYNC_TIME  (2000)
+/*the ts file is a recycled one, the data past the size are old data*/
+#define SEGMENT_INFO_FLAG_RECYCLED (1)
+
+/*number of recycled ts files written at the same time*/
+#define MAX_SEGMENT_WRITE_ENDS (8)
+
+/**\brief Segment information record of the information files*/
+typedef struct {
+  uint32_t        magic;                              /**< SEGMENT_INFO_MAGIC*/
+  uint16_t        version;                            /**< SEGMENT_INFO_VERSION*/
+  uint16_t        nb_pids;                            /**< Number of pids*/
+  uint32_t        seq;                                /**< Sequence number, the valid copy with the latest one is used*/
+  uint32_t        nb_packets;                         /**< Number of ts packets*/
+  uint64_t        id;                                 /**< Segment id*/
+  int64_t         duration;                           /**< Segment duration in ms*/
+  uint64_t        size;                               /**< Segment size*/
+  struct {
+    uint32_t      type;                               /**< Stream type*/
+    uint32_t      pid;                                /**< PID*/
+  } pids[DVR_MAX_RECORD_PIDS_COUNT];
+  uint32_t        crc;                                /**< CRC32 of the fields above*/
+  uint32_t        flags;                              /**< SEGMENT_INFO_FLAG_*, 0 in the older records, keeps the size a multiple of 8*/
+} Segment_InfoRecord_t;
+
+/**\brief Write position of a recycled ts file being written*/
+typedef struct {
+  char            location[DVR_MAX_LOCATION_SIZE];    /**< Location of the segment, empty if the entry is free*/
+  uint64_t        segment_id;                         /**< Segment id*/
+  loff_t          end;                                /**< End of the data written, the old data follow*/
+} Segment_WriteEnd_t;
+
+
+/**\brief Entry of the index file kept in memory*/
+typedef struct {
+  uint64_t        time;                               /**< Time of the entry*/
+  loff_t          offset;                             /**< Offset of the entry*/
+  long            pos;                                /**< Position of the line in the index file*/
+} Segment_IndexMark_t;
 
 /**\brief Segment context*/
 typedef struct {
   int             ts_fd;                              /**< Segment ts file fd*/
   FILE            *index_fp;                          /**< Time index file fd*/
-  FILE            *dat_fp;                            /**< Information file fd*/
-  FILE            *all_dat_fp;                            /**< Information file fd*/
-  FILE            *ongoing_fp;                        /**< Ongoing file fd, used to verify timeshift mode*/
+  int             dat_fd;                             /**< Information file fd*/
+  int             all_dat_fd;                         /**< All information file fd*/
+  Segment_InfoRecord_t info;                          /**< Last information stored, without seq and crc*/
+  uint32_t        info_seq;                           /**< Sequence number of the last information stored, 0 if none*/
+  uint32_t        info_sync_time;                     /**< Time of the last information sync in ms*/
+  DVR_Bool_t      info_unsynced;                      /**< Information is written after the last sync*/
+  DVR_Bool_t      all_dat_checked;                    /**< The all information file is checked for a torn record*/
+  DVR_Bool_t      ongoing;                            /**< Ongoing file is created, used to verify timeshift mode*/
+  DVR_Bool_t      write;                              /**< Segment is opened in write mode*/
   uint64_t        first_pts;                          /**< First pts value, use for write mode*/
   uint64_t        last_pts;                           /**< Last input pts value, use for write mode*/
   uint64_t        last_record_pts;                    /**< Last record pts value, use for write mode*/
@@ -40,6 +107,23 @@ typedef struct {
   float           avg_rate;
   int             time;
   DVR_Bool_t      force_sysclock;                     /**< If ture, force to use system clock as PVR index time source. If false, libdvr can determine index time source based on actual situation*/
+  uint32_t        index_interval;                     /**< Time in ms between two index entries*/
+  uint32_t        index_size;                         /**< Data size in bytes between two index entries*/
+  Segment_IndexMark_t *marks;                         /**< Index entries kept in memory, one every mark_stride lines*/
+  uint32_t        nb_marks;                           /**< Number of entries in marks*/
+  uint32_t        max_marks;                          /**< Number of entries allocated in marks*/
+  uint32_t        mark_stride;                        /**< Number of index lines between two marks*/
+  uint32_t        index_lines;                        /**< Number of index lines read*/
+  long            index_read_pos;                     /**< Position in the index file of the first line not read*/
+  uint64_t        index_last_time;                    /**< Time of the last index line read*/
+  loff_t          index_last_offset;                  /**< Offset of the last index line read*/
+  DVR_Bool_t      index_unsorted;                     /**< The index is not in the time order, the marks are not used*/
+  DVR_Bool_t      index_missing;                      /**< The index file failed to open, it is not opened again before SEGMENT_INDEX_RETRY_TIME*/
+  uint32_t        index_miss_time;                    /**< Time of the last failed open of the index file in ms*/
+  DVR_Bool_t      recycled;                           /**< Write mode, the ts file is a recycled one written in place*/
+  loff_t          write_end;                          /**< Write mode, end of the data written in the recycled ts file*/
+  loff_t          read_pos;                           /**< Read mode, position in the ts file read with pread, -1 if the file offset is used*/
+  loff_t          end;                                /**< End of the data of a recycled ts file closed, -1 if the data end at the file size*/
  } Segment_Context_t;
 
 /**\brief Segment file type*/
@@ -84,6 +168,22 @@ static void segment_get_fname(char fname[MAX_SEGMENT_PATH_SIZE],
 
 }
 
+/*the files of a removed segment wait under this name to be reused by the next one*/
+static void segment_get_recycle_fname(char fname[MAX_SEGMENT_PATH_SIZE],
+    const char location[DVR_MAX_LOCATION_SIZE],
+    Segment_FileType_t type)
+{
+  const char *ext = ".ts";
+
+  if (type == SEGMENT_FILE_TYPE_INDEX)
+    ext = ".idx";
+  else if (type == SEGMENT_FILE_TYPE_DAT)
+    ext = ".dat";
+
+  memset(fname, 0, MAX_SEGMENT_PATH_SIZE);
+  snprintf(fname, MAX_SEGMENT_PATH_SIZE, "%s-recycle%s", location, ext);
+}
+
 static void segment_get_dirname(char dir_name[MAX_SEGMENT_PATH_SIZE],
     const char location[DVR_MAX_LOCATION_SIZE])
 {
@@ -101,69 +201,531 @@ static void segment_get_dirname(char dir_name[MAX_SEGMENT_PATH_SIZE],
     memcpy(dir_name, location, p - location);
 }
 
+/*directories already checked, so the next segments skip mkdir and access*/
+static char dir_cache[MAX_SEGMENT_DIR_CACHE][MAX_SEGMENT_PATH_SIZE];
+static int dir_cache_next = 0;
+static pthread_mutex_t dir_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int segment_check_dir(const char *location)
+{
+  char dir_name[MAX_SEGMENT_PATH_SIZE];
+  int i, ret;
+
+  memset(dir_name, 0, sizeof(dir_name));
+  segment_get_dirname(dir_name, location);
+
+  pthread_mutex_lock(&dir_cache_lock);
+  for (i = 0; i < MAX_SEGMENT_DIR_CACHE; i++) {
+    if (dir_cache[i][0] && !strcmp(dir_cache[i], dir_name)) {
+      pthread_mutex_unlock(&dir_cache_lock);
+      return DVR_SUCCESS;
+    }
+  }
+  pthread_mutex_unlock(&dir_cache_lock);
+
+  ret = mkdir(dir_name, 0666);
+  if (ret == -1) {
+    DVR_WARN("mkdir of %s returns %d due to errno:%d,%s",
+        dir_name,ret,errno,strerror(errno));
+  }
+  if (access(dir_name, F_OK) == -1) {
+    DVR_ERROR("%s dir %s does not exist", __func__, dir_name);
+    return DVR_FAILURE;
+  }
+
+  pthread_mutex_lock(&dir_cache_lock);
+  snprintf(dir_cache[dir_cache_next], MAX_SEGMENT_PATH_SIZE, "%s", dir_name);
+  dir_cache_next = (dir_cache_next + 1) % MAX_SEGMENT_DIR_CACHE;
+  pthread_mutex_unlock(&dir_cache_lock);
+  return DVR_SUCCESS;
+}
+
+/*forget the directory of a location, it is checked again on the next open*/
+static void segment_uncache_dir(const char *location)
+{
+  char dir_name[MAX_SEGMENT_PATH_SIZE];
+  int i;
+
+  memset(dir_name, 0, sizeof(dir_name));
+  segment_get_dirname(dir_name, location);
+
+  pthread_mutex_lock(&dir_cache_lock);
+  for (i = 0; i < MAX_SEGMENT_DIR_CACHE; i++) {
+    if (!strcmp(dir_cache[i], dir_name))
+      dir_cache[i][0] = 0;
+  }
+  pthread_mutex_unlock(&dir_cache_lock);
+}
+
+static uint32_t segment_time_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+/*open the index file on first use*/
+static FILE *segment_get_index_fp(Segment_Context_t *p_ctx)
+{
+  char fname[MAX_SEGMENT_PATH_SIZE];
+
+  if (p_ctx->index_fp)
+    return p_ctx->index_fp;
+  if (p_ctx->index_missing && segment_time_ms() - p_ctx->index_miss_time < SEGMENT_INDEX_RETRY_TIME)
+    return NULL;
+
+  memset(fname, 0, sizeof(fname));
+  segment_get_fname(fname, p_ctx->location, p_ctx->segment_id, SEGMENT_FILE_TYPE_INDEX);
+  p_ctx->index_fp = fopen(fname, p_ctx->write ? "w+" : "r");
+  if (!p_ctx->index_fp) {
+    DVR_INFO("%s open file failed [%s], reason:%s", __func__, fname, strerror(errno));
+    p_ctx->index_missing = DVR_TRUE;
+    p_ctx->index_miss_time = segment_time_ms();
+  }
+  return p_ctx->index_fp;
+}
+
+/*open the information files on first use*/
+static int segment_get_info_fd(Segment_Context_t *p_ctx, Segment_FileType_t type)
+{
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  int *p_fd;
+  int flags;
+
+  if (type == SEGMENT_FILE_TYPE_DAT) {
+    p_fd = &p_ctx->dat_fd;
+    /*the record left in a recycled file by segment_reset_recycled is kept until the first store*/
+    flags = p_ctx->write ? (O_CREAT | O_RDWR | (p_ctx->recycled ? 0 : O_TRUNC)) : O_RDONLY;
+  } else if (type == SEGMENT_FILE_TYPE_ALL_DATA) {
+    p_fd = &p_ctx->all_dat_fd;
+    flags = p_ctx->write ? (O_CREAT | O_RDWR | O_APPEND) : O_RDONLY;
+  } else {
+    return -1;
+  }
+
+  if (*p_fd != -1)
+    return *p_fd;
+
+  memset(fname, 0, sizeof(fname));
+  segment_get_fname(fname, p_ctx->location, p_ctx->segment_id, type);
+  *p_fd = open(fname, flags, 0644);
+  if (*p_fd == -1) {
+    DVR_INFO("%s open file failed [%s], reason:%s", __func__, fname, strerror(errno));
+  }
+  return *p_fd;
+}
+
+static uint32_t segment_crc32(const uint8_t *p, size_t len)
+{
+  uint32_t crc = 0xffffffff;
+  int i;
+
+  while (len--) {
+    crc ^= *p++;
+    for (i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static void segment_info_to_record(Segment_InfoRecord_t *rec, Segment_StoreInfo_t *p_info)
+{
+  uint32_t i;
+
+  memset(rec, 0, sizeof(*rec));
+  rec->magic = SEGMENT_INFO_MAGIC;
+  rec->version = SEGMENT_INFO_VERSION;
+  rec->nb_pids = (p_info->nb_pids > DVR_MAX_RECORD_PIDS_COUNT) ? DVR_MAX_RECORD_PIDS_COUNT : p_info->nb_pids;
+  rec->nb_packets = p_info->nb_packets;
+  rec->id = p_info->id;
+  rec->duration = p_info->duration;
+  rec->size = p_info->size;
+  for (i = 0; i < rec->nb_pids; i++) {
+    rec->pids[i].type = p_info->pids[i].type;
+    rec->pids[i].pid = p_info->pids[i].pid;
+  }
+}
+
+static void segment_record_seal(Segment_InfoRecord_t *rec, uint32_t seq)
+{
+  rec->seq = seq;
+  rec->crc = segment_crc32((uint8_t *)rec, offsetof(Segment_InfoRecord_t, crc));
+}
+
+static int segment_record_to_info(Segment_InfoRecord_t *rec, Segment_StoreInfo_t *p_info)
+{
+  uint32_t i;
+
+  if (rec->magic != SEGMENT_INFO_MAGIC
+      || rec->version != SEGMENT_INFO_VERSION
+      || rec->nb_pids > DVR_MAX_RECORD_PIDS_COUNT
+      || rec->crc != segment_crc32((uint8_t *)rec, offsetof(Segment_InfoRecord_t, crc)))
+    return DVR_FAILURE;
+
+  if (!p_info)
+    return DVR_SUCCESS;
+
+  p_info->id = rec->id;
+  p_info->nb_pids = rec->nb_pids;
+  for (i = 0; i < rec->nb_pids; i++) {
+    p_info->pids[i].type = rec->pids[i].type;
+    p_info->pids[i].pid = rec->pids[i].pid;
+  }
+  p_info->duration = rec->duration;
+  p_info->size = rec->size;
+  p_info->nb_packets = rec->nb_packets;
+  return DVR_SUCCESS;
+}
+
+/*information files of the previous versions are in text*/
+static DVR_Bool_t segment_info_is_text(int fd)
+{
+  char buf[4];
+
+  return (pread(fd, buf, 3, 0) == 3 && !memcmp(buf, "id=", 3)) ? DVR_TRUE : DVR_FALSE;
+}
+
+/*parse a line of the index file, false if it is not a whole entry*/
+static DVR_Bool_t segment_parse_index_line(const char *buf, uint64_t *p_time, loff_t *p_offset)
+{
+  const char *p1, *p2;
+
+  if (!(p1 = strstr(buf, "time=")) || !(p2 = strstr(buf, "offset=")) || !strchr(p2, '}'))
+    return DVR_FALSE;
+  *p_time = strtoull(p1 + 5, NULL, 10);
+  *p_offset = strtoll(p2 + 7, NULL, 10);
+  return DVR_TRUE;
+}
+
+static void segment_index_add_mark(Segment_Context_t *p_ctx, uint64_t time, loff_t offset, long pos)
+{
+  Segment_IndexMark_t *marks;
+  uint32_t i;
+
+  if (p_ctx->nb_marks == SEGMENT_INDEX_MAX_MARKS) {
+    /*keep one mark of two, the memory used stays bounded on long recordings*/
+    for (i = 0; i < p_ctx->nb_marks / 2; i++)
+      p_ctx->marks[i] = p_ctx->marks[i * 2];
+    p_ctx->nb_marks /= 2;
+    p_ctx->mark_stride *= 2;
+    if (p_ctx->index_lines % p_ctx->mark_stride)
+      return;
+  }
+  if (p_ctx->nb_marks == p_ctx->max_marks) {
+    i = p_ctx->max_marks ? p_ctx->max_marks * 2 : 64;
+    marks = (Segment_IndexMark_t *)realloc(p_ctx->marks, i * sizeof(Segment_IndexMark_t));
+    if (!marks) {
+      p_ctx->index_unsorted = DVR_TRUE;
+      return;
+    }
+    p_ctx->marks = marks;
+    p_ctx->max_marks = i;
+  }
+  p_ctx->marks[p_ctx->nb_marks].time = time;
+  p_ctx->marks[p_ctx->nb_marks].offset = offset;
+  p_ctx->marks[p_ctx->nb_marks].pos = pos;
+  p_ctx->nb_marks++;
+}
+
+/*read the index lines appended since the last call, every mark_stride line is kept in memory*/
+static void segment_index_update(Segment_Context_t *p_ctx)
+{
+  char buf[256];
+  struct stat st;
+  uint64_t time;
+  loff_t offset;
+  size_t len;
+  long pos;
+
+  if (fstat(fileno(p_ctx->index_fp), &st) == -1)
+    return;
+  if (st.st_size < p_ctx->index_read_pos) {
+    /*the index file is written again*/
+    p_ctx->nb_marks = 0;
+    p_ctx->mark_stride = 0;
+    p_ctx->index_read_pos = 0;
+  }
+  if (!p_ctx->mark_stride) {
+    p_ctx->mark_stride = SEGMENT_INDEX_MARK_STRIDE;
+    p_ctx->index_lines = 0;
+    p_ctx->index_unsorted = DVR_FALSE;
+  }
+  if (st.st_size == p_ctx->index_read_pos)
+    return;
+  if (fseek(p_ctx->index_fp, p_ctx->index_read_pos, SEEK_SET) == -1)
+    return;
+
+  pos = p_ctx->index_read_pos;
+  memset(buf, 0, sizeof(buf));
+  while (fgets(buf, sizeof(buf), p_ctx->index_fp) != NULL) {
+    len = strlen(buf);
+    if (!segment_parse_index_line(buf, &time, &offset)) {
+      /*a line being written is read again on the next call*/
+      if (!len || buf[len - 1] != '\n')
+        break;
+      pos += len;
+      continue;
+    }
+    if (p_ctx->index_lines &&
+        (time < p_ctx->index_last_time || offset < p_ctx->index_last_offset))
+      p_ctx->index_unsorted = DVR_TRUE;
+    if (p_ctx->index_lines % p_ctx->mark_stride == 0)
+      segment_index_add_mark(p_ctx, time, offset, pos);
+    p_ctx->index_lines++;
+    p_ctx->index_last_time = time;
+    p_ctx->index_last_offset = offset;
+    pos += len;
+    memset(buf, 0, sizeof(buf));
+  }
+  p_ctx->index_read_pos = pos;
+  /*the next entries are appended at the end*/
+  if (p_ctx->write)
+    fseek(p_ctx->index_fp, 0, SEEK_END);
+}
+
+/*position of the index file where to start looking for a time or an offset,
+  all the lines before it are before the time or the offset*/
+static long segment_index_find(Segment_Context_t *p_ctx, DVR_Bool_t by_time, uint64_t key)
+{
+  Segment_IndexMark_t *mark;
+  uint32_t lo, hi, mid;
+
+  segment_index_update(p_ctx);
+  if (p_ctx->index_unsorted || !p_ctx->nb_marks)
+    return 0;
+
+  /*last mark before the key*/
+  lo = 0;
+  hi = p_ctx->nb_marks;
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    mark = &p_ctx->marks[mid];
+    if (by_time ? (mark->time < key) : (mark->offset < (loff_t)key))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo ? p_ctx->marks[lo - 1].pos : 0;
+}
+
+/*empty the index and rewrite the information of the recycled files before they are renamed,
+  a power cut before the first store leaves an empty segment, not the old data under the new id*/
+static void segment_reset_recycled(const char *location, uint64_t segment_id)
+{
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  Segment_InfoRecord_t rec;
+  Segment_StoreInfo_t info;
+  int fd;
+
+  segment_get_recycle_fname(fname, location, SEGMENT_FILE_TYPE_INDEX);
+  if (truncate(fname, 0) == -1 && errno != ENOENT)
+    DVR_WARN("%s, truncate [%s] failed, reason:%s", __func__, fname, strerror(errno));
+
+  /*a recycled segment with no data, the first store takes the other slot with a later seq*/
+  segment_get_recycle_fname(fname, location, SEGMENT_FILE_TYPE_DAT);
+  fd = open(fname, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+  if (fd == -1)
+    return;
+  memset(&info, 0, sizeof(info));
+  info.id = segment_id;
+  segment_info_to_record(&rec, &info);
+  rec.flags |= SEGMENT_INFO_FLAG_RECYCLED;
+  segment_record_seal(&rec, 0);
+  if (pwrite(fd, &rec, sizeof(rec), SEGMENT_INFO_SLOT_SIZE) != sizeof(rec))
+    DVR_WARN("%s, write [%s] failed, reason:%s", __func__, fname, strerror(errno));
+  fdatasync(fd);
+  close(fd);
+}
+
+/*take the recycled files of the location for a new segment, the ts file is returned opened*/
+static int segment_reuse_recycled(const char *location, uint64_t segment_id, const char *ts_fname)
+{
+  char old_name[MAX_SEGMENT_PATH_SIZE];
+  char new_name[MAX_SEGMENT_PATH_SIZE];
+  Segment_FileType_t types[] = {SEGMENT_FILE_TYPE_INDEX, SEGMENT_FILE_TYPE_DAT};
+  struct stat st;
+  size_t i;
+  int fd;
+
+  segment_get_recycle_fname(old_name, location, SEGMENT_FILE_TYPE_TS);
+  if (access(old_name, F_OK) == -1)
+    return -1;
+
+  /*the index and information files get the new id first, the old data are never under it*/
+  segment_reset_recycled(location, segment_id);
+  for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    segment_get_recycle_fname(old_name, location, types[i]);
+    segment_get_fname(new_name, location, segment_id, types[i]);
+    rename(old_name, new_name);
+  }
+
+  segment_get_recycle_fname(old_name, location, SEGMENT_FILE_TYPE_TS);
+  if (rename(old_name, ts_fname) == -1)
+    return -1;
+
+  fd = open(ts_fname, O_RDWR);
+  if (fd == -1)
+    return -1;
+
+  /*the file keeps its size and its blocks, the new data are written over the old ones.
+    the readers stop at the write position, see segment_get_end*/
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  DVR_INFO("%s, [%s] reused, %lld bytes", __func__, ts_fname, (long long)st.st_size);
+  return fd;
+}
+
+/*write positions of the recycled ts files being written, shared with the readers of the segments*/
+static Segment_WriteEnd_t segment_write_ends[MAX_SEGMENT_WRITE_ENDS];
+static int segment_nb_write_ends = 0;
+static pthread_mutex_t segment_write_end_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static Segment_WriteEnd_t *segment_find_write_end(const char *location, uint64_t segment_id)
+{
+  int i;
+
+  for (i = 0; i < MAX_SEGMENT_WRITE_ENDS; i++) {
+    if (segment_write_ends[i].location[0]
+        && segment_write_ends[i].segment_id == segment_id
+        && !strcmp(segment_write_ends[i].location, location))
+      return &segment_write_ends[i];
+  }
+  return NULL;
+}
+
+/*start sharing the write position of a recycled ts file, failure if too many are written*/
+static int segment_add_write_end(Segment_Context_t *p_ctx)
+{
+  Segment_WriteEnd_t *p_end;
+  int i, ret = DVR_FAILURE;
+
+  pthread_mutex_lock(&segment_write_end_lock);
+  for (i = 0; i < MAX_SEGMENT_WRITE_ENDS; i++) {
+    p_end = &segment_write_ends[i];
+    if (!p_end->location[0]) {
+      snprintf(p_end->location, sizeof(p_end->location), "%s", p_ctx->location);
+      p_end->segment_id = p_ctx->segment_id;
+      p_end->end = 0;
+      __atomic_add_fetch(&segment_nb_write_ends, 1, __ATOMIC_RELEASE);
+      ret = DVR_SUCCESS;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&segment_write_end_lock);
+  return ret;
+}
+
+static void segment_set_write_end(Segment_Context_t *p_ctx, DVR_Bool_t remove)
+{
+  Segment_WriteEnd_t *p_end;
+
+  pthread_mutex_lock(&segment_write_end_lock);
+  p_end = segment_find_write_end(p_ctx->location, p_ctx->segment_id);
+  if (p_end) {
+    p_end->end = p_ctx->write_end;
+    if (remove) {
+      memset(p_end, 0, sizeof(*p_end));
+      __atomic_sub_fetch(&segment_nb_write_ends, 1, __ATOMIC_RELEASE);
+    }
+  }
+  pthread_mutex_unlock(&segment_write_end_lock);
+}
+
+/*end of the data of the ts file, -1 if they end at the file size.
+  the old data of a recycled file are after it*/
+static loff_t segment_get_end(Segment_Context_t *p_ctx)
+{
+  Segment_WriteEnd_t *p_end;
+  loff_t end = p_ctx->end;
+
+  if (p_ctx->recycled)
+    return p_ctx->write_end;
+  /*no recycled file written, no lock on the read path*/
+  if (!__atomic_load_n(&segment_nb_write_ends, __ATOMIC_ACQUIRE))
+    return end;
+
+  pthread_mutex_lock(&segment_write_end_lock);
+  p_end = segment_find_write_end(p_ctx->location, p_ctx->segment_id);
+  if (p_end)
+    end = p_end->end;
+  pthread_mutex_unlock(&segment_write_end_lock);
+  return end;
+}
+
+/*the data of a recycled ts file left without close by a power cut end at the size stored*/
+static void segment_load_end(Segment_Context_t *p_ctx)
+{
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  Segment_InfoRecord_t rec[2];
+  int fd, i, latest = -1;
+
+  memset(fname, 0, sizeof(fname));
+  segment_get_fname(fname, p_ctx->location, p_ctx->segment_id, SEGMENT_FILE_TYPE_DAT);
+  fd = open(fname, O_RDONLY);
+  if (fd == -1)
+    return;
+  for (i = 0; i < 2; i++) {
+    if (pread(fd, &rec[i], sizeof(rec[i]), i * SEGMENT_INFO_SLOT_SIZE) != sizeof(rec[i])
+        || segment_record_to_info(&rec[i], NULL) != DVR_SUCCESS)
+      continue;
+    if (latest == -1 || (int32_t)(rec[i].seq - rec[latest].seq) > 0)
+      latest = i;
+  }
+  close(fd);
+  if (latest != -1 && (rec[latest].flags & SEGMENT_INFO_FLAG_RECYCLED)) {
+    p_ctx->end = rec[latest].size;
+    DVR_INFO("%s, segment %llu of [%s] ends at %lld", __func__,
+        p_ctx->segment_id, p_ctx->location, p_ctx->end);
+  }
+}
+
 int segment_open(Segment_OpenParams_t *params, Segment_Handle_t *p_handle)
 {
   Segment_Context_t *p_ctx;
   char ts_fname[MAX_SEGMENT_PATH_SIZE];
-  char index_fname[MAX_SEGMENT_PATH_SIZE];
-  char dat_fname[MAX_SEGMENT_PATH_SIZE];
-  char all_dat_fname[MAX_SEGMENT_PATH_SIZE];
-  char dir_name[MAX_SEGMENT_PATH_SIZE];
   char going_name[MAX_SEGMENT_PATH_SIZE];
-  int ret = 0;
+  int fd;
 
   DVR_RETURN_IF_FALSE(params);
   DVR_RETURN_IF_FALSE(p_handle);
 
   //DVR_INFO("%s, location:%s, id:%llu", __func__, params->location, params->segment_id);
 
+  if (segment_check_dir(params->location) != DVR_SUCCESS) {
+    *p_handle = NULL;
+    return DVR_FAILURE;
+  }
+
   p_ctx = (void*)malloc(sizeof(Segment_Context_t));
   DVR_RETURN_IF_FALSE(p_ctx);
   memset(p_ctx, 0, sizeof(Segment_Context_t));
+  p_ctx->dat_fd = -1;
+  p_ctx->all_dat_fd = -1;
+  p_ctx->end = -1;
+  p_ctx->read_pos = -1;
 
   memset(ts_fname, 0, sizeof(ts_fname));
   segment_get_fname(ts_fname, params->location, params->segment_id, SEGMENT_FILE_TYPE_TS);
 
-  memset(index_fname, 0, sizeof(index_fname));
-  segment_get_fname(index_fname, params->location, params->segment_id, SEGMENT_FILE_TYPE_INDEX);
-
-  memset(dat_fname, 0, sizeof(dat_fname));
-  segment_get_fname(dat_fname, params->location, params->segment_id, SEGMENT_FILE_TYPE_DAT);
-
-  memset(all_dat_fname, 0, sizeof(all_dat_fname));
-  segment_get_fname(all_dat_fname, params->location, params->segment_id, SEGMENT_FILE_TYPE_ALL_DATA);
-
-
-  memset(going_name, 0, sizeof(going_name));
-  segment_get_fname(going_name, params->location, params->segment_id, SEGMENT_FILE_TYPE_ONGOING);
-
-  memset(dir_name, 0, sizeof(dir_name));
-  segment_get_dirname(dir_name, params->location);
-
-  ret = mkdir(dir_name, 0666);
-  if (ret == -1) {
-    DVR_WARN("mkdir of %s returns %d due to errno:%d,%s",
-        dir_name,ret,errno,strerror(errno));
-  }
-  if (access(dir_name, F_OK) == -1) {
-    DVR_ERROR("%s dir %s does not exist", __func__, dir_name);
-    free(p_ctx);
-    return DVR_FAILURE;
-  }
-
+  /*the index and information files are opened on first use*/
   if (params->mode == SEGMENT_MODE_READ) {
     p_ctx->ts_fd = open(ts_fname, O_RDONLY);
-    p_ctx->index_fp = fopen(index_fname, "r");
-    p_ctx->dat_fp = fopen(dat_fname, "r");
-    p_ctx->ongoing_fp = NULL;
-    p_ctx->all_dat_fp = fopen(all_dat_fname, "r");
   } else if (params->mode == SEGMENT_MODE_WRITE) {
-    p_ctx->ts_fd = open(ts_fname, O_CREAT | O_RDWR | O_TRUNC, 0644);
-    p_ctx->index_fp = fopen(index_fname, "w+");
-    p_ctx->dat_fp = fopen(dat_fname, "w+");
-    p_ctx->all_dat_fp = fopen(all_dat_fname, "a+");
-    DVR_INFO("%s dir %s is opened", __func__, all_dat_fname);
-    p_ctx->ongoing_fp = fopen(going_name, "w+");
+    p_ctx->ts_fd = params->recycle ? segment_reuse_recycled(params->location, params->segment_id, ts_fname) : -1;
+    if (p_ctx->ts_fd == -1)
+      p_ctx->ts_fd = open(ts_fname, O_CREAT | O_RDWR | O_TRUNC, 0644);
+    p_ctx->write = DVR_TRUE;
+    p_ctx->first_pts = ULLONG_MAX;
+    p_ctx->last_pts = ULLONG_MAX;
+    p_ctx->last_record_pts = ULLONG_MAX;
+    p_ctx->avg_rate = 0.0;
+  } else if (params->mode == SEGMENT_MODE_REPAIR) {
+    p_ctx->ts_fd = open(ts_fname, O_RDONLY);
+    p_ctx->write = DVR_TRUE;
     p_ctx->first_pts = ULLONG_MAX;
     p_ctx->last_pts = ULLONG_MAX;
     p_ctx->last_record_pts = ULLONG_MAX;
@@ -171,38 +733,76 @@ int segment_open(Segment_OpenParams_t *params, Segment_Handle_t *p_handle)
   } else {
     DVR_INFO("%s, unknown mode use default", __func__);
     p_ctx->ts_fd = open(ts_fname, O_RDONLY);
-    p_ctx->index_fp = fopen(index_fname, "r");
-    p_ctx->dat_fp = fopen(dat_fname, "r");
-    p_ctx->all_dat_fp = fopen(all_dat_fname, "r");
-    p_ctx->ongoing_fp = NULL;
-  }
-
-  if (p_ctx->ts_fd == -1 || !p_ctx->index_fp || !p_ctx->dat_fp) {
-    DVR_INFO("%s open file failed [%s, %s, %s], reason:%s", __func__,
-        ts_fname, index_fname, dat_fname, strerror(errno));
-    if (p_ctx->ts_fd != -1)
-      close(p_ctx->ts_fd);
-    if (p_ctx->index_fp)
-      fclose(p_ctx->index_fp);
-    if (p_ctx->dat_fp)
-      fclose(p_ctx->dat_fp);
-    if (p_ctx->all_dat_fp)
-      fclose(p_ctx->all_dat_fp);
-    if (p_ctx->ongoing_fp)
-      fclose(p_ctx->ongoing_fp);
+  }
+
+  if (p_ctx->ts_fd == -1) {
+    DVR_INFO("%s open file failed [%s], reason:%s", __func__,
+        ts_fname, strerror(errno));
+    if (errno == ENOENT && params->mode == SEGMENT_MODE_WRITE)
+      segment_uncache_dir(params->location);
     free(p_ctx);
     *p_handle = NULL;
     return DVR_FAILURE;
   }
+
+  if (params->mode == SEGMENT_MODE_WRITE) {
+    /*only the existence of the ongoing file is checked, no need to keep it opened*/
+    memset(going_name, 0, sizeof(going_name));
+    segment_get_fname(going_name, params->location, params->segment_id, SEGMENT_FILE_TYPE_ONGOING);
+    fd = open(going_name, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd != -1) {
+      close(fd);
+      p_ctx->ongoing = DVR_TRUE;
+    }
+  } else if (params->mode == SEGMENT_MODE_REPAIR) {
+    /*the recording is over, an ongoing file left by a power cut is removed*/
+    memset(going_name, 0, sizeof(going_name));
+    segment_get_fname(going_name, params->location, params->segment_id, SEGMENT_FILE_TYPE_ONGOING);
+    unlink(going_name);
+  }
+
   p_ctx->segment_id = params->segment_id;
   strncpy(p_ctx->location, params->location, strlen(params->location)+1);
   p_ctx->force_sysclock = params->force_sysclock;
 
+  if (params->mode == SEGMENT_MODE_WRITE && params->recycle && lseek(p_ctx->ts_fd, 0, SEEK_END) > 0) {
+    /*a recycled file, the old data past the write position are not read*/
+    if (segment_add_write_end(p_ctx) == DVR_SUCCESS) {
+      p_ctx->recycled = DVR_TRUE;
+    } else if (ftruncate(p_ctx->ts_fd, 0) == -1) {
+      DVR_ERROR("%s, truncate [%s] failed, reason:%s", __func__, ts_fname, strerror(errno));
+    }
+    lseek(p_ctx->ts_fd, 0, SEEK_SET);
+  } else if (params->mode != SEGMENT_MODE_WRITE) {
+    segment_load_end(p_ctx);
+  }
+  if (!p_ctx->write)
+    p_ctx->read_pos = 0;
+  p_ctx->index_interval = params->index_interval ? params->index_interval : PCR_RECORD_INTERVAL_MS;
+  p_ctx->index_size = params->index_size ? params->index_size : SEGMENT_INDEX_SIZE;
+
   //DVR_INFO("%s, open file success p_ctx->location [%s]", __func__, p_ctx->location, params->mode);
   *p_handle = (Segment_Handle_t)p_ctx;
   return DVR_SUCCESS;
 }
 
+/*On close, write the last pts skipped by the index interval, so the index covers all data*/
+static void segment_index_flush(Segment_Context_t *p_ctx)
+{
+  if (!p_ctx->write || !p_ctx->index_fp)
+    return;
+  if (p_ctx->last_record_pts == ULLONG_MAX ||
+      p_ctx->last_pts == p_ctx->last_record_pts ||
+      p_ctx->last_offset <= p_ctx->last_record_offset)
+    return;
+
+  fseek(p_ctx->index_fp, 0, SEEK_END);
+  fprintf(p_ctx->index_fp, "\n{time=%llu, offset=%lld}", p_ctx->cur_time, p_ctx->last_offset);
+  fflush(p_ctx->index_fp);
+  p_ctx->last_record_pts = p_ctx->last_pts;
+  p_ctx->last_record_offset = p_ctx->last_offset;
+}
+
 int segment_close(Segment_Handle_t handle)
 {
   Segment_Context_t *p_ctx;
@@ -211,21 +811,30 @@ int segment_close(Segment_Handle_t handle)
   DVR_RETURN_IF_FALSE(p_ctx);
 
   if (p_ctx->ts_fd != -1) {
+    if (p_ctx->recycled) {
+      /*the old data past the end are removed, the blocks of the new data are kept*/
+      if (ftruncate(p_ctx->ts_fd, p_ctx->write_end) == -1)
+        DVR_ERROR("%s, truncate segment %llu failed, reason:%s", __func__,
+            p_ctx->segment_id, strerror(errno));
+      segment_set_write_end(p_ctx, DVR_TRUE);
+    }
     close(p_ctx->ts_fd);
   }
 
   if (p_ctx->index_fp) {
+    segment_index_flush(p_ctx);
     fclose(p_ctx->index_fp);
   }
 
-  if (p_ctx->dat_fp) {
-    fclose(p_ctx->dat_fp);
+  if (p_ctx->dat_fd != -1) {
+    if (p_ctx->info_unsynced)
+      fdatasync(p_ctx->dat_fd);
+    close(p_ctx->dat_fd);
   }
-  if (p_ctx->all_dat_fp) {
-    fclose(p_ctx->all_dat_fp);
+  if (p_ctx->all_dat_fd != -1) {
+    close(p_ctx->all_dat_fd);
   }
-  if (p_ctx->ongoing_fp != NULL) {
-    fclose(p_ctx->ongoing_fp);
+  if (p_ctx->ongoing) {
     char going_name[MAX_SEGMENT_PATH_SIZE];
     memset(going_name, 0, sizeof(going_name));
     segment_get_fname(going_name, p_ctx->location, p_ctx->segment_id, SEGMENT_FILE_TYPE_ONGOING);
@@ -233,19 +842,65 @@ int segment_close(Segment_Handle_t handle)
     unlink(going_name);
   }
 
+  free(p_ctx->marks);
   free(p_ctx);
   return 0;
 }
 
+/*position in the ts file, tracked in read mode so the reads do not seek*/
+static loff_t segment_get_pos(Segment_Context_t *p_ctx)
+{
+  if (p_ctx->read_pos >= 0)
+    return p_ctx->read_pos;
+  return lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+}
+
+static loff_t segment_set_pos(Segment_Context_t *p_ctx, loff_t pos)
+{
+  if (p_ctx->read_pos < 0)
+    return lseek(p_ctx->ts_fd, pos, SEEK_SET);
+  if (pos < 0)
+    return -1;
+  p_ctx->read_pos = pos;
+  return pos;
+}
+
 ssize_t segment_read(Segment_Handle_t handle, void *buf, size_t count)
 {
   Segment_Context_t *p_ctx;
+  DVR_Bool_t tail;
   ssize_t len;
+  loff_t end, pos;
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(buf);
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
-  len = read(p_ctx->ts_fd, buf, count);
+
+  /*the old data of a recycled file are not read*/
+  end = segment_get_end(p_ctx);
+  tail = dvr_live_edge_tail_count() ? DVR_TRUE : DVR_FALSE;
+  pos = p_ctx->read_pos;
+  if (pos < 0 && count > 0 && (end >= 0 || tail))
+    pos = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+  if (end >= 0 && count > 0) {
+    if (pos >= end)
+      return 0;
+    if (pos >= 0 && (loff_t)count > end - pos)
+      count = end - pos;
+  }
+
+  /*data still in the live tail of the recorder are read from memory*/
+  if (tail && count > 0 && pos >= 0) {
+    len = dvr_live_edge_tail_read(p_ctx->location, p_ctx->segment_id, pos, buf, count);
+    if (len > 0 && segment_set_pos(p_ctx, pos + len) == pos + len)
+      return len;
+  }
+
+  if (p_ctx->read_pos < 0)
+    return read(p_ctx->ts_fd, buf, count);
+  len = pread(p_ctx->ts_fd, buf, count, p_ctx->read_pos);
+  if (len > 0)
+    p_ctx->read_pos += len;
   return len;
 }
 
@@ -258,6 +913,14 @@ ssize_t segment_write(Segment_Handle_t handle, void *buf, size_t count)
   DVR_RETURN_IF_FALSE(buf);
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
   len = write(p_ctx->ts_fd, buf, count);
+  if (p_ctx->recycled && len > 0) {
+    loff_t pos = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+
+    if (pos > p_ctx->write_end) {
+      p_ctx->write_end = pos;
+      segment_set_write_end(p_ctx, DVR_FALSE);
+    }
+  }
   /*remove the fsync, use /proc to control the data writeback*/
   //if (p_ctx->time % TS_FILE_SYNC_TIME == 0)
   //  fsync(p_ctx->ts_fd);
@@ -272,7 +935,7 @@ int segment_update_pts_force(Segment_Handle_t handle, uint64_t pts, loff_t offse
 
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(segment_get_index_fp(p_ctx));
 
   if (p_ctx->first_pts == ULLONG_MAX) {
     DVR_INFO("%s first pcr:%llu", __func__, pts);
@@ -315,6 +978,19 @@ int segment_update_pts_force(Segment_Handle_t handle, uint64_t pts, loff_t offse
   return DVR_SUCCESS;
 }
 
+/*check if an index entry is due, the entries follow the data size on high bitrates
+  and are sparser on low bitrates, the time between two entries stays bounded*/
+static DVR_Bool_t segment_index_due(Segment_Context_t *p_ctx, int time_diff, loff_t size_diff)
+{
+  int interval = p_ctx->index_interval;
+
+  if (time_diff > interval * 10)
+    return DVR_TRUE;
+  if (time_diff > interval)
+    return (size_diff >= p_ctx->index_size / 64) ? DVR_TRUE : DVR_FALSE;
+  return (time_diff > interval / 8 && size_diff >= p_ctx->index_size) ? DVR_TRUE : DVR_FALSE;
+}
+
 int segment_update_pts(Segment_Handle_t handle, uint64_t pts, loff_t offset)
 {
   Segment_Context_t *p_ctx;
@@ -323,7 +999,7 @@ int segment_update_pts(Segment_Handle_t handle, uint64_t pts, loff_t offset)
 
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(segment_get_index_fp(p_ctx));
 
   if (p_ctx->first_pts == ULLONG_MAX) {
     DVR_INFO("%s first pcr:%llu", __func__, pts);
@@ -376,7 +1052,8 @@ int segment_update_pts(Segment_Handle_t handle, uint64_t pts, loff_t offset)
 
   record_diff = pts - p_ctx->last_record_pts;
   if (strlen(buf) > 0 &&
-      (record_diff > PCR_RECORD_INTERVAL_MS || p_ctx->last_record_pts == ULLONG_MAX)){
+      (p_ctx->last_record_pts == ULLONG_MAX ||
+       segment_index_due(p_ctx, record_diff, offset - p_ctx->last_record_offset))) {
     fputs(buf, p_ctx->index_fp);
     fflush(p_ctx->index_fp);
     p_ctx->time++;
@@ -409,18 +1086,18 @@ loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size)
 
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(segment_get_index_fp(p_ctx));
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
 
   if (time == 0) {
     offset = 0;
     DVR_INFO("seek time=%llu, offset=%lld time--%llu\n", pts, offset, time);
-    DVR_RETURN_IF_FALSE(lseek(p_ctx->ts_fd, offset, SEEK_SET) != -1);
+    DVR_RETURN_IF_FALSE(segment_set_pos(p_ctx, offset) != -1);
     return offset;
   }
 
   memset(buf, 0, sizeof(buf));
-  ret = fseek(p_ctx->index_fp, 0, SEEK_SET);
+  ret = fseek(p_ctx->index_fp, segment_index_find(p_ctx, DVR_TRUE, time), SEEK_SET);
   DVR_RETURN_IF_FALSE(ret != -1);
   int line = 0;
   while (fgets(buf, sizeof(buf), p_ctx->index_fp) != NULL) {
@@ -453,7 +1130,7 @@ loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size)
         offset = offset - offset%block_size;
       }
       //DVR_INFO("seek time=%llu, offset=%lld time--%llu line %d\n", pts, offset, time, line);
-      DVR_RETURN_IF_FALSE(lseek(p_ctx->ts_fd, offset, SEEK_SET) != -1);
+      DVR_RETURN_IF_FALSE(segment_set_pos(p_ctx, offset) != -1);
       return offset;
     }
   }
@@ -462,13 +1139,25 @@ loff_t segment_seek(Segment_Handle_t handle, uint64_t time, int block_size)
       offset = offset - offset%block_size;
     }
     DVR_INFO("seek time=%llu, offset=%lld time--%llu line %d end\n", pts, offset, time, line);
-    DVR_RETURN_IF_FALSE(lseek(p_ctx->ts_fd, offset, SEEK_SET) != -1);
+    DVR_RETURN_IF_FALSE(segment_set_pos(p_ctx, offset) != -1);
     return offset;
   }
   DVR_INFO("seek error line [%d]", line);
   return DVR_FAILURE;
 }
 
+loff_t segment_seek_position(Segment_Handle_t handle, loff_t position)
+{
+  Segment_Context_t *p_ctx;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
+  DVR_RETURN_IF_FALSE(position >= 0);
+
+  return segment_set_pos(p_ctx, position);
+}
+
 loff_t segment_tell_position(Segment_Handle_t handle)
 {
   Segment_Context_t *p_ctx;
@@ -476,7 +1165,7 @@ loff_t segment_tell_position(Segment_Handle_t handle)
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
-  pos = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+  pos = segment_get_pos(p_ctx);
   return pos;
 }
 
@@ -495,13 +1184,13 @@ loff_t segment_tell_position_time(Segment_Handle_t handle, loff_t position)
 
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(segment_get_index_fp(p_ctx));
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd);
 
+  DVR_RETURN_IF_FALSE(position != -1);
   memset(buf, 0, sizeof(buf));
-  ret2 = fseek(p_ctx->index_fp, 0, SEEK_SET);
+  ret2 = fseek(p_ctx->index_fp, segment_index_find(p_ctx, DVR_FALSE, position), SEEK_SET);
   DVR_RETURN_IF_FALSE(ret2 != -1);
-  DVR_RETURN_IF_FALSE(position != -1);
 
   while (fgets(buf, sizeof(buf), p_ctx->index_fp) != NULL) {
     memset(value, 0, sizeof(value));
@@ -554,14 +1243,14 @@ loff_t segment_tell_current_time(Segment_Handle_t handle)
 
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(segment_get_index_fp(p_ctx));
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd);
 
+  position = segment_get_pos(p_ctx);
+  DVR_RETURN_IF_FALSE(position != -1);
   memset(buf, 0, sizeof(buf));
-  ret = fseek(p_ctx->index_fp, 0, SEEK_SET);
+  ret = fseek(p_ctx->index_fp, segment_index_find(p_ctx, DVR_FALSE, position), SEEK_SET);
   DVR_RETURN_IF_FALSE(ret != -1);
-  position = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
-  DVR_RETURN_IF_FALSE(position != -1);
 
   while (fgets(buf, sizeof(buf), p_ctx->index_fp) != NULL) {
     memset(value, 0, sizeof(value));
@@ -606,12 +1295,12 @@ loff_t segment_tell_total_time(Segment_Handle_t handle)
 
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(segment_get_index_fp(p_ctx));
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd);
 
   memset(buf, 0, sizeof(buf));
   memset(last_buf, 0, sizeof(last_buf));
-  position = lseek(p_ctx->ts_fd, 0, SEEK_CUR);
+  position = segment_get_pos(p_ctx);
   DVR_RETURN_IF_FALSE(position != -1);
 
   // if unable to seek from end, it is necessary to seek to file beginning position.
@@ -649,140 +1338,77 @@ loff_t segment_tell_total_time(Segment_Handle_t handle)
     }
     offset = strtoull(value, NULL, 10);
   }
+  /*the data after the last entry are only indexed on close*/
+  if (p_ctx->write && p_ctx->last_pts != ULLONG_MAX &&
+      (pts == ULLONG_MAX || p_ctx->cur_time > pts))
+    pts = p_ctx->cur_time;
   //if (line < 2)
   //DVR_INFO("totle time=%llu, offset=%lld, position=%lld, line:%d\n", pts, offset, position, line);
   return (pts == ULLONG_MAX ? DVR_FAILURE : pts);
 }
 
-/* Should consider the case of cut power, todo... */
-int segment_store_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
-{
-  Segment_Context_t *p_ctx;
-  char buf[256];
-  uint32_t i;
-  int ret = 0;
-
-  p_ctx = (Segment_Context_t *)handle;
-  DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->dat_fp);
-  DVR_RETURN_IF_FALSE(p_info);
-  // seek to 0 to rewrite info
-  ret = fseek(p_ctx->dat_fp, 0, SEEK_SET);
-  DVR_RETURN_IF_FALSE(ret != -1);
-
-  /*Save segment id*/
-  memset(buf, 0, sizeof(buf));
-  sprintf(buf, "id=%lld\n", p_info->id);
-  fputs(buf, p_ctx->dat_fp);
-
-  /*Save number of pids*/
-  memset(buf, 0, sizeof(buf));
-  sprintf(buf, "nb_pids=%d\n", p_info->nb_pids);
-  fputs(buf, p_ctx->dat_fp);
-
-  /*Save pid information*/
-  for (i = 0; i < p_info->nb_pids; i++) {
-    memset(buf, 0, sizeof(buf));
-    sprintf(buf, "{pid=%d, type=%d}\n", p_info->pids[i].pid, p_info->pids[i].type);
-    fputs(buf, p_ctx->dat_fp);
-  }
-
-  /*Save segment duration*/
-  memset(buf, 0, sizeof(buf));
-  sprintf(buf, "duration=%ld\n", p_info->duration);
-  fputs(buf, p_ctx->dat_fp);
-
-  /*Save segment size*/
-  memset(buf, 0, sizeof(buf));
-  sprintf(buf, "size=%zu\n", p_info->size);
-  fputs(buf, p_ctx->dat_fp);
-
-  /*Save number of packets*/
-  memset(buf, 0, sizeof(buf));
-  sprintf(buf, "nb_packets=%d\n", p_info->nb_packets);
-  fputs(buf, p_ctx->dat_fp);
-
-  fflush(p_ctx->dat_fp);
-  //fsync(fileno(p_ctx->dat_fp));
-  return DVR_SUCCESS;
-}
-
-/* Should consider the case of cut power, todo... */
-int segment_store_allInfo(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
+/*append the information in text to a file of a previous version*/
+static int segment_print_info(int fd, Segment_StoreInfo_t *p_info)
 {
-  Segment_Context_t *p_ctx;
+  FILE *fp;
   char buf[256];
   uint32_t i;
-  int ret = 0;
 
-  p_ctx = (Segment_Context_t *)handle;
-  DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->all_dat_fp);
-  DVR_RETURN_IF_FALSE(p_info);
-
-  //seek to end to append info
-  ret = fseek(p_ctx->all_dat_fp, 0, SEEK_END);
-  DVR_RETURN_IF_FALSE(ret != -1);
+  fp = fdopen(dup(fd), "a");
+  DVR_RETURN_IF_FALSE(fp);
 
   /*Save segment id*/
   memset(buf, 0, sizeof(buf));
   sprintf(buf, "id=%lld\n", p_info->id);
-  fputs(buf, p_ctx->all_dat_fp);
+  fputs(buf, fp);
 
   /*Save number of pids*/
   memset(buf, 0, sizeof(buf));
   sprintf(buf, "nb_pids=%d\n", p_info->nb_pids);
-  fputs(buf, p_ctx->all_dat_fp);
+  fputs(buf, fp);
 
   /*Save pid information*/
   for (i = 0; i < p_info->nb_pids; i++) {
     memset(buf, 0, sizeof(buf));
     sprintf(buf, "{pid=%d, type=%d}\n", p_info->pids[i].pid, p_info->pids[i].type);
-    fputs(buf, p_ctx->all_dat_fp);
+    fputs(buf, fp);
   }
 
   /*Save segment duration*/
   memset(buf, 0, sizeof(buf));
   sprintf(buf, "duration=%ld\n", p_info->duration);
-  fputs(buf, p_ctx->all_dat_fp);
+  fputs(buf, fp);
 
   /*Save segment size*/
   memset(buf, 0, sizeof(buf));
   sprintf(buf, "size=%zu\n", p_info->size);
-  fputs(buf, p_ctx->all_dat_fp);
+  fputs(buf, fp);
 
   /*Save number of packets*/
   memset(buf, 0, sizeof(buf));
   sprintf(buf, "nb_packets=%d\n", p_info->nb_packets);
-  fputs(buf, p_ctx->all_dat_fp);
+  fputs(buf, fp);
 
-  fflush(p_ctx->all_dat_fp);
-  //fsync(fileno(p_ctx->all_dat_fp));
+  fclose(fp);
   return DVR_SUCCESS;
 }
 
-/* Should consider the case of cut power, todo... */
-int segment_load_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
+static int segment_parse_info(FILE *fp, Segment_StoreInfo_t *p_info)
 {
-  Segment_Context_t *p_ctx;
   uint32_t i;
   char buf[256];
   char value[256];
   char *p1, *p2;
 
-  p_ctx = (Segment_Context_t *)handle;
-  DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_info);
-
   /*Load segment id*/
-  p1 = fgets(buf, sizeof(buf), p_ctx->dat_fp);
+  p1 = fgets(buf, sizeof(buf), fp);
   DVR_RETURN_IF_FALSE(p1);
   p1 = strstr(buf, "id=");
   DVR_RETURN_IF_FALSE(p1);
   p_info->id = strtoull(p1 + 3, NULL, 10);
 
   /*Save number of pids*/
-  p1 = fgets(buf, sizeof(buf), p_ctx->dat_fp);
+  p1 = fgets(buf, sizeof(buf), fp);
   DVR_RETURN_IF_FALSE(p1);
   p1 = strstr(buf, "nb_pids=");
   DVR_RETURN_IF_FALSE(p1);
@@ -794,7 +1420,7 @@ int segment_load_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
   // just suppress it here.
   // coverity[tainted_data]
   for (i = 0; i < p_info->nb_pids; i++) {
-    p1 = fgets(buf, sizeof(buf), p_ctx->dat_fp);
+    p1 = fgets(buf, sizeof(buf), fp);
     DVR_RETURN_IF_FALSE(p1);
     memset(value, 0, sizeof(value));
     if ((p1 = strstr(buf, "pid="))) {
@@ -820,7 +1446,7 @@ int segment_load_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
   }
 
   /*Save segment duration*/
-  p1 = fgets(buf, sizeof(buf), p_ctx->dat_fp);
+  p1 = fgets(buf, sizeof(buf), fp);
   DVR_RETURN_IF_FALSE(p1);
   p1 = strstr(buf, "duration=");
   DVR_RETURN_IF_FALSE(p1);
@@ -828,14 +1454,14 @@ int segment_load_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
   //DVR_INFO("load info p_info->duration:%lld", p_info->duration);
 
   /*Save segment size*/
-  p1 = fgets(buf, sizeof(buf), p_ctx->dat_fp);
+  p1 = fgets(buf, sizeof(buf), fp);
   DVR_RETURN_IF_FALSE(p1);
   p1 = strstr(buf, "size=");
   DVR_RETURN_IF_FALSE(p1);
   p_info->size = strtoull(p1 + 5, NULL, 10);
 
   /*Save number of packets*/
-  p1 = fgets(buf, sizeof(buf), p_ctx->dat_fp);
+  p1 = fgets(buf, sizeof(buf), fp);
   DVR_RETURN_IF_FALSE(p1);
   p1 = strstr(buf, "nb_packets=");
   DVR_RETURN_IF_FALSE(p1);
@@ -844,24 +1470,15 @@ int segment_load_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
   return DVR_SUCCESS;
 }
 
-/* Should consider the case of cut power, todo... */
-int segment_load_allInfo(Segment_Handle_t handle, struct list_head *list)
+static int segment_parse_allInfo(FILE *fp, struct list_head *list)
 {
-  Segment_Context_t *p_ctx;
   uint32_t i;
   char buf[256];
   char value[256];
   char *p1, *p2;
 
-  p_ctx = (Segment_Context_t *)handle;
-  DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(list);
-  if (p_ctx->all_dat_fp == NULL) {
-    DVR_INFO("all dat file not open\n");
-    return DVR_FAILURE;
-  }
   //first get
-  p1 = fgets(buf, sizeof(buf), p_ctx->all_dat_fp);
+  p1 = fgets(buf, sizeof(buf), fp);
   DVR_RETURN_IF_FALSE(p1);
 
   do {
@@ -881,7 +1498,7 @@ int segment_load_allInfo(Segment_Handle_t handle, struct list_head *list)
     p_info->id = strtoull(p1 + 3, NULL, 10);
 
     /*Save number of pids*/
-    p1 = fgets(buf, sizeof(buf), p_ctx->all_dat_fp);
+    p1 = fgets(buf, sizeof(buf), fp);
     DVR_RETURN_IF_FALSE(p1);
     p1 = strstr(buf, "nb_pids=");
     DVR_RETURN_IF_FALSE(p1);
@@ -892,7 +1509,7 @@ int segment_load_allInfo(Segment_Handle_t handle, struct list_head *list)
     // just suppress it here.
     // coverity[tainted_data]
     for (i = 0; i < p_info->nb_pids; i++) {
-      p1 = fgets(buf, sizeof(buf), p_ctx->all_dat_fp);
+      p1 = fgets(buf, sizeof(buf), fp);
       DVR_RETURN_IF_FALSE(p1);
       memset(value, 0, sizeof(value));
       if ((p1 = strstr(buf, "pid="))) {
@@ -918,7 +1535,7 @@ int segment_load_allInfo(Segment_Handle_t handle, struct list_head *list)
     }
 
     /*Save segment duration*/
-    p1 = fgets(buf, sizeof(buf), p_ctx->all_dat_fp);
+    p1 = fgets(buf, sizeof(buf), fp);
     DVR_RETURN_IF_FALSE(p1);
     p1 = strstr(buf, "duration=");
     DVR_RETURN_IF_FALSE(p1);
@@ -926,25 +1543,215 @@ int segment_load_allInfo(Segment_Handle_t handle, struct list_head *list)
     //DVR_INFO("load info p_info->duration:%lld", p_info->duration);
 
     /*Save segment size*/
-    p1 = fgets(buf, sizeof(buf), p_ctx->all_dat_fp);
+    p1 = fgets(buf, sizeof(buf), fp);
     DVR_RETURN_IF_FALSE(p1);
     p1 = strstr(buf, "size=");
     DVR_RETURN_IF_FALSE(p1);
     p_info->size = strtoull(p1 + 5, NULL, 10);
 
     /*Save number of packets*/
-    p1 = fgets(buf, sizeof(buf), p_ctx->all_dat_fp);
+    p1 = fgets(buf, sizeof(buf), fp);
     DVR_RETURN_IF_FALSE(p1);
     p1 = strstr(buf, "nb_packets=");
     DVR_RETURN_IF_FALSE(p1);
     p_info->nb_packets = strtoull(p1 + 11, NULL, 10);
     //if reach end,exit loop
-    p1 = fgets(buf, sizeof(buf), p_ctx->all_dat_fp);
+    p1 = fgets(buf, sizeof(buf), fp);
   } while (p1);
 
   return DVR_SUCCESS;
 }
 
+/*read a text information file of a previous version*/
+static int segment_load_text(int fd, Segment_StoreInfo_t *p_info, struct list_head *list)
+{
+  FILE *fp;
+  int ret;
+
+  DVR_RETURN_IF_FALSE(lseek(fd, 0, SEEK_SET) != -1);
+  fp = fdopen(dup(fd), "r");
+  DVR_RETURN_IF_FALSE(fp);
+  ret = p_info ? segment_parse_info(fp, p_info) : segment_parse_allInfo(fp, list);
+  fclose(fp);
+  return ret;
+}
+
+int segment_store_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
+{
+  Segment_Context_t *p_ctx;
+  Segment_InfoRecord_t rec;
+  uint32_t now;
+  int fd;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_info);
+
+  segment_info_to_record(&rec, p_info);
+  if (p_ctx->recycled || p_ctx->end >= 0)
+    rec.flags |= SEGMENT_INFO_FLAG_RECYCLED;
+  /*nothing changed since the last store*/
+  if (p_ctx->info_seq && !memcmp(&rec, &p_ctx->info, sizeof(rec)))
+    return DVR_SUCCESS;
+
+  fd = segment_get_info_fd(p_ctx, SEGMENT_FILE_TYPE_DAT);
+  DVR_RETURN_IF_FALSE(fd != -1);
+
+  /*the two copies are written in turn, the reader uses the valid one with the latest seq*/
+  p_ctx->info = rec;
+  segment_record_seal(&rec, p_ctx->info_seq + 1);
+  if (pwrite(fd, &rec, sizeof(rec), ((rec.seq + 1) & 1) * SEGMENT_INFO_SLOT_SIZE) != sizeof(rec)) {
+    DVR_ERROR("%s, write info of segment %llu failed, reason:%s", __func__,
+        p_ctx->segment_id, strerror(errno));
+    /*write it again on the next store*/
+    p_ctx->info.magic = 0;
+    return DVR_FAILURE;
+  }
+  p_ctx->info_seq = rec.seq;
+  p_ctx->info_unsynced = DVR_TRUE;
+
+  now = segment_time_ms();
+  if (p_ctx->info_seq == 1 || now - p_ctx->info_sync_time >= SEGMENT_INFO_SYNC_TIME) {
+    fdatasync(fd);
+    p_ctx->info_sync_time = now;
+    p_ctx->info_unsynced = DVR_FALSE;
+  }
+  return DVR_SUCCESS;
+}
+
+int segment_store_allInfo(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
+{
+  Segment_Context_t *p_ctx;
+  Segment_InfoRecord_t rec;
+  int fd;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_info);
+
+  fd = segment_get_info_fd(p_ctx, SEGMENT_FILE_TYPE_ALL_DATA);
+  DVR_RETURN_IF_FALSE(fd != -1);
+
+  if (segment_info_is_text(fd))
+    return segment_print_info(fd, p_info);
+
+  /*a record torn by a power cut is cut off before the first append,
+    so the new records stay aligned*/
+  if (!p_ctx->all_dat_checked) {
+    struct stat st;
+
+    if (fstat(fd, &st) == 0 && st.st_size % sizeof(rec)) {
+      DVR_WARN("%s, torn record at the end of the all information file removed", __func__);
+      if (ftruncate(fd, st.st_size - st.st_size % sizeof(rec)) == -1)
+        DVR_ERROR("%s, truncate failed, reason:%s", __func__, strerror(errno));
+    }
+    p_ctx->all_dat_checked = DVR_TRUE;
+  }
+
+  /*one record per segment appended with a single write, a torn last record is dropped by the reader*/
+  segment_info_to_record(&rec, p_info);
+  segment_record_seal(&rec, 0);
+  if (write(fd, &rec, sizeof(rec)) != sizeof(rec)) {
+    DVR_ERROR("%s, write info of segment %llu failed, reason:%s", __func__,
+        p_info->id, strerror(errno));
+    return DVR_FAILURE;
+  }
+  fdatasync(fd);
+  return DVR_SUCCESS;
+}
+
+int segment_load_info(Segment_Handle_t handle, Segment_StoreInfo_t *p_info)
+{
+  Segment_Context_t *p_ctx;
+  Segment_InfoRecord_t rec[2];
+  int fd, i, latest = -1;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(p_info);
+
+  fd = segment_get_info_fd(p_ctx, SEGMENT_FILE_TYPE_DAT);
+  DVR_RETURN_IF_FALSE(fd != -1);
+
+  if (segment_info_is_text(fd))
+    return segment_load_text(fd, p_info, NULL);
+
+  for (i = 0; i < 2; i++) {
+    if (pread(fd, &rec[i], sizeof(rec[i]), i * SEGMENT_INFO_SLOT_SIZE) != sizeof(rec[i])
+        || segment_record_to_info(&rec[i], NULL) != DVR_SUCCESS)
+      continue;
+    if (latest == -1 || (int32_t)(rec[i].seq - rec[latest].seq) > 0)
+      latest = i;
+  }
+  if (latest == -1) {
+    DVR_INFO("%s, no valid info in segment %llu", __func__, p_ctx->segment_id);
+    return DVR_FAILURE;
+  }
+
+  return segment_record_to_info(&rec[latest], p_info);
+}
+
+/*offset of the next record start in the all information file, -1 if none*/
+static loff_t segment_find_record(int fd, loff_t offset)
+{
+  uint32_t magic = SEGMENT_INFO_MAGIC;
+  uint8_t buf[4096];
+  uint8_t *p;
+  ssize_t len;
+
+  while ((len = pread(fd, buf, sizeof(buf), offset)) >= (ssize_t)sizeof(magic)) {
+    p = memmem(buf, len, &magic, sizeof(magic));
+    if (p)
+      return offset + (p - buf);
+    /*the magic may be across two reads*/
+    offset += len - (sizeof(magic) - 1);
+  }
+  return -1;
+}
+
+int segment_load_allInfo(Segment_Handle_t handle, struct list_head *list)
+{
+  Segment_Context_t *p_ctx;
+  Segment_InfoRecord_t rec;
+  DVR_RecordSegmentInfo_t *p_info;
+  loff_t offset;
+  int fd, nb = 0;
+
+  p_ctx = (Segment_Context_t *)handle;
+  DVR_RETURN_IF_FALSE(p_ctx);
+  DVR_RETURN_IF_FALSE(list);
+
+  fd = segment_get_info_fd(p_ctx, SEGMENT_FILE_TYPE_ALL_DATA);
+  if (fd == -1) {
+    DVR_INFO("all dat file not open\n");
+    return DVR_FAILURE;
+  }
+
+  if (segment_info_is_text(fd))
+    return segment_load_text(fd, NULL, list);
+
+  for (offset = 0; pread(fd, &rec, sizeof(rec), offset) == sizeof(rec); offset += sizeof(rec)) {
+    if (segment_record_to_info(&rec, NULL) != DVR_SUCCESS) {
+      /*a record torn by a power cut shifts the records appended after it*/
+      DVR_WARN("%s, invalid record at %lld", __func__, offset);
+      offset = segment_find_record(fd, offset + 1);
+      if (offset == -1)
+        break;
+      offset -= sizeof(rec);
+      continue;
+    }
+
+    p_info = malloc(sizeof(DVR_RecordSegmentInfo_t));
+    DVR_RETURN_IF_FALSE(p_info);
+    memset(p_info, 0, sizeof(DVR_RecordSegmentInfo_t));
+    segment_record_to_info(&rec, p_info);
+    list_add_tail(&p_info->head, list);
+    nb++;
+  }
+
+  return nb ? DVR_SUCCESS : DVR_FAILURE;
+}
+
 int segment_delete(const char *location, uint64_t segment_id)
 {
   char fname[MAX_SEGMENT_PATH_SIZE];
@@ -976,6 +1783,37 @@ int segment_delete(const char *location, uint64_t segment_id)
   return DVR_SUCCESS;
 }
 
+int segment_recycle(const char *location, uint64_t segment_id)
+{
+  char fname[MAX_SEGMENT_PATH_SIZE];
+  char recycle_name[MAX_SEGMENT_PATH_SIZE];
+  Segment_FileType_t types[] = {SEGMENT_FILE_TYPE_INDEX, SEGMENT_FILE_TYPE_DAT};
+  size_t i;
+
+  DVR_RETURN_IF_FALSE(location);
+
+  /*only the files of one segment are kept, the others are deleted*/
+  segment_get_recycle_fname(recycle_name, location, SEGMENT_FILE_TYPE_TS);
+  if (access(recycle_name, F_OK) == 0)
+    return segment_delete(location, segment_id);
+
+  segment_get_fname(fname, location, segment_id, SEGMENT_FILE_TYPE_TS);
+  if (rename(fname, recycle_name) == -1) {
+    DVR_ERROR("%s, [%s] rename failed:%s", __func__, fname, strerror(errno));
+    return segment_delete(location, segment_id);
+  }
+
+  for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    segment_get_fname(fname, location, segment_id, types[i]);
+    segment_get_recycle_fname(recycle_name, location, types[i]);
+    if (rename(fname, recycle_name) == -1)
+      unlink(fname);
+  }
+
+  DVR_INFO("%s, [%s-%04llu] recycled", __func__, location, segment_id);
+  return DVR_SUCCESS;
+}
+
 int segment_ongoing(Segment_Handle_t handle)
 {
   Segment_Context_t *p_ctx;
@@ -1005,7 +1843,7 @@ loff_t segment_dump_pts(Segment_Handle_t handle)
 
   p_ctx = (Segment_Context_t *)handle;
   DVR_RETURN_IF_FALSE(p_ctx);
-  DVR_RETURN_IF_FALSE(p_ctx->index_fp);
+  DVR_RETURN_IF_FALSE(segment_get_index_fp(p_ctx));
   DVR_RETURN_IF_FALSE(p_ctx->ts_fd != -1);
 
   memset(buf, 0, sizeof(buf));
@@ -1050,6 +1888,9 @@ off_t segment_get_cur_segment_size(Segment_Handle_t handle)
   if (ret<0) {
     return -1;
   }
+  loff_t end = segment_get_end(p_ctx);
+  if (end >= 0 && end < sb.st_size)
+    return end;
   return sb.st_size;
 }
 
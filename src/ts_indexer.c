@@ -36,6 +36,7 @@ int
 ts_indexer_init (TS_Indexer_t *ts_indexer)
 {
   TSParser init_parser;
+  int i;
 
   if (ts_indexer == NULL) {
     return -1;
@@ -47,16 +48,55 @@ ts_indexer_init (TS_Indexer_t *ts_indexer)
   init_parser.PES.pts = -1;
   init_parser.PES.offset = 0;
   init_parser.PES.len = 0;
+  init_parser.PES.skip = 0;
   init_parser.PES.state = TS_INDEXER_STATE_INIT;
+  init_parser.PES.sc_state = 0xffffffff;
 
-  memcpy(&ts_indexer->video_parser, &init_parser, sizeof(TSParser));
-  memcpy(&ts_indexer->audio_parser, &init_parser, sizeof(TSParser));
+  for (i = 0; i < TS_INDEXER_MAX_STREAMS; i++) {
+    memcpy(&ts_indexer->streams[i], &init_parser, sizeof(TSParser));
+  }
+  ts_indexer->streams[0].type = TS_INDEXER_STREAM_TYPE_VIDEO;
+  ts_indexer->streams[1].type = TS_INDEXER_STREAM_TYPE_AUDIO;
+  memset(ts_indexer->pid_map, 0, sizeof(ts_indexer->pid_map));
   ts_indexer->callback     = NULL;
+  ts_indexer->events       = NULL;
+  ts_indexer->events_max   = 0;
+  ts_indexer->events_num   = 0;
   ts_indexer->offset       = 0;
 
   return 0;
 }
 
+/*Bind the parser at index to the PID, the previous PID of the parser is released*/
+static void
+stream_set_pid (TS_Indexer_t *ts_indexer, int index, int pid)
+{
+  TSParser *parser = &ts_indexer->streams[index];
+
+  if (parser->pid >= 0 && parser->pid < 0x1fff
+    && ts_indexer->pid_map[parser->pid] == index + 1) {
+    ts_indexer->pid_map[parser->pid] = 0;
+  }
+
+  parser->pid = pid;
+  parser->offset = 0;
+  parser->PES.pts = -1;
+  parser->PES.offset = 0;
+  parser->PES.len = 0;
+  parser->PES.skip = 0;
+  parser->PES.state = TS_INDEXER_STATE_INIT;
+  parser->PES.sc_state = 0xffffffff;
+  parser->PES.sc_len = 0;
+  parser->PES.sc_need = 0;
+
+  if (pid >= 0 && pid < 0x1fff) {
+    /*The PID is moved to this parser*/
+    if (ts_indexer->pid_map[pid] && ts_indexer->pid_map[pid] != index + 1)
+      ts_indexer->streams[ts_indexer->pid_map[pid] - 1].pid = 0x1fff;
+    ts_indexer->pid_map[pid] = index + 1;
+  }
+}
+
 /**
  * Release the TS indexer.
  * \param ts_indexer The TS indexer to be released.
@@ -80,7 +120,7 @@ ts_indexer_set_video_format (TS_Indexer_t *ts_indexer, TS_Indexer_StreamFormat_t
   if (ts_indexer == NULL)
     return -1;
 
-  ts_indexer->video_parser.format = format;
+  ts_indexer->streams[0].format = format;
 
   return 0;
 }
@@ -99,13 +139,7 @@ ts_indexer_set_video_pid (TS_Indexer_t *ts_indexer, int pid)
     return -1;
 
 
-  TSParser *parser = &ts_indexer->video_parser;
-  parser->pid = pid;
-  parser->offset = 0;
-  parser->PES.pts = -1;
-  parser->PES.offset = 0;
-  parser->PES.len = 0;
-  parser->PES.state = TS_INDEXER_STATE_INIT;
+  stream_set_pid(ts_indexer, 0, pid);
 
   return 0;
 }
@@ -123,169 +157,156 @@ ts_indexer_set_audio_pid (TS_Indexer_t *ts_indexer, int pid)
   if (ts_indexer == NULL)
     return -1;
 
-  TSParser *parser = &ts_indexer->audio_parser;
-  parser->pid = pid;
-  parser->offset = 0;
-  parser->PES.pts = -1;
-  parser->PES.offset = 0;
-  parser->PES.len = 0;
-  parser->PES.state = TS_INDEXER_STATE_INIT;
+  stream_set_pid(ts_indexer, 1, pid);
 
   return 0;
 }
 
 /**
- * Set the event callback function.
+ * Add a stream to be indexed, or update the type and format of an indexed PID.
  * \param ts_indexer The TS indexer.
- * \param callback The event callback function.
+ * \param pid The stream PID.
+ * \param type The stream type.
+ * \param format The video format, -1 if frames are not parsed.
  * \retval 0 On success.
  * \retval -1 On error.
  */
 int
-ts_indexer_set_event_callback (TS_Indexer_t *ts_indexer, TS_Indexer_EventCallback_t callback)
-{
-  ts_indexer->callback = callback;
-
-  return 0;
-}
-
-static void find_mpeg(uint8_t *data, int len, TS_Indexer_t *indexer, TSParser *stream)
+ts_indexer_add_stream (TS_Indexer_t *ts_indexer, int pid, TS_Indexer_StreamType_t type, TS_Indexer_StreamFormat_t format)
 {
   int i;
-  uint32_t needle = 0;
-  uint32_t needle1 = 0;
-  uint8_t *haystack = data;
-  int haystack_len = len;
-  int left = len;
-  // start code of picture header
-  uint8_t arr[4] = {0x00, 0x00, 0x01, 0x00};
-  // start code of sequence header
-  uint8_t arr1[4] = {0x00, 0x00, 0x01, 0xb3};
-  TS_Indexer_Event_t event;
 
-  /* mpeg header needs at least 4 bytes */
-  if (left < 4) {
-    memcpy(&stream->PES.data[0], &haystack, left);
-    stream->PES.len = left;
-    return;
-  }
-
-  memset(&event, 0, sizeof(event));
-  event.pid = stream->pid;
-  event.offset = stream->offset;
+  if (ts_indexer == NULL || pid < 0 || pid >= 0x1fff)
+    return -1;
 
-  for (i = 0; i < 4; ++i) {
-    needle += (arr[i] << (8 * i));
+  i = ts_indexer->pid_map[pid] - 1;
+  if (i < 0) {
+    /*Slot 0 and 1 are kept for ts_indexer_set_video_pid/ts_indexer_set_audio_pid*/
+    for (i = 2; i < TS_INDEXER_MAX_STREAMS; i++) {
+      if (ts_indexer->streams[i].pid == 0x1fff)
+        break;
+    }
+    if (i >= TS_INDEXER_MAX_STREAMS) {
+      ERR("%s no free stream parser for pid %#x\n", __func__, pid);
+      return -1;
+    }
+    stream_set_pid(ts_indexer, i, pid);
   }
 
-  for (i = 0; i < 4; ++i) {
-    needle1 += (arr1[i] << (8 * i));
-  }
+  ts_indexer->streams[i].type = type;
+  ts_indexer->streams[i].format = format;
 
-  for (i = 0; i < haystack_len - sizeof(needle) + 1;) {
-    if (left < 5) {
-      INF("MPEG2 picture header across TS Packet\n");
+  return 0;
+}
 
-      /* MEPG2 picture header across TS packet, should cache the left data */
-      memcpy(&stream->PES.data[0], haystack + i, left);
-      stream->PES.len = left;
-      return;
-    }
+/**
+ * Remove an indexed stream.
+ * \param ts_indexer The TS indexer.
+ * \param pid The stream PID.
+ * \retval 0 On success.
+ * \retval -1 On error.
+ */
+int
+ts_indexer_remove_stream (TS_Indexer_t *ts_indexer, int pid)
+{
+  if (ts_indexer == NULL || pid < 0 || pid >= 0x1fff)
+    return -1;
 
-    if (*(uint32_t *)(haystack + i) == needle) {
-      // picture header found
-      int frame_type = (haystack[i + 5] >> 3) & 0x7;
-      switch (frame_type) {
-        case 1:
-            INF("I frame found, offset: %lx\n", event.offset);
-            event.type = TS_INDEXER_EVENT_TYPE_MPEG2_I_FRAME;
-            break;
-
-        case 2:
-            INF("P frame found, offset: %lx\n", event.offset);
-            event.type = TS_INDEXER_EVENT_TYPE_MPEG2_P_FRAME;
-            break;
-
-        case 3:
-            INF("B frame found, offset: %lx\n", event.offset);
-            event.type = TS_INDEXER_EVENT_TYPE_MPEG2_B_FRAME;
-            break;
-
-        default:
-            i += 5;
-            left -= 5;
-            continue;
+  if (ts_indexer->pid_map[pid] == 0)
+    return -1;
 
-      }
+  stream_set_pid(ts_indexer, ts_indexer->pid_map[pid] - 1, 0x1fff);
 
-      event.pts = stream->PES.pts;
-      if (indexer->callback) {
-        indexer->callback(indexer, &event);
-      }
+  return 0;
+}
 
-      i += 5;
-      left -= 5;
-    } else if (*(uint32_t *)(haystack + i) == needle1) {
-      // sequence header found
-      event.type = TS_INDEXER_EVENT_TYPE_MPEG2_SEQUENCE;
-      event.pts = stream->PES.pts;
-      if (indexer->callback) {
-        indexer->callback(indexer, &event);
-      }
+/**
+ * Set the event callback function.
+ * \param ts_indexer The TS indexer.
+ * \param callback The event callback function.
+ * \retval 0 On success.
+ * \retval -1 On error.
+ */
+int
+ts_indexer_set_event_callback (TS_Indexer_t *ts_indexer, TS_Indexer_EventCallback_t callback)
+{
+  ts_indexer->callback = callback;
+
+  return 0;
+}
 
-      i += 5;
-      left -= 5;
+/*Deliver an event to the batch array of ts_indexer_parse_batch, or to the callback*/
+static void
+emit_event (TS_Indexer_t *ts_indexer, TS_Indexer_Event_t *event)
+{
+  if (ts_indexer->events) {
+    if (ts_indexer->events_num < ts_indexer->events_max) {
+      ts_indexer->events[ts_indexer->events_num++] = *event;
     } else {
-      i ++;
-      left --;
+      ERR("%s event array full, drop event %d of pid %#x\n", __func__, event->type, event->pid);
     }
+    return;
   }
 
-  if (left > 0) {
-    memcpy(&stream->PES.data[0], &haystack[i], left);
-    stream->PES.len = left;
-  } else {
-    stream->PES.len = 0;
+  if (ts_indexer->callback) {
+    ts_indexer->callback(ts_indexer, event);
   }
 }
 
-static uint8_t *get_nalu(uint8_t *data, size_t len, size_t *nalu_len, uint8_t is_hevc)
+/*Get the number of bytes from the start code value byte needed to parse the unit header*/
+static int
+start_code_header_len (TSParser *stream, uint8_t code)
 {
-  size_t i = 0;
-  uint8_t *p = data;
+  switch (stream->format) {
+    case TS_INDEXER_VIDEO_FORMAT_MPEG2:
+      /*picture_coding_type is in the second byte after the picture start code*/
+      return (code == 0x00) ? 3 : 1;
 
-  if (len == 0)
-    return NULL;
+    case TS_INDEXER_VIDEO_FORMAT_H264:
+      /*first_mb_in_slice and slice_type are in the 4 bytes after the NAL header*/
+      if ((code & 0x1f) == NAL_TYPE_NON_IDR || (code & 0x1f) == NAL_TYPE_IDR)
+        return 5;
+      return 1;
 
-  //INF("%s enter, len:%#lx\n", __func__, len);
-  while (i < len - 4) {
-    if (p[i] == 0x00 && p[i+1] == 0x00 && p[i+2] == 0x01) {
-      uint8_t *frame_data = data + i;
-      size_t frame_data_len = 0;
+    default:
+      return 1;
+  }
+}
 
-      i += 4;
-      //INF("%s start code prefix\n", __func__);
-      for (size_t j = i ; j < len - 4; ++j) {
-        if (p[j] == 0x00 && p[j+1] == 0x00 && p[j+2] == 0x01) {
-          frame_data_len = j - i;
+static void find_mpeg(TS_Indexer_t *indexer, TSParser *stream, TS_Indexer_Event_t *event)
+{
+  uint8_t *hdr = stream->PES.sc_header;
+
+  if (hdr[0] == 0x00) {
+    // picture header found
+    int frame_type = (hdr[2] >> 3) & 0x7;
+    switch (frame_type) {
+      case 1:
+          INF("I frame found, offset: %lx\n", event->offset);
+          event->type = TS_INDEXER_EVENT_TYPE_MPEG2_I_FRAME;
           break;
-        }
-      }
 
-      if (frame_data_len > 0) {
-        *nalu_len = frame_data_len;
-        return frame_data;
-      } else {
-        frame_data_len = len - i;
-        *nalu_len = frame_data_len;
-        return frame_data;
-      }
-    } else {
-      i ++;
+      case 2:
+          INF("P frame found, offset: %lx\n", event->offset);
+          event->type = TS_INDEXER_EVENT_TYPE_MPEG2_P_FRAME;
+          break;
+
+      case 3:
+          INF("B frame found, offset: %lx\n", event->offset);
+          event->type = TS_INDEXER_EVENT_TYPE_MPEG2_B_FRAME;
+          break;
+
+      default:
+          return;
     }
+  } else if (hdr[0] == 0xb3) {
+    // sequence header found
+    event->type = TS_INDEXER_EVENT_TYPE_MPEG2_SEQUENCE;
+  } else {
+    return;
   }
 
-  return NULL;
+  emit_event(indexer, event);
 }
 
 uint32_t golomb_uev(uint32_t *pu4_bitstrm_ofst, uint32_t *pu4_bitstrm_buf)
@@ -312,184 +333,190 @@ uint32_t golomb_uev(uint32_t *pu4_bitstrm_ofst, uint32_t *pu4_bitstrm_buf)
   return ((1 << u4_ldz) + u4_word - 1);
 }
 
-uint32_t reverseBytes(uint32_t num)
+
+static void find_h264(TS_Indexer_t *indexer, TSParser *stream, TS_Indexer_Event_t *event)
 {
-  uint32_t result = 0;
+  uint8_t *hdr = stream->PES.sc_header;
+  uint8_t nal_unit_type = (hdr[0] & 0x1f);
+  uint8_t slice_type;
+  uint32_t offset = 0;
+  uint32_t bitstrm_buf[2];
+
+  if (nal_unit_type != NAL_TYPE_IDR && nal_unit_type != NAL_TYPE_NON_IDR)
+    return;
 
-  result |= (num & 0xff) << 24;
-  result |= (num & 0xff00) << 8;
-  result |= (num & 0xff0000) >> 8;
-  result |= (num & 0xff000000) >> 24;
+  /*The second word is read by the bit stream macros when the first one is used up*/
+  bitstrm_buf[0] = ((uint32_t)hdr[1] << 24) | ((uint32_t)hdr[2] << 16) | ((uint32_t)hdr[3] << 8) | hdr[4];
+  bitstrm_buf[1] = 0;
 
-  return result;
+  //first_mb_in_slice
+  golomb_uev(&offset, bitstrm_buf);
+  slice_type = golomb_uev(&offset, bitstrm_buf);
+
+  if (nal_unit_type == NAL_TYPE_IDR) {
+    if (slice_type == 2 || slice_type == 7) {
+      event->type = TS_INDEXER_EVENT_TYPE_AVC_I_SLICE;
+    } else if (slice_type == 4 || slice_type == 9) {
+      event->type = TS_INDEXER_EVENT_TYPE_AVC_SI_SLICE;
+    } else {
+      ERR("0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
+            hdr[0], hdr[1], hdr[2], hdr[3], hdr[4]);
+      ERR("%s line%d invalid slice_type: %d, offset: %lx\n", __func__, __LINE__, slice_type, event->offset);
+      return;
+    }
+  } else {
+    if (slice_type == 0 || slice_type == 5) {
+        event->type = TS_INDEXER_EVENT_TYPE_AVC_P_SLICE;
+    } else if (slice_type == 1 || slice_type == 6) {
+        event->type = TS_INDEXER_EVENT_TYPE_AVC_B_SLICE;
+    } else if (slice_type == 2 || slice_type == 7) {
+        event->type = TS_INDEXER_EVENT_TYPE_AVC_I_SLICE;
+    } else if (slice_type == 3 || slice_type == 8) {
+        event->type = TS_INDEXER_EVENT_TYPE_AVC_SP_SLICE;
+    } else if (slice_type == 4 || slice_type == 9) {
+        event->type = TS_INDEXER_EVENT_TYPE_AVC_SI_SLICE;
+    } else {
+        ERR("%s line%d invalid slice_type: %d\n", __func__, __LINE__, slice_type);
+        return;
+    }
+  }
+
+  emit_event(indexer, event);
 }
 
-static void find_h264(uint8_t *data, size_t len, TS_Indexer_t *indexer, TSParser *stream)
+static void find_h265(TS_Indexer_t *indexer, TSParser *stream, TS_Indexer_Event_t *event)
 {
-  TS_Indexer_Event_t event;
-  uint8_t *nalu = data;
-  size_t pes_data_len = len;
-  size_t nalu_len;
-  uint8_t *p = NULL;
+  uint8_t *hdr = stream->PES.sc_header;
+  int nalu_type = (hdr[0] & 0x7E) >> 1;
 
-  memset(&event, 0, sizeof(event));
-  event.pid = stream->pid;
-  event.offset = stream->offset;
+  INF("0x%02x, nalu_type: %d, offset: %#lx\n", hdr[0], nalu_type, event->offset);
+  switch (nalu_type) {
+    case HEVC_NALU_BLA_W_LP:
+        event->type = TS_INDEXER_EVENT_TYPE_HEVC_BLA_W_LP;
+        break;
 
-  for (;;) {
-    int left = pes_data_len - (nalu - data);
-    if (left <= 5) {
-      memcpy(&stream->PES.data[0], nalu, left);
-      stream->PES.len = left;
-      break;
-    }
+    case HEVC_NALU_BLA_W_RADL:
+        event->type = TS_INDEXER_EVENT_TYPE_HEVC_BLA_W_RADL;
+        break;
 
-    nalu = get_nalu(nalu, left, &nalu_len, 0);
-    if (nalu == NULL)
-      break;
+    case HEVC_NALU_BLA_N_LP:
+        event->type = TS_INDEXER_EVENT_TYPE_HEVC_BLA_N_LP;
+        break;
 
-    if (nalu[0] == 0x00 && nalu[1] == 0x00 && nalu[2] == 0x01) {
-      p = &nalu[3];
-    }
+    case HEVC_NALU_IDR_W_RADL:
+        event->type = TS_INDEXER_EVENT_TYPE_HEVC_IDR_W_RADL;
+        //INF("HEVC I-frame found\n");
+        break;
 
-    uint32_t offset = 0;
-    uint32_t *pu4_bitstrm_buf = (uint32_t *)&p[1];
-    uint32_t *pu4_bitstrm_ofst = &offset;
-    if (p != NULL)
-    {
-      uint8_t nal_unit_type = (p[0] & 0x1f);
-      uint16_t u2_first_mb_in_slice;
-      uint8_t slice_type;
-
-      uint32_t reverseNum = reverseBytes(*pu4_bitstrm_buf);
-      u2_first_mb_in_slice = golomb_uev(pu4_bitstrm_ofst, &reverseNum);
-      slice_type = golomb_uev(pu4_bitstrm_ofst, &reverseNum);
-
-      event.pts = stream->PES.pts;
-      if (nal_unit_type == NAL_TYPE_IDR) {
-        if (slice_type == 2 || slice_type == 7) {
-          event.type = TS_INDEXER_EVENT_TYPE_AVC_I_SLICE;
-        } else if (slice_type == 4 || slice_type == 9) {
-          event.type = TS_INDEXER_EVENT_TYPE_AVC_SI_SLICE;
-        } else {
-          ERR("0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
-                nalu[0], nalu[1], nalu[2], nalu[3],
-                nalu[4], nalu[5], nalu[6], nalu[7]);
-          ERR("%s line%d invalid slice_type: %d, offset: %lx\n", __func__, __LINE__, slice_type, event.offset);
-          nalu += nalu_len;
-          continue;
-        }
-      } else if (nal_unit_type == NAL_TYPE_NON_IDR) {
-          //ERR("0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x\n",
-          //      nalu[0], nalu[1], nalu[2], nalu[3],
-          //      nalu[4], nalu[5], nalu[6], nalu[7]);
-        if (slice_type == 0 || slice_type == 5) {
-            event.type = TS_INDEXER_EVENT_TYPE_AVC_P_SLICE;
-        } else if (slice_type == 1 || slice_type == 6) {
-            event.type = TS_INDEXER_EVENT_TYPE_AVC_B_SLICE;
-        } else if (slice_type == 2 || slice_type == 7) {
-            event.type = TS_INDEXER_EVENT_TYPE_AVC_I_SLICE;
-        } else if (slice_type == 3 || slice_type == 8) {
-            event.type = TS_INDEXER_EVENT_TYPE_AVC_SP_SLICE;
-        } else if (slice_type == 4 || slice_type == 9) {
-            event.type = TS_INDEXER_EVENT_TYPE_AVC_SI_SLICE;
-        } else {
-            ERR("%s line%d invalid slice_type: %d\n", __func__, __LINE__, slice_type);
-            nalu += nalu_len;
-            continue;
-        }
-      } else {
-        nalu += nalu_len;
-        continue;
-      }
+    case HEVC_NALU_IDR_N_LP:
+        event->type = TS_INDEXER_EVENT_TYPE_HEVC_IDR_N_LP;
+        break;
 
-      if (indexer->callback) {
-        indexer->callback(indexer, &event);
-      }
-    }
+    case HEVC_NALU_TRAIL_CRA:
+        event->type = TS_INDEXER_EVENT_TYPE_HEVC_TRAIL_CRA;
+        break;
+
+    case HEVC_NALU_SPS:
+        event->type = TS_INDEXER_EVENT_TYPE_HEVC_SPS;
+        break;
+
+    case HEVC_NALU_AUD:
+        event->type = TS_INDEXER_EVENT_TYPE_HEVC_AUD;
+        break;
 
-    nalu += nalu_len;
+    default:
+        return;
   }
 
-  stream->PES.len = 0;
+  emit_event(indexer, event);
 }
 
-static void find_h265(uint8_t *data, int len, TS_Indexer_t *indexer, TSParser *stream)
+/*The unit header following a start code is complete*/
+static void
+start_code_found (TS_Indexer_t *indexer, TSParser *stream)
 {
   TS_Indexer_Event_t event;
-  uint8_t *nalu = data;
-  size_t pes_data_len = len;
-  size_t nalu_len;
 
   memset(&event, 0, sizeof(event));
   event.pid = stream->pid;
-  event.offset = stream->offset;
+  event.offset = stream->PES.sc_offset;
+  event.pts = stream->PES.sc_pts;
 
-  while (nalu != NULL) {
-    int left = pes_data_len - (nalu - data);
-    if (left <= 4) {
-      memcpy(&stream->PES.data[0], nalu, left);
-      stream->PES.len = left;
+  switch (stream->format) {
+    case TS_INDEXER_VIDEO_FORMAT_MPEG2:
+      find_mpeg(indexer, stream, &event);
       break;
-    }
 
-    nalu = get_nalu(nalu, left, &nalu_len, 1);
-    if (nalu == NULL)
+    case TS_INDEXER_VIDEO_FORMAT_H264:
+      find_h264(indexer, stream, &event);
       break;
 
-    if (nalu[0] == 0x00 && nalu[1] == 0x00 && nalu[2] == 0x01) {
-      int nalu_type = (nalu[3] & 0x7E) >> 1;
-      INF("0x%02x 0x%02x 0x%02x 0x%02x 0x%02x 0x%02x, nalu_type: %d, offset: %#lx\n",
-          nalu[3], nalu[4], nalu[5], nalu[6], nalu[7], nalu[8], nalu_type, event.offset);
-      switch (nalu_type) {
-        case HEVC_NALU_BLA_W_LP:
-            event.type = TS_INDEXER_EVENT_TYPE_HEVC_BLA_W_LP;
-            break;
-
-        case HEVC_NALU_BLA_W_RADL:
-            event.type = TS_INDEXER_EVENT_TYPE_HEVC_BLA_W_RADL;
-            break;
-
-        case HEVC_NALU_BLA_N_LP:
-            event.type = TS_INDEXER_EVENT_TYPE_HEVC_BLA_N_LP;
-            break;
-
-        case HEVC_NALU_IDR_W_RADL:
-            event.type = TS_INDEXER_EVENT_TYPE_HEVC_IDR_W_RADL;
-            //INF("HEVC I-frame found\n");
-            break;
-
-        case HEVC_NALU_IDR_N_LP:
-            event.type = TS_INDEXER_EVENT_TYPE_HEVC_IDR_N_LP;
-            break;
-
-        case HEVC_NALU_TRAIL_CRA:
-            event.type = TS_INDEXER_EVENT_TYPE_HEVC_TRAIL_CRA;
-            break;
-
-        case HEVC_NALU_SPS:
-            event.type = TS_INDEXER_EVENT_TYPE_HEVC_SPS;
-            break;
-
-        case HEVC_NALU_AUD:
-            event.type = TS_INDEXER_EVENT_TYPE_HEVC_AUD;
-            break;
-
-        default:
-            nalu += nalu_len;
-            continue;
-      }
+    case TS_INDEXER_VIDEO_FORMAT_HEVC:
+      find_h265(indexer, stream, &event);
+      break;
 
-      event.pts = stream->PES.pts;
-      if (indexer->callback) {
-        indexer->callback(indexer, &event);
-      }
+    default:
+      break;
+  }
+}
+
+/*Reset the start code state machine*/
+static void
+start_code_reset (PESParser *pes)
+{
+  pes->sc_state = 0xffffffff;
+  pes->sc_len = 0;
+  pes->sc_need = 0;
+}
+
+/*
+ * Feed the elementary stream data to the start code state machine.
+ * The state is kept in the parser, so start codes and unit headers split
+ * across TS packets are found, and every byte is only scanned once.
+ */
+static void
+es_data (TS_Indexer_t *indexer, TSParser *stream, uint8_t *data, int len)
+{
+  PESParser *pes = &stream->PES;
+  uint32_t state = pes->sc_state;
+  uint8_t *one;
+  uint8_t b;
+  int i = 0;
+  int j;
+
+  while (i < len) {
+    if (pes->sc_need == 0 && (state & 0xffffff) != 0x000001) {
+      /*Skip to the byte following the next 0x01, only the last 3 bytes matter*/
+      one = memchr(data + i, 0x01, len - i);
+      j = one ? (one - data + 1) : len;
+      if (j - i > 3)
+        i = j - 3;
+      for (; i < j; i++)
+        state = (state << 8) | data[i];
+      continue;
     }
 
-    nalu += nalu_len;
+    b = data[i++];
+    if ((state & 0xffffff) == 0x000001) {
+      /*Start code value byte, an incomplete unit header is dropped*/
+      pes->sc_header[0] = b;
+      pes->sc_len = 1;
+      pes->sc_need = start_code_header_len(stream, b);
+      pes->sc_offset = stream->offset;
+      pes->sc_pts = pes->pts;
+    } else {
+      pes->sc_header[pes->sc_len++] = b;
+    }
+    state = (state << 8) | b;
+
+    if (pes->sc_len >= pes->sc_need) {
+      start_code_found(indexer, stream);
+      pes->sc_len = 0;
+      pes->sc_need = 0;
+    }
   }
 
-  stream->PES.len = 0;
+  pes->sc_state = state;
 }
 
 /*Parse the PES packet*/
@@ -499,12 +526,9 @@ pes_packet(TS_Indexer_t *ts_indexer, uint8_t *data, int len, TSParser *stream)
   uint8_t *p = data;
   TS_Indexer_t *pi = ts_indexer;
   int left = len;
+  int skip;
   TS_Indexer_Event_t event;
 
-  memset(&event, 0, sizeof(event));
-  event.pid = stream->pid;
-  event.offset = stream->offset;
-
   INF("stream: %p, state: %d\n", stream, stream->PES.state);
   if (stream->PES.state <= TS_INDEXER_STATE_INIT) {
     INF("%s, invalid state\n", __func__);
@@ -512,30 +536,28 @@ pes_packet(TS_Indexer_t *ts_indexer, uint8_t *data, int len, TSParser *stream)
     return;
   }
 
-  /* needs splice two pieces of data together if have cache data */
+  /* needs splice two pieces of data together if have cached PES header */
   if (stream->PES.len > 0) {
     INF("%s have cache data %d bytes\n", __func__, stream->PES.len);
     memcpy(&stream->PES.data[stream->PES.len], data, len);
     p = &stream->PES.data[0];
     left = stream->PES.len + len;
-    stream->PES.len = left;
+    stream->PES.len = 0;
   }
 
   if (stream->PES.state == TS_INDEXER_STATE_TS_START) {
     /* needs cache data if no enough data to parse PES header */
     if (left < 6) {
-      if (stream->PES.len <= 0) {
-        memcpy(&stream->PES.data[0], p, left);
-        stream->PES.len = left;
-      }
+      memmove(&stream->PES.data[0], p, left);
+      stream->PES.len = left;
       INF("not enough ts payload len: %#x\n", left);
       return;
     }
 
     // chect the PES packet start code prefix
     if ((p[0] != 0) || (p[1] != 0) || (p[2] != 1)) {
-      stream->PES.len = 0;
       stream->PES.state = TS_INDEXER_STATE_INIT;
+      start_code_reset(&stream->PES);
       INF("%s, not the expected start code!\n", __func__);
       return;
     }
@@ -547,10 +569,8 @@ pes_packet(TS_Indexer_t *ts_indexer, uint8_t *data, int len, TSParser *stream)
 
   if (stream->PES.state == TS_INDEXER_STATE_PES_HEADER) {
     if (left < 8) {
-      if (stream->PES.len <= 0) {
-        memcpy(&stream->PES.data[0], p, left);
-        stream->PES.len = left;
-      }
+      memmove(&stream->PES.data[0], p, left);
+      stream->PES.len = left;
       INF("not enough optional pes header len: %#x\n", left);
       return;
     }
@@ -558,60 +578,49 @@ pes_packet(TS_Indexer_t *ts_indexer, uint8_t *data, int len, TSParser *stream)
     int header_length = p[2];
     if (p[1] & 0x80) {
       // parser pts
-      p += 3;
-      left -= 3;
-      event.pts = stream->PES.pts = (((uint64_t)(p[0] & 0x0E) << 29) |
-                                    ((uint64_t)p[1] << 22) |
-                                    ((uint64_t)(p[2] & 0xFE) << 14) |
-                                    ((uint64_t)p[3] << 7) |
-                                    (((uint64_t)p[4] & 0xFE) >> 1));
+      uint8_t *pts = p + 3;
+
+      memset(&event, 0, sizeof(event));
+      event.pid = stream->pid;
+      event.offset = stream->offset;
+      event.pts = stream->PES.pts = (((uint64_t)(pts[0] & 0x0E) << 29) |
+                                    ((uint64_t)pts[1] << 22) |
+                                    ((uint64_t)(pts[2] & 0xFE) << 14) |
+                                    ((uint64_t)pts[3] << 7) |
+                                    (((uint64_t)pts[4] & 0xFE) >> 1));
       INF("pts: %lx, pos:%lx\n", event.pts, event.offset);
 
-      if (stream == &pi->video_parser) {
+      if (stream->type == TS_INDEXER_STREAM_TYPE_VIDEO) {
         event.type = TS_INDEXER_EVENT_TYPE_VIDEO_PTS;
-      } else {
+      } else if (stream->type == TS_INDEXER_STREAM_TYPE_AUDIO) {
         event.type = TS_INDEXER_EVENT_TYPE_AUDIO_PTS;
+      } else {
+        event.type = TS_INDEXER_EVENT_TYPE_SUBTITLE_PTS;
       }
-      if (pi->callback) {
-        pi->callback(pi, &event);
-      }
+      emit_event(pi, &event);
     }
-    if (stream->format != -1) {
+    if (stream->type == TS_INDEXER_STREAM_TYPE_VIDEO && stream->format != -1) {
       stream->PES.state = TS_INDEXER_STATE_PES_PTS;
-
-      p += header_length;
-      left -= header_length;
+      stream->PES.skip = 3 + header_length;
     } else {
       stream->PES.state = TS_INDEXER_STATE_INIT;
-      left = 0;
+      return;
     }
   }
 
-  stream->PES.len = left;
-  if (left <= 0
-    || stream->PES.state < TS_INDEXER_STATE_PES_PTS) {
-    return;
+  /* the optional PES header may continue in the next TS packet */
+  if (stream->PES.skip > 0) {
+    skip = (stream->PES.skip < left) ? stream->PES.skip : left;
+    p += skip;
+    left -= skip;
+    stream->PES.skip -= skip;
   }
 
-  INF("stream->format: %d, left: %d\n", stream->format, left);
-  switch (stream->format) {
-    case TS_INDEXER_VIDEO_FORMAT_MPEG2:
-      find_mpeg(p, left, pi, &pi->video_parser);
-      break;
-
-    case TS_INDEXER_VIDEO_FORMAT_H264:
-      find_h264(p, left, pi, &pi->video_parser);
-      break;
-
-    case TS_INDEXER_VIDEO_FORMAT_HEVC:
-      find_h265(p, left, pi, &pi->video_parser);
-      break;
+  if (left <= 0)
+    return;
 
-    default:
-      stream->PES.state = TS_INDEXER_STATE_INIT;
-      stream->PES.len = 0;
-      break;
-  }
+  INF("stream->format: %d, left: %d\n", stream->format, left);
+  es_data(pi, stream, p, left);
 }
 
 /*Parse the TS packet.*/
@@ -622,37 +631,30 @@ ts_packet(TS_Indexer_t *ts_indexer, uint8_t *data)
   uint8_t afc;
   uint8_t *p = data;
   TS_Indexer_t *pi = ts_indexer;
+  TSParser *stream;
   int len;
   int is_start;
   TS_Indexer_Event_t event;
 
   is_start = p[1] & 0x40;
   pid = ((p[1] & 0x1f) << 8) | p[2];
-  if (pid == 0x1fff)
-    return;
 
-  if ((pid != pi->video_parser.pid) &&
-      (pid != pi->audio_parser.pid)) {
+  /*pid_map of 0x1fff is never set*/
+  if (pi->pid_map[pid] == 0)
     return;
-  }
+  stream = &pi->streams[pi->pid_map[pid] - 1];
 
   if (is_start) {
     memset(&event, 0, sizeof(event));
     event.pid = pid;
     event.offset = pi->offset;
     event.type = TS_INDEXER_EVENT_TYPE_START_INDICATOR;
-    if (pi->callback) {
-      pi->callback(pi, &event);
-    }
+    emit_event(pi, &event);
 
-    if (pid == pi->video_parser.pid) {
-      pi->video_parser.offset = pi->offset;
-      pi->video_parser.PES.state = TS_INDEXER_STATE_TS_START;
-    }
-    else if (pid == pi->audio_parser.pid) {
-      pi->audio_parser.offset = pi->offset;
-      pi->audio_parser.PES.state = TS_INDEXER_STATE_TS_START;
-    }
+    stream->offset = pi->offset;
+    stream->PES.state = TS_INDEXER_STATE_TS_START;
+    stream->PES.len = 0;
+    stream->PES.skip = 0;
   }
 
   afc = (p[3] >> 4) & 0x03;
@@ -667,9 +669,7 @@ ts_packet(TS_Indexer_t *ts_indexer, uint8_t *data)
       event.pid = pid;
       event.offset = pi->offset;
       event.type = TS_INDEXER_EVENT_TYPE_DISCONTINUITY_INDICATOR;
-      if (pi->callback) {
-        pi->callback(pi, &event);
-      }
+      emit_event(pi, &event);
     }
     p++;
     len--;
@@ -686,26 +686,17 @@ ts_packet(TS_Indexer_t *ts_indexer, uint8_t *data)
   // has payload
   if ((afc & 1) && (len > 0)) {
     // parser pes packet
-    pes_packet(pi, p, len, (pid == pi->video_parser.pid) ? &pi->video_parser : &pi->audio_parser);
+    pes_packet(pi, p, len, stream);
   }
 }
 
-/**
- * Parse the TS stream and generate the index data.
- * \param ts_indexer The TS indexer.
- * \param data The TS data.
- * \param len The length of the TS data in bytes.
- * \return The left TS data length of bytes.
- */
-int
-ts_indexer_parse (TS_Indexer_t *ts_indexer, uint8_t *data, int len)
+/*Parse the TS packets, stop before a packet if the batch array may not hold its events*/
+static int
+parse_packets (TS_Indexer_t *ts_indexer, uint8_t *data, int len)
 {
   uint8_t *p = data;
   int left = len;
 
-  if (ts_indexer == NULL || data == NULL  || len <= 0)
-    return -1;
-
   while (left > 0) {
     // find the sync byte
     if (*p == 0x47) {
@@ -714,6 +705,12 @@ ts_indexer_parse (TS_Indexer_t *ts_indexer, uint8_t *data, int len)
         return left;
       }
 
+      if (ts_indexer->events
+        && ts_indexer->events_max - ts_indexer->events_num < TS_INDEXER_PACKET_EVENTS_MAX) {
+        INF("%s event array full, %d bytes left\n", __func__, left);
+        return left;
+      }
+
       // parse one ts packet
       ts_packet(ts_indexer, p);
       p += TS_PKT_SIZE;
@@ -728,3 +725,57 @@ ts_indexer_parse (TS_Indexer_t *ts_indexer, uint8_t *data, int len)
 
   return left;
 }
+
+/**
+ * Parse the TS stream and generate the index data.
+ * \param ts_indexer The TS indexer.
+ * \param data The TS data.
+ * \param len The length of the TS data in bytes.
+ * \return The left TS data length of bytes.
+ */
+int
+ts_indexer_parse (TS_Indexer_t *ts_indexer, uint8_t *data, int len)
+{
+  if (ts_indexer == NULL || data == NULL  || len <= 0)
+    return -1;
+
+  return parse_packets(ts_indexer, data, len);
+}
+
+/**
+ * Parse the TS stream and store the generated events in an array instead of
+ * calling the event callback.
+ * \param ts_indexer The TS indexer.
+ * \param data The TS data.
+ * \param len The length of the TS data in bytes.
+ * \param events The array to store the events.
+ * \param max_events The size of the event array, at least TS_INDEXER_PACKET_EVENTS_MAX.
+ * \param[out] nb_events Returns the number of events stored.
+ * \return The left TS data length of bytes, it includes the packets not parsed
+ *  because the event array is full.
+ * \retval -1 On error.
+ */
+int
+ts_indexer_parse_batch (TS_Indexer_t *ts_indexer, uint8_t *data, int len,
+    TS_Indexer_Event_t *events, int max_events, int *nb_events)
+{
+  int left;
+
+  if (ts_indexer == NULL || data == NULL || len <= 0
+    || events == NULL || max_events < TS_INDEXER_PACKET_EVENTS_MAX
+    || nb_events == NULL)
+    return -1;
+
+  ts_indexer->events = events;
+  ts_indexer->events_max = max_events;
+  ts_indexer->events_num = 0;
+
+  left = parse_packets(ts_indexer, data, len);
+
+  *nb_events = ts_indexer->events_num;
+  ts_indexer->events = NULL;
+  ts_indexer->events_max = 0;
+  ts_indexer->events_num = 0;
+
+  return left;
+}
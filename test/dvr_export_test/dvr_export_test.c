@@ -0,0 +1,115 @@
+#ifdef _FORTIFY_SOURCE
+#undef _FORTIFY_SOURCE
+#endif
+/**\file
+ * \brief Export a time range of a recording, and check that the PAT and PMT
+ * of the exported segment agree with the ones copied with the range.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dvr_segment.h"
+#include "dvr_export.h"
+
+#define TS_PKT_SIZE (188)
+
+static uint32_t time_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*the section starting in a packet, NULL if none*/
+static uint8_t *section_start(uint8_t *p)
+{
+  int off = 4;
+
+  if (!(p[1] & 0x40) || !(p[3] & 0x10))
+    return NULL;
+  if (p[3] & 0x20)
+    off += 1 + p[4];
+  if (off >= TS_PKT_SIZE)
+    return NULL;
+  off += 1 + p[off];
+  return (off + 12 <= TS_PKT_SIZE) ? p + off : NULL;
+}
+
+/*every PAT points to the PMT pid of the first one, with the same version,
+  and every PMT on it has the version of the first one*/
+static int check_psi(const char *out_path)
+{
+  char fname[512];
+  uint8_t pkt[TS_PKT_SIZE], *sec;
+  int pmt_pid = -1, pat_version = -1, pmt_version = -1;
+  int nb_pat = 0, nb_pmt = 0, bad = 0, pid;
+  FILE *fp;
+
+  snprintf(fname, sizeof(fname), "%s-0000.ts", out_path);
+  fp = fopen(fname, "r");
+  if (!fp) {
+    printf("open %s failed\n", fname);
+    return -1;
+  }
+  while (fread(pkt, 1, TS_PKT_SIZE, fp) == TS_PKT_SIZE) {
+    if (pkt[0] != 0x47 || !(sec = section_start(pkt)))
+      continue;
+    pid = ((pkt[1] & 0x1f) << 8) | pkt[2];
+    if (pid == 0 && sec[0] == 0x00) {
+      int pmt = ((sec[10] & 0x1f) << 8) | sec[11];
+
+      if (!nb_pat++) {
+        pmt_pid = pmt;
+        pat_version = (sec[5] >> 1) & 0x1f;
+      } else if (pmt != pmt_pid || ((sec[5] >> 1) & 0x1f) != pat_version) {
+        bad++;
+      }
+    } else if (pid == pmt_pid && sec[0] == 0x02) {
+      if (!nb_pmt++)
+        pmt_version = (sec[5] >> 1) & 0x1f;
+      else if (((sec[5] >> 1) & 0x1f) != pmt_version)
+        bad++;
+    }
+  }
+  fclose(fp);
+
+  printf("PAT: %d, PMT: %d on pid 0x%x, version %d/%d, %d not matching\n",
+      nb_pat, nb_pmt, pmt_pid, pat_version, pmt_version, bad);
+  return (nb_pat && nb_pmt && !bad) ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+  DVR_RecordSegmentInfo_t info;
+  uint64_t start_ms, end_ms;
+  uint32_t start;
+  int ret;
+
+  if (argc < 5) {
+    printf("Usage: %s location start_ms end_ms out_path\n", argv[0]);
+    printf("  location: the record file's location, such as /data/pvr/rec\n");
+    printf("  start_ms, end_ms: the time range from the start of the recording\n");
+    printf("  out_path: the location of the exported recording, such as /data/pvr/clip\n");
+    return -1;
+  }
+  start_ms = strtoull(argv[2], NULL, 10);
+  end_ms = strtoull(argv[3], NULL, 10);
+
+  start = time_ms();
+  ret = dvr_export_range(argv[1], start_ms, end_ms, argv[4]);
+  if (ret != DVR_SUCCESS) {
+    printf("export %s failed\n", argv[1]);
+    return -1;
+  }
+  printf("exported in %u ms\n", time_ms() - start);
+
+  memset(&info, 0, sizeof(info));
+  if (dvr_segment_get_info(argv[4], 0, &info) != DVR_SUCCESS) {
+    printf("no information in %s\n", argv[4]);
+    return -1;
+  }
+  printf("duration: %lu ms, size: %zu, pids: %u\n", info.duration, info.size, info.nb_pids);
+  return check_psi(argv[4]);
+}
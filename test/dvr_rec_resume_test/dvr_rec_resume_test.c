@@ -0,0 +1,130 @@
+#ifdef _FORTIFY_SOURCE
+#undef _FORTIFY_SOURCE
+#endif
+/**\file
+ * \brief Measure the latency from dvr_record_resume() to the first byte
+ * written to the segment, on a live demux.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include "dvr_record.h"
+
+static DVR_Result_t record_event_handler(DVR_RecordEvent_t event, void *params, void *userdata)
+{
+  return 0;
+}
+
+static int64_t now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static size_t record_size(DVR_RecordHandle_t recorder)
+{
+  DVR_RecordStatus_t status;
+
+  memset(&status, 0, sizeof(status));
+  dvr_record_get_status(recorder, &status);
+  return status.info.size;
+}
+
+int main(int argc, char **argv)
+{
+  DVR_RecordHandle_t recorder;
+  DVR_RecordOpenParams_t open_param;
+  DVR_RecordStartParams_t start_param;
+  int dmx = 0;
+  int vpid = 611;
+  int apid = 612;
+  int loops = 10;
+  int pause_ms = 1000;
+  int timeout_ms = 2000;
+  int64_t total = 0, worst = 0;
+  int nb = 0, failed = 0;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+      if (!strncmp(argv[i], "v", 1))
+          sscanf(argv[i], "v=%i", &vpid);
+      else if (!strncmp(argv[i], "a", 1))
+          sscanf(argv[i], "a=%i", &apid);
+      else if (!strncmp(argv[i], "dmx", 3))
+          sscanf(argv[i], "dmx=%i", &dmx);
+      else if (!strncmp(argv[i], "loops", 5))
+          sscanf(argv[i], "loops=%i", &loops);
+      else if (!strncmp(argv[i], "pause", 5))
+          sscanf(argv[i], "pause=%i", &pause_ms);
+      else if (!strncmp(argv[i], "help", 4)) {
+          printf("Usage: %s [dmx=id] [v=pid] [a=pid] [loops=n] [pause=ms]\n", argv[0]);
+          exit(0);
+      }
+  }
+
+  memset(&open_param, 0, sizeof(open_param));
+  open_param.dmx_dev_id = dmx;
+  open_param.notification_size = (1000*1024 + 2);
+  open_param.event_fn = record_event_handler;
+  if (dvr_record_open(&recorder, &open_param) != DVR_SUCCESS) {
+    printf("open recorder on dmx%d failed\n", dmx);
+    return -1;
+  }
+
+  memset(&start_param, 0, sizeof(start_param));
+  strncpy(start_param.location, "/data/data/resume-", sizeof(start_param.location) - 1);
+  start_param.segment.segment_id = 0;
+  start_param.segment.nb_pids = 2;
+  start_param.segment.pids[0].pid = vpid;
+  start_param.segment.pids[0].type = DVR_STREAM_TYPE_VIDEO;
+  start_param.segment.pid_action[0] = DVR_RECORD_PID_CREATE;
+  start_param.segment.pids[1].pid = apid;
+  start_param.segment.pids[1].type = DVR_STREAM_TYPE_AUDIO;
+  start_param.segment.pid_action[1] = DVR_RECORD_PID_CREATE;
+  if (dvr_record_start_segment(recorder, &start_param) != DVR_SUCCESS) {
+    printf("start segment failed\n");
+    dvr_record_close(recorder);
+    return -1;
+  }
+
+  /*let the stream settle*/
+  sleep(2);
+
+  for (i = 0; i < loops; i++) {
+    size_t size;
+    int64_t start, lat;
+
+    dvr_record_pause(recorder);
+    usleep(pause_ms * 1000);
+    size = record_size(recorder);
+
+    start = now_us();
+    dvr_record_resume(recorder);
+    while (record_size(recorder) == size && now_us() - start < timeout_ms * 1000)
+      usleep(1000);
+    lat = now_us() - start;
+
+    if (record_size(recorder) == size) {
+      printf("loop %d: nothing written %d ms after resume\n", i, timeout_ms);
+      failed++;
+      continue;
+    }
+    printf("loop %d: first write %lld us after resume\n", i, (long long)lat);
+    total += lat;
+    if (lat > worst)
+      worst = lat;
+    nb++;
+  }
+
+  dvr_record_stop_segment(recorder, NULL);
+  dvr_record_close(recorder);
+
+  if (nb)
+    printf("resume latency: avg %lld us, worst %lld us, %d/%d loops\n",
+        (long long)(total / nb), (long long)worst, nb, loops);
+  return failed ? -1 : 0;
+}
@@ -0,0 +1,39 @@
+#ifdef _FORTIFY_SOURCE
+#undef _FORTIFY_SOURCE
+#endif
+/**\file
+ * \brief Rebuild the index and information files of a recording, and
+ * report the scan throughput.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dvr_reindex.h"
+
+int main(int argc, char **argv)
+{
+  DVR_ReindexStats_t stats;
+  int workers = 0;
+  int ret;
+
+  if (argc < 2) {
+    printf("Usage: %s location [workers]\n", argv[0]);
+    printf("  location: the record file's location, such as /data/pvr/rec\n");
+    printf("  workers: segments scanned in parallel, 0 for the number of CPUs\n");
+    return -1;
+  }
+  if (argc > 2)
+    workers = atoi(argv[2]);
+
+  memset(&stats, 0, sizeof(stats));
+  ret = dvr_reindex(argv[1], workers, &stats);
+  if (ret != DVR_SUCCESS && !stats.nb_segments) {
+    printf("reindex %s failed\n", argv[1]);
+    return -1;
+  }
+
+  printf("segments: %u, failed: %u, workers: %u\n", stats.nb_segments, stats.nb_failed, stats.nb_workers);
+  printf("scanned: %llu bytes in %u ms, %.2f GB/min\n", (unsigned long long)stats.bytes, stats.time,
+      stats.time ? (double)stats.bytes / 1e9 / (stats.time / 60000.0) : 0.0);
+  return (ret == DVR_SUCCESS) ? 0 : -1;
+}
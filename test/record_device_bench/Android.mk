@@ -0,0 +1,29 @@
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_VENDOR_MODULE := true
+
+ANDROID_LOG_INCLUDE:=system/core/liblog/include \
+
+#record_device is built in with its nodes and ioctls redirected to the fakes
+LOCAL_SRC_FILES:= record_device_bench.c \
+                  ../../src/record_device.c \
+                  ../../src/dvr_pool.c
+
+LOCAL_CFLAGS := -DRECORD_DEVICE_DVR_NAME=\"/data/local/tmp/dvrbench.dvr%d\" \
+                -DRECORD_DEVICE_DMX_NAME=\"/data/local/tmp/dvrbench.dmx%d\" \
+                -Dioctl=fake_ioctl
+
+LOCAL_MODULE:= record_device_bench
+LOCAL_LICENSE_KINDS := SPDX-license-identifier-Apache-2.0
+LOCAL_LICENSE_CONDITIONS := notice
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../include/ \
+                    $(ANDROID_LOG_INCLUDE)
+
+LOCAL_SHARED_LIBRARIES := libamdvr
+LOCAL_SHARED_LIBRARIES += libcutils liblog libdl libc
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,320 @@
+/**\file
+ * \brief Micro-benchmark of record_device_read on a pipe backed fake device.
+ *
+ * The record device is built with its dvr and demux nodes redirected to
+ * fifos, and its ioctl calls redirected to fake_ioctl(). A writer thread
+ * feeds ts packets to the dvr fifo as fast as it is read, while a control
+ * thread keeps adding and removing a pid, as a pid update during recording
+ * does, each demux ioctl taking the time of a driver call. The read
+ * throughput and the longest read stall are reported.
+ *
+ * With secure=n, n secure recordings of the same sid read the output of the
+ * secure demux with record_device_read_ext(). The dvr write pointer moves at
+ * rate=kbps, and the secure demux library is the fake of test/secdmx_fake,
+ * installed as libdmx_client.so in the library path. The number of
+ * SECDMX_ProcessData() calls and the time spent in record_device_read_ext()
+ * are reported.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dlfcn.h>
+
+#include "dvr_types.h"
+#include "record_device.h"
+#include "dmx.h"
+
+#define BENCH_READ_SIZE  (256 * 1024)
+#define BENCH_WRITE_SIZE (188 * 348)
+#define BENCH_SECBUF_SIZE (2 * 1024 * 1024)
+#define BENCH_SECURE_MAX (8)
+
+static volatile int running = 1;
+static char dvr_name[64];
+static int ioctl_us = 1000;
+static int rate_kbps = 20000;
+static uint64_t bench_start;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*the dvr write pointer of the secure buffer, moving at rate_kbps*/
+static uint32_t fake_wp(void)
+{
+  uint64_t bytes = (now_ns() - bench_start) / 1000000 * rate_kbps / 8;
+
+  return (uint32_t)(bytes % BENCH_SECBUF_SIZE);
+}
+
+/*the demux filter ioctls take the driver time and succeed, the others reach the fifos*/
+int fake_ioctl(int fd, unsigned long request, ...)
+{
+  va_list ap;
+  void *arg;
+
+  va_start(ap, request);
+  arg = va_arg(ap, void *);
+  va_end(ap);
+
+  if (request == DMX_SET_PES_FILTER || request == DMX_START || request == DMX_STOP) {
+    usleep(ioctl_us);
+    return 0;
+  }
+  if (request == DMX_SET_SEC_MEM)
+    return 0;
+  if (request == DMX_GET_DVR_MEM) {
+    ((struct dvr_mem_info *)arg)->wp_offset = fake_wp();
+    return 0;
+  }
+  return syscall(SYS_ioctl, fd, request, arg);
+}
+
+static void *writer_thread(void *arg)
+{
+  uint8_t *buf = malloc(BENCH_WRITE_SIZE);
+  int fd, i;
+
+  for (i = 0; i < BENCH_WRITE_SIZE; i += 188) {
+    memset(buf + i, 0xff, 188);
+    buf[i] = 0x47;
+  }
+  fd = open(dvr_name, O_WRONLY);
+  while (running && fd >= 0) {
+    if (write(fd, buf, BENCH_WRITE_SIZE) < 0 && errno != EINTR)
+      break;
+  }
+  if (fd >= 0)
+    close(fd);
+  free(buf);
+  return NULL;
+}
+
+static void *control_thread(void *arg)
+{
+  Record_DeviceHandle_t dev = (Record_DeviceHandle_t)arg;
+  long *updates = malloc(sizeof(long));
+
+  *updates = 0;
+  while (running) {
+    record_device_add_pid(dev, 0x100);
+    record_device_remove_pid(dev, 0x100);
+    (*updates)++;
+  }
+  return updates;
+}
+
+typedef struct {
+  Record_DeviceHandle_t dev;
+  uint8_t               *secbuf;
+  uint64_t              bytes;
+  uint64_t              calls;
+  uint64_t              time;
+  uint64_t              worst;
+} secure_reader_t;
+
+static void *secure_thread(void *arg)
+{
+  secure_reader_t *r = (secure_reader_t *)arg;
+  size_t addr, len;
+  uint64_t t0, t1;
+  ssize_t ret;
+
+  while (running) {
+    /*the record thread polls the dvr for 10 ms before each read*/
+    usleep(10 * 1000);
+    t0 = now_ns();
+    ret = record_device_read_ext(r->dev, &addr, &len);
+    t1 = now_ns();
+    if (ret > 0)
+      r->bytes += ret;
+    r->calls++;
+    r->time += t1 - t0;
+    if (t1 - t0 > r->worst)
+      r->worst = t1 - t0;
+  }
+  return NULL;
+}
+
+static int bench_secure(int nb, int seconds)
+{
+  secure_reader_t readers[BENCH_SECURE_MAX];
+  pthread_t threads[BENCH_SECURE_MAX];
+  Record_DeviceOpenParams_t params;
+  void (*fake_stats)(uint64_t *calls, uint64_t *bytes);
+  uint64_t calls = 0, bytes = 0, total = 0, worst = 0, reads = 0;
+  char dmx_name[64];
+  void *lib;
+  int keep, keep_dmx, i;
+
+  if (nb > BENCH_SECURE_MAX)
+    nb = BENCH_SECURE_MAX;
+
+  /*hold the fifos open so the device opens them without a writer*/
+  snprintf(dmx_name, sizeof(dmx_name), RECORD_DEVICE_DMX_NAME, 0);
+  keep = open(dvr_name, O_RDWR);
+  keep_dmx = open(dmx_name, O_RDWR);
+  bench_start = now_ns();
+
+  memset(readers, 0, sizeof(readers));
+  for (i = 0; i < nb; i++) {
+    memset(&params, 0, sizeof(params));
+    params.dmx_dev_id = 0;
+    params.buf_size = BENCH_READ_SIZE;
+    if (record_device_open(&readers[i].dev, &params) != DVR_SUCCESS) {
+      printf("open fake device failed\n");
+      return -1;
+    }
+    readers[i].secbuf = malloc(BENCH_SECBUF_SIZE);
+    if (record_device_set_secure_buffer(readers[i].dev, readers[i].secbuf, BENCH_SECBUF_SIZE) != DVR_SUCCESS) {
+      printf("set secure buffer failed, is the fake libdmx_client.so in the library path?\n");
+      return -1;
+    }
+    record_device_start(readers[i].dev);
+  }
+
+  for (i = 0; i < nb; i++)
+    pthread_create(&threads[i], NULL, secure_thread, &readers[i]);
+  sleep(seconds);
+  running = 0;
+
+  for (i = 0; i < nb; i++) {
+    pthread_join(threads[i], NULL);
+    record_device_stop(readers[i].dev);
+    record_device_close(readers[i].dev);
+    free(readers[i].secbuf);
+    bytes += readers[i].bytes;
+    reads += readers[i].calls;
+    total += readers[i].time;
+    if (readers[i].worst > worst)
+      worst = readers[i].worst;
+  }
+  close(keep);
+  close(keep_dmx);
+
+  lib = dlopen("libdmx_client.so", RTLD_NOW | RTLD_NOLOAD);
+  fake_stats = lib ? dlsym(lib, "SECDMX_FakeStats") : NULL;
+  if (fake_stats)
+    fake_stats(&calls, &bytes);
+
+  fprintf(stderr, "secure readers: %d, reads: %llu, process calls: %llu (%.1f/s), %.1f MB processed, avg read %.1f us, worst %.1f us\n",
+      nb, (unsigned long long)reads, (unsigned long long)calls, (double)calls / seconds,
+      bytes / 1e6, reads ? total / 1e3 / reads : 0.0, worst / 1e3);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  Record_DeviceHandle_t dev;
+  Record_DeviceOpenParams_t params;
+  pthread_t writer, control;
+  uint8_t *buf;
+  uint64_t start, end, t0, t1, worst = 0, bytes = 0;
+  long reads = 0, *updates = NULL;
+  int seconds = 5;
+  int with_control = 1;
+  int secure = 0;
+  int i, ret;
+
+  for (i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], "time", 4))
+      sscanf(argv[i], "time=%i", &seconds);
+    else if (!strncmp(argv[i], "ioctl", 5))
+      sscanf(argv[i], "ioctl=%i", &ioctl_us);
+    else if (!strncmp(argv[i], "secure", 6))
+      sscanf(argv[i], "secure=%i", &secure);
+    else if (!strncmp(argv[i], "rate", 4))
+      sscanf(argv[i], "rate=%i", &rate_kbps);
+    else if (!strncmp(argv[i], "nocontrol", 9))
+      with_control = 0;
+    else if (!strncmp(argv[i], "quiet", 5))
+      g_dvr_log_level = LOG_LV_FATAL;
+    else if (!strncmp(argv[i], "help", 4)) {
+      printf("Usage: %s [time=seconds] [ioctl=us] [nocontrol] [quiet] [secure=n] [rate=kbps]\n", argv[0]);
+      return 0;
+    }
+  }
+
+  /*survive the writer on close*/
+  signal(SIGPIPE, SIG_IGN);
+
+  /*the nodes record_device opens for dmx 0*/
+  snprintf(dvr_name, sizeof(dvr_name), RECORD_DEVICE_DVR_NAME, 0);
+  unlink(dvr_name);
+  if (mkfifo(dvr_name, 0600) < 0) {
+    printf("mkfifo %s failed: %s\n", dvr_name, strerror(errno));
+    return -1;
+  }
+  {
+    char dmx_name[64];
+
+    snprintf(dmx_name, sizeof(dmx_name), RECORD_DEVICE_DMX_NAME, 0);
+    unlink(dmx_name);
+    mkfifo(dmx_name, 0600);
+  }
+
+  if (secure > 0) {
+    ret = bench_secure(secure, seconds);
+    unlink(dvr_name);
+    return ret;
+  }
+
+  pthread_create(&writer, NULL, writer_thread, NULL);
+
+  memset(&params, 0, sizeof(params));
+  params.dmx_dev_id = 0;
+  params.buf_size = BENCH_READ_SIZE;
+  if (record_device_open(&dev, &params) != DVR_SUCCESS) {
+    printf("open fake device failed\n");
+    return -1;
+  }
+  record_device_start(dev);
+  if (with_control)
+    pthread_create(&control, NULL, control_thread, dev);
+
+  buf = malloc(BENCH_READ_SIZE);
+  start = now_ns();
+  end = start + (uint64_t)seconds * 1000000000ULL;
+  t0 = start;
+  while (t0 < end) {
+    ret = record_device_read(dev, buf, BENCH_READ_SIZE, 1000);
+    t1 = now_ns();
+    if (ret > 0) {
+      bytes += ret;
+      reads++;
+    }
+    if (t1 - t0 > worst)
+      worst = t1 - t0;
+    t0 = t1;
+  }
+
+  running = 0;
+  if (with_control)
+    pthread_join(control, (void **)&updates);
+  record_device_stop(dev);
+  record_device_close(dev);
+  pthread_join(writer, NULL);
+
+  fprintf(stderr, "reads: %ld, %.1f MB/s, avg %.1f us, worst %.1f us, pid updates: %ld\n",
+      reads, bytes / ((t0 - start) / 1e9) / 1e6,
+      reads ? (t0 - start) / 1e3 / reads : 0.0, worst / 1e3,
+      updates ? *updates : 0L);
+  free(updates);
+  free(buf);
+  unlink(dvr_name);
+  return 0;
+}
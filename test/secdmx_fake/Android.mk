@@ -0,0 +1,17 @@
+LOCAL_PATH := $(call my-dir)
+
+include $(CLEAR_VARS)
+LOCAL_VENDOR_MODULE := true
+
+#install it as libdmx_client.so in the library path of the benchmark
+LOCAL_SRC_FILES:= secdmx_fake.c
+
+LOCAL_MODULE:= libdmx_client_fake
+LOCAL_LICENSE_KINDS := SPDX-license-identifier-Apache-2.0
+LOCAL_LICENSE_CONDITIONS := notice
+
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_SHARED_LIBRARIES := libc
+
+include $(BUILD_SHARED_LIBRARY)
@@ -0,0 +1,178 @@
+/**\file
+ * \brief Fake secure demux client library, to run record_device off target.
+ *
+ * It exports the SECDMX_* functions record_device loads with dlsym(), so it
+ * is used in place of libdmx_client.so by putting it in the library path
+ * under that name. SECDMX_ProcessData() costs SECDMX_FAKE_CALL_US
+ * microseconds (300 by default, as a call to the secure world) and moves
+ * the data written since its last call to the outputs of the sid.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define FAKE_MAX_SID     8
+#define FAKE_MAX_OUTPUTS 16
+
+typedef struct {
+  int      used;
+  int      sid;
+  size_t   addr;
+  size_t   size;
+  size_t   filled;
+} fake_output_t;
+
+typedef struct {
+  uint8_t  *buf;
+  size_t   size;
+  uint32_t wp;
+} fake_sid_t;
+
+static pthread_mutex_t fake_lock = PTHREAD_MUTEX_INITIALIZER;
+static fake_sid_t sids[FAKE_MAX_SID];
+static fake_output_t outputs[FAKE_MAX_OUTPUTS];
+static int call_us = -1;
+static uint64_t process_calls;
+static uint64_t process_bytes;
+
+int SECDMX_Init(int ts_clone_enabled)
+{
+  const char *env = getenv("SECDMX_FAKE_CALL_US");
+
+  if (call_us < 0)
+    call_us = env ? atoi(env) : 300;
+  return 0;
+}
+
+int SECDMX_Deinit(void)
+{
+  return 0;
+}
+
+int SECDMX_AllocateDVRBuffer(int sid, size_t *size, size_t *addr)
+{
+  if (sid < 0 || sid >= FAKE_MAX_SID || !size || !addr)
+    return -1;
+
+  pthread_mutex_lock(&fake_lock);
+  if (!sids[sid].buf) {
+    sids[sid].buf = malloc(*size);
+    sids[sid].size = *size;
+    sids[sid].wp = 0;
+  }
+  *size = sids[sid].size;
+  *addr = (size_t)sids[sid].buf;
+  pthread_mutex_unlock(&fake_lock);
+  return sids[sid].buf ? 0 : -1;
+}
+
+int SECDMX_FreeDVRBuffer(int sid)
+{
+  if (sid < 0 || sid >= FAKE_MAX_SID)
+    return -1;
+
+  pthread_mutex_lock(&fake_lock);
+  free(sids[sid].buf);
+  memset(&sids[sid], 0, sizeof(sids[sid]));
+  pthread_mutex_unlock(&fake_lock);
+  return 0;
+}
+
+int SECDMX_AddOutputBuffer(int sid, size_t addr, size_t size, size_t *handle)
+{
+  int i;
+
+  pthread_mutex_lock(&fake_lock);
+  for (i = 0; i < FAKE_MAX_OUTPUTS; i++) {
+    if (!outputs[i].used)
+      break;
+  }
+  if (i == FAKE_MAX_OUTPUTS) {
+    pthread_mutex_unlock(&fake_lock);
+    return -1;
+  }
+  outputs[i].used = 1;
+  outputs[i].sid = sid;
+  outputs[i].addr = addr;
+  outputs[i].size = size;
+  outputs[i].filled = 0;
+  *handle = i + 1;
+  pthread_mutex_unlock(&fake_lock);
+  return 0;
+}
+
+int SECDMX_AddDVRPids(size_t handle, uint16_t *pids, int pid_num)
+{
+  return 0;
+}
+
+int SECDMX_RemoveOutputBuffer(size_t handle)
+{
+  if (handle < 1 || handle > FAKE_MAX_OUTPUTS)
+    return -1;
+
+  pthread_mutex_lock(&fake_lock);
+  outputs[handle - 1].used = 0;
+  pthread_mutex_unlock(&fake_lock);
+  return 0;
+}
+
+int SECDMX_GetOutputBufferStatus(size_t handle, size_t *start_addr, size_t *len)
+{
+  fake_output_t *o;
+
+  if (handle < 1 || handle > FAKE_MAX_OUTPUTS)
+    return -1;
+
+  pthread_mutex_lock(&fake_lock);
+  o = &outputs[handle - 1];
+  *start_addr = o->addr;
+  *len = o->filled;
+  o->filled = 0;
+  pthread_mutex_unlock(&fake_lock);
+  return 0;
+}
+
+int SECDMX_ProcessData(int sid, size_t wp)
+{
+  fake_sid_t *s;
+  size_t advance;
+  int i;
+
+  if (sid < 0 || sid >= FAKE_MAX_SID)
+    return -1;
+
+  /*the secure world call*/
+  if (call_us > 0)
+    usleep(call_us);
+
+  pthread_mutex_lock(&fake_lock);
+  s = &sids[sid];
+  advance = (wp >= s->wp) ? wp - s->wp : wp + s->size - s->wp;
+  s->wp = wp;
+  for (i = 0; i < FAKE_MAX_OUTPUTS; i++) {
+    fake_output_t *o = &outputs[i];
+
+    if (o->used && o->sid == sid) {
+      o->filled += advance;
+      if (o->filled > o->size)
+        o->filled = o->size;
+    }
+  }
+  process_calls++;
+  process_bytes += advance;
+  pthread_mutex_unlock(&fake_lock);
+  return 0;
+}
+
+/*not in the real library, the benchmark looks it up to report the processing calls*/
+void SECDMX_FakeStats(uint64_t *calls, uint64_t *bytes)
+{
+  pthread_mutex_lock(&fake_lock);
+  *calls = process_calls;
+  *bytes = process_bytes;
+  pthread_mutex_unlock(&fake_lock);
+}